@@ -0,0 +1,147 @@
+#include "alignops.h"
+#include "tiffregion.h"
+#include "tilestore.h"
+
+#include <algorithm>
+
+cv::Size AlignSource::size() const
+{
+    if (!full.empty()) return full.size();
+    return tiled ? tiled->size() : region->size();
+}
+
+// 画像の一部（画素・マスクとも共有）
+static StitchImage viewOf(const StitchImage& img, const cv::Rect& roi)
+{
+    StitchImage r;
+    r.pixels = img.pixels(roi);
+    if (!img.mask.empty()) r.mask = img.mask(roi);
+    return r;
+}
+
+StitchImage AlignSource::read(const cv::Rect& roi) const
+{
+    if (!full.empty()) return viewOf(full, roi);
+    if (tiled) return tiled->read(roi);
+    return region->read(roi);
+}
+
+AlignInputs alignInputs(const AlignSource& a, const AlignSource& b, cv::Point pos1, cv::Point pos2, int margin)
+{
+    AlignInputs r;
+    cv::Rect roi1, roi2;
+    if (!overlapRegions(a.size(), b.size(), pos1, pos2, margin, roi1, roi2)) return r;
+    // 2枚とも位置合わせ用のグレースケールがあればそちらから（グレースケール化・αの判定を毎回しない）
+    if (a.gray && b.gray && a.gray->pixels.depth() == b.gray->pixels.depth()) {
+        r.in1 = viewOf(*a.gray, roi1);
+        r.in2 = viewOf(*b.gray, roi2);
+    } else {
+        r.in1 = a.read(roi1);
+        r.in2 = b.read(roi2);
+    }
+    r.pos1 = pos1 + roi1.tl();
+    r.pos2 = pos2 + roi2.tl();
+    r.fix = roi1.tl() - roi2.tl();
+    r.ok = !r.in1.empty() && !r.in2.empty();
+    return r;
+}
+
+return_struct1 fixResult(return_struct1 r, const AlignInputs& in)
+{
+    if (r.score == 0) return return_struct1{};
+    r.x += in.fix.x;
+    r.y += in.fix.y;
+    return r;
+}
+
+return_struct1 runPhaseAlign(const AlignSource& a, const AlignSource& b, cv::Point pos1, cv::Point pos2,
+                             const std::function<bool()>& isCanceled)
+{
+    const AlignInputs in = alignInputs(a, b, pos1, pos2, 0);
+    if (!in.ok) return return_struct1{};
+    return fixResult(align_phase_correlate(in.in1, in.in2, in.pos1, in.pos2, isCanceled), in);
+}
+
+// 1/k へ縮小（k x k の面積平均。端の k に満たない分は捨てる）
+// 行の帯ごとに読むので、全体を展開せずに済む（k の倍数の行で区切れば帯ごとに縮小しても同じ結果）
+static StitchImage shrinkSource(const AlignSource& s, int k)
+{
+    const cv::Size size = s.size();
+    const cv::Size small(std::max(1, size.width / k), std::max(1, size.height / k));
+    const int usedW = std::min(size.width, small.width * k);
+    const int usedH = std::min(size.height, small.height * k);
+    const int band = k * std::max(1, 1024 / k);
+
+    StitchImage r;
+    for (int y = 0; y < usedH; y += band) {
+        const int h = std::min(band, usedH - y);
+        const StitchImage part = s.read(cv::Rect(0, y, usedW, h));
+        const cv::Size partSmall(small.width, std::max(1, h / k));
+        if (r.empty()) r.pixels.create(small, part.pixels.type());
+        const int row = y / k;
+        cv::resize(part.pixels, r.pixels.rowRange(row, row + partSmall.height), partSmall, 0, 0, cv::INTER_AREA);
+        if (!part.mask.empty()) {
+            if (r.mask.empty()) r.mask = cv::Mat1b(small, uchar(255)); // それまでの帯は全面有効
+            cv::Mat1b m = r.mask.rowRange(row, row + partSmall.height);
+            cv::resize(part.mask, m, partSmall, 0, 0, cv::INTER_NEAREST);
+        }
+    }
+    return r;
+}
+
+return_struct1 runCoarsePlacement(const AlignSource& a, const AlignSource& b)
+{
+    constexpr int kMaxSide = 512;
+    const cv::Size sa = a.size(), sb = b.size();
+    const int longest = std::max({sa.width, sa.height, sb.width, sb.height});
+    if (longest <= 0) return return_struct1{};
+
+    // 整数倍で長辺 kMaxSide 以下へ（同じ倍率で 2枚とも）
+    const int k = std::max(1, (longest + kMaxSide - 1) / kMaxSide);
+    return_struct1 r = align_coarse_placement(shrinkSource(a, k), shrinkSource(b, k), kMaxSide);
+    if (r.score == 0) return r;
+    r.x *= k;
+    r.y *= k;
+    return r;
+}
+
+std::optional<double> runVerifySsim(const AlignSource& a, const AlignSource& b, const return_struct1& r)
+{
+    if (r.score == 0) return std::nullopt; // 重なり無し
+
+    const AlignInputs in = alignInputs(a, b, cv::Point(0, 0), cv::Point(r.x, r.y), 0);
+    if (!in.ok) return std::nullopt;
+    return SSIM_calc_oneshot(SSIM_TaskInput{in.in1, in.in2, in.pos1, in.pos2, 0, 0});
+}
+
+return_struct1 runSsimSearch(const AlignSource& a, const AlignSource& b, cv::Point pos1, cv::Point pos2,
+                             int radius, const std::function<bool()>& isCanceled)
+{
+    const AlignInputs in = alignInputs(a, b, pos1, pos2, radius);
+    if (!in.ok) return return_struct1{};
+
+    return fixResult(align_ssim_search(in.in1, in.in2, in.pos1, in.pos2, radius, isCanceled), in);
+}
+
+return_struct1 runTopKSearch(const AlignSource& a, const AlignSource& b, cv::Point pos1, cv::Point pos2, int k)
+{
+    // 折り返し候補は重なりの幅・高さまでずれるので、その分を余白として読む
+    const cv::Rect ov = cv::Rect(pos1, a.size()) & cv::Rect(pos2, b.size());
+    const AlignInputs in = alignInputs(a, b, pos1, pos2, std::max(ov.width, ov.height));
+    if (!in.ok) return return_struct1{};
+    return fixResult(align_phase_topk(in.in1, in.in2, in.pos1, in.pos2, k), in);
+}
+
+std::pair<return_struct1, double> runSurfaceSearch(const AlignSource& a, const AlignSource& b,
+                                                   cv::Point pos1, cv::Point pos2, int radius,
+                                                   const std::function<bool()>& isCanceled)
+{
+    const AlignInputs in = alignInputs(a, b, pos1, pos2, radius);
+    if (!in.ok) return {return_struct1{}, 0.0};
+    return_struct1 best = fixResult(align_ncc_surface(in.in1, in.in2, in.pos1, in.pos2, radius), in);
+    if (best.score == 0 || (isCanceled && isCanceled())) return {return_struct1{}, 0.0};
+
+    const double ncc = best.score;
+    best.score = runVerifySsim(a, b, best).value_or(0.0);
+    return {best, ncc};
+}
@@ -0,0 +1,66 @@
+#ifndef ALIGNOPS_H
+#define ALIGNOPS_H
+
+#include "stitchcore.h"
+
+#include <functional>
+#include <memory>
+#include <optional>
+#include <utility>
+
+class TiffRegionReader;
+class TiledImage;
+
+// ボタン操作 1回分の位置合わせ処理（GUI のジョブとセッション再生で共通）
+
+// 位置合わせの入力。読み込み済みなら共有ビュー、圧縮して保持していれば該当タイルだけ展開、
+// 全体デコード前なら TIFF から該当範囲だけ読む
+// gray は full の alignGrayImage（読み込み後に先読みで作る）。2枚とも揃っていて深さが同じならこちらを読む
+struct AlignSource {
+    StitchImage full;
+    std::shared_ptr<TiffRegionReader> region;
+    std::shared_ptr<const TiledImage> tiled;
+    std::shared_ptr<const StitchImage> gray;
+
+    cv::Size size() const;
+    StitchImage read(const cv::Rect& roi) const;
+};
+
+// 重なり（+margin）だけを切り出した2枚と、その位置
+struct AlignInputs {
+    bool ok = false;
+    StitchImage in1, in2;
+    cv::Point pos1, pos2;
+    cv::Point fix; // 部分画像どうしの相対位置 → 元画像どうしの相対位置
+};
+
+AlignInputs alignInputs(const AlignSource& a, const AlignSource& b, cv::Point pos1, cv::Point pos2, int margin);
+
+// 部分画像での結果を元画像どうしの位置へ
+return_struct1 fixResult(return_struct1 r, const AlignInputs& in);
+
+// Calc. iFFT（重なりだけで位相相関）。isCanceled は先読みの打ち切り用（止めたら score 0）
+return_struct1 runPhaseAlign(const AlignSource& a, const AlignSource& b, cv::Point pos1, cv::Point pos2,
+                             const std::function<bool()>& isCanceled = {});
+
+// 自動配置（今の位置に関係なく、縮小した全体から 2枚目のおおよその位置を求める）
+// 大きな画像・圧縮して保持している画像・デコード前の TIFF は行の帯ごとに読んで縮小する
+return_struct1 runCoarsePlacement(const AlignSource& a, const AlignSource& b);
+
+// 求めた位置（1枚目基準の 2枚目位置）での SSIM。重ならなければ空
+std::optional<double> runVerifySsim(const AlignSource& a, const AlignSource& b, const return_struct1& r);
+
+// Calc. SSIM 全探索（±radius の全候補を並列に評価）
+return_struct1 runSsimSearch(const AlignSource& a, const AlignSource& b, cv::Point pos1, cv::Point pos2,
+                             int radius, const std::function<bool()>& isCanceled);
+
+// Calc. SSIM 位相ピーク（位相相関の上位 k 個のピークと折り返しの ±1px だけを SSIM で評価）
+return_struct1 runTopKSearch(const AlignSource& a, const AlignSource& b, cv::Point pos1, cv::Point pos2, int k);
+
+// Calc. SSIM 相関面（±radius の NCC を一括で求め、最良位置だけ SSIM で確認）
+// first.score は SSIM、second は相関面の最大 NCC。見つからなければ first.score == 0
+std::pair<return_struct1, double> runSurfaceSearch(const AlignSource& a, const AlignSource& b,
+                                                   cv::Point pos1, cv::Point pos2, int radius,
+                                                   const std::function<bool()>& isCanceled);
+
+#endif // ALIGNOPS_H
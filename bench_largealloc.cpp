@@ -0,0 +1,80 @@
+// 大きな画像の確保（largealloc）の効果を測るベンチマーク
+// 通常の確保（1スレッドで 0 埋め）と、ヒュージページ + 行の帯ごとの並列 first-touch を比べる
+// 使い方: bench_largealloc [幅] [高さ] [回数]   例: bench_largealloc 30000 20000 3
+// 複数ソケットの Linux では numactl --hardware でノード数を確認し、--interleave 等を付けずに実行する
+
+#include "largealloc.h"
+#include "stitchcore.h"
+
+#include <opencv2/core.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+static double msSince(std::chrono::steady_clock::time_point t0)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// 合成と同じ分け方（行の帯ごと）の読み書き
+static void rowPass(cv::Mat& m)
+{
+    cv::parallel_for_(cv::Range(0, m.rows), [&](const cv::Range& range) {
+        for (int r = range.start; r < range.end; ++r) {
+            cv::Vec4b* p = m.ptr<cv::Vec4b>(r);
+            for (int c = 0; c < m.cols; ++c) {
+                p[c][0] = (uchar)(p[c][0] + 1);
+                p[c][3] = 255;
+            }
+        }
+    });
+}
+
+static void run(bool enabled, int W, int H, int iters)
+{
+    setLargeAllocEnabled(enabled);
+
+    // 1) 確保 + 行ごとの並列パス
+    double alloc = 0, pass = 0;
+    int hugetlb = 0; // hugetlbfs の 2MB ページが取れた回数（予約が無ければ透過的ヒュージページ頼み）
+    for (int i = 0; i < iters; ++i) {
+        auto t0 = std::chrono::steady_clock::now();
+        cv::Mat canvas = createLargeZeroed(H, W, CV_8UC4);
+        alloc += msSince(t0);
+        if (largeAllocUsesHugeTlb(canvas)) ++hugetlb;
+
+        t0 = std::chrono::steady_clock::now();
+        for (int k = 0; k < 3; ++k) rowPass(canvas);
+        pass += msSince(t0);
+    }
+
+    // 2) 2枚のフェザー合成（重なり 20%）
+    StitchImage a, b;
+    a.pixels = cv::Mat(H, W * 6 / 10, CV_8UC4, cv::Scalar(60, 120, 180, 255));
+    b.pixels = cv::Mat(H, W * 6 / 10, CV_8UC4, cv::Scalar(180, 120, 60, 255));
+    double blend = 0;
+    for (int i = 0; i < iters; ++i) {
+        const auto t0 = std::chrono::steady_clock::now();
+        const StitchImage r = make_canvas_bgra_feather_dt(a, b, cv::Point2d(-(W * 4 / 10), 0), 80.0f);
+        blend += msSince(t0);
+        CV_Assert(r.cols() == W * 4 / 10 + W * 6 / 10);
+    }
+
+    std::printf("%-8s alloc %8.1f ms   row pass x3 %8.1f ms   feather blend %8.1f ms   hugetlb %d/%d\n",
+                enabled ? "large" : "default", alloc / iters, pass / iters, blend / iters, hugetlb, iters);
+}
+
+int main(int argc, char** argv)
+{
+    const int W = argc > 1 ? std::atoi(argv[1]) : 20000;
+    const int H = argc > 2 ? std::atoi(argv[2]) : 20000;
+    const int iters = argc > 3 ? std::max(1, std::atoi(argv[3])) : 3;
+
+    std::printf("canvas %d x %d BGRA8 (%.1f GB), threads %d\n",
+                W, H, (double)W * H * 4 / (1 << 30), cv::getNumThreads());
+    run(false, W, H, iters);
+    run(true, W, H, iters);
+    return 0;
+}
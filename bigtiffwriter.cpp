@@ -0,0 +1,214 @@
+#include "bigtiffwriter.h"
+
+#include <QtEndian>
+
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+
+namespace {
+
+// TIFF のフィールド型
+constexpr quint16 kShort = 3;
+constexpr quint16 kLong = 4;
+constexpr quint16 kLong8 = 16;
+
+constexpr qint64 kDataOffset = 16; // BigTIFF ヘッダの直後から画素
+
+struct IfdEntry {
+    quint16 tag;
+    quint16 type;
+    quint64 count;
+    QByteArray value; // 8バイト以下ならインライン、超えれば別置き
+};
+
+QByteArray le16(quint16 v) { v = qToLittleEndian(v); return QByteArray(reinterpret_cast<const char*>(&v), 2); }
+QByteArray le32(quint32 v) { v = qToLittleEndian(v); return QByteArray(reinterpret_cast<const char*>(&v), 4); }
+QByteArray le64(quint64 v) { v = qToLittleEndian(v); return QByteArray(reinterpret_cast<const char*>(&v), 8); }
+
+} // namespace
+
+BigTiffWriter::~BigTiffWriter()
+{
+    if (thread_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closing_ = true;
+            failed_ = true; // 途中で破棄された
+        }
+        cv_.notify_all();
+        thread_.join();
+    }
+    // close まで行かなかった（エラー・キャンセルで途中で抜けた）書きかけのファイルは消す
+    if (file_.isOpen()) {
+        file_.close();
+        file_.remove();
+    }
+}
+
+bool BigTiffWriter::open(const QString& path, cv::Size size, int type)
+{
+    const int depth = CV_MAT_DEPTH(type), cn = CV_MAT_CN(type);
+    CV_Assert(depth == CV_8U || depth == CV_16U);
+    CV_Assert(cn == 1 || cn == 3 || cn == 4);
+    CV_Assert(size.width > 0 && size.height > 0);
+
+    file_.setFileName(path);
+    if (!file_.open(QIODevice::WriteOnly | QIODevice::Truncate)) return false;
+
+    size_ = size;
+    type_ = type;
+    rowsQueued_ = 0;
+
+    // ヘッダ: "II", 43, オフセット幅 8, 0, 最初の IFD の位置（close で書き直す）
+    QByteArray h;
+    h += "II";
+    h += le16(43);
+    h += le16(8);
+    h += le16(0);
+    h += le64(0);
+    if (file_.write(h) != h.size()) {
+        file_.close();
+        file_.remove();
+        return false;
+    }
+
+    closing_ = false;
+    failed_ = false;
+    thread_ = std::thread(&BigTiffWriter::writerLoop, this);
+    return true;
+}
+
+bool BigTiffWriter::write(const cv::Mat& rows)
+{
+    CV_Assert(rows.type() == type_ && rows.cols == size_.width);
+    CV_Assert(rowsQueued_ + rows.rows <= size_.height);
+
+    // TIFF の並び（RGB / RGBA）へ。ここで複製するので呼び出し側はすぐ再利用できる
+    cv::Mat t;
+    switch (rows.channels()) {
+    case 3: cv::cvtColor(rows, t, cv::COLOR_BGR2RGB); break;
+    case 4: cv::cvtColor(rows, t, cv::COLOR_BGRA2RGBA); break;
+    default: t = rows.clone(); break;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return queue_.size() < maxQueued_ || failed_; });
+    if (failed_) return false;
+    queue_.push_back(t);
+    rowsQueued_ += rows.rows;
+    lock.unlock();
+    cv_.notify_all();
+    return true;
+}
+
+void BigTiffWriter::writerLoop()
+{
+    for (;;) {
+        cv::Mat m;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return !queue_.empty() || closing_; });
+            if (queue_.empty()) return; // closing
+            m = queue_.front();
+        }
+
+        // ストリップは連続して並ぶので、行をそのまま追記すれば良い
+        const qint64 rowBytes = (qint64)m.cols * (qint64)m.elemSize();
+        bool ok = true;
+        for (int r = 0; r < m.rows && ok; ++r) {
+            ok = file_.write(reinterpret_cast<const char*>(m.ptr(r)), rowBytes) == rowBytes;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.pop_front();
+            if (!ok) failed_ = true;
+        }
+        cv_.notify_all();
+        if (!ok) return;
+    }
+}
+
+bool BigTiffWriter::close()
+{
+    if (!thread_.joinable()) return false;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closing_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+
+    const bool ok = !failed_ && rowsQueued_ == size_.height && writeIfd();
+    file_.close();
+    if (!ok) file_.remove();
+    return ok;
+}
+
+bool BigTiffWriter::writeIfd()
+{
+    const int cn = CV_MAT_CN(type_);
+    const quint16 bits = CV_MAT_DEPTH(type_) == CV_16U ? 16 : 8;
+    const quint64 rowBytes = (quint64)size_.width * cn * (bits / 8);
+    const int strips = (size_.height + rowsPerStrip_ - 1) / rowsPerStrip_;
+
+    QByteArray offsets, counts;
+    for (int i = 0; i < strips; ++i) {
+        const int rows = std::min(rowsPerStrip_, size_.height - i * rowsPerStrip_);
+        offsets += le64(kDataOffset + (quint64)i * rowsPerStrip_ * rowBytes);
+        counts += le64((quint64)rows * rowBytes);
+    }
+
+    QByteArray bps;
+    for (int k = 0; k < cn; ++k) bps += le16(bits);
+
+    std::vector<IfdEntry> entries = {
+        {256, kLong, 1, le32((quint32)size_.width)},                 // ImageWidth
+        {257, kLong, 1, le32((quint32)size_.height)},                // ImageLength
+        {258, kShort, (quint64)cn, bps},                             // BitsPerSample
+        {259, kShort, 1, le16(1)},                                   // Compression: なし
+        {262, kShort, 1, le16(cn == 1 ? 1 : 2)},                     // Photometric: MinIsBlack / RGB
+        {273, kLong8, (quint64)strips, offsets},                     // StripOffsets
+        {277, kShort, 1, le16((quint16)cn)},                         // SamplesPerPixel
+        {278, kLong, 1, le32((quint32)rowsPerStrip_)},               // RowsPerStrip
+        {279, kLong8, (quint64)strips, counts},                      // StripByteCounts
+        {284, kShort, 1, le16(1)},                                   // PlanarConfig: 連続
+    };
+    if (cn == 4) entries.push_back({338, kShort, 1, le16(2)});       // ExtraSamples: 非事前乗算α
+
+    // 8バイトを超える値は IFD の前に置く
+    qint64 pos = file_.pos(); // 画素の直後
+    std::vector<QByteArray> inlineValues(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        QByteArray v = entries[i].value;
+        if (v.size() > 8) {
+            if (pos % 2) { file_.write(QByteArray(1, '\0')); ++pos; } // 語境界
+            if (file_.write(v) != v.size()) return false;
+            inlineValues[i] = le64((quint64)pos);
+            pos += v.size();
+        } else {
+            v.append(QByteArray(8 - v.size(), '\0'));
+            inlineValues[i] = v;
+        }
+    }
+
+    if (pos % 2) { file_.write(QByteArray(1, '\0')); ++pos; }
+    const qint64 ifdPos = pos;
+
+    QByteArray ifd;
+    ifd += le64(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        ifd += le16(entries[i].tag);
+        ifd += le16(entries[i].type);
+        ifd += le64(entries[i].count);
+        ifd += inlineValues[i];
+    }
+    ifd += le64(0); // 次の IFD なし
+    if (file_.write(ifd) != ifd.size()) return false;
+
+    // ヘッダの IFD 位置を書き直す
+    if (!file_.seek(8)) return false;
+    return file_.write(le64((quint64)ifdPos)) == 8;
+}
@@ -0,0 +1,57 @@
+#ifndef BIGTIFFWRITER_H
+#define BIGTIFFWRITER_H
+
+#include <QFile>
+#include <QString>
+
+#include <opencv2/core.hpp>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 上から順に行を流し込む BigTIFF 書き出し（非圧縮ストリップ）。close が成功しなかったファイルは残さない
+// 画像全体をメモリに持たずに書ける。ディスクへの書き込みは専用スレッドで行い、
+// 呼び出し側は次の行の合成を続けられる（キューが満杯の時だけ待つ）
+// 対応: u8 / u16、1 / 3 / 4ch（OpenCV の BGR / BGRA 並びで渡す）
+class BigTiffWriter
+{
+public:
+    BigTiffWriter() = default;
+    ~BigTiffWriter();
+
+    BigTiffWriter(const BigTiffWriter&) = delete;
+    BigTiffWriter& operator=(const BigTiffWriter&) = delete;
+
+    bool open(const QString& path, cv::Size size, int type);
+
+    // 続きの行を書く（幅・型は open と同じ）
+    bool write(const cv::Mat& rows);
+
+    // 残りの行と IFD を書いて閉じる。全行を書いていなければ失敗
+    bool close();
+
+    int rowsWritten() const { return rowsQueued_; }
+
+private:
+    void writerLoop();
+    bool writeIfd();
+
+    QFile file_;
+    cv::Size size_;
+    int type_ = 0;
+    int rowsQueued_ = 0;
+    int rowsPerStrip_ = 64;
+
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<cv::Mat> queue_;     // 書き込み待ちの行（TIFF の並びに変換済み）
+    size_t maxQueued_ = 4;
+    bool closing_ = false;
+    bool failed_ = false;
+};
+
+#endif // BIGTIFFWRITER_H
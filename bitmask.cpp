@@ -0,0 +1,265 @@
+#include "bitmask.h"
+#include "simdkernels.h"
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/core.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// 最下位の 1 の位置（v != 0）
+static inline int lowestBit(uint64_t v)
+{
+#if defined(_MSC_VER)
+    unsigned long i;
+    _BitScanForward64(&i, v);
+    return (int)i;
+#else
+    return __builtin_ctzll(v);
+#endif
+}
+
+static inline int popcount64(uint64_t v)
+{
+#if defined(_MSC_VER)
+    return (int)__popcnt64(v);
+#else
+    return __builtin_popcountll(v);
+#endif
+}
+
+BitMask::BitMask(cv::Size size, bool value)
+    : rows_(std::max(0, size.height)), cols_(std::max(0, size.width)), words_((cols_ + 63) / 64),
+      bits_((size_t)rows_ * words_, value ? ~0ULL : 0ULL)
+{
+    // 行末の余りビットを落とす
+    if (value && (cols_ & 63)) {
+        const uint64_t tail = (1ULL << (cols_ & 63)) - 1;
+        for (int y = 0; y < rows_; ++y) row(y)[words_ - 1] = tail;
+    }
+}
+
+BitMask BitMask::fromLogical(const cv::Mat1b& mask)
+{
+    BitMask m(mask.size(), false);
+    const int W = m.cols_;
+    const SimdKernels& K = simdKernels();
+    cv::parallel_for_(cv::Range(0, m.rows_), [&](const cv::Range& range) {
+        for (int y = range.start; y < range.end; ++y) K.packMaskRow(mask.ptr<uchar>(y), m.row(y), W);
+    });
+    return m;
+}
+
+BitMask BitMask::fromImage(const StitchImage& img, const cv::Rect& roi, double alphaThreshold)
+{
+    CV_Assert(!img.empty());
+    CV_Assert((roi & cv::Rect(0, 0, img.cols(), img.rows())) == roi);
+
+    if (img.hasAlpha()) {
+        // alpha >= 0.5 → u8: alpha >= 128, u16: alpha >= 32768
+        const double thr = (double)std::lround(alphaThreshold * pixelMaxValue(img.pixels.depth()));
+        cv::Mat1b m;
+        if (img.pixels.depth() == CV_8U) {
+            // u8 は alpha の取り出しと比較を 1パスで
+            const SimdKernels& K = simdKernels();
+            const uint8_t t = cv::saturate_cast<uint8_t>(thr);
+            m.create(roi.size());
+            for (int y = 0; y < roi.height; ++y) {
+                K.alphaMaskRow(img.pixels.ptr<uchar>(roi.y + y) + 4 * (size_t)roi.x, m.ptr<uchar>(y), roi.width, t);
+            }
+            return fromLogical(m);
+        }
+        cv::Mat alpha;
+        cv::extractChannel(img.pixels(roi), alpha, 3);
+        cv::compare(alpha, thr, m, cv::CMP_GE);
+        return fromLogical(m);
+    }
+    if (!img.mask.empty()) return fromLogical(img.mask(roi));
+    return BitMask(roi.size(), true); // マスク無し＝全面有効
+}
+
+BitMask& BitMask::operator&=(const BitMask& other)
+{
+    CV_Assert(size() == other.size());
+    simdKernels().andWords(bits_.data(), other.bits_.data(), bits_.size());
+    return *this;
+}
+
+// 行 src の bit x0 から 64bit を取り出す
+static inline uint64_t extractWord(const uint64_t *src, int srcWords, int x0)
+{
+    const int k = x0 >> 6;
+    const int sh = x0 & 63;
+    uint64_t w = (k < srcWords) ? (src[k] >> sh) : 0;
+    if (sh && k + 1 < srcWords) w |= src[k + 1] << (64 - sh);
+    return w;
+}
+
+void BitMask::assignRegion(const BitMask& src, const cv::Rect& roi)
+{
+    CV_Assert((roi & cv::Rect(0, 0, src.cols_, src.rows_)) == roi);
+
+    rows_ = roi.height;
+    cols_ = roi.width;
+    words_ = (cols_ + 63) / 64;
+    bits_.resize((size_t)rows_ * words_); // 容量は縮めない
+
+    const uint64_t tail = (cols_ & 63) ? (1ULL << (cols_ & 63)) - 1 : ~0ULL;
+    for (int y = 0; y < rows_; ++y) {
+        const uint64_t *s = src.row(roi.y + y);
+        uint64_t *d = row(y);
+        for (int i = 0; i < words_; ++i) d[i] = extractWord(s, src.words_, roi.x + (i << 6));
+        if (words_) d[words_ - 1] &= tail;
+    }
+}
+
+void BitMask::andRegion(const BitMask& src, const cv::Rect& roi)
+{
+    CV_Assert(roi.size() == size());
+    CV_Assert((roi & cv::Rect(0, 0, src.cols_, src.rows_)) == roi);
+
+    // 語の境界に揃っていれば語ごとの AND（余りビットはこちらが 0 なので崩れない）
+    if ((roi.x & 63) == 0) {
+        const SimdKernels& K = simdKernels();
+        for (int y = 0; y < rows_; ++y) K.andWords(row(y), src.row(roi.y + y) + (roi.x >> 6), (size_t)words_);
+        return;
+    }
+
+    for (int y = 0; y < rows_; ++y) {
+        const uint64_t *s = src.row(roi.y + y);
+        uint64_t *d = row(y);
+        for (int i = 0; i < words_; ++i) d[i] &= extractWord(s, src.words_, roi.x + (i << 6));
+    }
+}
+
+int64_t BitMask::count() const
+{
+    int64_t n = 0;
+    for (uint64_t w : bits_) n += popcount64(w);
+    return n;
+}
+
+namespace {
+
+// 高さが同じ列の区間（ヒストグラムの棒を幅つきで持つ）
+struct Segment {
+    int x;
+    int w;
+    int h;
+};
+
+// 行の run（[begin, end)）を取り出す
+void rowRuns(const uint64_t *bits, int words, std::vector<std::pair<int, int>>& runs)
+{
+    runs.clear();
+    int start = -1;
+    for (int i = 0; i < words; ++i) {
+        uint64_t w = bits[i];
+        int base = i << 6;
+        int pos = 0;
+        while (pos < 64) {
+            if (start < 0) {
+                // 次の 1 を探す
+                const uint64_t rest = pos ? (w >> pos) : w;
+                if (!rest) break;
+                pos += lowestBit(rest);
+                start = base + pos;
+            } else {
+                // 次の 0 を探す
+                const uint64_t rest = ~(pos ? (w >> pos) : w) & (pos ? (~0ULL >> pos) : ~0ULL);
+                if (!rest) break;
+                pos += lowestBit(rest);
+                runs.emplace_back(start, base + pos);
+                start = -1;
+            }
+        }
+    }
+    if (start >= 0) runs.emplace_back(start, words << 6); // 余りビットは 0 なので行末では閉じている
+}
+
+// run の中は高さ +k、外は 0 に更新（隣り合う同じ高さはまとめる）
+void updateSegments(const std::vector<Segment>& segs, const std::vector<std::pair<int, int>>& runs, int k,
+                    std::vector<Segment>& out)
+{
+    out.clear();
+    auto push = [&out](int x, int w, int h) {
+        if (w <= 0) return;
+        if (!out.empty() && out.back().h == h && out.back().x + out.back().w == x) out.back().w += w;
+        else out.push_back({x, w, h});
+    };
+
+    size_t ri = 0;
+    for (const Segment& s : segs) {
+        int p = s.x;
+        const int end = s.x + s.w;
+        while (p < end) {
+            while (ri < runs.size() && runs[ri].second <= p) ++ri;
+            if (ri < runs.size() && runs[ri].first <= p) {
+                const int q = std::min(end, runs[ri].second);
+                push(p, q - p, s.h + k);
+                p = q;
+            } else {
+                const int q = (ri < runs.size()) ? std::min(end, runs[ri].first) : end;
+                push(p, q - p, 0);
+                p = q;
+            }
+        }
+    }
+}
+
+} // namespace
+
+cv::Rect BitMask::maxRect() const
+{
+    if (empty()) return cv::Rect(0, 0, 0, 0);
+
+    // 作業領域はスレッドごとに使い回す（SSIM の候補ごとに呼ばれる）
+    thread_local std::vector<Segment> segs, next;
+    thread_local std::vector<std::pair<int, int>> runs;
+    thread_local std::vector<std::pair<int, int>> st; // (左端, 高さ)
+    segs.assign(1, Segment{0, cols_, 0});
+
+    int64_t bestArea = 0;
+    cv::Rect best(0, 0, 0, 0);
+
+    const size_t rowBytes = (size_t)words_ * sizeof(uint64_t);
+    int y = 0;
+    while (y < rows_) {
+        // 同じ内容の行をまとめる
+        int y1 = y + 1;
+        while (y1 < rows_ && std::memcmp(row(y1), row(y), rowBytes) == 0) ++y1;
+        const int k = y1 - y;
+        const int bottom = y1 - 1;
+
+        rowRuns(row(y), words_, runs);
+        updateSegments(segs, runs, k, next);
+        segs.swap(next);
+
+        // 幅つきヒストグラムの最大矩形（番兵として右端に高さ 0）
+        st.clear();
+        for (size_t i = 0; i <= segs.size(); ++i) {
+            const int x = (i < segs.size()) ? segs[i].x : cols_;
+            const int h = (i < segs.size()) ? segs[i].h : 0;
+            int left = x;
+            while (!st.empty() && st.back().second >= h) {
+                const auto [l, sh] = st.back();
+                st.pop_back();
+                const int64_t area = (int64_t)sh * (x - l);
+                if (area > bestArea) {
+                    bestArea = area;
+                    best = cv::Rect(l, bottom - sh + 1, x - l, sh);
+                }
+                left = l;
+            }
+            st.emplace_back(left, h);
+        }
+
+        y = y1;
+    }
+    return best;
+}
@@ -0,0 +1,54 @@
+#ifndef BITMASK_H
+#define BITMASK_H
+
+#include "imagetypes.h"
+
+#include <opencv2/core.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// ビット詰めのマスク（1画素 1bit、各行を 64bit 語に詰める。行末の余りビットは常に 0）
+// AND・画素数は 64画素ずつ。最大矩形は行の run（連続する 1 の区間）単位で求める
+class BitMask
+{
+public:
+    BitMask() = default;
+    BitMask(cv::Size size, bool value);
+
+    // 非0 を 1 とする
+    static BitMask fromLogical(const cv::Mat1b& mask);
+
+    // 画像の範囲 roi（画像の座標）の有効領域（4ch: alpha >= 閾値 / 分離マスク / 無ければ全面）
+    static BitMask fromImage(const StitchImage& img, const cv::Rect& roi, double alphaThreshold = 0.5);
+
+    int rows() const { return rows_; }
+    int cols() const { return cols_; }
+    cv::Size size() const { return cv::Size(cols_, rows_); }
+    bool empty() const { return rows_ == 0 || cols_ == 0; }
+    int wordsPerRow() const { return words_; }
+
+    const uint64_t *row(int y) const { return bits_.data() + (size_t)y * words_; }
+    uint64_t *row(int y) { return bits_.data() + (size_t)y * words_; }
+    bool test(int x, int y) const { return (row(y)[x >> 6] >> (x & 63)) & 1u; }
+
+    // src の範囲 roi を切り出してこのマスクにする（確保済みの領域は使い回す）
+    void assignRegion(const BitMask& src, const cv::Rect& roi);
+    // src の範囲 roi（このマスクと同じサイズ）と AND
+    void andRegion(const BitMask& src, const cv::Rect& roi);
+
+    BitMask& operator&=(const BitMask& other); // 同じサイズであること
+    int64_t count() const;
+
+    // 1 だけからなる最大面積の矩形。無ければ (0,0,0,0)
+    // 同じ内容の行が続く区間は、区間の最後の行だけ評価する（途中で終わる矩形は下へ伸ばせば必ず広い）
+    cv::Rect maxRect() const;
+
+private:
+    int rows_ = 0;
+    int cols_ = 0;
+    int words_ = 0;
+    std::vector<uint64_t> bits_;
+};
+
+#endif // BITMASK_H
@@ -0,0 +1,190 @@
+// タイル圧縮の往復確認
+// 1) LZ77 の圧縮 → 展開が元に戻るか（圧縮できないデータ・繰り返し・重なる一致・長さの延長バイト・最大オフセット）
+// 2) TiledImage に入れて読み出した画像が元と一致するか（256 の倍数でない端のタイル・範囲の読み出し・マスク）
+// 使い方: check_tilestore   失敗があれば終了コード 1
+
+#include "tilecodec.h"
+#include "tilestore.h"
+
+#include <opencv2/core.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+static int g_failures = 0;
+
+static void check(bool ok, const std::string& what)
+{
+    std::printf("  %-4s %s\n", ok ? "OK" : "FAIL", what.c_str());
+    if (!ok) ++g_failures;
+}
+
+// 再現できる疑似乱数（xorshift64）
+static uint64_t g_state = 0x9E3779B97F4A7C15ULL;
+static uint8_t nextByte()
+{
+    g_state ^= g_state << 13;
+    g_state ^= g_state >> 7;
+    g_state ^= g_state << 17;
+    return (uint8_t)(g_state >> 24);
+}
+
+static std::vector<uint8_t> randomBytes(size_t n)
+{
+    std::vector<uint8_t> v(n);
+    for (auto& b : v) b = nextByte();
+    return v;
+}
+
+// 周期 period のパターン（period < 一致長なので、展開時に一致が自分自身と重なる）
+static std::vector<uint8_t> periodic(size_t n, size_t period)
+{
+    const std::vector<uint8_t> unit = randomBytes(period);
+    std::vector<uint8_t> v(n);
+    for (size_t i = 0; i < n; ++i) v[i] = unit[i % period];
+    return v;
+}
+
+static void roundTrip(const std::vector<uint8_t>& src, const std::string& what)
+{
+    std::vector<uint8_t> packed;
+    lzCompress(src.data(), src.size(), packed);
+    std::vector<uint8_t> back(src.size());
+    const bool ok = lzDecompress(packed.data(), packed.size(), back.data(), back.size()) && back == src;
+    char ratio[64];
+    std::snprintf(ratio, sizeof(ratio), " (%zu -> %zu bytes)", src.size(), packed.size());
+    check(ok, what + ratio);
+}
+
+static void checkCodec()
+{
+    std::printf("[codec]\n");
+    for (size_t n : {0, 1, 4, 12, 13, 16, 17, 31}) roundTrip(randomBytes(n), "short input " + std::to_string(n));
+    for (size_t n : {13, 17, 64}) roundTrip(std::vector<uint8_t>(n, 7), "short run " + std::to_string(n));
+
+    roundTrip(randomBytes(256 * 256 * 4), "incompressible 256x256 BGRA");
+    roundTrip(randomBytes(1 << 20), "incompressible 1MB");
+
+    roundTrip(std::vector<uint8_t>(1 << 20, 0xAB), "single-byte run (offset 1, long length extensions)");
+    for (size_t p : {2, 3, 4, 5, 7, 13}) roundTrip(periodic(100000, p), "period " + std::to_string(p) + " (overlapping matches)");
+
+    // 長いリテラル（延長バイト付き）の後に一致
+    {
+        std::vector<uint8_t> v = randomBytes(5000);
+        const std::vector<uint8_t> head(v.begin(), v.begin() + 3000);
+        v.insert(v.end(), head.begin(), head.end());
+        roundTrip(v, "long literal run then a long match");
+    }
+    // 最大オフセット付近（65535 バイト前と一致 / 届かない）
+    for (size_t gap : {65531, 65535, 65536, 70000}) {
+        std::vector<uint8_t> v = randomBytes(gap);
+        const std::vector<uint8_t> head(v.begin(), v.begin() + 64);
+        v.insert(v.end(), head.begin(), head.end());
+        roundTrip(v, "repeat at distance " + std::to_string(gap));
+    }
+    // 画像らしい行: (r * 7 + c) % 251
+    {
+        std::vector<uint8_t> v(300 * 300);
+        for (int r = 0; r < 300; ++r)
+            for (int c = 0; c < 300; ++c) v[(size_t)r * 300 + c] = (uint8_t)((r * 7 + c) % 251);
+        roundTrip(v, "gradient 300x300");
+    }
+
+    // 壊れた入力・長さ違いは false（範囲外を読み書きしない）
+    {
+        const std::vector<uint8_t> src = periodic(10000, 3);
+        std::vector<uint8_t> packed;
+        lzCompress(src.data(), src.size(), packed);
+        std::vector<uint8_t> back(src.size());
+        check(!lzDecompress(packed.data(), packed.size() / 2, back.data(), back.size()), "truncated input is rejected");
+        check(!lzDecompress(packed.data(), packed.size(), back.data(), back.size() - 1), "short output is rejected");
+        std::vector<uint8_t> bigger(src.size() + 1);
+        check(!lzDecompress(packed.data(), packed.size(), bigger.data(), bigger.size()), "size mismatch is rejected");
+    }
+}
+
+// 画素ごとに違う内容（行・列・チャンネルで変わる。乱数なら圧縮できない）
+static cv::Mat makeImage(cv::Size size, int type, bool random)
+{
+    cv::Mat m(size, type);
+    const int cn = m.channels();
+    for (int r = 0; r < m.rows; ++r) {
+        for (int c = 0; c < m.cols; ++c) {
+            for (int k = 0; k < cn; ++k) {
+                const int v = random ? nextByte() : (r * 7 + c + 31 * k) % 251;
+                if (m.depth() == CV_8U) m.ptr<uint8_t>(r)[c * cn + k] = (uint8_t)v;
+                else m.ptr<uint16_t>(r)[c * cn + k] = (uint16_t)(v * 257 + r);
+            }
+        }
+    }
+    return m;
+}
+
+static bool same(const cv::Mat& a, const cv::Mat& b)
+{
+    return a.size() == b.size() && a.type() == b.type() && cv::norm(a, b, cv::NORM_INF) == 0;
+}
+
+static void checkTiled()
+{
+    std::printf("[tiled]\n");
+    const cv::Size sizes[] = {{1000, 700}, {257, 255}, {256, 256}, {3, 5}};
+    const int types[] = {CV_8UC1, CV_8UC3, CV_8UC4, CV_16UC1, CV_16UC4};
+    for (const cv::Size& size : sizes) {
+        for (int type : types) {
+            for (bool random : {false, true}) {
+                StitchImage img;
+                img.pixels = makeImage(size, type, random);
+                // 1 / 3ch はマスク付き（左上の四分円を無効に）も試す
+                if (CV_MAT_CN(type) != 4) {
+                    img.mask = cv::Mat1b(size, uchar(255));
+                    img.mask(cv::Rect(0, 0, (size.width + 1) / 2, (size.height + 1) / 2)).setTo(0);
+                }
+                const auto t = TiledImage::compress(img);
+                const cv::Rect all(cv::Point(0, 0), size);
+                const StitchImage back = t->read(all);
+                // 端のタイルをまたぐ範囲
+                const cv::Rect roi(size.width / 3, size.height / 3, size.width - size.width / 3, size.height - size.height / 3);
+                const StitchImage part = t->read(roi);
+
+                bool ok = same(back.pixels, img.pixels) && same(part.pixels, img.pixels(roi));
+                if (!img.mask.empty()) ok = ok && same(back.mask, img.mask) && same(t->validMask(roi), img.mask(roi));
+
+                char what[128];
+                std::snprintf(what, sizeof(what), "%dx%d type %d %s (%.1f%% of raw)", size.width, size.height, type,
+                              random ? "random" : "gradient", 100.0 * t->compressedBytes() / t->rawBytes());
+                check(ok, what);
+            }
+        }
+    }
+
+    // writeRows で帯ごとに書いた画像（最後の帯は 256 行に満たない）
+    {
+        const cv::Size size(700, 600);
+        StitchImage img;
+        img.pixels = makeImage(size, CV_8UC3, false);
+        TiledImage t(size, CV_8UC3, false, 256);
+        for (int y = 0; y < size.height; y += 256) {
+            StitchImage band;
+            band.pixels = img.pixels.rowRange(y, std::min(size.height, y + 256));
+            t.writeRows(y, band);
+        }
+        check(same(t.read(cv::Rect(cv::Point(0, 0), size)).pixels, img.pixels), "writeRows with a short last band");
+    }
+}
+
+int main()
+{
+    checkCodec();
+    checkTiled();
+
+    if (g_failures) {
+        std::printf("%d FAILED\n", g_failures);
+        return 1;
+    }
+    std::printf("all passed\n");
+    return 0;
+}
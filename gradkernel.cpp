@@ -0,0 +1,220 @@
+#include "gradkernel.h"
+#include "simdkernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+namespace {
+
+// GaussianBlur(ksize=(0,0), σ=1.0) は float 画像で 9タップになる
+constexpr int kTaps = 9;
+constexpr int kR = kTaps / 2;
+constexpr int kBand = 64;
+
+// getGaussianKernel(9, 1.0, CV_32F) と同じ重み（double で正規化してから float へ）
+struct GaussKernel {
+    float w[kTaps];
+    GaussKernel()
+    {
+        const double sigma = 1.0;
+        double t[kTaps], s = 0.0;
+        for (int i = 0; i < kTaps; ++i) {
+            const double x = i - kR;
+            t[i] = std::exp(-x * x / (2.0 * sigma * sigma));
+            s += t[i];
+        }
+        for (int i = 0; i < kTaps; ++i) w[i] = (float)(t[i] / s);
+    }
+};
+
+const GaussKernel& gauss()
+{
+    static const GaussKernel k;
+    return k;
+}
+
+inline int reflect101(int i, int n)
+{
+    if (i < 0) return -i;
+    if (i >= n) return 2 * n - 2 - i;
+    return i;
+}
+
+// スレッドごとの作業領域（最大幅に合わせて伸ばすだけで、縮めない）
+struct Scratch {
+    std::vector<float> pad;   // 左右を折り返した入力 1行
+    std::vector<float> ring;  // 水平方向にぼかした行 x 9
+    std::vector<float> blur;  // ぼかし済みの 3行（Sobel 用に左右 1画素ずつ折り返す）
+    std::vector<float> row;   // 1行分の勾配強度（FP16 出力の時だけ使う）
+    int capacity = 0;
+
+    void reserve(int W)
+    {
+        if (W <= capacity) return;
+        capacity = W;
+        pad.assign((size_t)W + 2 * kR, 0.0f);
+        ring.assign((size_t)W * kTaps, 0.0f);
+        blur.assign((size_t)(W + 2) * 3, 0.0f);
+        row.assign((size_t)W, 0.0f);
+    }
+};
+
+// FP16 の 1行の書き出し・読み込み（書き出しは scale 倍して変換）。F16C の無い版は OpenCV の変換で
+inline void store_row(const SimdKernels& K, cv::float16_t* dst, const float* src, int n, float scale)
+{
+    if (K.storeRowF16) {
+        K.storeRowF16(reinterpret_cast<uint16_t*>(dst), src, n, scale);
+        return;
+    }
+    for (int x = 0; x < n; ++x) dst[x] = cv::float16_t(src[x] * scale);
+}
+
+inline void load_row(const SimdKernels& K, const cv::float16_t* src, float* dst, int n)
+{
+    if (K.loadRowF16) {
+        K.loadRowF16(reinterpret_cast<const uint16_t*>(src), dst, n);
+        return;
+    }
+    for (int x = 0; x < n; ++x) dst[x] = (float)src[x];
+}
+
+// FP16 で途中の勾配強度を持つ時の倍率（u16 の勾配強度は FP16 の最大値 65504 を超えるので画素の最大値で割っておく）
+inline float fp16StoreScale(int depth)
+{
+    return depth == CV_16U ? 1.0f / 65535.0f : 1.0f / 255.0f;
+}
+
+// 1パス目: 出力行 [y0, y1) の勾配強度を out へ（FP16 は fp16StoreScale 倍）。総和・二乗和を返す
+template <typename T, typename OutT>
+void grad_rows(const cv::Mat& src, cv::Mat& out, int y0, int y1, double& sum, double& sumSq)
+{
+    const int W = src.cols, H = src.rows;
+    const float* w = gauss().w;
+
+    static thread_local Scratch s;
+    s.reserve(W);
+    const SimdKernels& K = simdKernels();
+
+    // 入力 1行 → 水平ぼかし → リングの slot
+    auto horizontal = [&](int r) {
+        const T* p = src.ptr<T>(r);
+        float* q = s.pad.data() + kR;
+        for (int x = 0; x < W; ++x) q[x] = (float)p[x];
+        for (int k = 1; k <= kR; ++k) {
+            q[-k] = q[k];
+            q[W - 1 + k] = q[W - 1 - k];
+        }
+        K.convRow9(s.pad.data(), s.ring.data() + (size_t)(r % kTaps) * W, W, w);
+    };
+
+    // 仮想行 v（-1, H も可）のぼかし済み行を blur の slot へ
+    // 必要な入力行は [q-R, q+R] の折り返しで、直近に読んだ 9行に収まる
+    int next = std::max(0, std::min(y0, reflect101(y0 - 1, H)) - kR);
+    const float* rows[kTaps];
+    auto blurRow = [&](int v, int slot) {
+        const int q = reflect101(v, H);
+        for (const int need = std::min(H - 1, q + kR); next <= need; ++next) horizontal(next);
+        for (int k = 0; k < kTaps; ++k) rows[k] = s.ring.data() + (size_t)(reflect101(q - kR + k, H) % kTaps) * W;
+        float* b = s.blur.data() + (size_t)slot * (W + 2) + 1;
+        K.convCol9(rows, b, W, w);
+        b[-1] = b[1];
+        b[W] = b[W - 2];
+    };
+
+    auto slotRow = [&](int v) { return s.blur.data() + (size_t)((v - (y0 - 1)) % 3) * (W + 2) + 1; };
+
+    blurRow(y0 - 1, 0);
+    blurRow(y0, 1);
+    for (int y = y0; y < y1; ++y) {
+        blurRow(y + 1, (y + 1 - (y0 - 1)) % 3);
+        OutT* o = out.ptr<OutT>(y);
+        float* dst;
+        if constexpr (std::is_same_v<OutT, float>) dst = o;
+        else dst = s.row.data();
+        sum += K.sobelMagRow(slotRow(y - 1), slotRow(y), slotRow(y + 1), dst, W, &sumSq);
+        if constexpr (!std::is_same_v<OutT, float>) store_row(K, o, dst, W, fp16StoreScale(src.depth()));
+    }
+}
+
+// 2パス目: 標準化と Hanning窓（その場で）。mean, invStd は 1パス目で書いた値の尺度に合わせておく
+template <typename OutT>
+void normalize_rows(cv::Mat& out, int y0, int y1, float mean, float invStd, const std::vector<float>& wc, double coeffR)
+{
+    const int W = out.cols;
+    static thread_local std::vector<float> buf;
+    if ((int)buf.size() < W) buf.resize(W);
+    const SimdKernels& K = simdKernels();
+
+    for (int y = y0; y < y1; ++y) {
+        OutT* o = out.ptr<OutT>(y);
+        float* p;
+        if constexpr (std::is_same_v<OutT, float>) p = o;
+        else { p = buf.data(); load_row(K, o, p, W); }
+
+        const float scale = invStd * (float)(0.5 * (1.0 - std::cos(coeffR * y)));
+        K.windowRow(p, wc.data(), W, mean, scale);
+
+        if constexpr (!std::is_same_v<OutT, float>) store_row(K, o, p, W, 1.0f);
+    }
+}
+
+template <typename OutT>
+void grad_window_impl(const cv::Mat& eq, cv::Mat& out)
+{
+    const int W = eq.cols, H = eq.rows;
+    const int bands = (H + kBand - 1) / kBand;
+    cv::AutoBuffer<double, 64> sums(bands), sumSqs(bands);
+
+    cv::parallel_for_(cv::Range(0, bands), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; ++i) {
+            const int y0 = i * kBand, y1 = std::min(H, y0 + kBand);
+            double s = 0.0, q = 0.0;
+            if (eq.depth() == CV_8U) grad_rows<uint8_t, OutT>(eq, out, y0, y1, s, q);
+            else grad_rows<uint16_t, OutT>(eq, out, y0, y1, s, q);
+            sums[i] = s;
+            sumSqs[i] = q;
+        }
+    });
+
+    // meanStdDev と同じ（母標準偏差）
+    double sum = 0.0, sumSq = 0.0;
+    for (int i = 0; i < bands; ++i) {
+        sum += sums[i];
+        sumSq += sumSqs[i];
+    }
+    const double n = (double)W * (double)H;
+    const double mean = sum / n;
+    const double stddev = std::sqrt(std::max(0.0, sumSq / n - mean * mean));
+    const float invStd = stddev > 1e-6 ? (float)(1.0 / stddev) : 1.0f;
+    const float storeScale = std::is_same_v<OutT, float> ? 1.0f : fp16StoreScale(eq.depth());
+
+    // createHanningWindow と同じ窓（行方向は行ごとに、列方向は 1回だけ求める）
+    std::vector<float> wc(W);
+    const double coeffC = 2.0 * CV_PI / (double)(W - 1);
+    const double coeffR = 2.0 * CV_PI / (double)(H - 1);
+    for (int x = 0; x < W; ++x) wc[x] = (float)(0.5 * (1.0 - std::cos(coeffC * x)));
+
+    cv::parallel_for_(cv::Range(0, bands), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; ++i) {
+            normalize_rows<OutT>(out, i * kBand, std::min(H, (i + 1) * kBand),
+                                 (float)mean * storeScale, invStd / storeScale, wc, coeffR);
+        }
+    });
+}
+
+} // namespace
+
+cv::Mat grad_window_fused(const cv::Mat& eq, int depth)
+{
+    CV_Assert(eq.type() == CV_8UC1 || eq.type() == CV_16UC1);
+    CV_Assert(eq.cols > kR && eq.rows > kR);
+    CV_Assert(depth == CV_32F || depth == CV_16F);
+
+    cv::Mat out(eq.size(), CV_MAKETYPE(depth, 1));
+    if (depth == CV_32F) grad_window_impl<float>(eq, out);
+    else grad_window_impl<cv::float16_t>(eq, out);
+    return out;
+}
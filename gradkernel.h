@@ -0,0 +1,16 @@
+#ifndef GRADKERNEL_H
+#define GRADKERNEL_H
+
+#include <opencv2/core.hpp>
+
+// 位相相関法の前処理（CLAHE 以降）の融合カーネル
+// GaussianBlur(σ=1.0) → Sobel(3x3) x/y → 勾配強度 を行の帯ごとに 1パスで求め（中間の float 画像を作らない）、
+// 同じパスで平均・標準偏差を集計し、2パス目で標準化と Hanning窓を掛ける
+// 境界は OpenCV の既定（BORDER_REFLECT_101）と同じ。行の計算は実行時に選んだ SIMD の版（simdkernels.h）で行う
+
+// CLAHE 後の 1ch（u8 / u16）から、clahe_then_grad と同じ値（float の丸め差のみ）を返す
+// depth: CV_32F（phaseCorrelate へ渡す）/ CV_16F（保持用。メモリ半分。使う時に CV_32F へ戻す）
+// 5x5 より小さい画像は対象外（呼び出し側で従来の実装を使う）
+cv::Mat grad_window_fused(const cv::Mat& eq, int depth = CV_32F);
+
+#endif // GRADKERNEL_H
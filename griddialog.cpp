@@ -0,0 +1,121 @@
+#include "griddialog.h"
+
+#include <QCheckBox>
+#include <QCollator>
+#include <QDialogButtonBox>
+#include <QDoubleSpinBox>
+#include <QFileDialog>
+#include <QFileInfo>
+#include <QFormLayout>
+#include <QHBoxLayout>
+#include <QLabel>
+#include <QLineEdit>
+#include <QPushButton>
+#include <QSpinBox>
+
+#include <algorithm>
+#include <cmath>
+
+GridDialog::GridDialog(QWidget *parent) : QDialog(parent)
+{
+    setWindowTitle("グリッド結合");
+
+    auto *form = new QFormLayout(this);
+
+    auto *filesRow = new QHBoxLayout;
+    filesLabel = new QLabel("未選択", this);
+    auto *filesButton = new QPushButton("選択...", this);
+    filesRow->addWidget(filesLabel, 1);
+    filesRow->addWidget(filesButton);
+    form->addRow("タイル", filesRow);
+
+    rowsSpin = new QSpinBox(this);
+    rowsSpin->setRange(1, 10000);
+    colsSpin = new QSpinBox(this);
+    colsSpin->setRange(1, 10000);
+    form->addRow("行数", rowsSpin);
+    form->addRow("列数", colsSpin);
+
+    overlapSpin = new QDoubleSpinBox(this);
+    overlapSpin->setRange(1.0, 49.0);
+    overlapSpin->setSuffix(" %");
+    overlapSpin->setValue(10.0);
+    form->addRow("公称の重なり", overlapSpin);
+
+    snakeCheck = new QCheckBox("蛇行スキャン（奇数行は右から左）", this);
+    form->addRow(QString(), snakeCheck);
+
+    auto *outRow = new QHBoxLayout;
+    outEdit = new QLineEdit(this);
+    auto *outButton = new QPushButton("...", this);
+    outRow->addWidget(outEdit, 1);
+    outRow->addWidget(outButton);
+    form->addRow("出力 (BigTIFF)", outRow);
+
+    auto *buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, this);
+    okButton = buttons->button(QDialogButtonBox::Ok);
+    form->addRow(buttons);
+
+    connect(filesButton, &QPushButton::clicked, this, &GridDialog::chooseFiles);
+    connect(outButton, &QPushButton::clicked, this, &GridDialog::chooseOutput);
+    connect(buttons, &QDialogButtonBox::accepted, this, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, this, &QDialog::reject);
+    connect(rowsSpin, QOverload<int>::of(&QSpinBox::valueChanged), this, &GridDialog::updateState);
+    connect(colsSpin, QOverload<int>::of(&QSpinBox::valueChanged), this, &GridDialog::updateState);
+    connect(outEdit, &QLineEdit::textChanged, this, &GridDialog::updateState);
+
+    updateState();
+}
+
+void GridDialog::chooseFiles()
+{
+    QStringList files = QFileDialog::getOpenFileNames(this, "タイルを選択", QString(),
+                                                      "Images (*.png *.jpg *.jpeg *.bmp *.tif *.tiff);;All Files (*.*)");
+    if (files.isEmpty()) return;
+
+    // 連番のファイル名を数値順に（tile_2 < tile_10）
+    QCollator collator;
+    collator.setNumericMode(true);
+    std::sort(files.begin(), files.end(), [&collator](const QString& a, const QString& b) {
+        return collator.compare(a, b) < 0;
+    });
+    paths = files;
+
+    // 行・列が未設定なら正方に近い形を提案
+    if (rowsSpin->value() * colsSpin->value() != paths.size()) {
+        int c = (int)std::ceil(std::sqrt((double)paths.size()));
+        while (c > 1 && paths.size() % c != 0) --c;
+        colsSpin->setValue(std::max(1, (int)paths.size() / std::max(1, c)));
+        rowsSpin->setValue(std::max(1, c));
+    }
+    if (outEdit->text().isEmpty()) {
+        outEdit->setText(QFileInfo(paths.front()).dir().filePath("mosaic.tif"));
+    }
+    updateState();
+}
+
+void GridDialog::chooseOutput()
+{
+    const QString path = QFileDialog::getSaveFileName(this, "出力先", outEdit->text(), "BigTIFF (*.tif *.tiff)");
+    if (!path.isEmpty()) outEdit->setText(path);
+}
+
+void GridDialog::updateState()
+{
+    const int need = rowsSpin->value() * colsSpin->value();
+    filesLabel->setText(paths.isEmpty() ? QString("未選択")
+                                        : QString("%1 枚（%2 枚必要）").arg(paths.size()).arg(need));
+    okButton->setEnabled(!paths.isEmpty() && paths.size() == need && !outEdit->text().isEmpty());
+}
+
+GridSpec GridDialog::spec() const
+{
+    GridSpec s;
+    s.paths = paths;
+    s.rows = rowsSpin->value();
+    s.cols = colsSpin->value();
+    s.overlap = overlapSpin->value() / 100.0;
+    s.snake = snakeCheck->isChecked();
+    s.outPath = outEdit->text();
+    return s;
+}
@@ -0,0 +1,39 @@
+#ifndef GRIDDIALOG_H
+#define GRIDDIALOG_H
+
+#include "gridmosaic.h"
+
+#include <QDialog>
+
+class QLabel;
+class QSpinBox;
+class QDoubleSpinBox;
+class QCheckBox;
+class QLineEdit;
+class QPushButton;
+
+// グリッド結合の設定
+class GridDialog : public QDialog
+{
+    Q_OBJECT
+public:
+    explicit GridDialog(QWidget *parent = nullptr);
+
+    GridSpec spec() const;
+
+private:
+    void chooseFiles();
+    void chooseOutput();
+    void updateState();
+
+    QStringList paths;
+    QLabel *filesLabel = nullptr;
+    QSpinBox *rowsSpin = nullptr;
+    QSpinBox *colsSpin = nullptr;
+    QDoubleSpinBox *overlapSpin = nullptr;
+    QCheckBox *snakeCheck = nullptr;
+    QLineEdit *outEdit = nullptr;
+    QPushButton *okButton = nullptr;
+};
+
+#endif // GRIDDIALOG_H
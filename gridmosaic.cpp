@@ -0,0 +1,203 @@
+#include "gridmosaic.h"
+#include "bigtiffwriter.h"
+#include "imageio.h"
+#include "stitchcore.h"
+
+#include <QImageReader>
+#include <QtConcurrent/QtConcurrent>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+// ファイル順 → グリッド位置
+int fileIndex(const GridSpec& s, int row, int col)
+{
+    const int c = (s.snake && (row % 2 == 1)) ? (s.cols - 1 - col) : col;
+    return row * s.cols + c;
+}
+
+} // namespace
+
+GridResult runGridMosaic(const GridSpec& spec,
+                         const std::function<bool()>& isCanceled,
+                         const std::function<void(int row)>& onRowDone)
+{
+    GridResult res;
+    if (spec.rows < 1 || spec.cols < 1 || spec.paths.size() != spec.rows * spec.cols) {
+        res.error = QString("ファイル数 (%1) が %2 x %3 と一致しません。").arg(spec.paths.size()).arg(spec.rows).arg(spec.cols);
+        return res;
+    }
+    if (!(spec.overlap > 0.0 && spec.overlap < 0.5)) {
+        res.error = "重なりは 0 より大きく 50% 未満にしてください。";
+        return res;
+    }
+
+    // 公称の配置（1枚目のサイズで揃っているものとする。ヘッダだけ読む）
+    const QSize first = QImageReader(spec.paths.front()).size();
+    if (!first.isValid()) {
+        res.error = "1枚目の画像サイズを読めません: " + spec.paths.front();
+        return res;
+    }
+    const cv::Size tile(first.width(), first.height());
+    const int stepX = (int)std::lround(tile.width * (1.0 - spec.overlap));
+    const int stepY = (int)std::lround(tile.height * (1.0 - spec.overlap));
+    // 辺は 64bit で求める（cv::Mat の行・列は int）
+    const int64_t canvasW = (int64_t)stepX * (spec.cols - 1) + tile.width;
+    const int64_t canvasH = (int64_t)stepY * (spec.rows - 1) + tile.height;
+    if (canvasW > INT_MAX || canvasH > INT_MAX) {
+        res.error = "結合後の画像が大きすぎます。";
+        return res;
+    }
+    const cv::Size canvas((int)canvasW, (int)canvasH);
+
+    // 公称の重なりから外れる結果は誤検出とみなす（重なり幅の半分まで許す）
+    const int tolX = std::max(4, (tile.width - stepX) / 2);
+    const int tolY = std::max(4, (tile.height - stepY) / 2);
+
+    BigTiffWriter writer; // 画素型は1行目を読んでから決める
+
+    std::vector<StitchImage> prevImgs;  // 前の行（上の隣との位置合わせ用）
+    std::vector<cv::Point> prevPos;
+    std::vector<FeatherTile> live;      // まだ書き出していない行に掛かるタイル
+    int flushedY = 0;                   // ここより上は書き出し済み
+    int type = -1;
+
+    for (int r = 0; r < spec.rows; ++r) {
+        if (isCanceled()) {
+            res.error = "キャンセルされました。";
+            return res;
+        }
+
+        // 行のタイルを並列に読み込む
+        QList<int> cols;
+        for (int c = 0; c < spec.cols; ++c) cols << c;
+        const QList<StitchImage> imgsList = QtConcurrent::blockingMapped<QList<StitchImage>>(cols, [&](int c) {
+            return loadStitchImage(spec.paths[fileIndex(spec, r, c)]);
+        });
+        std::vector<StitchImage> imgs(imgsList.begin(), imgsList.end());
+
+        for (int c = 0; c < spec.cols; ++c) {
+            if (imgs[c].empty()) {
+                res.error = "読み込みに失敗しました: " + spec.paths[fileIndex(spec, r, c)];
+                return res;
+            }
+            if (type < 0) type = imgs[c].pixels.type();
+            if (imgs[c].pixels.type() != type) {
+                res.error = "画素型が揃っていません: " + spec.paths[fileIndex(spec, r, c)];
+                return res;
+            }
+        }
+
+        if (r == 0) {
+            if (!writer.open(spec.outPath, canvas, type)) {
+                res.error = "書き出し先を開けません: " + spec.outPath;
+                return res;
+            }
+        }
+
+        // 左・上の隣とだけ位置合わせする（各ペアは独立なので並列）
+        const cv::Point stepRight(stepX, 0), stepDown(0, stepY);
+        const QList<std::pair<return_struct1, return_struct1>> pairs =
+            QtConcurrent::blockingMapped<QList<std::pair<return_struct1, return_struct1>>>(cols, [&](int c) {
+                return_struct1 left, up;
+                if (c > 0) left = align_phase_pair(imgs[c - 1], imgs[c], stepRight);
+                if (r > 0) up = align_phase_pair(prevImgs[c], imgs[c], stepDown);
+                return std::make_pair(left, up);
+            });
+
+        // 位置を決める（左から順に。左・上の予測をスコアで重み付け平均）
+        // 上の予測は前の行の最も上のタイル + 公称の送り - tolY（= 書き出し済みの行）より上には来ない。
+        // 左の予測は列ごとに tolY ずつずれが積み重なり得るので、同じ線で打ち切る（行の中で上へ流れ続けない）
+        int floorY = 0; // 1行目はキャンバスの上端
+        if (r > 0) {
+            int prevTop = prevPos[0].y;
+            for (const cv::Point& p : prevPos) prevTop = std::min(prevTop, p.y);
+            floorY = prevTop + stepY - tolY;
+        }
+        std::vector<cv::Point> pos(spec.cols);
+        for (int c = 0; c < spec.cols; ++c) {
+            const return_struct1& left = pairs[c].first;
+            const return_struct1& up = pairs[c].second;
+
+            auto accept = [&](const return_struct1& p, cv::Point nominal) {
+                ++res.pairs;
+                if (p.score != 0 && std::abs(p.x - nominal.x) <= tolX && std::abs(p.y - nominal.y) <= tolY) return true;
+                ++res.rejected;
+                return false;
+            };
+
+            double wsum = 0.0;
+            cv::Point2d acc(0, 0);
+            cv::Point fallback(stepX * c, stepY * r); // 公称位置
+            if (c > 0) {
+                const bool ok = accept(left, stepRight);
+                cv::Point pred = pos[c - 1] + (ok ? cv::Point(left.x, left.y) : stepRight);
+                pred.y = std::max(pred.y, floorY);
+                fallback = pred;
+                if (ok) { acc += cv::Point2d(pred) * left.score; wsum += left.score; }
+            }
+            if (r > 0) {
+                const bool ok = accept(up, stepDown);
+                const cv::Point pred = prevPos[c] + (ok ? cv::Point(up.x, up.y) : stepDown);
+                if (c == 0) fallback = pred;
+                if (ok) { acc += cv::Point2d(pred) * up.score; wsum += up.score; }
+            }
+            pos[c] = (wsum > 0) ? cv::Point((int)std::lround(acc.x / wsum), (int)std::lround(acc.y / wsum)) : fallback;
+        }
+
+        std::vector<FeatherTile> tiles(spec.cols);
+        cv::parallel_for_(cv::Range(0, spec.cols), [&](const cv::Range& range) {
+            for (int c = range.start; c < range.end; ++c) {
+                tiles[c] = prepareFeatherTile(imgs[c], pos[c], canvas, spec.featherRadius);
+            }
+        });
+        for (FeatherTile& t : tiles) live.push_back(std::move(t));
+
+        // 確定した行を書き出す：次の行は、この行の最も上のタイル + 公称の送り - 許容幅より上には来ない
+        // （上の予測はこの線より下、左の予測は次の行でこの線で打ち切る）。残るのは現在の行のタイルだけ
+        int limit = canvas.height;
+        if (r + 1 < spec.rows) {
+            int top = pos[0].y;
+            for (const cv::Point& p : pos) top = std::min(top, p.y);
+            limit = std::clamp(top + stepY - tolY, flushedY, canvas.height);
+        }
+        std::vector<const FeatherTile*> active;
+        for (const FeatherTile& t : live) active.push_back(&t);
+
+        constexpr int kChunk = 256; // 1回に合成する行数
+        cv::Mat band;
+        for (int y = flushedY; y < limit; y += kChunk) {
+            if (isCanceled()) {
+                res.error = "キャンセルされました。";
+                return res;
+            }
+            const int y1 = std::min(limit, y + kChunk);
+            composeFeatherRows(active, canvas, y, y1, spec.featherRadius, band);
+            if (!writer.write(band)) {
+                res.error = "書き出しに失敗しました。";
+                return res;
+            }
+        }
+        flushedY = limit;
+
+        // 書き出し済みの範囲にしか掛からないタイルは手放す（通常は前の行と現在の行だけ残る）
+        live.erase(std::remove_if(live.begin(), live.end(), [flushedY](const FeatherTile& t) {
+                       return t.rect.y + t.rect.height <= flushedY;
+                   }), live.end());
+        prevImgs = std::move(imgs);
+        prevPos = std::move(pos);
+
+        if (onRowDone) onRowDone(r);
+    }
+
+    if (!writer.close()) {
+        res.error = "書き出しに失敗しました。";
+        return res;
+    }
+    res.ok = true;
+    res.size = canvas;
+    return res;
+}
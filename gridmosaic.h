@@ -0,0 +1,38 @@
+#ifndef GRIDMOSAIC_H
+#define GRIDMOSAIC_H
+
+#include <QString>
+#include <QStringList>
+
+#include <opencv2/core.hpp>
+
+#include <functional>
+
+// R x C のタイルスキャンを結合する（グリッドモード）
+// - 隣接ペア（左・上）だけを位相相関で位置合わせし、公称の重なりから外れた結果は公称位置に戻す
+// - 行ごとに読み込み・位置合わせ・合成し、確定した出力行はすぐ BigTIFF へ書き出す
+//   （保持するのは直前の行と現在の行のタイルだけ）
+// 出力範囲は公称配置の外接矩形。はみ出した分は捨てる
+struct GridSpec {
+    QStringList paths;          // 行優先（snake なら奇数行は右から左）
+    int rows = 1;
+    int cols = 1;
+    double overlap = 0.1;       // 公称の重なり（タイル幅・高さに対する割合、0.5 未満）
+    bool snake = false;
+    float featherRadius = 80.0f;
+    QString outPath;            // .tif（BigTIFF）
+};
+
+struct GridResult {
+    bool ok = false;
+    QString error;
+    cv::Size size;
+    int pairs = 0;              // 位置合わせしたペア数
+    int rejected = 0;           // 公称位置に戻したペア数
+};
+
+GridResult runGridMosaic(const GridSpec& spec,
+                         const std::function<bool()>& isCanceled,
+                         const std::function<void(int row)>& onRowDone);
+
+#endif // GRIDMOSAIC_H
@@ -0,0 +1,271 @@
+#include "imagecache.h"
+#include "imageio.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QSettings>
+#include <QStandardPaths>
+
+#include <opencv2/core.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace {
+
+constexpr char kMagic[8] = {'I', 'S', 'T', 'R', 'A', 'W', '0', '1'};
+constexpr qint64 kAlign = 4096; // ページ境界
+
+// キャッシュファイルの先頭
+struct RawHeader {
+    char magic[8];
+    qint32 rows;
+    qint32 cols;
+    qint32 type;
+    qint32 hasMask;
+    qint64 pixelOffset;
+    qint64 maskOffset;
+};
+
+std::mutex g_indexMutex; // index.ini と容量整理の排他
+
+qint64 alignUp(qint64 v) { return (v + kAlign - 1) / kAlign * kAlign; }
+
+QString cacheDir()
+{
+    const QString dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/decoded";
+    QDir().mkpath(dir);
+    return dir;
+}
+
+QString rawPath(const QString& key) { return cacheDir() + "/" + key + ".raw"; }
+
+// ファイルごとのキャッシュキー（files/）と、キャッシュの最終使用時刻（used/、容量整理の順番）
+QString indexPath() { return cacheDir() + "/index.ini"; }
+
+// マップしたファイルを cv::Mat の参照カウントで保持する
+// （Mat の寿命が尽きた時点でアンマップ。create() 等の新規確保は既定のアロケータへ回す）
+class MappedFileAllocator : public cv::MatAllocator
+{
+public:
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                           cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const override
+    {
+        return cv::Mat::getDefaultAllocator()->allocate(dims, sizes, type, data, step, flags, usageFlags);
+    }
+    bool allocate(cv::UMatData* u, cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const override
+    {
+        return cv::Mat::getDefaultAllocator()->allocate(u, flags, usageFlags);
+    }
+    void deallocate(cv::UMatData* u) const override
+    {
+        if (!u) return;
+        delete static_cast<std::shared_ptr<QFile>*>(u->handle);
+        delete u;
+    }
+};
+
+const MappedFileAllocator g_mappedAllocator;
+
+cv::Mat wrapMapped(const std::shared_ptr<QFile>& file, uchar* data, int rows, int cols, int type)
+{
+    cv::Mat m(rows, cols, type, data);
+    auto *u = new cv::UMatData(&g_mappedAllocator);
+    u->data = u->origdata = data;
+    u->size = m.total() * m.elemSize();
+    u->handle = new std::shared_ptr<QFile>(file);
+    u->refcount = 1;
+    m.u = u;
+    m.allocator = &g_mappedAllocator;
+    return m;
+}
+
+// ファイル内容のハッシュ
+QString hashFile(const QString& path)
+{
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly)) return QString();
+    QCryptographicHash h(QCryptographicHash::Sha1);
+    if (!h.addData(&f)) return QString();
+    return QString::fromLatin1(h.result().toHex());
+}
+
+bool writeMat(QSaveFile& f, const cv::Mat& m)
+{
+    const qint64 rowBytes = (qint64)m.cols * (qint64)m.elemSize();
+    for (int r = 0; r < m.rows; ++r) {
+        if (f.write(reinterpret_cast<const char*>(m.ptr(r)), rowBytes) != rowBytes) return false;
+    }
+    return true;
+}
+
+bool padTo(QSaveFile& f, qint64 offset)
+{
+    const qint64 n = offset - f.pos();
+    if (n <= 0) return true;
+    const QByteArray zeros(n, '\0');
+    return f.write(zeros) == n;
+}
+
+// 最近使った印（ファイルの更新日時は読み取り専用で開いたままでは変えられない OS があるので index.ini に持つ）
+void markUsed(const QString& key)
+{
+    std::lock_guard<std::mutex> lock(g_indexMutex);
+    QSettings index(indexPath(), QSettings::IniFormat);
+    index.setValue("used/" + key, QDateTime::currentMSecsSinceEpoch());
+}
+
+// 容量上限を超えた分を、最近使われていない順に消す（印の無いものは保存した日時で）。g_indexMutex を持って呼ぶ
+void trimCache()
+{
+    const qint64 maxBytes = (qint64)(QSettings().value("cache/maxGB", 32.0).toDouble() * 1024.0 * 1024.0 * 1024.0);
+
+    QSettings index(indexPath(), QSettings::IniFormat);
+    const QFileInfoList files = QDir(cacheDir()).entryInfoList({"*.raw"}, QDir::Files);
+    std::vector<std::pair<qint64, QFileInfo>> byUse;
+    qint64 total = 0;
+    for (const QFileInfo& fi : files) {
+        total += fi.size();
+        const qint64 used = index.value("used/" + fi.completeBaseName(), fi.lastModified().toMSecsSinceEpoch()).toLongLong();
+        byUse.emplace_back(used, fi);
+    }
+    if (total <= maxBytes) return;
+    std::sort(byUse.begin(), byUse.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    for (const auto& [used, fi] : byUse) { // 古い順
+        if (total <= maxBytes) break;
+        if (QFile::remove(fi.absoluteFilePath())) { // マップ中（Windows）は消せないので残す
+            total -= fi.size();
+            index.remove("used/" + fi.completeBaseName());
+        }
+    }
+}
+
+} // namespace
+
+QString cacheKeyForFile(const QString& path)
+{
+    const QFileInfo fi(path);
+    if (!fi.isFile()) return QString();
+
+    const QString abs = fi.absoluteFilePath();
+    const QString id = QString::fromLatin1(QCryptographicHash::hash(abs.toUtf8(), QCryptographicHash::Sha1).toHex());
+    const QString stamp = QString("%1;%2").arg(fi.size()).arg(fi.lastModified().toMSecsSinceEpoch());
+
+    // サイズ・更新日時が前回と同じなら、前回のハッシュをそのまま使う
+    {
+        std::lock_guard<std::mutex> lock(g_indexMutex);
+        QSettings index(indexPath(), QSettings::IniFormat);
+        if (index.value("files/" + id + "/stamp").toString() == stamp) {
+            const QString key = index.value("files/" + id + "/key").toString();
+            if (!key.isEmpty()) return key;
+        }
+    }
+
+    const QString key = hashFile(abs);
+    if (key.isEmpty()) return key;
+
+    std::lock_guard<std::mutex> lock(g_indexMutex);
+    QSettings index(indexPath(), QSettings::IniFormat);
+    index.setValue("files/" + id + "/stamp", stamp);
+    index.setValue("files/" + id + "/key", key);
+    return key;
+}
+
+QString cacheKeyForImage(const StitchImage& img)
+{
+    QCryptographicHash h(QCryptographicHash::Sha1);
+    const qint32 meta[3] = {img.rows(), img.cols(), img.pixels.type()};
+    h.addData(QByteArrayView(reinterpret_cast<const char*>(meta), sizeof(meta)));
+
+    auto addMat = [&h](const cv::Mat& m) {
+        const qsizetype rowBytes = (qsizetype)m.cols * (qsizetype)m.elemSize();
+        for (int r = 0; r < m.rows; ++r) h.addData(QByteArrayView(reinterpret_cast<const char*>(m.ptr(r)), rowBytes));
+    };
+    addMat(img.pixels);
+    if (!img.mask.empty()) addMat(img.mask);
+
+    return "img-" + QString::fromLatin1(h.result().toHex());
+}
+
+StitchImage loadCachedImage(const QString& key)
+{
+    StitchImage out;
+    if (key.isEmpty()) return out;
+
+    auto file = std::make_shared<QFile>(rawPath(key));
+    if (!file->open(QIODevice::ReadOnly)) return out;
+
+    RawHeader h;
+    if (file->read(reinterpret_cast<char*>(&h), sizeof(h)) != (qint64)sizeof(h)) return out;
+    if (std::memcmp(h.magic, kMagic, sizeof(kMagic)) != 0 || h.rows <= 0 || h.cols <= 0) return out;
+
+    const qint64 pixelBytes = (qint64)h.rows * h.cols * (qint64)CV_ELEM_SIZE(h.type);
+    const qint64 maskBytes = h.hasMask ? (qint64)h.rows * h.cols : 0;
+    if (h.pixelOffset + pixelBytes > file->size() || (h.hasMask && h.maskOffset + maskBytes > file->size())) return out;
+
+    // プライベートマップ（誤って書き込んでもファイルは変わらない）
+    uchar *pix = file->map(h.pixelOffset, pixelBytes, QFileDevice::MapPrivateOption);
+    if (!pix) return out;
+    out.pixels = wrapMapped(file, pix, h.rows, h.cols, h.type);
+
+    if (h.hasMask) {
+        uchar *mask = file->map(h.maskOffset, maskBytes, QFileDevice::MapPrivateOption);
+        if (!mask) return StitchImage();
+        out.mask = wrapMapped(file, mask, h.rows, h.cols, CV_8UC1);
+    }
+
+    markUsed(key);
+    return out;
+}
+
+bool storeCachedImage(const QString& key, const StitchImage& img)
+{
+    if (key.isEmpty() || img.empty()) return false;
+
+    const QString path = rawPath(key);
+    if (QFile::exists(path)) return true;
+
+    RawHeader h;
+    std::memcpy(h.magic, kMagic, sizeof(kMagic));
+    h.rows = img.rows();
+    h.cols = img.cols();
+    h.type = img.pixels.type();
+    h.hasMask = img.mask.empty() ? 0 : 1;
+    h.pixelOffset = alignUp(sizeof(RawHeader));
+    const qint64 pixelBytes = (qint64)h.rows * h.cols * (qint64)img.pixels.elemSize();
+    h.maskOffset = h.hasMask ? alignUp(h.pixelOffset + pixelBytes) : 0;
+
+    // 書き終えてから置き換える（途中で落ちても壊れたキャッシュを残さない）
+    QSaveFile f(path);
+    if (!f.open(QIODevice::WriteOnly)) return false;
+    bool ok = f.write(reinterpret_cast<const char*>(&h), sizeof(h)) == (qint64)sizeof(h);
+    ok = ok && padTo(f, h.pixelOffset) && writeMat(f, img.pixels);
+    if (h.hasMask) ok = ok && padTo(f, h.maskOffset) && writeMat(f, img.mask);
+    if (!ok || !f.commit()) return false;
+
+    std::lock_guard<std::mutex> lock(g_indexMutex);
+    trimCache();
+    return true;
+}
+
+StitchImage loadStitchImageCached(const QString& path, QString *key)
+{
+    const QString k = cacheKeyForFile(path);
+    if (key) *key = k;
+
+    StitchImage img = loadCachedImage(k);
+    if (!img.empty()) return img;
+
+    img = loadStitchImage(path);
+    if (!img.empty()) storeCachedImage(k, img);
+    return img;
+}
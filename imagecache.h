@@ -0,0 +1,28 @@
+#ifndef IMAGECACHE_H
+#define IMAGECACHE_H
+
+#include "imagetypes.h"
+
+#include <QString>
+
+// デコード済み画像のディスクキャッシュ
+// - 生画素をページ境界に揃えて保存し、次回はメモリマップで開く（デコード不要）
+// - キーはファイル内容のハッシュ。パス・サイズ・更新日時が前回と同じならハッシュ計算も省く
+// - 容量は QSettings の cache/maxGB（既定 32GB）。古く使われていないものから消す
+
+// ファイルのキャッシュキー（読めなければ空）
+QString cacheKeyForFile(const QString& path);
+
+// 画素内容からのキー（結合結果などファイルの無い画像用）
+QString cacheKeyForImage(const StitchImage& img);
+
+// キャッシュから開く（メモリマップ。書き込みはプロセス内のコピーにのみ反映）。無ければ空
+StitchImage loadCachedImage(const QString& key);
+
+// キャッシュへ保存（既にあれば何もしない）
+bool storeCachedImage(const QString& key, const StitchImage& img);
+
+// キャッシュ経由で読み込む。初回はデコードしてキャッシュへ保存する
+StitchImage loadStitchImageCached(const QString& path, QString *key = nullptr);
+
+#endif // IMAGECACHE_H
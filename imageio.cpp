@@ -0,0 +1,163 @@
+#include "imageio.h"
+#include "bigtiffwriter.h"
+
+#include <QFile>
+#include <QFileInfo>
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/core.hpp>
+
+#include <algorithm>
+#include <climits>
+#include <vector>
+
+// QImageをOpenCV形式へ変換（OpenCVで読めない形式のフォールバック）
+static cv::Mat qimage_to_mat_bgra(const QImage& img)
+{
+    QImage converted = img.convertToFormat(QImage::Format_ARGB32); // 32-bit BGRA相当
+    cv::Mat mat(converted.height(), converted.width(), CV_8UC4,
+                (void*)converted.bits(), converted.bytesPerLine());
+    return mat.clone(); // QImageの寿命から独立させる
+}
+
+// ファイルをデコードする（日本語パス対策で QFile 経由）
+static cv::Mat decodeFile(const QString& path)
+{
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly)) return cv::Mat();
+
+    if (f.size() >= INT_MAX) {
+        // imdecode のバッファは int 長まで
+        f.close();
+        return cv::imread(QFile::encodeName(path).toStdString(), cv::IMREAD_UNCHANGED);
+    }
+
+    const QByteArray bytes = f.readAll();
+    const cv::Mat buf(1, (int)bytes.size(), CV_8U, (void*)bytes.constData());
+    return cv::imdecode(buf, cv::IMREAD_UNCHANGED);
+}
+
+StitchImage loadStitchImage(const QString& path)
+{
+    StitchImage out;
+
+    cv::Mat m = decodeFile(path);
+
+    // u8 / u16 以外（float など）は Qt 経由で 8bit BGRA に落とす
+    if (m.empty() || (m.depth() != CV_8U && m.depth() != CV_16U)) {
+        QImage qi(path);
+        if (qi.isNull()) return out;
+        m = qimage_to_mat_bgra(qi);
+    }
+
+    // Gray + Alpha → BGRA
+    if (m.channels() == 2) {
+        std::vector<cv::Mat> ch;
+        cv::split(m, ch);
+        cv::merge(std::vector<cv::Mat>{ch[0], ch[0], ch[0], ch[1]}, m);
+    }
+
+    // αが全面不透明なら 3ch に落とす（メモリ削減。矩形入力として扱える）
+    if (m.channels() == 4) {
+        cv::Mat alpha;
+        cv::extractChannel(m, alpha, 3);
+        double minA = 0.0;
+        cv::minMaxLoc(alpha, &minA);
+        if (minA >= pixelMaxValue(m.depth())) cv::cvtColor(m, m, cv::COLOR_BGRA2BGR);
+    }
+
+    out.pixels = m;
+    return out;
+}
+
+QImage toDisplayImage(const StitchImage& img)
+{
+    if (img.empty()) return QImage();
+
+    // 表示は 8bit で十分
+    cv::Mat m8;
+    if (img.pixels.depth() == CV_16U) img.pixels.convertTo(m8, CV_8U, 1.0 / 257.0);
+    else m8 = img.pixels;
+
+    if (img.mask.empty() && m8.channels() == 1) {
+        QImage q(m8.data, m8.cols, m8.rows, m8.step, QImage::Format_Grayscale8);
+        return q.copy();
+    }
+    if (img.mask.empty() && m8.channels() == 3) {
+        QImage q(m8.data, m8.cols, m8.rows, m8.step, QImage::Format_BGR888);
+        return q.copy();
+    }
+
+    cv::Mat bgra;
+    switch (m8.channels()) {
+    case 1: cv::cvtColor(m8, bgra, cv::COLOR_GRAY2BGRA); break;
+    case 3: cv::cvtColor(m8, bgra, cv::COLOR_BGR2BGRA); break;
+    default: bgra = m8; break;
+    }
+    if (!img.mask.empty()) cv::insertChannel(img.mask, bgra, 3); // 分離マスクをαとして表示
+
+    QImage q(bgra.data, bgra.cols, bgra.rows, bgra.step, QImage::Format_ARGB32);
+    return q.copy();
+}
+
+// 分離マスクをαとして付ける
+static cv::Mat maskAsAlpha(const cv::Mat& pixels, const cv::Mat1b& mask)
+{
+    const int depth = pixels.depth();
+    cv::Mat alpha;
+    mask.convertTo(alpha, depth, pixelMaxValue(depth) / 255.0);
+
+    cv::Mat bgra;
+    cv::cvtColor(pixels, bgra, pixels.channels() == 1 ? cv::COLOR_GRAY2BGRA : cv::COLOR_BGR2BGRA);
+    cv::insertChannel(alpha, bgra, 3);
+    return bgra;
+}
+
+// この大きさ（バイト）以上の TIFF は BigTIFF へ行の帯ごとに書く
+// （通常の TIFF のオフセットは 32bit。全体の BGRA 変換・エンコード結果もメモリに持たない）
+static constexpr qint64 kBigTiffBytes = qint64(1) << 31;
+
+static bool saveBigTiffRows(const QString& path, const StitchImage& img)
+{
+    const int type = img.mask.empty() ? img.pixels.type() : CV_MAKETYPE(img.pixels.depth(), 4);
+    BigTiffWriter writer;
+    if (!writer.open(path, img.size(), type)) return false;
+
+    constexpr int kBand = 256;
+    for (int y = 0; y < img.rows(); y += kBand) {
+        const cv::Rect r(0, y, img.cols(), std::min(kBand, img.rows() - y));
+        if (!writer.write(img.mask.empty() ? img.pixels(r) : maskAsAlpha(img.pixels(r), img.mask(r)))) {
+            writer.close();
+            return false;
+        }
+    }
+    return writer.close();
+}
+
+bool saveStitchImage(const QString& path, const StitchImage& img)
+{
+    if (img.empty()) return false;
+
+    QString suffix = QFileInfo(path).suffix().toLower();
+    if (suffix.isEmpty()) suffix = "png";
+
+    const int cn = img.mask.empty() ? img.pixels.channels() : 4;
+    if ((suffix == "tif" || suffix == "tiff")
+        && pixelCount(img.size()) * CV_ELEM_SIZE(CV_MAKETYPE(img.pixels.depth(), cn)) >= kBigTiffBytes) {
+        return saveBigTiffRows(path, img);
+    }
+
+    // 分離マスクはαとして書き出す
+    const cv::Mat out = img.mask.empty() ? img.pixels : maskAsAlpha(img.pixels, img.mask);
+
+    std::vector<uchar> buf;
+    try {
+        if (!cv::imencode("." + suffix.toStdString(), out, buf)) return false;
+    } catch (const cv::Exception&) {
+        return false; // 未対応の拡張子など
+    }
+
+    QFile f(path);
+    if (!f.open(QIODevice::WriteOnly)) return false;
+    return f.write(reinterpret_cast<const char*>(buf.data()), (qint64)buf.size()) == (qint64)buf.size();
+}
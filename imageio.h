@@ -0,0 +1,26 @@
+#ifndef IMAGEIO_H
+#define IMAGEIO_H
+
+#include "imagetypes.h"
+
+#include <QImage>
+#include <QString>
+
+// 画像ファイルを元の深さ・チャンネル数のまま読み込む（失敗時は空）
+StitchImage loadStitchImage(const QString& path);
+
+// 表示用の 8bit QImage を作る
+QImage toDisplayImage(const StitchImage& img);
+
+// 1枚の QImage で表示する上限（ARGB32 換算のバイト数）
+// 超える画像は縮小版を表示し、拡大した時は見えている範囲をタイルごとに QImage へ変換して描く
+constexpr qint64 kMaxDisplayBytes = qint64(1) << 31;
+inline bool needsChunkedDisplay(cv::Size size)
+{
+    return pixelCount(size) * 4 >= kMaxDisplayBytes;
+}
+
+// 深さ・チャンネル数を保ったまま書き出す（形式は拡張子から。無ければPNG）
+bool saveStitchImage(const QString& path, const StitchImage& img);
+
+#endif // IMAGEIO_H
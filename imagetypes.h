@@ -0,0 +1,95 @@
+#ifndef IMAGETYPES_H
+#define IMAGETYPES_H
+
+#include <opencv2/core.hpp>
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+
+// 画素型ごとの特性（u8 / u16）
+template <typename T> struct PixelTraits;
+
+template <> struct PixelTraits<uint8_t> {
+    static constexpr int depth = CV_8U;
+    static constexpr double maxValue = 255.0;
+};
+
+template <> struct PixelTraits<uint16_t> {
+    static constexpr int depth = CV_16U;
+    static constexpr double maxValue = 65535.0;
+};
+
+// テンプレート関数の呼び分け用タグ
+template <typename T, int CN>
+struct PixelTag {
+    using type = T;
+    static constexpr int channels = CN;
+};
+
+// 入力画像（画素 + 任意の分離マスク）
+// pixels: CV_8U / CV_16U, 1 / 3 / 4ch（4ch は BGRA でαを内包）
+// mask  : 1 / 3ch 用の有効領域（CV_8U, 0 or 255）。空なら全面有効（不透明な矩形）
+struct StitchImage {
+    cv::Mat pixels;
+    cv::Mat1b mask;
+
+    bool empty() const { return pixels.empty(); }
+    int rows() const { return pixels.rows; }
+    int cols() const { return pixels.cols; }
+    cv::Size size() const { return pixels.size(); }
+    bool hasAlpha() const { return pixels.channels() == 4; }
+    bool isOpaqueRect() const { return !hasAlpha() && mask.empty(); }
+};
+
+// 深さ・チャンネル数に応じてテンプレート関数を呼び分ける
+// f は PixelTag<T, CN> を受け取る汎用ラムダを想定
+template <typename F>
+decltype(auto) dispatchPixelType(int type, F&& f)
+{
+    switch (type) {
+    case CV_8UC1:  return f(PixelTag<uint8_t, 1>{});
+    case CV_8UC3:  return f(PixelTag<uint8_t, 3>{});
+    case CV_8UC4:  return f(PixelTag<uint8_t, 4>{});
+    case CV_16UC1: return f(PixelTag<uint16_t, 1>{});
+    case CV_16UC3: return f(PixelTag<uint16_t, 3>{});
+    case CV_16UC4: return f(PixelTag<uint16_t, 4>{});
+    default: break;
+    }
+    CV_Error(cv::Error::StsUnsupportedFormat, "unsupported pixel type (u8/u16, 1/3/4ch only)");
+}
+
+// 深さの最大値（CV_8U → 255, CV_16U → 65535）
+inline double pixelMaxValue(int depth)
+{
+    return depth == CV_16U ? PixelTraits<uint16_t>::maxValue : PixelTraits<uint8_t>::maxValue;
+}
+
+// 画素数は 64bit で数える（cv::Size::area() / cv::Rect::area() は int で、2^31 画素を超えると溢れる）
+inline int64_t pixelCount(cv::Size s)
+{
+    return (int64_t)s.width * (int64_t)s.height;
+}
+
+inline int64_t pixelCount(const cv::Rect& r)
+{
+    return (int64_t)r.width * (int64_t)r.height;
+}
+
+// 64bit で求めた辺の長さ・座標を int へ（cv::Mat の行・列は int。収まらなければ CV_Error）
+inline int checkedExtent(int64_t v)
+{
+    if (v < INT_MIN || v > INT_MAX) CV_Error(cv::Error::StsOutOfRange, "image extent exceeds the int range");
+    return (int)v;
+}
+
+// 2つの矩形の外接矩形（合成キャンバス用。端の座標を 64bit で求めてから確かめる）
+inline cv::Rect unionExtent(const cv::Rect& a, const cv::Rect& b)
+{
+    const int64_t x0 = std::min<int64_t>(a.x, b.x), y0 = std::min<int64_t>(a.y, b.y);
+    const int64_t x1 = std::max<int64_t>((int64_t)a.x + a.width, (int64_t)b.x + b.width);
+    const int64_t y1 = std::max<int64_t>((int64_t)a.y + a.height, (int64_t)b.y + b.height);
+    return cv::Rect(checkedExtent(x0), checkedExtent(y0), checkedExtent(x1 - x0), checkedExtent(y1 - y0));
+}
+
+#endif // IMAGETYPES_H
@@ -0,0 +1,261 @@
+#include "jobengine.h"
+
+#include <QRunnable>
+#include <QPointer>
+
+#include <exception>
+#include <set>
+
+// 完了済みジョブをパネルに残す件数
+static constexpr int kHistoryLimit = 100;
+
+JobEngine::JobEngine(QObject *parent) : QObject(parent)
+{
+    // ジョブ自体は粗粒度。中の画素並列は QtConcurrent のグローバルプールが受け持つ
+    m_pool.setMaxThreadCount(2);
+}
+
+JobEngine::~JobEngine()
+{
+    cancelAll();
+    m_pool.waitForDone();
+}
+
+bool JobEngine::isActiveState(State s)
+{
+    return s == State::Waiting || s == State::Queued || s == State::Running;
+}
+
+QString JobEngine::stateName(State s)
+{
+    switch (s) {
+    case State::Waiting:  return "待機";
+    case State::Queued:   return "キュー";
+    case State::Running:  return "実行中";
+    case State::Finished: return "完了";
+    case State::Canceled: return "キャンセル";
+    case State::Failed:   return "失敗";
+    }
+    return QString();
+}
+
+JobEngine::JobId JobEngine::submit(Spec spec)
+{
+    // 同じ要求が未完了なら合流
+    if (!spec.key.isEmpty()) {
+        auto k = m_keys.constFind(spec.key);
+        if (k != m_keys.constEnd()) {
+            auto it = m_jobs.find(*k);
+            if (it != m_jobs.end() && isActiveState(it->second.state)) return *k;
+        }
+    }
+
+    const JobId id = m_next++;
+    Job job;
+    job.spec = std::move(spec);
+    job.canceled = std::make_shared<std::atomic_bool>(false);
+    job.timer.start();
+
+    if (!job.spec.key.isEmpty()) m_keys.insert(job.spec.key, id);
+    m_jobs.emplace(id, std::move(job));
+
+    emit jobChanged(id);
+    schedule();
+    trimHistory();
+    return id;
+}
+
+void JobEngine::cancel(JobId id)
+{
+    auto it = m_jobs.find(id);
+    if (it == m_jobs.end()) return;
+    Job& job = it->second;
+
+    job.canceled->store(true);
+
+    // まだ投入前なら即キャンセル。実行中は work の終了を待つ
+    if (job.state == State::Waiting) {
+        setState(id, job, State::Canceled);
+        schedule(); // 依存ジョブへ伝播
+    }
+}
+
+void JobEngine::cancelAll()
+{
+    std::vector<JobId> ids;
+    for (const auto& [id, job] : m_jobs) {
+        if (isActiveState(job.state)) ids.push_back(id);
+    }
+    for (JobId id : ids) cancel(id);
+}
+
+bool JobEngine::isActive(JobId id) const
+{
+    auto it = m_jobs.find(id);
+    return it != m_jobs.end() && isActiveState(it->second.state);
+}
+
+JobEngine::Info JobEngine::info(JobId id) const
+{
+    Info r;
+    auto it = m_jobs.find(id);
+    if (it == m_jobs.end()) return r;
+
+    const Job& job = it->second;
+    r.id = id;
+    r.title = job.spec.title;
+    r.priority = job.spec.priority;
+    r.state = job.state;
+    r.error = job.error;
+    r.elapsedMs = isActiveState(job.state) ? job.timer.elapsed() : job.elapsedMs;
+    return r;
+}
+
+QList<JobEngine::Info> JobEngine::jobs() const
+{
+    QList<Info> r;
+    for (const auto& kv : m_jobs) r.push_back(info(kv.first));
+    return r;
+}
+
+void JobEngine::setState(JobId id, Job& job, State s)
+{
+    job.state = s;
+    if (!isActiveState(s)) {
+        job.elapsedMs = job.timer.elapsed();
+        auto k = m_keys.find(job.spec.key);
+        if (k != m_keys.end() && *k == id) m_keys.erase(k);
+    }
+    emit jobChanged(id);
+}
+
+// 依存が揃ったジョブをプールへ投入する
+void JobEngine::schedule()
+{
+    bool changed = true;
+    while (changed) { // キャンセルの伝播が連鎖する場合があるので収束まで回す
+        changed = false;
+        for (auto& [id, job] : m_jobs) {
+            if (job.state != State::Waiting) continue;
+
+            bool ready = true;
+            bool broken = false;
+            for (JobId dep : job.spec.dependsOn) {
+                auto d = m_jobs.find(dep);
+                if (d == m_jobs.end()) continue; // 履歴から消えた＝完了済み
+                if (d->second.state == State::Canceled || d->second.state == State::Failed) broken = true;
+                else if (d->second.state != State::Finished) ready = false;
+            }
+
+            if (broken) {
+                job.canceled->store(true);
+                setState(id, job, State::Canceled);
+                changed = true;
+            } else if (ready) {
+                start(id, job);
+            }
+        }
+    }
+    releaseResults();
+}
+
+void JobEngine::start(JobId id, Job& job)
+{
+    Context ctx;
+    ctx.canceled = job.canceled;
+    for (JobId dep : job.spec.dependsOn) {
+        auto d = m_jobs.find(dep);
+        ctx.inputs.push_back(d != m_jobs.end() ? d->second.result : std::any());
+    }
+
+    setState(id, job, State::Queued);
+
+    QPointer<JobEngine> self(this);
+    auto work = job.spec.work;
+    QRunnable *r = QRunnable::create([self, id, work, ctx = std::move(ctx)]() mutable {
+        if (self) {
+            QMetaObject::invokeMethod(self, [self, id]() {
+                if (!self) return;
+                auto it = self->m_jobs.find(id);
+                if (it != self->m_jobs.end() && it->second.state == State::Queued) {
+                    self->setState(id, it->second, State::Running);
+                }
+            }, Qt::QueuedConnection);
+        }
+
+        std::any result;
+        QString error;
+        if (!ctx.isCanceled()) {
+            try {
+                result = work(ctx);
+            } catch (const std::exception& e) {
+                error = QString::fromLocal8Bit(e.what());
+            } catch (...) {
+                error = "unknown error";
+            }
+        }
+
+        if (self) {
+            QMetaObject::invokeMethod(self, [self, id, result = std::move(result), error]() mutable {
+                if (self) self->onDone(id, std::move(result), error);
+            }, Qt::QueuedConnection);
+        }
+    });
+
+    m_pool.start(r, static_cast<int>(job.spec.priority));
+}
+
+void JobEngine::onDone(JobId id, std::any result, QString error)
+{
+    auto it = m_jobs.find(id);
+    if (it == m_jobs.end()) return;
+    Job& job = it->second;
+
+    // コールバック内で submit されると履歴整理で job が消えうるので、先に取り出しておく
+    if (job.canceled->load()) {
+        setState(id, job, State::Canceled);
+    } else if (!error.isEmpty()) {
+        job.error = error;
+        const auto onFailed = job.spec.onFailed;
+        setState(id, job, State::Failed);
+        if (onFailed) onFailed(error);
+    } else {
+        job.result = result;
+        const auto onFinished = job.spec.onFinished;
+        setState(id, job, State::Finished);
+        if (onFinished) onFinished(result);
+    }
+
+    schedule();
+}
+
+// 待機中のジョブが参照しない結果は手放す（結合画像など大きいものがある）
+void JobEngine::releaseResults()
+{
+    std::set<JobId> needed;
+    for (const auto& [id, job] : m_jobs) {
+        if (job.state != State::Waiting) continue;
+        for (JobId dep : job.spec.dependsOn) needed.insert(dep);
+    }
+    for (auto& [id, job] : m_jobs) {
+        if (job.state == State::Finished && job.result.has_value() && !needed.count(id)) job.result.reset();
+    }
+}
+
+void JobEngine::trimHistory()
+{
+    int finished = 0;
+    for (const auto& kv : m_jobs) {
+        if (!isActiveState(kv.second.state)) ++finished;
+    }
+
+    // 古い順に消す（待機中ジョブに渡す結果を持っているものは残す）
+    for (auto it = m_jobs.begin(); it != m_jobs.end() && finished > kHistoryLimit;) {
+        if (!isActiveState(it->second.state) && !it->second.result.has_value()) {
+            it = m_jobs.erase(it);
+            --finished;
+        } else {
+            ++it;
+        }
+    }
+}
@@ -0,0 +1,102 @@
+#ifndef JOBENGINE_H
+#define JOBENGINE_H
+
+#include <QObject>
+#include <QThreadPool>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QString>
+
+#include <any>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+// 重い処理（位置合わせ・検証・結合・書き出し・読み込み）の共通実行エンジン
+// - 優先度つきで専用スレッドプールへ投入（画素単位の並列はグローバルプール側）
+// - dependsOn で連鎖（位置合わせ → 検証 → 結合 → 書き出し）
+// - 同じ key の未完了ジョブがあれば合流（重複要求をまとめる）
+// - キャンセルは協調式（work 側で isCanceled() を見る）
+// 状態の更新とコールバックは全て GUIスレッドで行う
+class JobEngine : public QObject
+{
+    Q_OBJECT
+public:
+    using JobId = quint64;
+
+    enum class Priority { Low = 0, Normal = 1, High = 2 };
+    enum class State { Waiting, Queued, Running, Finished, Canceled, Failed };
+
+    // ジョブ内から参照する実行時情報
+    struct Context {
+        std::vector<std::any> inputs;               // 依存ジョブの結果（dependsOn の順）
+        std::shared_ptr<std::atomic_bool> canceled;
+        bool isCanceled() const { return canceled->load(std::memory_order_relaxed); }
+    };
+
+    struct Spec {
+        QString title;                                      // パネル表示名
+        QString key;                                        // 合流用キー（空なら合流しない）
+        Priority priority = Priority::Normal;
+        QList<JobId> dependsOn;                             // 未完了のジョブを指定する
+        std::function<std::any(Context&)> work;             // 別スレッドで実行
+        std::function<void(const std::any&)> onFinished;    // GUIスレッドで実行
+        std::function<void(const QString&)> onFailed;       // GUIスレッドで実行
+    };
+
+    // パネル表示用
+    struct Info {
+        JobId id = 0;
+        QString title;
+        Priority priority = Priority::Normal;
+        State state = State::Waiting;
+        QString error;
+        qint64 elapsedMs = -1;
+    };
+
+    explicit JobEngine(QObject *parent = nullptr);
+    ~JobEngine() override;
+
+    JobId submit(Spec spec);
+    void cancel(JobId id);
+    void cancelAll();
+
+    bool isActive(JobId id) const; // 待機中・実行中か
+    Info info(JobId id) const;
+    QList<Info> jobs() const;
+
+    static QString stateName(State s);
+
+signals:
+    void jobChanged(JobEngine::JobId id);
+
+private:
+    struct Job {
+        Spec spec;
+        State state = State::Waiting;
+        std::shared_ptr<std::atomic_bool> canceled;
+        std::any result;
+        QString error;
+        QElapsedTimer timer;
+        qint64 elapsedMs = -1;
+    };
+
+    void schedule();
+    void start(JobId id, Job& job);
+    void onDone(JobId id, std::any result, QString error);
+    void setState(JobId id, Job& job, State s);
+    void releaseResults();
+    void trimHistory();
+
+    static bool isActiveState(State s);
+
+    QThreadPool m_pool;
+    std::map<JobId, Job> m_jobs;
+    QHash<QString, JobId> m_keys;
+    JobId m_next = 1;
+};
+
+#endif // JOBENGINE_H
@@ -0,0 +1,82 @@
+#include "jobpanel.h"
+
+#include <QTreeWidget>
+#include <QHeaderView>
+#include <QPushButton>
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+
+// パネルに表示する件数
+static constexpr int kMaxRows = 100;
+
+static QString priorityName(JobEngine::Priority p)
+{
+    switch (p) {
+    case JobEngine::Priority::Low:    return "低";
+    case JobEngine::Priority::Normal: return "中";
+    case JobEngine::Priority::High:   return "高";
+    }
+    return QString();
+}
+
+JobPanel::JobPanel(JobEngine *engine, QWidget *parent) : QWidget(parent), engine_(engine)
+{
+    tree_ = new QTreeWidget(this);
+    tree_->setColumnCount(4);
+    tree_->setHeaderLabels({"ジョブ", "優先度", "状態", "時間 (ms)"});
+    tree_->setRootIsDecorated(false);
+    tree_->setSelectionMode(QAbstractItemView::ExtendedSelection);
+    tree_->header()->setSectionResizeMode(0, QHeaderView::Stretch);
+
+    auto *btnCancel = new QPushButton("キャンセル", this);
+    auto *btnCancelAll = new QPushButton("全てキャンセル", this);
+    connect(btnCancel, &QPushButton::clicked, this, &JobPanel::cancelSelected);
+    connect(btnCancelAll, &QPushButton::clicked, engine_, &JobEngine::cancelAll);
+
+    auto *buttons = new QHBoxLayout;
+    buttons->addStretch(1);
+    buttons->addWidget(btnCancel);
+    buttons->addWidget(btnCancelAll);
+
+    auto *layout = new QVBoxLayout(this);
+    layout->setContentsMargins(0, 0, 0, 0);
+    layout->addWidget(tree_);
+    layout->addLayout(buttons);
+
+    connect(engine_, &JobEngine::jobChanged, this, &JobPanel::onJobChanged);
+}
+
+void JobPanel::onJobChanged(JobEngine::JobId id)
+{
+    const JobEngine::Info info = engine_->info(id);
+    if (info.id == 0) return;
+
+    QTreeWidgetItem *item = items_.value(id, nullptr);
+    if (!item) {
+        item = new QTreeWidgetItem;
+        item->setData(0, Qt::UserRole, QVariant::fromValue<qulonglong>(id));
+        tree_->insertTopLevelItem(0, item); // 新しいものを上に
+        items_.insert(id, item);
+
+        // 古い行を落とす
+        while (tree_->topLevelItemCount() > kMaxRows) {
+            QTreeWidgetItem *old = tree_->takeTopLevelItem(tree_->topLevelItemCount() - 1);
+            items_.remove(old->data(0, Qt::UserRole).toULongLong());
+            delete old;
+        }
+    }
+
+    item->setText(0, info.title);
+    item->setText(1, priorityName(info.priority));
+    item->setText(2, info.error.isEmpty() ? JobEngine::stateName(info.state)
+                                          : JobEngine::stateName(info.state) + ": " + info.error);
+    item->setText(3, info.elapsedMs >= 0 ? QString::number(info.elapsedMs) : QString());
+}
+
+void JobPanel::cancelSelected()
+{
+    const auto selected = tree_->selectedItems();
+    for (QTreeWidgetItem *item : selected) {
+        engine_->cancel(item->data(0, Qt::UserRole).toULongLong());
+    }
+}
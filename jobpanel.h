@@ -0,0 +1,29 @@
+#ifndef JOBPANEL_H
+#define JOBPANEL_H
+
+#include <QWidget>
+#include <QHash>
+
+#include "jobengine.h"
+
+class QTreeWidget;
+class QTreeWidgetItem;
+
+// ジョブ一覧（状態・経過時間）とキャンセル操作
+class JobPanel : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit JobPanel(JobEngine *engine, QWidget *parent = nullptr);
+
+private slots:
+    void onJobChanged(JobEngine::JobId id);
+    void cancelSelected();
+
+private:
+    JobEngine *engine_ = nullptr;
+    QTreeWidget *tree_ = nullptr;
+    QHash<JobEngine::JobId, QTreeWidgetItem*> items_;
+};
+
+#endif // JOBPANEL_H
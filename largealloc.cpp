@@ -0,0 +1,179 @@
+#include "largealloc.h"
+
+#include <atomic>
+#include <cstring>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#elif defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+namespace {
+
+std::atomic_bool g_enabled{true};
+
+constexpr size_t kHugePage = size_t(2) << 20;
+
+#if defined(__linux__)
+// 2MB のヒュージページを明示する（既定のヒュージページが 1GB などの環境でも 2MB 単位で確保・解放できるように）
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#endif
+
+inline size_t roundUp(size_t n, size_t unit)
+{
+    return (n + unit - 1) / unit * unit;
+}
+
+// 実際に確保した範囲（解放はこの長さで行う。UMatData::handle に持たせる）
+struct Mapping {
+    size_t length = 0;
+    bool hugetlb = false;   // hugetlbfs のページか（透過的ヒュージページ・通常のページなら false）
+};
+
+// OS から直接確保（戻り値は 0 初期化済みとは限らない）
+void* mapLarge(size_t bytes, Mapping& m)
+{
+#if defined(__linux__)
+    m.length = roundUp(bytes, kHugePage);
+#ifdef MAP_HUGETLB
+    void* p = mmap(nullptr, m.length, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_2MB, -1, 0);
+    if (p != MAP_FAILED) {
+        m.hugetlb = true;
+        return p;
+    }
+#endif
+    // 予約済みの 2MB ヒュージページが無ければ通常のページで確保し、透過的ヒュージページを頼む
+    void* q = mmap(nullptr, m.length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (q == MAP_FAILED) return nullptr;
+#ifdef MADV_HUGEPAGE
+    madvise(q, m.length, MADV_HUGEPAGE);
+#endif
+    return q;
+#elif defined(_WIN32)
+    // ラージページは SeLockMemoryPrivilege が要るので通常のページ（first-touch の配置だけ効く）
+    m.length = bytes;
+    return VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+    m.length = bytes;
+    return cv::fastMalloc(bytes);
+#endif
+}
+
+void unmapLarge(void* p, const Mapping& m)
+{
+#if defined(__linux__)
+    munmap(p, m.length); // 確保した時の長さ（hugetlbfs のページは 2MB の倍数でないと解放できない）
+#elif defined(_WIN32)
+    (void)m;
+    VirtualFree(p, 0, MEM_RELEASE);
+#else
+    (void)m;
+    cv::fastFree(p);
+#endif
+}
+
+// 行の帯ごとに並列で 0 を書く（処理側の cv::parallel_for_(Range(0, rows)) と同じ分け方）
+void firstTouch(uchar* data, int rows, size_t rowBytes)
+{
+    cv::parallel_for_(cv::Range(0, rows), [&](const cv::Range& range) {
+        std::memset(data + rowBytes * range.start, 0, rowBytes * (size_t)(range.end - range.start));
+    });
+}
+
+class LargeImageAllocator : public cv::MatAllocator
+{
+public:
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data0, size_t* step,
+                           cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const override
+    {
+        // 呼び出し側のバッファ・小さな確保は OpenCV 既定に任せる
+        size_t total = CV_ELEM_SIZE(type);
+        for (int i = 0; i < dims; ++i) total *= (size_t)sizes[i];
+        if (data0 || dims < 1 || total < kLargeAllocThreshold) {
+            return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data0, step, flags, usageFlags);
+        }
+
+        // 連続（step は詰めた値）
+        size_t s = CV_ELEM_SIZE(type);
+        for (int i = dims - 1; i >= 0; --i) {
+            if (step) step[i] = s;
+            s *= (size_t)sizes[i];
+        }
+
+        Mapping m;
+        uchar* data = static_cast<uchar*>(mapLarge(total, m));
+        if (!data) CV_Error(cv::Error::StsNoMem, "large image allocation failed");
+        firstTouch(data, sizes[0], total / (size_t)sizes[0]);
+
+        cv::UMatData* u = new cv::UMatData(this);
+        u->data = u->origdata = data;
+        u->size = total;
+        u->handle = new Mapping(m);
+        return u;
+    }
+
+    bool allocate(cv::UMatData* u, cv::AccessFlag, cv::UMatUsageFlags) const override
+    {
+        return u != nullptr;
+    }
+
+    void deallocate(cv::UMatData* u) const override
+    {
+        if (!u) return;
+        CV_Assert(u->urefcount == 0);
+        CV_Assert(u->refcount == 0);
+        Mapping* m = static_cast<Mapping*>(u->handle);
+        unmapLarge(u->origdata, *m);
+        delete m;
+        u->handle = nullptr;
+        u->origdata = nullptr;
+        delete u;
+    }
+};
+
+} // namespace
+
+cv::MatAllocator* largeImageAllocator()
+{
+    static LargeImageAllocator a;
+    return &a;
+}
+
+cv::Mat createLargeZeroed(int rows, int cols, int type)
+{
+    const size_t bytes = (size_t)rows * (size_t)cols * CV_ELEM_SIZE(type);
+    if (!g_enabled.load(std::memory_order_relaxed) || bytes < kLargeAllocThreshold) {
+        return cv::Mat(rows, cols, type, cv::Scalar::all(0));
+    }
+
+    cv::Mat m;
+    m.allocator = largeImageAllocator();
+    m.create(rows, cols, type); // 確保時に 0 を書いている
+    return m;
+}
+
+void setLargeAllocEnabled(bool enabled)
+{
+    g_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool largeAllocEnabled()
+{
+    return g_enabled.load(std::memory_order_relaxed);
+}
+
+bool largeAllocUsesHugeTlb(const cv::Mat& m)
+{
+    if (!m.u || m.u->currAllocator != largeImageAllocator() || !m.u->handle) return false;
+    return static_cast<const Mapping*>(m.u->handle)->hugetlb;
+}
@@ -0,0 +1,30 @@
+#ifndef LARGEALLOC_H
+#define LARGEALLOC_H
+
+#include <opencv2/core.hpp>
+
+#include <cstddef>
+
+// 結合キャンバス等の大きな画像用の確保
+// - Linux: 2MB 単位で mmap し、明示的な 2MB ヒュージページ（MAP_HUGETLB | MAP_HUGE_2MB）→ 透過的ヒュージページ（MADV_HUGEPAGE）の順に試す
+// - 確保直後に行の帯ごとに並列で 0 を書く（first-touch）。処理側も cv::parallel_for_ で行を分けるので、
+//   各帯のページはそれを処理するスレッドの NUMA ノードに置かれる
+// - 閾値未満は OpenCV の通常の確保と同じ
+
+// 大きな確保に使う MatAllocator（閾値以上だけ上記の確保、未満は OpenCV 既定）
+cv::MatAllocator* largeImageAllocator();
+
+// rows x cols の 0 初期化済み画像（閾値以上は largeImageAllocator で確保し、並列に 0 を書く）
+cv::Mat createLargeZeroed(int rows, int cols, int type);
+
+// 有効・無効（ベンチマークでの比較用。無効なら常に OpenCV の通常の確保 + 1スレッドで 0 埋め）
+void setLargeAllocEnabled(bool enabled);
+bool largeAllocEnabled();
+
+// m が hugetlbfs の 2MB ページに載っているか（透過的ヒュージページ・通常のページ・閾値未満なら false）
+bool largeAllocUsesHugeTlb(const cv::Mat& m);
+
+// この大きさ（バイト）以上を対象にする
+constexpr size_t kLargeAllocThreshold = size_t(32) << 20;
+
+#endif // LARGEALLOC_H
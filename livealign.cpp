@@ -0,0 +1,231 @@
+#include "livealign.h"
+#include "stitchcore.h"
+
+#include <QPointer>
+#include <QRunnable>
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/core.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+// これより小さい段は作らない
+static constexpr int kMinPyramidSide = 32;
+
+// gray 8bit へ（u16 は上位8bit）
+static cv::Mat1b toGray8(const cv::Mat& im)
+{
+    cv::Mat g;
+    switch (im.channels()) {
+    case 1: g = im; break;
+    case 3: cv::cvtColor(im, g, cv::COLOR_BGR2GRAY); break;
+    default: cv::cvtColor(im, g, cv::COLOR_BGRA2GRAY); break;
+    }
+    cv::Mat1b g8;
+    if (g.depth() == CV_16U) g.convertTo(g8, CV_8U, 1.0 / 257.0);
+    else g8 = g;
+    return g8;
+}
+
+// 有効マスク（0/255）。全面有効なら空
+static cv::Mat1b validMask(const StitchImage& img, const cv::Rect& r)
+{
+    cv::Mat1b m;
+    if (img.hasAlpha()) {
+        cv::Mat alpha;
+        cv::extractChannel(img.pixels(r), alpha, 3);
+        cv::compare(alpha, std::round(pixelMaxValue(alpha.depth()) * 0.5), m, cv::CMP_GE);
+    } else if (!img.mask.empty()) {
+        m = img.mask(r);
+    }
+    return m;
+}
+
+std::shared_ptr<const LivePyramid> buildLivePyramid(const StitchImage& img)
+{
+    auto pyr = std::make_shared<LivePyramid>();
+    if (img.empty() || std::min(img.rows(), img.cols()) < 2 * kMinPyramidSide) return pyr;
+
+    // 1/2 段は元画像から直接作る（等倍の gray は持たない）
+    cv::Mat half;
+    cv::resize(img.pixels, half, cv::Size(), 0.5, 0.5, cv::INTER_AREA);
+    cv::Mat1b g = toGray8(half);
+
+    cv::Mat1b m = validMask(img, cv::Rect(0, 0, img.cols(), img.rows()));
+    if (!m.empty()) {
+        cv::resize(m, m, g.size(), 0, 0, cv::INTER_AREA);
+        cv::compare(m, 255, m, cv::CMP_GE); // 縁が混ざった画素は無効扱い
+    }
+
+    while (true) {
+        pyr->gray.push_back(g);
+        pyr->mask.push_back(m);
+        if (std::min(g.rows, g.cols) < 2 * kMinPyramidSide) break;
+
+        cv::Mat1b g2, m2;
+        cv::resize(g, g2, cv::Size(), 0.5, 0.5, cv::INTER_AREA);
+        if (!m.empty()) {
+            cv::resize(m, m2, g2.size(), 0, 0, cv::INTER_AREA);
+            cv::compare(m2, 255, m2, cv::CMP_GE);
+        }
+        g = g2;
+        m = m2;
+    }
+    return pyr;
+}
+
+void livePyramidRoi(const StitchImage& src, const LivePyramid *pyr, int level, const cv::Rect& r,
+                    cv::Mat1b& g, cv::Mat1b& m)
+{
+    if (level == 0) {
+        g = toGray8(src.pixels(r));
+        m = validMask(src, r);
+        return;
+    }
+    g = pyr->gray[level - 1](r);
+    m = pyr->mask[level - 1].empty() ? cv::Mat1b() : pyr->mask[level - 1](r);
+}
+
+// マスク付き NCC
+static double maskedNcc(const cv::Mat1b& a, const cv::Mat1b& b, const cv::Mat1b& m)
+{
+    cv::Scalar ma, sa, mb, sb;
+    cv::meanStdDev(a, ma, sa, m);
+    cv::meanStdDev(b, mb, sb, m);
+    if (sa[0] < 1e-6 || sb[0] < 1e-6) return 0.0; // 平坦
+
+    cv::Mat fa, fb;
+    a.convertTo(fa, CV_32F, 1.0, -ma[0]);
+    b.convertTo(fb, CV_32F, 1.0, -mb[0]);
+    const double cov = cv::mean(fa.mul(fb), m)[0];
+    return cov / (sa[0] * sb[0]);
+}
+
+LiveScore computeLiveScore(const LiveRequest& req)
+{
+    const auto t0 = std::chrono::steady_clock::now();
+
+    LiveScore s;
+    s.pos1 = req.pos1;
+    s.pos2 = req.pos2;
+    if (req.src1.empty() || req.src2.empty()) return s;
+
+    const cv::Rect r1(req.pos1, req.src1.size());
+    const cv::Rect r2(req.pos2, req.src2.size());
+    const cv::Rect ov = r1 & r2 & req.view;
+    if (ov.width < 8 || ov.height < 8) return s;
+
+    // 画素数が予算に収まる段を選ぶ
+    const int maxLevel = (req.pyr1 && req.pyr2)
+                             ? (int)std::min(req.pyr1->gray.size(), req.pyr2->gray.size()) : 0;
+    int level = 0;
+    while (level < maxLevel && (double)pixelCount(ov) / double(1LL << (2 * level)) > req.pixelBudget) ++level;
+    if ((double)pixelCount(ov) / double(1LL << (2 * level)) > 4.0 * req.pixelBudget) {
+        s.pending = true; // ピラミッドがまだ無い
+        return s;
+    }
+
+    // 段の座標へ（両画像で同じ大きさに揃える）
+    const int sc = 1 << level;
+    auto levelSize = [&](const StitchImage& src, const LivePyramid *pyr) {
+        return level == 0 ? src.size() : pyr->gray[level - 1].size();
+    };
+    const cv::Size ls1 = levelSize(req.src1, req.pyr1.get());
+    const cv::Size ls2 = levelSize(req.src2, req.pyr2.get());
+
+    cv::Point o1((ov.x - req.pos1.x) / sc, (ov.y - req.pos1.y) / sc);
+    cv::Point o2((ov.x - req.pos2.x) / sc, (ov.y - req.pos2.y) / sc);
+    int w = std::min({ov.width / sc, ls1.width - o1.x, ls2.width - o2.x});
+    int h = std::min({ov.height / sc, ls1.height - o1.y, ls2.height - o2.y});
+    if (w < 8 || h < 8) return s;
+
+    cv::Mat1b g1, m1, g2, m2;
+    livePyramidRoi(req.src1, req.pyr1.get(), level, cv::Rect(o1, cv::Size(w, h)), g1, m1);
+    livePyramidRoi(req.src2, req.pyr2.get(), level, cv::Rect(o2, cv::Size(w, h)), g2, m2);
+
+    s.level = level;
+
+    const int R = req.snapRadius;
+    if (R > 0 && w > 2 * R + 8 && h > 2 * R + 8) {
+        // テンプレート（1枚目の内側）は、両方の有効画素だけの長方形に限る（align_ncc_surface と同じ）：
+        // 2枚目は ±R のどの候補でも有効な画素（(2R+1)角で収縮）、1枚目はそのまま
+        cv::Rect T(R, R, w - 2 * R, h - 2 * R); // 段の重なり座標
+        if (!m1.empty() || !m2.empty()) {
+            cv::Mat1b e2 = m2.empty() ? cv::Mat1b(h, w, uchar(255)) : m2.clone();
+            if (!m2.empty()) cv::erode(e2, e2, cv::getStructuringElement(cv::MORPH_RECT, cv::Size(2 * R + 1, 2 * R + 1)));
+            cv::Mat1b andMask = e2(T).clone();
+            if (!m1.empty()) cv::bitwise_and(andMask, m1(T), andMask);
+            const cv::Rect rect = maxRectOnesFromLogical(andMask);
+            T = cv::Rect(T.tl() + rect.tl(), rect.size());
+        }
+        if (T.width < 8 || T.height < 8) return s;
+
+        // 周囲 ±R の NCC 面を一度に求める（中央が現在位置）
+        cv::Mat1f surf;
+        cv::matchTemplate(g2(cv::Rect(T.x - R, T.y - R, T.width + 2 * R, T.height + 2 * R)), g1(T), surf,
+                          cv::TM_CCOEFF_NORMED);
+
+        double maxV = 0.0;
+        cv::Point maxL;
+        cv::minMaxLoc(surf, nullptr, &maxV, nullptr, &maxL);
+        if (!std::isfinite(maxV)) return s; // 平坦なテンプレート
+
+        s.ncc = surf(R, R);
+        s.bestNcc = maxV;
+        s.snapDelta = cv::Point(-(maxL.x - R) * sc, -(maxL.y - R) * sc);
+    } else {
+        cv::Mat1b m;
+        if (!m1.empty() && !m2.empty()) cv::bitwise_and(m1, m2, m);
+        else m = !m1.empty() ? m1 : m2;
+        if (!m.empty() && cv::countNonZero(m) < 16) return s;
+
+        s.ncc = maskedNcc(g1, g2, m);
+        s.bestNcc = s.ncc;
+    }
+
+    s.valid = true;
+    s.elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    return s;
+}
+
+LiveAligner::LiveAligner(QObject *parent) : QObject(parent)
+{
+    pool_.setMaxThreadCount(1);
+}
+
+LiveAligner::~LiveAligner()
+{
+    pool_.waitForDone();
+}
+
+void LiveAligner::request(const LiveRequest& req)
+{
+    if (running_) {
+        // 実行中なら最新の要求だけ残す
+        pending_ = req;
+        hasPending_ = true;
+        return;
+    }
+    start(req);
+}
+
+void LiveAligner::start(const LiveRequest& req)
+{
+    running_ = true;
+    QPointer<LiveAligner> self(this);
+    pool_.start(QRunnable::create([self, req]() {
+        const LiveScore s = computeLiveScore(req);
+        if (!self) return;
+        QMetaObject::invokeMethod(self, [self, s]() {
+            if (!self) return;
+            self->running_ = false;
+            emit self->scored(s);
+            if (self->hasPending_) {
+                self->hasPending_ = false;
+                self->start(self->pending_);
+            }
+        }, Qt::QueuedConnection);
+    }));
+}
@@ -0,0 +1,72 @@
+#ifndef LIVEALIGN_H
+#define LIVEALIGN_H
+
+#include <QObject>
+#include <QThreadPool>
+
+#include "imagetypes.h"
+
+#include <memory>
+#include <vector>
+
+// ドラッグ中の即時スコア用の縮小ピラミッド（8bit gray + 有効マスク）
+// gray[k] は 1/2^(k+1) 縮小。等倍は元画像から必要な範囲だけ都度切り出す
+struct LivePyramid {
+    std::vector<cv::Mat1b> gray;
+    std::vector<cv::Mat1b> mask; // 各段とも空なら全面有効
+};
+
+std::shared_ptr<const LivePyramid> buildLivePyramid(const StitchImage& img);
+
+// 段 level の範囲 r（段の座標）の gray 8bit と有効マスク（全面有効なら空）を取り出す
+// level 0 は元画像から都度変換、それ以外はピラミッドの参照
+void livePyramidRoi(const StitchImage& src, const LivePyramid *pyr, int level, const cv::Rect& r,
+                    cv::Mat1b& g, cv::Mat1b& m);
+
+// 1回分の入力
+struct LiveRequest {
+    StitchImage src1, src2;
+    std::shared_ptr<const LivePyramid> pyr1, pyr2;
+    cv::Point pos1, pos2;
+    cv::Rect view;              // 表示中のシーン範囲（この中の重なりだけ評価する）
+    int pixelBudget = 1 << 16;  // 評価する画素数の上限
+    int snapRadius = 0;         // >0 なら評価段で ±snapRadius の範囲の最良位置も求める
+};
+
+struct LiveScore {
+    bool valid = false;
+    bool pending = false;       // ピラミッド準備中で評価できなかった
+    double ncc = 0.0;
+    int level = 0;              // 評価した段（0 = 等倍）
+    cv::Point pos1, pos2;       // 評価した位置
+    cv::Point snapDelta;        // 2枚目をこれだけ動かすと最良（等倍画素）
+    double bestNcc = 0.0;
+    double elapsedMs = 0.0;
+};
+
+// 表示範囲に限った重なりの NCC（予算に収まる段で評価）
+LiveScore computeLiveScore(const LiveRequest& req);
+
+// 最新の要求だけを別スレッドで処理する（ドラッグ中の途中要求は間引く）
+class LiveAligner : public QObject
+{
+    Q_OBJECT
+public:
+    explicit LiveAligner(QObject *parent = nullptr);
+    ~LiveAligner() override;
+
+    void request(const LiveRequest& req);
+
+signals:
+    void scored(const LiveScore& score);
+
+private:
+    void start(const LiveRequest& req);
+
+    QThreadPool pool_;
+    bool running_ = false;
+    bool hasPending_ = false;
+    LiveRequest pending_;
+};
+
+#endif // LIVEALIGN_H
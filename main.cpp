@@ -1,7 +1,20 @@
 #include "mainwindow.h"
 
+#include "threadbudget.h"
+#include "watchservice.h"
+#include "sessionlog.h"
+#include "simdkernels.h"
+
 #include <QApplication>
+#include <QCommandLineParser>
 #include <QProcessEnvironment>
+#include <QSettings>
+#include <QTextStream>
+
+#include <algorithm>
+#include <cstring>
+#include <initializer_list>
+#include <memory>
 
 int main(int argc, char *argv[])
 {
@@ -11,10 +24,93 @@ int main(int argc, char *argv[])
     // あるいは制限なしなら
     qputenv("QT_IMAGEIO_MAXALLOC", QByteArray("0"));
 #endif
+    // OpenCV の読み込みは既定で 2^30 画素まで。数十億画素の結合結果も開けるよう上げる（指定があればそのまま）
+    if (qEnvironmentVariableIsEmpty("OPENCV_IO_MAX_IMAGE_PIXELS")) {
+        qputenv("OPENCV_IO_MAX_IMAGE_PIXELS", QByteArray::number(qint64(1) << 40));
+    }
+
+    // --watch / --replay はウィンドウを作らない（ディスプレイの無いマシンでも動くよう QCoreApplication）
+    const bool headless = std::any_of(argv + 1, argv + argc, [](const char *s) {
+        for (const char *opt : {"--watch", "--replay"}) {
+            const size_t n = std::strlen(opt);
+            if (std::strncmp(s, opt, n) == 0 && (s[n] == '\0' || s[n] == '=')) return true;
+        }
+        return false;
+    });
+    std::unique_ptr<QCoreApplication> a(headless ? new QCoreApplication(argc, argv) : new QApplication(argc, argv));
+    QCoreApplication::setOrganizationName("Image_Stitcher_Two");
+    QCoreApplication::setApplicationName("Image_Stitcher_Two");
+
+    // スレッド数（設定値をコマンドラインで上書き。コア固定はスレッド生成前に行う）
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption threadsOpt("threads", "総スレッド数（0 = 論理コア数）", "n");
+    QCommandLineOption pinOpt("pin-cores", "先頭の（総スレッド数の）コアに固定する");
+    QCommandLineOption watchOpt("watch", "監視フォルダのタイルセットを順次結合する（ウィンドウなし）", "dir");
+    QCommandLineOption outOpt("out", "--watch の出力フォルダ（既定: <dir>/stitched）", "dir");
+    QCommandLineOption depthOpt("queue-depth", "--watch の段の間のキュー上限（セット数、既定 2）", "n");
+    QCommandLineOption reportOpt("report-sec", "--watch の統計の出力間隔（秒、既定 60）", "sec");
+    QCommandLineOption recordOpt("record", "操作を記録する（JSON Lines）", "file");
+    QCommandLineOption replayOpt("replay", "記録した操作をウィンドウなしで再生し、ステップごとの時間を出す", "file");
+    QCommandLineOption replayReportOpt("replay-report", "--replay の結果を JSON で書き出す", "file");
+    QCommandLineOption replayOutOpt("replay-out", "--replay の export の書き出し先（既定: 一時フォルダ）", "dir");
+    QCommandLineOption isaOpt("isa", "SIMD の命令セット（auto / sse2 / avx2 / avx512。CPU が対応する版まで）", "name");
+    parser.addOption(threadsOpt);
+    parser.addOption(pinOpt);
+    parser.addOption(watchOpt);
+    parser.addOption(outOpt);
+    parser.addOption(depthOpt);
+    parser.addOption(reportOpt);
+    parser.addOption(recordOpt);
+    parser.addOption(replayOpt);
+    parser.addOption(replayReportOpt);
+    parser.addOption(replayOutOpt);
+    parser.addOption(isaOpt);
+    parser.process(*a);
+
+    ThreadBudget::Settings budget = ThreadBudget::loadSettings();
+    if (parser.isSet(threadsOpt)) budget.threads = std::max(0, parser.value(threadsOpt).toInt());
+    if (parser.isSet(pinOpt)) budget.pinCores = true;
+    ThreadBudget::apply(budget);
+
+    // SIMD の版（設定値をコマンドラインで上書き。auto は CPU に合わせる。環境変数 STITCHER_ISA も効く）
+    const QString isa = parser.isSet(isaOpt) ? parser.value(isaOpt) : QSettings().value("simd/isa", "auto").toString();
+    if (isa != "auto") {
+        SimdIsa v;
+        if (!parseSimdIsa(isa.toLatin1().constData(), &v) || !setSimdIsa(v)) {
+            QTextStream(stderr) << QString("命令セット %1 は使えません（%2 を使います）")
+                                       .arg(isa, simdIsaName(activeSimdIsa())) << Qt::endl;
+        }
+    }
+
+    if (parser.isSet(replayOpt)) {
+        ReplayOptions opt;
+        opt.reportPath = parser.value(replayReportOpt);
+        opt.outDir = parser.value(replayOutOpt);
+        return replaySession(parser.value(replayOpt), opt);
+    }
+
+    if (headless) {
+        WatchService::Options opt;
+        opt.watchDir = parser.value(watchOpt);
+        opt.outDir = parser.value(outOpt);
+        if (parser.isSet(depthOpt)) opt.queueDepth = parser.value(depthOpt).toInt();
+        if (parser.isSet(reportOpt)) opt.reportSec = parser.value(reportOpt).toInt();
+
+        WatchService service(opt);
+        QString error;
+        if (!service.start(&error)) {
+            QTextStream(stderr) << error << Qt::endl;
+            return 1;
+        }
+        return a->exec();
+    }
 
-    QApplication a(argc, argv);
     MainWindow w;
+    if (parser.isSet(recordOpt) && !w.startRecording(parser.value(recordOpt))) {
+        QTextStream(stderr) << "記録ファイルを開けません: " << parser.value(recordOpt) << Qt::endl;
+    }
     w.resize(1000,700);
     w.show();
-    return a.exec();
+    return a->exec();
 }
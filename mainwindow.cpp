@@ -12,465 +12,175 @@
 #include <QIntValidator>
 
 #include <QPointer>
+#include <QDockWidget>
+#include <QMenuBar>
+#include <QMenu>
+#include <QCheckBox>
+#include <QScrollBar>
+#include <QInputDialog>
+#include <QSettings>
+#include <QTimer>
+#include <QActionGroup>
+#include <QJsonArray>
+#include <QJsonObject>
+
+#include "imageio.h"
+#include "jobpanel.h"
+#include "tileitem.h"
+#include "threadbudget.h"
+#include "imagecache.h"
+#include "projectfile.h"
+#include "tiffregion.h"
+#include "griddialog.h"
+#include "alignops.h"
+#include "tilestore.h"
+#include "simdkernels.h"
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/core.hpp>
 
 #include <algorithm>
 #include <cmath>
+#include <utility>
+#include <vector>
 
-// QImageをOpenCV形式へ変換
-static cv::Mat qimage_to_mat_bgra(const QImage& img)
-{
-    QImage converted = img.convertToFormat(QImage::Format_ARGB32); // 32-bit BGRA相当
-    cv::Mat mat(converted.height(), converted.width(), CV_8UC4,
-                (void*)converted.bits(), converted.bytesPerLine());
-    return mat.clone(); // QImageの寿命から独立させる
-}
-
-// BGRAからAを取り出し、logical配列にする
-cv::Mat1b alphaMaskFromBGRA(const cv::Mat& bgra, double alphaThreshold = 0.5)
-{
-    CV_Assert(!bgra.empty());
-    CV_Assert(bgra.type() == CV_8UC4); // BGRA 8bit
-
-    // alpha >= 0.5 → alpha >= 128
-    const int thr = (int)std::lround(alphaThreshold * 255.0);
-
-    std::vector<cv::Mat> ch;
-    cv::split(bgra, ch);         // ch[3] が alpha
-    cv::Mat1b mask;
-    cv::compare(ch[3], thr, mask, cv::CMP_GE); // 0 or 255 のマスク
-
-    // 「logical配列」(0/1)にしたいなら 0/255 を 0/1 に落とす
-    mask /= 255;
-
-    return mask; // CV_8U, 値は 0 or 1
-}
-
-// 最大矩形を探索する。
-static inline void largestRectHistogram( // ヒストグラム最大矩形
-    const std::vector<int>& h,
-    int& bestArea, int& bestL, int& bestR, int& bestH)
-{
-    const int W = (int)h.size();
-    bestArea = 0; bestL = 0; bestR = -1; bestH = 0;
-
-    std::vector<int> st;
-    st.reserve(W + 1);
-
-    auto hh = [&](int i)->int { return (i == W) ? 0 : h[i]; };
-
-    for (int i = 0; i <= W; ++i) {
-        int cur = hh(i);
-        while (!st.empty() && hh(st.back()) > cur) {
-            int height = hh(st.back());
-            st.pop_back();
-
-            int left = st.empty() ? 0 : st.back() + 1;
-            int right = i - 1;
-            int area = height * (right - left + 1);
-
-            if (area > bestArea) {
-                bestArea = area;
-                bestL = left;
-                bestR = right;
-                bestH = height;
-            }
-        }
-        st.push_back(i);
-    }
-}
-
-// 入力: logical配列 mask（CV_8U, 値0/1推奨。非0をtrue扱いでもOK）
-// 出力: 最大面積矩形の (x,y,w,h)。無ければ (0,0,0,0)
-cv::Rect maxRectOnesFromLogical(const cv::Mat1b& mask)
+MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::MainWindow)
 {
-    CV_Assert(!mask.empty());
-    CV_Assert(mask.channels() == 1);
-    CV_Assert(mask.depth() == CV_8U);
-
-    const int H = mask.rows;
-    const int W = mask.cols;
-
-    std::vector<int> heights(W, 0);
-
-    int bestAreaAll = 0;
-    int bestTop = 0, bestLeft = 0, bestBottom = -1, bestRight = -1;
+    ui->setupUi(this);
 
-    for (int r = 0; r < H; ++r) {
-        const uchar* row = mask.ptr<uchar>(r);
+    connect(ui->pushButton_1, &QPushButton::clicked, this, &MainWindow::Image_in_clicked);
+    connect(ui->pushButton_2, &QPushButton::clicked, this, &MainWindow::Front_Back);
+    connect(ui->graphicsView, &maincampus::zoomChanged,
+            this, [this](int pct){ zoomLabel->setText(QString("%1%").arg(pct)); requestLiveScore(); });
 
-        for (int c = 0; c < W; ++c) {
-            if (row[c]) heights[c] += 1;
-            else heights[c] = 0;
-        }
+    connect(ui->dropArea, &DropArea::filesDropped, this, [this](const QStringList& paths){
+        File_input(paths);
+    });
 
-        int area, l, rr, h;
-        largestRectHistogram(heights, area, l, rr, h);
+    scene = new QGraphicsScene(this);
 
-        if (area > bestAreaAll) {
-            bestAreaAll = area;
-            bestBottom = r;
-            bestLeft = l;
-            bestRight = rr;
-            bestTop = r - h + 1;
+    // ジョブエンジンとジョブ一覧
+    jobs = new JobEngine(this);
+    jobPanel = new JobPanel(jobs, this);
+    auto *jobDock = new QDockWidget("ジョブ", this);
+    jobDock->setObjectName("jobDock");
+    jobDock->setWidget(jobPanel);
+    addDockWidget(Qt::BottomDockWidgetArea, jobDock);
+    QMenu *fileMenu = menuBar()->addMenu("ファイル");
+    connect(fileMenu->addAction("プロジェクトを開く..."), &QAction::triggered, this, &MainWindow::openProject);
+    connect(fileMenu->addAction("プロジェクトを保存..."), &QAction::triggered, this, &MainWindow::saveProject);
+    fileMenu->addSeparator();
+    connect(fileMenu->addAction("グリッド結合..."), &QAction::triggered, this, &MainWindow::gridMosaic);
+    fileMenu->addSeparator();
+    actRecord = fileMenu->addAction("操作を記録...");
+    actRecord->setCheckable(true);
+    connect(actRecord, &QAction::triggered, this, [this](bool on) {
+        if (!on) {
+            recorder.close();
+            return;
         }
-    }
-
-    if (bestAreaAll <= 0) return cv::Rect(0, 0, 0, 0);
-
-    return cv::Rect(
-        bestLeft,
-        bestTop,
-        bestRight - bestLeft + 1,
-        bestBottom - bestTop + 1
-        );
-}
-
-// iFFT用関数
-static cv::Mat1f clahe_then_grad(const cv::Mat& im_bgr)
-{
-    CV_Assert(!im_bgr.empty());
-    CV_Assert(im_bgr.channels() == 3);
-
-    cv::Mat g8;
-    cv::cvtColor(im_bgr, g8, cv::COLOR_BGR2GRAY);
-
-    // CLAHE
-    cv::Ptr<cv::CLAHE> clahe = cv::createCLAHE(2.0, cv::Size(8, 8));
-    clahe->apply(g8, g8);
-
-    cv::Mat1f g;
-    g8.convertTo(g, CV_32F);
-
-    // Gaussian blur (sigma=1.0, ksize=(0,0) means auto)
-    cv::GaussianBlur(g, g, cv::Size(0, 0), 1.0);
-
-    // Sobel gradients
-    cv::Mat1f gx, gy;
-    cv::Sobel(g, gx, CV_32F, 1, 0, 3);
-    cv::Sobel(g, gy, CV_32F, 0, 1, 3);
-
-    // magnitude
-    cv::Mat1f mag;
-    cv::magnitude(gx, gy, mag);
-
-    // mag -= mean; mag /= std
-    cv::Scalar mean, stddev;
-    cv::meanStdDev(mag, mean, stddev);
-    mag -= (float)mean[0];
-    float s = (float)stddev[0];
-    if (s > 1e-6f) mag /= s;
-
-    // Hanning window (reduce edge/DC effects)
-    cv::Mat1f win;
-    cv::createHanningWindow(win, mag.size(), CV_32F);
-    mag = mag.mul(win);
-
-    return mag;
-}
-
-static void paste_over(cv::Mat& dst, const cv::Mat& src, int x, int y)
-{
-    CV_Assert(dst.channels() == src.channels());
-    CV_Assert(dst.depth() == src.depth());
-    CV_Assert(x >= 0 && y >= 0);
-    CV_Assert(x + src.cols <= dst.cols);
-    CV_Assert(y + src.rows <= dst.rows);
-
-    src.copyTo(dst(cv::Rect(x, y, src.cols, src.rows)));
-}
-
-
-// BGRA画像２枚を合成（距離変換フェザー）
-// cam1, cam2: CV_8UC4 (BGRA)
-// shift: phaseCorrelate(a,b) の戻り値を想定（あなたの符号規約に合わせて x2=-shift.x）
-// featherRadius: フェザー幅（ピクセル）。0以下なら無制限（画像内側ほど重くなる）
-cv::Mat make_canvas_bgra_feather_dt(
-    const cv::Mat& cam1,
-    const cv::Mat& cam2,
-    const cv::Point2d& shift_from_phaseCorrelate,
-    float featherRadius = 80.0f)
-{
-    CV_Assert(!cam1.empty() && !cam2.empty());
-    CV_Assert(cam1.type() == CV_8UC4 && cam2.type() == CV_8UC4);
-
-    // 貼り付けオフセット（あなたのコードと同じ）
-    const int x1 = 0, y1 = 0;
-    const int x2 = (int)std::lround(-shift_from_phaseCorrelate.x);
-    const int y2 = (int)std::lround(-shift_from_phaseCorrelate.y);
-
-    const int h1 = cam1.rows, w1 = cam1.cols;
-    const int h2 = cam2.rows, w2 = cam2.cols;
-
-    // キャンバスサイズ
-    const int min_x = std::min(x1, x2);
-    const int min_y = std::min(y1, y2);
-    const int max_x = std::max(x1 + w1, x2 + w2);
-    const int max_y = std::max(y1 + h1, y2 + h2);
-
-    const int out_w = max_x - min_x;
-    const int out_h = max_y - min_y;
-
-    const int sx = -min_x;
-    const int sy = -min_y;
-
-    // 各画像をキャンバス座標に配置（未合成で保持）
-    cv::Mat img1(out_h, out_w, CV_8UC4, cv::Scalar(0,0,0,0));
-    cv::Mat img2(out_h, out_w, CV_8UC4, cv::Scalar(0,0,0,0));
-
-    {
-        cv::Rect roi1(x1 + sx, y1 + sy, w1, h1);
-        CV_Assert(0 <= roi1.x && 0 <= roi1.y && roi1.x + roi1.width <= out_w && roi1.y + roi1.height <= out_h);
-        cam1.copyTo(img1(roi1));
-    }
-    {
-        cv::Rect roi2(x2 + sx, y2 + sy, w2, h2);
-        CV_Assert(0 <= roi2.x && 0 <= roi2.y && roi2.x + roi2.width <= out_w && roi2.y + roi2.height <= out_h);
-        cam2.copyTo(img2(roi2));
-    }
-
-    // 有効領域マスク（alpha > 0）
-    cv::Mat1b m1(out_h, out_w, uchar(0));
-    cv::Mat1b m2(out_h, out_w, uchar(0));
-
-    for (int r = 0; r < out_h; ++r) {
-        const cv::Vec4b* p1 = img1.ptr<cv::Vec4b>(r);
-        const cv::Vec4b* p2 = img2.ptr<cv::Vec4b>(r);
-        uchar* q1 = m1.ptr<uchar>(r);
-        uchar* q2 = m2.ptr<uchar>(r);
-        for (int c = 0; c < out_w; ++c) {
-            q1[c] = (p1[c][3] > 0) ? 255 : 0;
-            q2[c] = (p2[c][3] > 0) ? 255 : 0;
+        const QString path = QFileDialog::getSaveFileName(this, "操作を記録", "session.jsonl",
+                                                          "Session Log (*.jsonl);;All Files (*.*)");
+        if (path.isEmpty() || !startRecording(path)) {
+            if (!path.isEmpty()) QMessageBox::warning(this, "操作を記録", "ファイルを開けません。");
+            actRecord->setChecked(false);
         }
+    });
+    QMenu *viewMenu = menuBar()->addMenu("表示");
+    viewMenu->addAction(jobDock->toggleViewAction());
+
+    // 重なりの確認表示（排他選択）
+    viewMenu->addSeparator();
+    QMenu *overlayMenu = viewMenu->addMenu("重なり表示");
+    auto *overlayGroup = new QActionGroup(this);
+    const std::pair<const char *, OverlayMode> overlayModes[] = {
+        {"なし", OverlayMode::Off},
+        {"差分", OverlayMode::Difference},
+        {"チェッカー", OverlayMode::Checker},
+        {"疑似カラー（画像1: マゼンタ / 画像2: 緑）", OverlayMode::FalseColor},
+    };
+    for (const auto& [name, mode] : overlayModes) {
+        QAction *a = overlayMenu->addAction(name);
+        a->setCheckable(true);
+        a->setChecked(mode == OverlayMode::Off);
+        overlayGroup->addAction(a);
+        connect(a, &QAction::triggered, this, [this, mode = mode]() {
+            overlayMode = mode;
+            requestOverlay();
+        });
     }
 
-    // 距離変換（非ゼロ画素について、最も近いゼロ画素までの距離）
-    // → 有効領域内部ほど距離が大きく、境界で0に近い
-    cv::Mat1f d1, d2;
-    cv::distanceTransform(m1, d1, cv::DIST_L2, 3);
-    cv::distanceTransform(m2, d2, cv::DIST_L2, 3);
-
-    // フェザー幅制御（任意）
-    if (featherRadius > 0.0f) {
-        cv::min(d1, featherRadius, d1);
-        cv::min(d2, featherRadius, d2);
-    }
-
-    // 合成（フェザー）
-    cv::Mat canvas(out_h, out_w, CV_8UC4, cv::Scalar(0,0,0,0));
-    constexpr float eps = 1e-6f;
-
-    for (int r = 0; r < out_h; ++r) {
-        const cv::Vec4b* p1 = img1.ptr<cv::Vec4b>(r);
-        const cv::Vec4b* p2 = img2.ptr<cv::Vec4b>(r);
-        const float* dd1 = d1.ptr<float>(r);
-        const float* dd2 = d2.ptr<float>(r);
-        cv::Vec4b* out = canvas.ptr<cv::Vec4b>(r);
-
-        for (int c = 0; c < out_w; ++c) {
-            const cv::Vec4b a = p1[c];
-            const cv::Vec4b b = p2[c];
-
-            const float a1 = a[3] / 255.0f;
-            const float a2 = b[3] / 255.0f;
-
-            const bool v1 = a1 > 0.0f;
-            const bool v2 = a2 > 0.0f;
-
-            if (!v1 && !v2) {
-                out[c] = cv::Vec4b(0,0,0,0);
-                continue;
-            }
-            if (v1 && !v2) {
-                out[c] = a;
-                continue;
-            }
-            if (!v1 && v2) {
-                out[c] = b;
-                continue;
-            }
-
-            // 両方有効：距離から重み
-            float ww1 = dd1[c];
-            float ww2 = dd2[c];
-            float wws = ww1 + ww2;
-
-            // あり得る：境界ピッタリで両方ほぼ0 → その場合は等分
-            if (wws < eps) { ww1 = 0.5f; ww2 = 0.5f;}
-            else { ww1 /= wws; ww2 /= wws; }
-
-            // αも含めて「事前乗算」で混ぜる（境界が破綻しにくい）
-            // premult = rgb * alpha
-            const float p1b = (a[0]/255.0f) * a1;
-            const float p1g = (a[1]/255.0f) * a1;
-            const float p1r = (a[2]/255.0f) * a1;
-
-            const float p2b = (b[0]/255.0f) * a2;
-            const float p2g = (b[1]/255.0f) * a2;
-            const float p2r = (b[2]/255.0f) * a2;
-
-            // フェザー重みで混合
-            const float ao = std::clamp(a1*ww1 + a2*ww2, 0.0f, 1.0f); // 出力alpha
-            float ob = 0.0f, og = 0.0f, or_ = 0.0f;
-
-            if (ao > eps) {
-                ob = (p1b*ww1 + p2b*ww2) / ao;
-                og = (p1g*ww1 + p2g*ww2) / ao;
-                or_ = (p1r*ww1 + p2r*ww2) / ao;
-            }
-
-            out[c][0] = (uchar)std::lround(std::clamp(ob, 0.0f, 1.0f) * 255.0f);
-            out[c][1] = (uchar)std::lround(std::clamp(og, 0.0f, 1.0f) * 255.0f);
-            out[c][2] = (uchar)std::lround(std::clamp(or_, 0.0f, 1.0f) * 255.0f);
-            out[c][3] = (uchar)std::lround(ao * 255.0f);
+    // スレッド数（QSettings に保存。コア固定は次回起動から有効）
+    QMenu *settingsMenu = menuBar()->addMenu("設定");
+    connect(settingsMenu->addAction("スレッド数..."), &QAction::triggered, this, [this]() {
+        ThreadBudget::Settings s = ThreadBudget::loadSettings();
+        bool ok = false;
+        const int n = QInputDialog::getInt(this, "スレッド数", "総スレッド数（0 = 論理コア数）",
+                                           s.threads, 0, 1024, 1, &ok);
+        if (!ok) return;
+        s.threads = n;
+        ThreadBudget::saveSettings(s);
+        ThreadBudget::apply(s); // コア固定は起動時のまま
+        if (ThreadBudget::pinned()) {
+            QMessageBox::information(this, "スレッド数",
+                                     "コア固定中です。固定するコアの範囲は再起動後に新しいスレッド数へ合わせます。");
         }
-    }
-
-    return canvas;
-}
-
-// 2つの画像から重なり領域をクロップして取り出す
-return_struct2 Crop_2ImageTo2Image(cv::Mat input1, cv::Mat input2, QSize px1, QPoint pos1, QSize px2, QPoint pos2)
-{
-    // 座標移動ベクトルを計算
-    int dx = std::min(pos1.x(), pos2.x());
-    int dy = std::min(pos1.y(), pos2.y());
-
-    // キャンパスサイズを計算
-    int camX = std::max(pos1.x() + px1.width(), pos2.x() + px2.width()) - dx;
-    int camY = std::max(pos1.y() + px1.height(), pos2.y() + px2.height()) - dy;
-
-    // キャンパスを作成し、各画像を割り当て
-    cv::Mat cam1(camY, camX, CV_8UC4, cv::Scalar(0,0,0,0));
-    cv::Rect roi(pos1.x() - dx, pos1.y() - dy, input1.cols, input1.rows); // 貼り付け先座標
-    input1.copyTo(cam1(roi));
-
-    cv::Mat cam2(camY, camX, CV_8UC4, cv::Scalar(0,0,0,0));
-    roi = cv::Rect(pos2.x() - dx, pos2.y() - dy, input2.cols, input2.rows); // 貼り付け先座標
-    input2.copyTo(cam2(roi));
-
-    // Alphaをlogical配列へ変換
-    cv::Mat1b logicalMask1 = alphaMaskFromBGRA(cam1, 0.5); // 0/1
-    cv::Mat1b logicalMask2 = alphaMaskFromBGRA(cam2, 0.5); // 0/1
-
-    // 重なり領域を得る
-    cv::Mat1b andMask;
-    cv::bitwise_and(logicalMask1, logicalMask2, andMask);
-
-    // and領域を矩形化する
-    cv::Rect rect = maxRectOnesFromLogical(andMask);
-
-    // 画像を3ch化
-    cv::Mat cam1_3ch, cam2_3ch;
-    cv::cvtColor(cam1, cam1_3ch, cv::COLOR_BGRA2BGR);
-    cv::cvtColor(cam2, cam2_3ch, cv::COLOR_BGRA2BGR);
-
-    // 重なり領域をcropして取り出す
-    cv::Mat crop1 = cam1_3ch(rect).clone();
-    cv::Mat crop2 = cam2_3ch(rect).clone();
-
-    // 返り値を設定
-    return_struct2 r;
-    r.img1 = crop1;
-    r.img2 = crop2;
-    return r;
-};
-
-// SSIM計算関数
-static double ssim_single_channel(const cv::Mat& i1u8, const cv::Mat& i2u8)
-{
-    cv::Mat I1, I2;
-    i1u8.convertTo(I1, CV_32F);
-    i2u8.convertTo(I2, CV_32F);
-
-    const double C1 = (0.01 * 255) * (0.01 * 255);
-    const double C2 = (0.03 * 255) * (0.03 * 255);
-
-    cv::Mat mu1, mu2;
-    cv::GaussianBlur(I1, mu1, cv::Size(11, 11), 1.5);
-    cv::GaussianBlur(I2, mu2, cv::Size(11, 11), 1.5);
-
-    cv::Mat mu1_2 = mu1.mul(mu1);
-    cv::Mat mu2_2 = mu2.mul(mu2);
-    cv::Mat mu1_mu2 = mu1.mul(mu2);
-
-    cv::Mat sigma1_2, sigma2_2, sigma12;
-    cv::GaussianBlur(I1.mul(I1), sigma1_2, cv::Size(11, 11), 1.5);
-    sigma1_2 -= mu1_2;
-
-    cv::GaussianBlur(I2.mul(I2), sigma2_2, cv::Size(11, 11), 1.5);
-    sigma2_2 -= mu2_2;
-
-    cv::GaussianBlur(I1.mul(I2), sigma12, cv::Size(11, 11), 1.5);
-    sigma12 -= mu1_mu2;
-
-    cv::Mat t1 = 2 * mu1_mu2 + C1;
-    cv::Mat t2 = 2 * sigma12 + C2;
-    cv::Mat t3 = mu1_2 + mu2_2 + C1;
-    cv::Mat t4 = sigma1_2 + sigma2_2 + C2;
-
-    cv::Mat ssim_map = (t1.mul(t2)) / (t3.mul(t4));
-    return cv::mean(ssim_map)[0];
-}
-
-double ssim(const cv::Mat& a, const cv::Mat& b)
-{
-    CV_Assert(!a.empty() && !b.empty());
-    CV_Assert(a.size() == b.size());
-
-    cv::Mat A = a, B = b;
-
-    // SSIMは基本「同じチャンネル数」で。迷ったらグレースケールに落とすのが簡単
-    if (A.channels() == 3) cv::cvtColor(A, A, cv::COLOR_BGR2GRAY);
-    if (B.channels() == 3) cv::cvtColor(B, B, cv::COLOR_BGR2GRAY);
-    if (A.channels() == 4) cv::cvtColor(A, A, cv::COLOR_BGRA2GRAY);
-    if (B.channels() == 4) cv::cvtColor(B, B, cv::COLOR_BGRA2GRAY);
-
-    CV_Assert(A.type() == CV_8U && B.type() == CV_8U);
-    return ssim_single_channel(A, B);
-}
-
-// SSIM 各スレッドの計算処理
-static double SSIM_calc_oneshot(const SSIM_TaskInput& in)
-{
-    // 2枚目画像を(dx,dy)移動
-    QPoint in_pos2(in.pos2.x() + in.dx, in.pos2.y() + in.dy);
-
-    // 重なり領域をcropして取り出す。
-    return_struct2 r_st = Crop_2ImageTo2Image(in.input1, in.input2, in.px1, in.pos1, in.px2, in_pos2);
-    cv::Mat crop1 = r_st.img1;
-    cv::Mat crop2 = r_st.img2;
+    });
+    QAction *actPin = settingsMenu->addAction("コア固定（再起動後に有効）");
+    actPin->setCheckable(true);
+    actPin->setChecked(ThreadBudget::loadSettings().pinCores);
+    connect(actPin, &QAction::toggled, this, [](bool on) {
+        ThreadBudget::Settings s = ThreadBudget::loadSettings();
+        s.pinCores = on;
+        ThreadBudget::saveSettings(s);
+    });
 
-    /*
-    cv::imshow("crop1",crop1);
-    cv::imshow("crop2",crop2);
-    cv::waitKey(0);
-    */
+    // 読み込んだ画像・結合結果をタイルごとに圧縮して保持（次に読み込む画像から有効）
+    QAction *actCompress = settingsMenu->addAction("画像を圧縮して保持");
+    actCompress->setCheckable(true);
+    actCompress->setChecked(QSettings().value("memory/compressTiles", false).toBool());
+    connect(actCompress, &QAction::toggled, this, [](bool on) {
+        QSettings().setValue("memory/compressTiles", on);
+    });
 
-    if (crop1.rows == 0) {
-        return 0.0;
+    // SIMD の版（QSettings に保存。すぐ切り替わる。CPU が対応していない版は選べない）
+    QMenu *isaMenu = settingsMenu->addMenu("SIMD 命令セット");
+    auto *isaGroup = new QActionGroup(this);
+    const QString savedIsa = QSettings().value("simd/isa", "auto").toString();
+    const SimdIsa detected = detectedSimdIsa();
+    auto addIsa = [&](const QString& label, const QString& key, SimdIsa isa) {
+        QAction *a = isaMenu->addAction(label);
+        a->setCheckable(true);
+        a->setEnabled(isa <= detected);
+        a->setChecked(key == savedIsa);
+        isaGroup->addAction(a);
+        connect(a, &QAction::triggered, this, [this, key, isa]() {
+            QSettings().setValue("simd/isa", key);
+            setSimdIsa(isa);
+            statusBar()->showMessage(QString("SIMD: %1").arg(simdIsaName(activeSimdIsa())), 3000);
+        });
+    };
+    addIsa(QString("自動（%1）").arg(simdIsaName(detected)), "auto", detected);
+    for (SimdIsa isa : {SimdIsa::Avx512, SimdIsa::Avx2, SimdIsa::Baseline}) {
+        addIsa(simdIsaName(isa), simdIsaName(isa), isa);
     }
-
-    double v = ssim(crop1, crop2);
-    return v;
-}
-
-MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::MainWindow)
-{
-    ui->setupUi(this);
-
-    connect(ui->pushButton_1, &QPushButton::clicked, this, &MainWindow::Image_in_clicked);
-    connect(ui->pushButton_2, &QPushButton::clicked, this, &MainWindow::Front_Back);
-    connect(ui->graphicsView, &maincampus::zoomChanged,
-            this, [this](int pct){ zoomLabel->setText(QString("%1%").arg(pct)); });
-
-    connect(ui->dropArea, &DropArea::filesDropped, this, [this](const QStringList& paths){
-        File_input(paths);
+    if (!isaGroup->checkedAction()) isaGroup->actions().first()->setChecked(true);
+
+    // 画像を動かし終えたら、その位置の位相相関を空き時間に求めておく
+    actSpeculate = settingsMenu->addAction("位相相関を先読み");
+    actSpeculate->setCheckable(true);
+    actSpeculate->setChecked(QSettings().value("speculate/enabled", true).toBool());
+    connect(actSpeculate, &QAction::toggled, this, [this](bool on) {
+        QSettings().setValue("speculate/enabled", on);
+        if (on) scheduleSpeculation();
+        else cancelSpeculation();
     });
 
-    scene = new QGraphicsScene(this);
+    // 先読みは最後に動かしてから 500ms 後（ドラッグ中・連続操作中は始めない）
+    speculateTimer = new QTimer(this);
+    speculateTimer->setSingleShot(true);
+    speculateTimer->setInterval(500);
+    connect(speculateTimer, &QTimer::timeout, this, &MainWindow::startSpeculation);
 
     ui->graphicsView->setScene(scene);
 
@@ -486,6 +196,27 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::MainWi
     zoomLabel->setText("100%");
     statusBar()->addPermanentWidget(zoomLabel);
 
+    // ドラッグ中の即時スコア（表示範囲の重なりを縮小して NCC）
+    live = new LiveAligner(this);
+    liveLabel = new QLabel(this);
+    snapCheck = new QCheckBox("スナップ", this);
+    snapCheck->setToolTip("ドラッグを離した時、近傍で NCC が最大の位置へ画像2を吸着させる");
+    statusBar()->addPermanentWidget(liveLabel);
+    statusBar()->addPermanentWidget(snapCheck);
+    connect(live, &LiveAligner::scored, this, &MainWindow::onLiveScored);
+    connect(ui->graphicsView->horizontalScrollBar(), &QScrollBar::valueChanged, this, &MainWindow::requestLiveScore);
+    connect(ui->graphicsView->verticalScrollBar(), &QScrollBar::valueChanged, this, &MainWindow::requestLiveScore);
+
+    // 重なり表示は最前面。マウスは下の画像へ通す
+    overlay = new OverlayRenderer(this);
+    overlayItem = new QGraphicsPixmapItem();
+    overlayItem->setZValue(1e9);
+    overlayItem->setAcceptedMouseButtons(Qt::NoButton);
+    overlayItem->setTransformationMode(Qt::FastTransformation); // 拡大しても画素をぼかさない
+    overlayItem->setVisible(false);
+    scene->addItem(overlayItem);
+    connect(overlay, &OverlayRenderer::rendered, this, &MainWindow::onOverlayRendered);
+
     // 透明度制御
     ui->sliderOpacity1->setRange(0, 100);
     ui->spinOpacity1->setRange(0, 100);
@@ -531,11 +262,14 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::MainWi
 
     applyBg(ui->comboBox->currentIndex());
 
+    // SSIMボタンの探索方法
+    ui->comboSearch->addItems({"全探索", "相関面", "位相ピーク"});
+
     // 計算開始ボタン
     connect(ui->pushButton_Calc1, &QPushButton::clicked, this, &MainWindow::calc_iFFT);
 
-    // 計算完了通知を受け取る
-    connect(&m_ifftWatcher, &QFutureWatcher<cv::Mat>::finished, this, &MainWindow::iFFT_finish);
+    // 自動配置ボタン
+    connect(ui->pushButton_Auto, &QPushButton::clicked, this, &MainWindow::autoPlace);
 
     // 結合ボタン
     connect(ui->pushButton_3, &QPushButton::clicked, this, &MainWindow::stitch_image12);
@@ -545,15 +279,20 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::MainWi
 
     // 計算開始ボタン
     connect(ui->pushButton_Calc2, &QPushButton::clicked, this, &MainWindow::calc_SSIM);
+}
 
-    // 計算完了通知を受け取る
-    connect(&m_ssimWatcher, &QFutureWatcher<return_struct1>::finished,
-            this, &MainWindow::ssim_finish,
-            Qt::QueuedConnection);
+bool MainWindow::startRecording(const QString& path)
+{
+    const bool ok = recorder.open(path);
+    if (actRecord) actRecord->setChecked(ok);
+    return ok;
 }
 
 MainWindow::~MainWindow()
 {
+    // 実行中のジョブを止めてから UI を破棄する
+    delete jobs;
+    jobs = nullptr;
     delete ui;
 }
 
@@ -570,6 +309,18 @@ static double percentToOpacity(int percent)
     return 1.0 - (percent / 100.0); // 0.0〜1.0
 }
 
+// 全体デコード前の枠の縮小率
+static constexpr int kPlaceholderScale = 16;
+
+// 位置を負の無限大方向へ丸め
+static cv::Point floorPoint(const QPointF& p)
+{
+    return cv::Point(
+        static_cast<int>(std::floor(p.x())),
+        static_cast<int>(std::floor(p.y()))
+        );
+}
+
 void MainWindow::Image_in_clicked()
 {
     const QStringList paths = QFileDialog::getOpenFileNames(
@@ -586,46 +337,231 @@ void MainWindow::Image_in_clicked()
     File_input(paths);
 }
 
+// 縮小版の倍率（圧縮して保持する画像・1枚の QImage にできない大きな画像の表示用。拡大表示では TileItem がタイルを読んで描く）
+// 1/4 から始め、縮小版が 2^26 画素以下になるまで半分にする
+static int previewScale(cv::Size size)
+{
+    int s = 4;
+    while (pixelCount(size) / ((int64_t)s * s) > (int64_t(1) << 26)) s *= 2;
+    return s;
+}
+
+static StitchImage shrinkForPreview(const StitchImage& img, int scale)
+{
+    const cv::Size dst(std::max(1, (img.cols() + scale - 1) / scale), std::max(1, (img.rows() + scale - 1) / scale));
+    StitchImage r;
+    cv::resize(img.pixels, r.pixels, dst, 0, 0, cv::INTER_AREA);
+    if (!img.mask.empty()) cv::resize(img.mask, r.mask, dst, 0, 0, cv::INTER_NEAREST);
+    return r;
+}
+
+// 圧縮した画像の縮小版（タイルの高さ、または倍率の帯ごとに展開して縮小する。どちらも 2 の冪）
+static QImage tiledPreview(const TiledImage& t)
+{
+    const int scale = previewScale(t.size());
+    const int band = std::max(t.tileSize(), scale);
+    std::vector<cv::Mat> pixels, masks;
+    for (int y0 = 0; y0 < t.rows(); y0 += band) {
+        StitchImage rows = t.read(cv::Rect(0, y0, t.cols(), std::min(band, t.rows() - y0)));
+        if (t.hasMask() && rows.mask.empty()) rows.mask = cv::Mat1b(rows.size(), 255);
+        const StitchImage small = shrinkForPreview(rows, scale);
+        pixels.push_back(small.pixels);
+        if (t.hasMask()) masks.push_back(small.mask);
+    }
+    StitchImage preview;
+    cv::vconcat(pixels, preview.pixels);
+    if (!masks.empty()) {
+        cv::Mat m;
+        cv::vconcat(masks, m);
+        preview.mask = m;
+    }
+    return toDisplayImage(preview);
+}
+
+// 表示用の画像（1枚の QImage にできない大きさなら縮小版。拡大表示は showRendered で設定するタイル描画）
+static QImage displayImageFor(const StitchImage& img)
+{
+    if (!needsChunkedDisplay(img.size())) return toDisplayImage(img);
+    return toDisplayImage(shrinkForPreview(img, previewScale(img.size())));
+}
+
+// 全体を展開した画像（書き出し用）
+static StitchImage expandRendered(const RenderedImage& r)
+{
+    return r.tiled ? r.tiled->read(cv::Rect(cv::Point(0, 0), r.tiled->size())) : r.image;
+}
+
+// 1ファイル分の読み込み（ジョブ内で実行）。compress ならタイルごとに圧縮し、展開した全体は捨てる
+static RenderedImage loadRendered(const QString& path, bool compress)
+{
+    RenderedImage r;
+    r.image = loadStitchImageCached(path, &r.cacheKey); // 2回目以降はメモリマップ
+    if (r.image.empty()) return r;
+    if (compress) {
+        r.display = toDisplayImage(shrinkForPreview(r.image, previewScale(r.image.size())));
+        r.tiled = TiledImage::compress(r.image);
+        r.image = StitchImage();
+    } else {
+        r.display = displayImageFor(r.image);
+    }
+    return r;
+}
+
 void MainWindow::File_input(QStringList paths) {
+    recorder.record("load", QJsonObject{{"paths", QJsonArray::fromStringList(paths)}});
+
+    // 部分読み込みできる TIFF はヘッダだけ先に読んで枠を配置し、全体デコードを待たずに位置合わせできるようにする
+    JobEngine::Spec probe;
+    probe.title = QString("ヘッダ読み込み (%1枚)").arg(paths.size());
+    probe.priority = JobEngine::Priority::High;
+    probe.work = [paths](JobEngine::Context&) -> std::any {
+        QList<std::shared_ptr<TiffRegionReader>> readers;
+        for (const QString& p : paths) readers.push_back(TiffRegionReader::open(p));
+        return readers;
+    };
+    probe.onFinished = [this, paths](const std::any& r) {
+        const auto readers = placePlaceholders(paths, std::any_cast<QList<std::shared_ptr<TiffRegionReader>>>(r));
+
+        // デコードはジョブで並列に行い、配置は入力順に GUIスレッドで行う
+        JobEngine::Spec spec;
+        spec.title = QString("読み込み (%1枚)").arg(paths.size());
+        spec.priority = JobEngine::Priority::Normal;
+        const bool compress = QSettings().value("memory/compressTiles", false).toBool();
+        spec.work = [paths, compress](JobEngine::Context&) -> std::any {
+            return QtConcurrent::blockingMapped<QList<RenderedImage>>(paths, [compress](const QString& p) {
+                return loadRendered(p, compress);
+            });
+        };
+        spec.onFinished = [this, paths, readers](const std::any& r) {
+            placeImages(paths, std::any_cast<QList<RenderedImage>>(r), readers);
+        };
+        jobs->submit(spec);
+    };
+    jobs->submit(probe);
+}
+
+// 部分読み込みできる画像の枠（縮小した灰色の仮画像）を先に置く。戻り値は枠を置けたものだけ
+QList<std::shared_ptr<TiffRegionReader>> MainWindow::placePlaceholders(const QStringList& paths,
+                                                                      QList<std::shared_ptr<TiffRegionReader>> readers)
+{
+    for (int i = 0; i < paths.size(); ++i) {
+        const auto reader = readers[i];
+        if (!reader) continue;
+
+        QGraphicsPixmapItem **target = nullptr;
+        if (item1 == nullptr) {
+            target = &item1;
+            exp_png1 = paths[i];
+            src1 = StitchImage();
+            region1 = reader;
+            cacheKey1.clear();
+            stitched1 = false;
+        } else if (item2 == nullptr) {
+            target = &item2;
+            exp_png2 = paths[i];
+            src2 = StitchImage();
+            region2 = reader;
+            cacheKey2.clear();
+        } else {
+            readers[i].reset(); // 2枚を超える分は placeImages で警告する
+            continue;
+        }
+        sceneGen++;
+        hasIfft = hasSsim = false;
+        z_value++;
+
+        const cv::Size sz = reader->size();
+        QPixmap pix(std::max(1, sz.width / kPlaceholderScale), std::max(1, sz.height / kPlaceholderScale));
+        pix.fill(Qt::darkGray);
+        *target = addTileItem(pix);
+        (*target)->setTransform(QTransform::fromScale((qreal)sz.width / pix.width(), (qreal)sz.height / pix.height()));
+        (*target)->setZValue(z_value);
+    }
+
+    if (item2 != nullptr) {
+        ui->sliderOpacity2->setValue(40);
+    }
+    return readers;
+}
+
+void MainWindow::placeImages(const QStringList& paths, const QList<RenderedImage>& images,
+                             const QList<std::shared_ptr<TiffRegionReader>>& readers) {
     int const n = paths.size();
     for (int i = 0; i < n; ++i) {
+        const std::shared_ptr<TiffRegionReader> reader = i < readers.size() ? readers[i] : nullptr;
 
-        // 画像ファイルとして読み込めるか確認
-        QPixmap pix(paths[i]);
-        if (pix.isNull()) {
+        // 画像ファイルとして読み込めたか確認（深さ・チャンネル数はそのまま）
+        const StitchImage& img = images[i].image;
+        if (img.empty() && !images[i].tiled) {
             QMessageBox::warning(this, "error", QString("%1枚目の画像の読み込みに失敗しました。").arg(i + 1));
             continue; // 次のiへ進む
         }
 
+        // 枠を置いた画像なら中身を差し替える（同じ画像なので位置合わせの結果は捨てない）
+        if (reader) {
+            QGraphicsPixmapItem *item = nullptr;
+            if (reader == region1) {
+                item = item1;
+                src1 = img;
+                gray1.reset();
+                tiled1 = images[i].tiled;
+                cacheKey1 = images[i].cacheKey;
+            } else if (reader == region2) {
+                item = item2;
+                src2 = img;
+                gray2.reset();
+                tiled2 = images[i].tiled;
+                cacheKey2 = images[i].cacheKey;
+            }
+            if (item) {
+                showRendered(item, images[i]);
+                if (!images[i].tiled) precomputeImage(img);
+            }
+            continue; // 枠が削除済みなら何もしない
+        }
+
         QGraphicsPixmapItem **target = nullptr;
         if (item1 == nullptr) {
             target = &item1;
             exp_png1 = paths[i];
+            src1 = img;
+            gray1.reset();
+            tiled1 = images[i].tiled;
+            region1.reset();
+            cacheKey1 = images[i].cacheKey;
+            stitched1 = false;
         } else if (item2 == nullptr) {
             target = &item2;
             exp_png2 = paths[i];
+            src2 = img;
+            gray2.reset();
+            tiled2 = images[i].tiled;
+            region2.reset();
+            cacheKey2 = images[i].cacheKey;
         } else {
             QMessageBox::warning(this, "error", "入力できる画像は2枚までです。");
             return; // forを終了
         }
+        sceneGen++;
+        hasIfft = hasSsim = false;
 
         // z値を計算
         z_value++;
 
+        const QPixmap pix = QPixmap::fromImage(images[i].display);
+
         if (*target == nullptr) {
-            *target = scene->addPixmap(pix);
-            (*target)->setFlags(QGraphicsItem::ItemIsMovable |
-                                QGraphicsItem::ItemIsSelectable |
-                                QGraphicsItem::ItemIsFocusable);
-        } else {
-            (*target)->setPixmap(pix);
+            *target = addTileItem(pix);
         }
+        showRendered(*target, images[i]);
         (*target)->setZValue(z_value);
+        if (!images[i].tiled) precomputeImage(img); // 即時スコア・重なり表示は展開済みの画像だけ
     }
 
     if (item2 != nullptr) {
         ui->sliderOpacity2->setValue(40);
     }
+    scheduleSpeculation();
 }
 
 void MainWindow::deleteSelectedItems()
@@ -634,10 +570,19 @@ void MainWindow::deleteSelectedItems()
     if (selected.isEmpty()) return;
 
     for (QGraphicsItem *it : selected) {
+        recorder.record("delete", QJsonObject{{"item", it == item1 ? 1 : 2}});
+
         // item1/item2 なら nullptr に戻す
         if (it == item1) {
             item1 = item2;
             exp_png1 = exp_png2;
+            src1 = src2;
+            tiled1 = tiled2;
+            pyr1 = pyr2;
+            gray1 = gray2;
+            region1 = region2;
+            cacheKey1 = cacheKey2;
+            stitched1 = false;
         }
 
         ui->sliderOpacity1->setValue(0);
@@ -646,12 +591,198 @@ void MainWindow::deleteSelectedItems()
         onOpacity2Changed(0);
 
         item2 = nullptr;
+        src2 = StitchImage();
+        tiled2.reset();
+        pyr2.reset();
+        gray2.reset();
+        region2.reset();
+        cacheKey2.clear();
+        sceneGen++;
+        hasIfft = hasSsim = false;
         scene->removeItem(it);
         delete it;
     }
+    cancelSpeculation();
+    requestOverlay();
 }
 
 
+QGraphicsPixmapItem *MainWindow::addTileItem(const QPixmap& pix)
+{
+    auto *item = new TileItem(pix);
+    item->onMoved = [this]() {
+        requestLiveScore();
+        scheduleSpeculation();
+    };
+    item->onReleased = [this]() {
+        if (!snapCheck->isChecked()) return;
+        snapPending = true; // 離した位置のスコアが出たら吸着
+        requestLiveScore();
+    };
+    scene->addItem(item);
+    return item;
+}
+
+// 画像アイテムへ表示を入れる
+// 圧縮して保持している画像・1枚の QImage にできない画像は、縮小版を元の大きさに拡大し、拡大表示ではタイルごとに描く
+void MainWindow::showRendered(QGraphicsPixmapItem *item, const RenderedImage& image)
+{
+    auto *tile = static_cast<TileItem*>(item); // addTileItem で作ったもの
+    tile->setPixmap(QPixmap::fromImage(image.display));
+
+    TileItem::TileSource source;
+    if (image.tiled) {
+        source.size = image.tiled->size();
+        source.tileSize = image.tiled->tileSize();
+        source.read = [t = image.tiled](const cv::Rect& r) { return t->read(r); };
+    } else if (!image.image.empty() && needsChunkedDisplay(image.image.size())) {
+        source.size = image.image.size();
+        source.tileSize = 512;
+        source.read = [img = image.image](const cv::Rect& r) {
+            StitchImage v;
+            v.pixels = img.pixels(r);
+            if (!img.mask.empty()) v.mask = img.mask(r);
+            return v;
+        };
+    }
+    if (source.read) {
+        tile->setTransform(QTransform::fromScale((qreal)source.size.width / image.display.width(),
+                                                 (qreal)source.size.height / image.display.height()));
+    } else {
+        tile->setTransform(QTransform());
+    }
+    tile->setTileSource(std::move(source));
+}
+
+// 読み込んだ画像の先読み（低優先度）
+// 縮小ピラミッド（ドラッグ中の即時スコア・重なり表示用）と、位置合わせ用のグレースケール + 有効領域
+using Precomputed = std::pair<std::shared_ptr<const LivePyramid>, std::shared_ptr<const StitchImage>>;
+
+void MainWindow::precomputeImage(const StitchImage& img)
+{
+    JobEngine::Spec spec;
+    spec.title = "先読み: 縮小ピラミッド・グレースケール";
+    spec.priority = JobEngine::Priority::Low;
+    spec.work = [img](JobEngine::Context& ctx) -> std::any {
+        Precomputed r;
+        r.first = buildLivePyramid(img);
+        if (!ctx.isCanceled()) r.second = std::make_shared<const StitchImage>(alignGrayImage(img));
+        return r;
+    };
+    const uchar *data = img.pixels.data;
+    spec.onFinished = [this, data](const std::any& r) {
+        // 完了時点でその画像を持っている側へ（削除・入れ替え済みなら捨てる）
+        const auto pre = std::any_cast<Precomputed>(r);
+        if (src1.pixels.data == data) {
+            pyr1 = pre.first;
+            gray1 = pre.second;
+        }
+        if (src2.pixels.data == data) {
+            pyr2 = pre.first;
+            gray2 = pre.second;
+        }
+        requestLiveScore();
+    };
+    jobs->submit(spec);
+}
+
+void MainWindow::requestLiveScore()
+{
+    requestOverlay(); // 表示範囲・位置が変わる契機は同じ
+
+    if (!item1 || !item2) {
+        liveLabel->clear();
+        return;
+    }
+
+    LiveRequest req;
+    req.src1 = src1;
+    req.src2 = src2;
+    req.pyr1 = pyr1;
+    req.pyr2 = pyr2;
+    req.pos1 = floorPoint(item1->pos());
+    req.pos2 = floorPoint(item2->pos());
+
+    const QRectF view = ui->graphicsView->mapToScene(ui->graphicsView->viewport()->rect()).boundingRect();
+    req.view = cv::Rect(floorPoint(view.topLeft()), cv::Size((int)std::ceil(view.width()) + 1, (int)std::ceil(view.height()) + 1));
+    req.pixelBudget = liveBudget;
+    req.snapRadius = snapCheck->isChecked() ? 3 : 0;
+    live->request(req);
+}
+
+void MainWindow::onLiveScored(const LiveScore& score)
+{
+    if (score.pending) {
+        liveLabel->setText("NCC: 準備中");
+        return;
+    }
+    if (!score.valid) {
+        liveLabel->setText("NCC: -");
+        return;
+    }
+
+    // 1フレーム (~16ms) に収まるよう評価画素数を調整
+    if (score.elapsedMs > 8.0) liveBudget = std::max(liveBudget / 2, 1 << 12);
+    else if (score.elapsedMs < 2.0) liveBudget = std::min(liveBudget * 2, 1 << 20);
+
+    QString text = QString("NCC: %1 (1/%2)").arg(score.ncc, 0, 'f', 3).arg(1 << score.level);
+    if (score.snapDelta != cv::Point(0, 0)) {
+        text += QString("  最良 %1 @ (%2, %3)").arg(score.bestNcc, 0, 'f', 3).arg(score.snapDelta.x).arg(score.snapDelta.y);
+    }
+    liveLabel->setText(text);
+
+    // 離した位置の結果なら吸着
+    if (snapPending && item1 && item2 &&
+        score.pos1 == floorPoint(item1->pos()) && score.pos2 == floorPoint(item2->pos())) {
+        snapPending = false;
+        if (score.snapDelta != cv::Point(0, 0)) item2->moveBy(score.snapDelta.x, score.snapDelta.y);
+    }
+}
+
+void MainWindow::requestOverlay()
+{
+    if (overlayMode == OverlayMode::Off || !item1 || !item2 || src1.empty() || src2.empty()) {
+        overlayItem->setVisible(false);
+        return;
+    }
+
+    OverlayRequest req;
+    req.mode = overlayMode;
+    req.src1 = src1;
+    req.src2 = src2;
+    req.pyr1 = pyr1;
+    req.pyr2 = pyr2;
+    req.pos1 = floorPoint(item1->pos());
+    req.pos2 = floorPoint(item2->pos());
+
+    const QRectF view = ui->graphicsView->mapToScene(ui->graphicsView->viewport()->rect()).boundingRect();
+    req.view = cv::Rect(floorPoint(view.topLeft()), cv::Size((int)std::ceil(view.width()) + 1, (int)std::ceil(view.height()) + 1));
+    req.zoom = ui->graphicsView->transform().m11();
+    overlay->request(req);
+}
+
+void MainWindow::onOverlayRendered(const OverlayResult& result)
+{
+    // 表示を切った・画像が差し替わった後の結果は捨てる
+    if (overlayMode == OverlayMode::Off || result.data1 != src1.pixels.data || result.data2 != src2.pixels.data) {
+        overlayItem->setVisible(false);
+        return;
+    }
+    if (result.pending) {
+        statusBar()->showMessage("重なり表示: 縮小画像を準備中", 2000);
+        return; // ピラミッドができたら requestLiveScore から再要求される
+    }
+    if (!result.valid) {
+        overlayItem->setVisible(false);
+        return;
+    }
+
+    overlayItem->setPixmap(QPixmap::fromImage(result.image));
+    overlayItem->setPos(result.origin.x, result.origin.y);
+    overlayItem->setScale(result.scale);
+    overlayItem->setVisible(true);
+}
+
 void MainWindow::Front_Back()
 {
     if (!item1 || !item2) {
@@ -659,6 +790,8 @@ void MainWindow::Front_Back()
         return; // どちらか未定義の場合
     }
 
+    recorder.record("front_back");
+
     const qreal z1 = item1->zValue();
     const qreal z2 = item2->zValue();
 
@@ -689,7 +822,57 @@ void MainWindow::onOpacity2Changed(int percent)
     setOpacityForItem(item2, percent);
 }
 
-// iFFTを別スレッドで開始
+// 位相相関の key（画像の世代と位置）。calc_iFFT と先読みで共通
+static QString ifftKey(quint64 gen, cv::Point pos1, cv::Point pos2)
+{
+    return QString("ifft:%1:%2,%3:%4,%5").arg(gen).arg(pos1.x).arg(pos1.y).arg(pos2.x).arg(pos2.y);
+}
+
+// 位置・画像が変わった。今の先読みは止め、しばらく動かなければ新しい位置で始める
+void MainWindow::scheduleSpeculation()
+{
+    cancelSpeculation();
+    if (item1 && item2 && actSpeculate->isChecked()) speculateTimer->start();
+}
+
+void MainWindow::cancelSpeculation()
+{
+    speculateTimer->stop();
+    if (!speculateAdopted && jobs->isActive(speculateJob)) jobs->cancel(speculateJob);
+    speculateJob = 0;
+    speculateKey.clear();
+    speculateReady = false;
+    speculateAdopted = false;
+}
+
+// 今の位置の位相相関を低優先度で求めておく（Calc. と同じ入力・同じ処理なので結果も同じ）
+void MainWindow::startSpeculation()
+{
+    if (!item1 || !item2 || !actSpeculate->isChecked()) return;
+    if (jobs->isActive(stitchJob) || jobs->isActive(ssimJob)) return; // ボタンの処理を優先
+
+    const AlignSource input1{src1, region1, tiled1, gray1};
+    const AlignSource input2{src2, region2, tiled2, gray2};
+    const cv::Point pos1 = floorPoint(item1->pos());
+    const cv::Point pos2 = floorPoint(item2->pos());
+    const QString key = ifftKey(sceneGen, pos1, pos2);
+
+    JobEngine::Spec spec;
+    spec.title = "先読み: 位相相関";
+    spec.priority = JobEngine::Priority::Low;
+    spec.work = [input1, input2, pos1, pos2](JobEngine::Context& ctx) -> std::any {
+        return runPhaseAlign(input1, input2, pos1, pos2, [&ctx]() { return ctx.isCanceled(); });
+    };
+    spec.onFinished = [this, key](const std::any& r) {
+        if (key != speculateKey) return; // 動かした・画像が変わった
+        speculateResult = std::any_cast<return_struct1>(r);
+        speculateReady = true;
+    };
+    speculateKey = key;
+    speculateJob = jobs->submit(spec);
+}
+
+// iFFTをジョブで開始（位置合わせ → 検証SSIM の連鎖）
 void MainWindow::calc_iFFT()
 {
     // 画像があるか判定
@@ -699,129 +882,108 @@ void MainWindow::calc_iFFT()
         return;
     }
 
-    // 画像データをOpenCV向けに変換
-    cv::Mat mat1, mat2;
-    QImage img_QI = item1->pixmap().toImage();
-    mat1 = qimage_to_mat_bgra(img_QI);   // CV_8UC4 (BGRA)
-    img_QI = item2->pixmap().toImage();
-    mat2 = qimage_to_mat_bgra(img_QI);
-
-    // 入力をコピーしておく（別スレッドで安全に使うため）
-    cv::Mat input1 = mat1.clone();
-    cv::Mat input2 = mat2.clone();
+    // 画像データ（共有のみ。別スレッドでは読み取り専用）。重なりの範囲だけ使う
+    const AlignSource input1{src1, region1, tiled1, gray1};
+    const AlignSource input2{src2, region2, tiled2, gray2};
 
     // その他の入力値を取得
-    QSize px1 = item1->pixmap().size();
-    QPointF pos1f = item1->pos();
-    QSize px2 = item2->pixmap().size();
-    QPointF pos2f = item2->pos();
-
-    // 位置を負の無限大方向へ丸め
-    QPoint pos1(
-        static_cast<int>(std::floor(pos1f.x())),
-        static_cast<int>(std::floor(pos1f.y()))
-        );
-    QPoint pos2(
-        static_cast<int>(std::floor(pos2f.x())),
-        static_cast<int>(std::floor(pos2f.y()))
-        );
+    const cv::Point pos1 = floorPoint(item1->pos());
+    const cv::Point pos2 = floorPoint(item2->pos());
+    const quint64 gen = sceneGen;
+    recorder.record("ifft", QJsonObject{{"pos1", SessionRecorder::point(pos1)}, {"pos2", SessionRecorder::point(pos2)}});
+
+    // 位置合わせ（同じ画像・同じ位置の先読みがあればその結果を使う）
+    JobEngine::Spec align;
+    align.title = "位相相関";
+    align.key = ifftKey(gen, pos1, pos2);
+    align.priority = JobEngine::Priority::High;
+    if (speculateKey == align.key && speculateReady) {
+        align.title = "位相相関（先読み済み）";
+        align.work = [r = speculateResult](JobEngine::Context&) -> std::any { return r; };
+    } else if (speculateKey == align.key && jobs->info(speculateJob).state == JobEngine::State::Running) {
+        // 実行中の先読みの完了を待つ（この後に動かしても先読みは止めない）
+        speculateAdopted = true;
+        align.title = "位相相関（先読み中）";
+        align.dependsOn = {speculateJob};
+        align.work = [](JobEngine::Context& ctx) -> std::any { return ctx.inputs[0]; };
+    } else {
+        // 待機中の先読みは低優先度のまま後回しになるので、止めて高優先度で求め直す
+        // （待つと、先読みがキャンセルされた時に Calc. も連鎖して止まる）
+        cancelSpeculation();
+        align.work = [input1, input2, pos1, pos2](JobEngine::Context&) -> std::any {
+            // ここは別スレッド。UI触らない。
+            return runPhaseAlign(input1, input2, pos1, pos2);
+        };
+    }
+    align.onFinished = [this, gen](const std::any& r) {
+        if (gen != sceneGen) return; // 画像が差し替えられた
+        iFFT_finish(std::any_cast<return_struct1>(r));
+    };
+    const JobEngine::JobId alignId = jobs->submit(align);
+
+    // 検証（求めた位置でのSSIM）
+    JobEngine::Spec verify;
+    verify.title = "SSIM検証";
+    verify.key = align.key + ":verify";
+    verify.priority = JobEngine::Priority::High;
+    verify.dependsOn = {alignId};
+    verify.work = [input1, input2](JobEngine::Context& ctx) -> std::any {
+        const std::optional<double> v = runVerifySsim(input1, input2, std::any_cast<return_struct1>(ctx.inputs[0]));
+        return v ? std::any(*v) : std::any(); // 重なり無し
+    };
+    verify.onFinished = [this, gen](const std::any& r) {
+        if (gen != sceneGen || !r.has_value()) return;
+        ui->label_7->setText(QString::number(std::any_cast<double>(r)));
+    };
+    jobs->submit(verify);
+}
 
-    // QtConcurrentで別スレッド実行
-    auto future = QtConcurrent::run([input1, input2, px1, pos1, px2, pos2]() -> return_struct1 {
-        // ここは別スレッド。UI触らない。
-
-        // 重なり領域をcropして取り出す。
-        return_struct2 r_st = Crop_2ImageTo2Image(input1, input2, px1, pos1, px2, pos2);
-        cv::Mat crop1 = r_st.img1;
-        cv::Mat crop2 = r_st.img2;
-
-        /*
-        cv::imshow("crop1",crop1);
-        cv::imshow("crop2",crop2);
-        cv::waitKey(0);
-        */
-
-        if (crop1.rows == 0) {
-            return_struct1 r;
-            r.score = 0;
-            r.x = 0;
-            r.y = 0;
-            return r;
+// 自動配置：縮小した全体の位相相関でおおよその位置を求め、その位置から calc_iFFT で詰める
+void MainWindow::autoPlace()
+{
+    if (!item1 || item1->pixmap().isNull() ||
+        !item2 || item2->pixmap().isNull()) {
+        QMessageBox::warning(this, "OpenCV", "Calc. need two images.");
+        return;
+    }
+    cancelSpeculation();
+
+    const AlignSource input1{src1, region1, tiled1, gray1};
+    const AlignSource input2{src2, region2, tiled2, gray2};
+    const quint64 gen = sceneGen;
+    recorder.record("auto");
+
+    JobEngine::Spec spec;
+    spec.title = "自動配置";
+    spec.key = QString("auto:%1").arg(gen);
+    spec.priority = JobEngine::Priority::High;
+    spec.work = [input1, input2](JobEngine::Context&) -> std::any {
+        return runCoarsePlacement(input1, input2);
+    };
+    spec.onFinished = [this, gen](const std::any& r) {
+        if (gen != sceneGen) return; // 画像が差し替えられた
+        const return_struct1 res = std::any_cast<return_struct1>(r);
+        if (res.score == 0) {
+            QMessageBox::warning(this, "自動配置", "画像間の重なりが見つけられませんでした。");
+            return;
         }
-
-        // 以下、計算
-        cv::Mat1f a = clahe_then_grad(crop1);
-        cv::Mat1f b = clahe_then_grad(crop2);
-
-        // 位相相関法による位置合わせ
-        double response = 0.0;
-        cv::Point2d shift = cv::phaseCorrelate(a, b, cv::noArray(), &response);
-
-        // 四捨五入
-        cv::Point2d shift_r(std::round(shift.x), std::round(shift.y));
-
-        // 2枚目画像の位置計算
-        int x_r = pos2.x() - pos1.x() - shift_r.x;
-        int y_r = pos2.y() - pos1.y() - shift_r.y;
-
-        return_struct1 r;
-        r.score = response;
-        r.x = x_r;
-        r.y = y_r;
-
-        return r;
-    });
-
-    m_ifftWatcher.setFuture(future);
-
-    // 例: UIを一時無効化など（任意）
-    // ui->btnStart->setEnabled(false);
-
+        statusBar()->showMessage(QString("自動配置: (%1, %2)、縮小画像の NCC %3").arg(res.x).arg(res.y).arg(res.score, 0, 'f', 3), 5000);
+        item1->setPos(0, 0);
+        item2->setPos(res.x, res.y);
+        calc_iFFT(); // 等倍で詰める
+    };
+    jobs->submit(spec);
 }
 
-void MainWindow::iFFT_finish()
+void MainWindow::iFFT_finish(const return_struct1& result)
 {
-    return_struct1 result = m_ifftWatcher.result();
     ui->label_5->setText(QString::number(result.score));
 
     if (result.score != 0) {
+        hasIfft = true;
+        lastIfft = result;
         item1->setPos(0, 0);
         item2->setPos(result.x, result.y);
-
-        // SSIM計算
-        // 画像データをOpenCV向けに変換
-        cv::Mat mat1, mat2;
-        QImage img_QI = item1->pixmap().toImage();
-        mat1 = qimage_to_mat_bgra(img_QI);   // CV_8UC4 (BGRA)
-        img_QI = item2->pixmap().toImage();
-        mat2 = qimage_to_mat_bgra(img_QI);
-
-        // 入力をコピーしておく（別スレッドで安全に使うため）
-        cv::Mat input1 = mat1.clone();
-        cv::Mat input2 = mat2.clone();
-
-        // その他の入力値を取得
-        QSize px1 = item1->pixmap().size();
-        QPointF pos1f = item1->pos();
-        QSize px2 = item2->pixmap().size();
-        QPointF pos2f = item2->pos();
-
-        // 位置を負の無限大方向へ丸め
-        QPoint pos1(
-            static_cast<int>(std::floor(pos1f.x())),
-            static_cast<int>(std::floor(pos1f.y()))
-            );
-        QPoint pos2(
-            static_cast<int>(std::floor(pos2f.x())),
-            static_cast<int>(std::floor(pos2f.y()))
-            );
-
-
-        SSIM_TaskInput ssim_input_one{input1,input2,px1,pos1,px2,pos2,0,0};
-
-        double score_now = SSIM_calc_oneshot(ssim_input_one);
-        ui->label_7->setText(QString::number(score_now));
-
     } else {
         QMessageBox::warning(this, "Calc. iFFT", "画像間の重なりが見つけられませんでした。");
     }
@@ -835,42 +997,100 @@ void MainWindow::stitch_image12() {
         QMessageBox::warning(this, "PNG export", "結合には画像が2枚必要です。");
         return;
     }
+    if ((src1.empty() && !tiled1) || (src2.empty() && !tiled2)) {
+        QMessageBox::warning(this, "PNG export", "画像の読み込み中です。完了後に結合してください。");
+        return;
+    }
+    if (jobs->isActive(stitchJob)) return; // 連打防止
+    cancelSpeculation(); // 結合に CPU を回す
+
+    const StitchImage input1 = src1;
+    const StitchImage input2 = src2;
+    const cv::Point pos1 = floorPoint(item1->pos());
+    const cv::Point pos2 = floorPoint(item2->pos());
+    const quint64 gen = sceneGen;
+    recorder.record("stitch", QJsonObject{{"pos1", SessionRecorder::point(pos1)}, {"pos2", SessionRecorder::point(pos2)}});
+
+    JobEngine::Spec spec;
+    spec.title = "結合";
+    spec.priority = JobEngine::Priority::Normal;
+    spec.work = [input1, input2, t1 = tiled1, t2 = tiled2, pos1, pos2](JobEngine::Context&) -> std::any {
+        cv::Point2d shiftV(pos1.x - pos2.x, pos1.y - pos2.y);
+
+        RenderedImage r;
+        if (t1 || t2) {
+            // 圧縮して保持している側があれば、キャンバスの帯ごとに必要なタイルだけ展開して合成し、結果も圧縮する
+            const std::shared_ptr<const TiledImage> a = t1 ? t1 : TiledImage::compress(input1);
+            const std::shared_ptr<const TiledImage> b = t2 ? t2 : TiledImage::compress(input2);
+            if (a->type() == b->type()) {
+                r.tiled = make_canvas_feather_tiled(*a, *b, pos2 - pos1, /*featherRadius=*/80.0f);
+            } else {
+                // 深さ・チャンネル数が違えば全体を展開して揃える
+                const StitchImage full1 = a->read(cv::Rect(cv::Point(0, 0), a->size()));
+                const StitchImage full2 = b->read(cv::Rect(cv::Point(0, 0), b->size()));
+                r.tiled = TiledImage::compress(make_canvas_bgra_feather_dt(full1, full2, shiftV, /*featherRadius=*/80.0f));
+            }
+            r.display = tiledPreview(*r.tiled);
+            return r;
+        }
+        r.image = make_canvas_bgra_feather_dt(input1, input2, shiftV, /*featherRadius=*/80.0f);
+        r.display = displayImageFor(r.image);
+        return r;
+    };
+    spec.onFinished = [this, gen](const std::any& r) {
+        if (gen != sceneGen) {
+            statusBar()->showMessage("画像が変更されたため、結合結果を破棄しました。", 5000);
+            return;
+        }
+        stitch_finish(std::any_cast<RenderedImage>(r));
+    };
+    stitchJob = jobs->submit(spec);
+}
 
-    // OpenCV形式へ画像を変換
-    cv::Mat mat1, mat2;
-    QImage img_QI = item1->pixmap().toImage();
-    mat1 = qimage_to_mat_bgra(img_QI);
-    img_QI = item2->pixmap().toImage();
-    mat2 = qimage_to_mat_bgra(img_QI);
-
-    QPointF pos1f = item1->pos();
-    QPointF pos2f = item2->pos();
-
-    // 位置を負の無限大方向へ丸め
-    QPoint pos1(
-        static_cast<int>(std::floor(pos1f.x())),
-        static_cast<int>(std::floor(pos1f.y()))
-        );
-    QPoint pos2(
-        static_cast<int>(std::floor(pos2f.x())),
-        static_cast<int>(std::floor(pos2f.y()))
-        );
-
-    cv::Point2d shiftV(pos1.x() - pos2.x(), pos1.y() - pos2.y());
-
-    cv::Mat output = make_canvas_bgra_feather_dt(mat1, mat2, shiftV, /*featherRadius=*/80.0f);
-    //cv::imshow("test", output);
-    //cv::waitKey(0);
-
+void MainWindow::stitch_finish(const RenderedImage& result)
+{
     // item1へ結合画像を代入
-    QImage qimg(output.data, output.cols, output.rows, output.step, QImage::Format_ARGB32);
-    QPixmap px = QPixmap::fromImage(qimg.copy());
-    item1->setPixmap(px);
+    src1 = result.image;
+    tiled1 = result.tiled;
+    showRendered(item1, result);
     item1->setPos(0, 0);
 
     // item2を初期化
     delete item2;
     item2 = nullptr;
+    src2 = StitchImage();
+    tiled2.reset();
+    pyr1.reset();
+    pyr2.reset();
+    gray1.reset();
+    gray2.reset();
+    region1.reset();
+    region2.reset();
+    cacheKey1.clear();
+    cacheKey2.clear();
+    stitched1 = true;
+    sceneGen++;
+    hasIfft = hasSsim = false;
+    cancelSpeculation();
+    requestOverlay();
+
+    // 結合結果もキャッシュへ（プロジェクトから開けるように）。圧縮して保持している結果は展開しない
+    if (!tiled1) {
+        precomputeImage(src1);
+
+        JobEngine::Spec cache;
+        cache.title = "キャッシュ保存";
+        cache.priority = JobEngine::Priority::Low;
+        const StitchImage image = src1;
+        cache.work = [image](JobEngine::Context&) -> std::any {
+            const QString key = cacheKeyForImage(image);
+            return storeCachedImage(key, image) ? key : QString();
+        };
+        cache.onFinished = [this, data = image.pixels.data](const std::any& r) {
+            if (src1.pixels.data == data) cacheKey1 = std::any_cast<QString>(r);
+        };
+        jobs->submit(cache);
+    }
 
     // 透明度を初期化
     ui->sliderOpacity1->setValue(0);
@@ -886,9 +1106,12 @@ void MainWindow::png_export() {
     } else if (item1 == nullptr && item2 != nullptr) {
         QMessageBox::warning(this, "PNG export", "何かがおかしいようです。");
         return;
-    } else if (item1 != nullptr && item2 != nullptr) {
+    } else if (item1 != nullptr && item2 != nullptr && !jobs->isActive(stitchJob)) {
         QMessageBox::warning(this, "PNG export", "先に画像を結合してください。");
         return;
+    } else if (src1.empty() && !tiled1 && !jobs->isActive(stitchJob)) {
+        QMessageBox::warning(this, "PNG export", "画像の読み込み中です。");
+        return;
     }
 
     QFileInfo fi(exp_png1);
@@ -908,31 +1131,37 @@ void MainWindow::png_export() {
     {
         return;
     }
-
-    QImage img = item1->pixmap().toImage();   // RGBA保持
-    img.save(newpath, "PNG");
-}
-
-// SSIM 各スレッドのデータ構造化
-static return_struct1 SSIM_calc_oneshot_struct(const SSIM_TaskInput& in)
-{
-    return_struct1 r;
-    r.x = in.pos2.x() - in.pos1.x() + in.dx;
-    r.y = in.pos2.y() - in.pos1.y() + in.dy;
-    r.score = SSIM_calc_oneshot(in); // double を返す純計算
-    return r;
-}
-
-// スコア最大だけ保持
-static void SSIM_calc_reduceMax(return_struct1& acc, const return_struct1& v)
-{
-    if (v.score > acc.score) acc = v;
+    recorder.record("export", QJsonObject{{"path", newpath}});
+
+    // 元の深さ・チャンネル数のまま書き出す。結合中ならその完了に続けて実行
+    JobEngine::Spec spec;
+    spec.title = "書き出し: " + QFileInfo(newpath).fileName();
+    spec.priority = JobEngine::Priority::Normal;
+    RenderedImage current;
+    current.image = src1;
+    current.tiled = tiled1;
+    if (jobs->isActive(stitchJob)) {
+        spec.dependsOn = {stitchJob};
+        spec.work = [newpath](JobEngine::Context& ctx) -> std::any {
+            return saveStitchImage(newpath, expandRendered(std::any_cast<RenderedImage>(ctx.inputs[0])));
+        };
+    } else {
+        spec.work = [newpath, current](JobEngine::Context&) -> std::any {
+            return saveStitchImage(newpath, expandRendered(current)); // 圧縮して保持していればここで一時的に展開
+        };
+    }
+    spec.onFinished = [this](const std::any& r) {
+        if (!std::any_cast<bool>(r)) QMessageBox::warning(this, "PNG export", "書き出しに失敗しました。");
+    };
+    jobs->submit(spec);
 }
 
 void MainWindow::calc_SSIM() {
-    if (m_ssimWatcher.isRunning()) return; // 連打防止
+    if (jobs->isActive(ssimJob)) return; // 連打防止
 
     int i_pix = ui->spinBoxSSIM->value();
+    const int topK = ui->spinTopK->value();
+    const int mode = ui->comboSearch->currentIndex();
 
     // 画像があるか判定
     if (!item1 || item1->pixmap().isNull() ||
@@ -941,69 +1170,77 @@ void MainWindow::calc_SSIM() {
         return;
     }
 
-    // 画像データをOpenCV向けに変換
-    QImage img1 = item1->pixmap().toImage();
-    QImage img2 = item2->pixmap().toImage();
+    cancelSpeculation(); // 探索に CPU を回す
 
-    cv::Mat mat1 = qimage_to_mat_bgra(img1); // CV_8UC4
-    cv::Mat mat2 = qimage_to_mat_bgra(img2);
-
-    // 入力をコピーしておく（別スレッドで安全に使うため）
-    cv::Mat input1 = mat1.clone();
-    cv::Mat input2 = mat2.clone();
+    // 画像データ（共有のみ。別スレッドでは読み取り専用）。重なり + 探索範囲だけ使う
+    const AlignSource input1{src1, region1, tiled1, gray1};
+    const AlignSource input2{src2, region2, tiled2, gray2};
 
     // その他の入力値を取得
-    QSize px1 = item1->pixmap().size();
-    QPointF pos1f = item1->pos();
-    QSize px2 = item2->pixmap().size();
-    QPointF pos2f = item2->pos();
-
-    // 位置を負の無限大方向へ丸め
-    QPoint pos1(
-        static_cast<int>(std::floor(pos1f.x())),
-        static_cast<int>(std::floor(pos1f.y()))
-        );
-    QPoint pos2(
-        static_cast<int>(std::floor(pos2f.x())),
-        static_cast<int>(std::floor(pos2f.y()))
-        );
-
-    // 入力変数群を用意
-    const int N = (2 * i_pix + 1) * (2 * i_pix + 1);
-    QVector<SSIM_TaskInput> inputs;
-    inputs.reserve(N);
+    const cv::Point pos1 = floorPoint(item1->pos());
+    const cv::Point pos2 = floorPoint(item2->pos());
+    const quint64 gen = sceneGen;
+    recorder.record("ssim", QJsonObject{
+        {"pos1", SessionRecorder::point(pos1)},
+        {"pos2", SessionRecorder::point(pos2)},
+        {"radius", i_pix},
+        {"search", mode == 2 ? "topk" : mode == 1 ? "surface" : "exhaustive"},
+        {"k", topK},
+    });
 
-    for (int ix = -i_pix; ix <= i_pix; ++ix) {
-        for (int iy = -i_pix; iy <= i_pix; ++iy) {
-            inputs.push_back(SSIM_TaskInput{input1, input2, px1, pos1, px2, pos2, ix, iy});
-        }
+    JobEngine::Spec spec;
+    spec.priority = JobEngine::Priority::High;
+
+    if (mode == 2) {
+        // 位相ピーク：上位 K 個のピーク（折り返し含む）の ±1px だけ SSIM で確認
+        spec.title = QString("位相ピーク探索 (K=%1)").arg(topK);
+        spec.work = [input1, input2, pos1, pos2, topK](JobEngine::Context&) -> std::any {
+            return runTopKSearch(input1, input2, pos1, pos2, topK);
+        };
+        spec.onFinished = [this, gen](const std::any& r) {
+            if (gen != sceneGen) return; // 画像が差し替えられた
+            ssim_finish(std::any_cast<return_struct1>(r));
+        };
+        ssimJob = jobs->submit(spec);
+        return;
     }
 
-    ssim_inputs_save = inputs;
-
-    // 集約まで含めて並列実行（戻り値は return_struct1 1個）
-    QFuture<return_struct1> future = QtConcurrent::mappedReduced(
-        inputs,
-        SSIM_calc_oneshot_struct,
-        SSIM_calc_reduceMax,
-        QtConcurrent::UnorderedReduce  // 順序不要ならこれが速いことが多い
-        );
-
-    // watcherへ
-    m_ssimWatcher.setFuture(future);
-
-    // UIは開始時にロック（任意）
-    //ui->runButton->setEnabled(false);
+    if (mode == 1) {
+        // 相関面：±i_pix の NCC を一括で求め、最良位置だけ SSIM で確認
+        spec.title = QString("相関面探索 (±%1 px)").arg(i_pix);
+        spec.work = [input1, input2, pos1, pos2, i_pix](JobEngine::Context& ctx) -> std::any {
+            return runSurfaceSearch(input1, input2, pos1, pos2, i_pix, [&ctx]() { return ctx.isCanceled(); });
+        };
+        spec.onFinished = [this, gen](const std::any& r) {
+            if (gen != sceneGen) return; // 画像が差し替えられた
+            const auto res = std::any_cast<std::pair<return_struct1, double>>(r);
+            if (res.first.score != 0) {
+                statusBar()->showMessage(QString("相関面の最大 NCC: %1").arg(res.second, 0, 'f', 4), 5000);
+            }
+            ssim_finish(res.first);
+        };
+        ssimJob = jobs->submit(spec);
+        return;
+    }
 
+    spec.title = QString("SSIM探索 (±%1 px)").arg(i_pix);
+    spec.work = [input1, input2, pos1, pos2, i_pix](JobEngine::Context& ctx) -> std::any {
+        return runSsimSearch(input1, input2, pos1, pos2, i_pix, [&ctx]() { return ctx.isCanceled(); });
+    };
+    spec.onFinished = [this, gen](const std::any& r) {
+        if (gen != sceneGen) return; // 画像が差し替えられた
+        ssim_finish(std::any_cast<return_struct1>(r));
+    };
+    ssimJob = jobs->submit(spec);
 }
 
-void MainWindow::ssim_finish()
+void MainWindow::ssim_finish(const return_struct1& result)
 {
-    return_struct1 result = m_ssimWatcher.future().result();
-
     ui->label_7->setText(QString::number(result.score));
 
     if (result.score != 0) {
+        hasSsim = true;
+        lastSsim = result;
         item1->setPos(0, 0);
         item2->setPos(result.x, result.y);
         ui->label_5->setText(QString("-"));
@@ -1011,3 +1248,162 @@ void MainWindow::ssim_finish()
         QMessageBox::warning(this, "Calc. SSIM", "画像間の重なりが見つけられませんでした。");
     }
 }
+
+void MainWindow::clearImages()
+{
+    delete item1;
+    delete item2;
+    item1 = item2 = nullptr;
+    src1 = src2 = StitchImage();
+    tiled1.reset();
+    tiled2.reset();
+    pyr1.reset();
+    pyr2.reset();
+    gray1.reset();
+    gray2.reset();
+    region1.reset();
+    region2.reset();
+    exp_png1.clear();
+    exp_png2.clear();
+    cacheKey1.clear();
+    cacheKey2.clear();
+    stitched1 = false;
+    hasIfft = hasSsim = false;
+    sceneGen++;
+    cancelSpeculation();
+    ui->label_5->clear();
+    ui->label_7->clear();
+    requestOverlay();
+}
+
+void MainWindow::saveProject()
+{
+    if (item1 == nullptr) {
+        QMessageBox::warning(this, "プロジェクト", "保存できる画像がありません。");
+        return;
+    }
+    if (stitched1 && tiled1) {
+        QMessageBox::warning(this, "プロジェクト", "圧縮して保持している結合結果はキャッシュへ保存しないため、プロジェクトに保存できません。先に書き出してください。");
+        return;
+    }
+    if (stitched1 && cacheKey1.isEmpty()) {
+        QMessageBox::warning(this, "プロジェクト", "結合結果をキャッシュへ保存中です。完了後にもう一度保存してください。");
+        return;
+    }
+
+    const QString initial = QFileInfo(exp_png1).dir().filePath(QFileInfo(exp_png1).completeBaseName() + ".istproj");
+    const QString path = QFileDialog::getSaveFileName(this, "プロジェクトを保存", initial,
+                                                      "Stitch Project (*.istproj);;All Files (*.*)");
+    if (path.isEmpty()) return;
+
+    ProjectData data;
+    data.tiles.push_back(ProjectTile{stitched1 ? QString() : exp_png1, exp_png1, cacheKey1, item1->pos(), item1->zValue()});
+    if (item2) data.tiles.push_back(ProjectTile{exp_png2, exp_png2, cacheKey2, item2->pos(), item2->zValue()});
+    data.hasIfft = hasIfft;
+    data.ifft = lastIfft;
+    data.hasSsim = hasSsim;
+    data.ssim = lastSsim;
+    data.searchRadius = ui->spinBoxSSIM->value();
+
+    if (!::saveProject(path, data)) QMessageBox::warning(this, "プロジェクト", "保存に失敗しました。");
+}
+
+void MainWindow::openProject()
+{
+    const QString path = QFileDialog::getOpenFileName(this, "プロジェクトを開く", QString(),
+                                                      "Stitch Project (*.istproj);;All Files (*.*)");
+    if (path.isEmpty()) return;
+
+    ProjectData data;
+    QString error;
+    if (!loadProject(path, &data, &error)) {
+        QMessageBox::warning(this, "プロジェクト", "開けませんでした: " + error);
+        return;
+    }
+    if (data.tiles.isEmpty()) return;
+    if (data.tiles.size() > 2) data.tiles = data.tiles.mid(0, 2); // 入力は2枚まで
+    recorder.record("project", QJsonObject{{"path", path}});
+
+    clearImages();
+
+    // キャッシュがあればメモリマップ、無ければ元ファイルからデコード
+    JobEngine::Spec spec;
+    spec.title = "プロジェクト読み込み: " + QFileInfo(path).fileName();
+    spec.priority = JobEngine::Priority::Normal;
+    spec.work = [tiles = data.tiles](JobEngine::Context&) -> std::any {
+        return QtConcurrent::blockingMapped<QList<RenderedImage>>(tiles, [](const ProjectTile& t) {
+            RenderedImage r;
+            r.image = loadCachedImage(t.cacheKey);
+            r.cacheKey = t.cacheKey;
+            if (r.image.empty() && !t.path.isEmpty()) r.image = loadStitchImageCached(t.path, &r.cacheKey);
+            if (!r.image.empty()) r.display = displayImageFor(r.image);
+            return r;
+        });
+    };
+    const quint64 gen = sceneGen;
+    spec.onFinished = [this, data, gen](const std::any& r) {
+        if (gen != sceneGen) return; // 読み込み中に画像が追加された
+
+        const auto images = std::any_cast<QList<RenderedImage>>(r);
+        QStringList names;
+        for (const ProjectTile& t : data.tiles) names << t.name;
+        placeImages(names, images);
+
+        // 配置と結果を復元（読めなかった画像は詰めて配置されている）
+        QList<ProjectTile> placed;
+        for (int i = 0; i < images.size(); ++i) {
+            if (!images[i].image.empty()) placed.push_back(data.tiles[i]);
+        }
+        QGraphicsPixmapItem *items[2] = {item1, item2};
+        for (int i = 0; i < placed.size() && items[i]; ++i) {
+            items[i]->setPos(placed[i].pos);
+            items[i]->setZValue(placed[i].z);
+            z_value = std::max(z_value, (int)std::ceil(placed[i].z));
+        }
+        stitched1 = item1 && !placed.isEmpty() && placed[0].path.isEmpty();
+
+        ui->spinBoxSSIM->setValue(data.searchRadius);
+        hasIfft = data.hasIfft;
+        lastIfft = data.ifft;
+        hasSsim = data.hasSsim;
+        lastSsim = data.ssim;
+        if (hasIfft) ui->label_5->setText(QString::number(lastIfft.score));
+        if (hasSsim) ui->label_7->setText(QString::number(lastSsim.score));
+        requestLiveScore();
+    };
+    jobs->submit(spec);
+}
+
+// R x C のタイルスキャンを行ごとに位置合わせ・合成し、そのまま BigTIFF へ書き出す
+void MainWindow::gridMosaic()
+{
+    GridDialog dlg(this);
+    if (dlg.exec() != QDialog::Accepted) return;
+    const GridSpec spec = dlg.spec();
+
+    JobEngine::Spec job;
+    job.title = QString("グリッド結合 (%1 x %2)").arg(spec.rows).arg(spec.cols);
+    job.priority = JobEngine::Priority::Normal;
+    QPointer<MainWindow> self(this);
+    job.work = [spec, self](JobEngine::Context& ctx) -> std::any {
+        return runGridMosaic(spec, [&ctx]() { return ctx.isCanceled(); }, [self, rows = spec.rows](int r) {
+            QMetaObject::invokeMethod(self, [self, r, rows]() {
+                if (self) self->statusBar()->showMessage(QString("グリッド結合: %1 / %2 行").arg(r + 1).arg(rows));
+            }, Qt::QueuedConnection);
+        });
+    };
+    job.onFinished = [this](const std::any& r) {
+        const GridResult res = std::any_cast<GridResult>(r);
+        if (!res.ok) {
+            QMessageBox::warning(this, "グリッド結合", res.error);
+            return;
+        }
+        QString msg = QString("グリッド結合: %1 x %2 px を書き出しました（%3 ペア中 %4 を公称位置に補正）")
+                          .arg(res.size.width).arg(res.size.height).arg(res.pairs).arg(res.rejected);
+        statusBar()->showMessage(msg, 10000);
+    };
+    job.onFailed = [this](const QString& error) {
+        QMessageBox::warning(this, "グリッド結合", error);
+    };
+    jobs->submit(job);
+}
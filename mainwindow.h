@@ -5,10 +5,18 @@
 #include <QGraphicsView>
 #include <QGraphicsScene>
 #include <QLabel>
-#include <QFutureWatcher>
+#include <QImage>
 
 #include <opencv2/core.hpp>
 
+#include "stitchcore.h"
+#include "jobengine.h"
+#include "livealign.h"
+#include "overlaypreview.h"
+#include "sessionlog.h"
+
+#include <memory>
+
 QT_BEGIN_NAMESPACE
 namespace Ui {
 class MainWindow;
@@ -16,28 +24,19 @@ class MainWindow;
 QT_END_NAMESPACE
 
 class QLabel;
-
-struct return_struct1 {
-    double score = 0.0;
-    int x = 0;
-    int y = 0;
-};
-
-struct return_struct2 {
-    cv::Mat img1;
-    cv::Mat img2;
-};
-
-// SSIM 1スレッドの入力
-struct SSIM_TaskInput {
-    cv::Mat input1;
-    cv::Mat input2;
-    QSize px1;
-    QPoint pos1;
-    QSize px2;
-    QPoint pos2;
-    int dx;
-    int dy;
+class JobPanel;
+class QCheckBox;
+class QAction;
+class QTimer;
+class TiffRegionReader;
+class TiledImage;
+
+// ジョブで作った画像（元データ + 表示用）
+struct RenderedImage {
+    StitchImage image;
+    QImage display;
+    QString cacheKey; // デコード済みキャッシュのキー（無ければ空）
+    std::shared_ptr<TiledImage> tiled; // 圧縮して保持する時はこちら（image は空、display は縮小版）
 };
 
 class MainWindow : public QMainWindow
@@ -48,17 +47,22 @@ public:
     MainWindow(QWidget *parent = nullptr);
     ~MainWindow();
 
+    // 操作の記録を始める（--record / ファイルメニュー）
+    bool startRecording(const QString& path);
+
 private slots:
     void Image_in_clicked();
     void Front_Back();
     void onOpacity1Changed(int percent);
     void onOpacity2Changed(int percent);
     void calc_iFFT(); // ボタンを押した時に実行
-    void iFFT_finish(); // 計算完了時に実行
+    void autoPlace(); // 自動配置ボタン（粗い配置 → calc_iFFT）
     void stitch_image12(); // 結合ボタンを押した時に実行
     void png_export(); // exportボタンを押した時に実行
     void calc_SSIM(); // ボタンを押した時に実行
-    void ssim_finish(); // 計算完了時に実行
+    void openProject();
+    void saveProject();
+    void gridMosaic();
 
 private:
     Ui::MainWindow *ui;
@@ -69,15 +73,78 @@ private:
 
     // ファイルインプット
     void File_input(QStringList);
+    void placeImages(const QStringList& paths, const QList<RenderedImage>& images,
+                     const QList<std::shared_ptr<TiffRegionReader>>& readers = {}); // 読み込み完了時に実行
+    QList<std::shared_ptr<TiffRegionReader>> placePlaceholders(const QStringList& paths,
+                                                               QList<std::shared_ptr<TiffRegionReader>> readers);
+
+    // 計算完了時に実行
+    void iFFT_finish(const return_struct1& result);
+    void ssim_finish(const return_struct1& result);
+    void stitch_finish(const RenderedImage& result);
 
     // inputファイル名
     QString exp_png1;
     QString exp_png2;
 
+    // デコード済みキャッシュのキー（item1 / item2 に対応）。item1 が結合結果なら stitched1
+    QString cacheKey1;
+    QString cacheKey2;
+    bool stitched1 = false;
+
+    // 直近の位置合わせ結果（プロジェクトに保存）
+    bool hasIfft = false;
+    return_struct1 lastIfft;
+    bool hasSsim = false;
+    return_struct1 lastSsim;
+
+    // 画像を全て取り除く
+    void clearImages();
+
     // 画像データの保持
     QGraphicsPixmapItem *item1 = nullptr;
     QGraphicsPixmapItem *item2 = nullptr;
 
+    // 元の深さ・チャンネル数の画像データ（item1 / item2 に対応）
+    StitchImage src1;
+    StitchImage src2;
+
+    // 部分読み込みできる TIFF（全体デコードが終わるまでは src が空で、位置合わせはここから読む）
+    std::shared_ptr<TiffRegionReader> region1;
+    std::shared_ptr<TiffRegionReader> region2;
+
+    // 圧縮して保持している画像（src は空。位置合わせ・結合・表示は必要なタイルだけ展開する）
+    std::shared_ptr<TiledImage> tiled1;
+    std::shared_ptr<TiledImage> tiled2;
+    void showRendered(QGraphicsPixmapItem *item, const RenderedImage& image);
+
+    // 画像データの世代。差し替え・削除のたびに進め、古いジョブ結果を捨てる
+    quint64 sceneGen = 0;
+
+    // 画像アイテムの作成（移動・リリースを通知）
+    QGraphicsPixmapItem *addTileItem(const QPixmap& pix);
+
+    // ドラッグ中の即時スコア
+    LiveAligner *live = nullptr;
+    QLabel *liveLabel = nullptr;
+    QCheckBox *snapCheck = nullptr;
+    std::shared_ptr<const LivePyramid> pyr1; // src1 / src2 の縮小ピラミッド
+    std::shared_ptr<const LivePyramid> pyr2;
+    std::shared_ptr<const StitchImage> gray1; // src1 / src2 の位置合わせ用グレースケール（alignGrayImage）
+    std::shared_ptr<const StitchImage> gray2;
+    int liveBudget = 1 << 16; // 1回の評価画素数（処理時間に合わせて調整）
+    bool snapPending = false;
+    void precomputeImage(const StitchImage& img); // 縮小ピラミッド・位置合わせ用グレースケールを低優先度で
+    void requestLiveScore();
+    void onLiveScored(const LiveScore& score);
+
+    // 重なりの確認表示（差分・チェッカー・疑似カラー）。表示範囲だけを表示倍率に合った段で作る
+    OverlayRenderer *overlay = nullptr;
+    QGraphicsPixmapItem *overlayItem = nullptr;
+    OverlayMode overlayMode = OverlayMode::Off;
+    void requestOverlay();
+    void onOverlayRendered(const OverlayResult& result);
+
     // 画像データの削除
     void deleteSelectedItems();
 
@@ -88,14 +155,30 @@ private:
     // 透明度制御
     void setOpacityForItem(QGraphicsPixmapItem *item, int percent);
 
-    // iFFTの戻り値
-    QFutureWatcher<return_struct1> m_ifftWatcher;
-
-    // SSIMの戻り値
-    QFutureWatcher<return_struct1> m_ssimWatcher;
-
-    // SSIM入力値を保存
-    QVector<SSIM_TaskInput> ssim_inputs_save;
+    // 操作の記録（性能の回帰確認用。--replay で再生）
+    SessionRecorder recorder;
+    QAction *actRecord = nullptr;
+
+    // 重い処理は全てジョブとして実行
+    JobEngine *jobs = nullptr;
+    JobPanel *jobPanel = nullptr;
+
+    // 実行中のジョブ（連打防止・連鎖用）
+    JobEngine::JobId ssimJob = 0;
+    JobEngine::JobId stitchJob = 0;
+
+    // 位相相関の先読み（画像を動かし終えてしばらくしたら、その位置の結果を低優先度で求めておく）
+    // Calc. が同じ位置・同じ画像で押されたら、完了済みならその結果を使い、実行中なら完了を待つ
+    QAction *actSpeculate = nullptr;
+    QTimer *speculateTimer = nullptr;
+    JobEngine::JobId speculateJob = 0;
+    QString speculateKey;          // 対象（calc_iFFT の key と同じ形式）
+    bool speculateReady = false;
+    bool speculateAdopted = false; // Calc. が完了を待っている（動かしても止めない）
+    return_struct1 speculateResult;
+    void scheduleSpeculation();
+    void startSpeculation();
+    void cancelSpeculation();
 };
 
 class MyGraphicsView : public QGraphicsView
@@ -0,0 +1,214 @@
+#include "overlaypreview.h"
+
+#include <QPointer>
+#include <QRunnable>
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/core.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+// ピラミッドが無いなどで、これより大きな範囲になる時は作らない
+static constexpr double kMaxOverlayPixels = 8.0 * 1024 * 1024;
+
+struct OverlayRenderer::Cache {
+    OverlayMode mode = OverlayMode::Off;
+    const uchar *data1 = nullptr;
+    const uchar *data2 = nullptr;
+    cv::Point pos1, pos2;
+    int level = -1;
+    int cell = 0;
+    cv::Rect rect;      // 段の座標（1枚目基準）
+    cv::Mat4b image;
+};
+
+// a から b を除いた部分（最大4つの帯）
+static std::vector<cv::Rect> subtractRect(const cv::Rect& a, const cv::Rect& b)
+{
+    const cv::Rect i = a & b;
+    if (i.empty()) return {a};
+
+    std::vector<cv::Rect> r;
+    const cv::Rect parts[] = {
+        cv::Rect(a.x, a.y, a.width, i.y - a.y),
+        cv::Rect(a.x, i.br().y, a.width, a.br().y - i.br().y),
+        cv::Rect(a.x, i.y, i.x - a.x, i.height),
+        cv::Rect(i.br().x, i.y, a.br().x - i.br().x, i.height),
+    };
+    for (const cv::Rect& p : parts) {
+        if (!p.empty()) r.push_back(p);
+    }
+    return r;
+}
+
+// 段 level の範囲 rect（1枚目の段の座標）を dst（BGRA）へ描く。2枚目は 1枚目から d ずれている
+static void renderRegion(const OverlayRequest& req, int level, cv::Point d, int cell,
+                         const cv::Rect& rect, cv::Mat4b dst)
+{
+    cv::Mat1b g1, m1, g2, m2;
+    livePyramidRoi(req.src1, req.pyr1.get(), level, rect, g1, m1);
+    livePyramidRoi(req.src2, req.pyr2.get(), level, rect - d, g2, m2);
+
+    cv::Mat1b alpha;
+    if (!m1.empty() && !m2.empty()) cv::bitwise_and(m1, m2, alpha);
+    else if (!m1.empty()) alpha = m1;
+    else if (!m2.empty()) alpha = m2;
+    else alpha = cv::Mat1b(rect.size(), 255);
+
+    switch (req.mode) {
+    case OverlayMode::Difference: {
+        // 差の絶対値（ずれが見やすいよう 2倍）
+        cv::Mat1b t;
+        cv::absdiff(g1, g2, t);
+        t.convertTo(t, CV_8U, 2.0);
+        const cv::Mat ch[] = {t, t, t, alpha};
+        cv::merge(ch, 4, dst);
+        break;
+    }
+    case OverlayMode::FalseColor: {
+        // 1枚目をマゼンタ、2枚目を緑に。一致していればグレー
+        const cv::Mat ch[] = {g1, g2, g1, alpha};
+        cv::merge(ch, 4, dst);
+        break;
+    }
+    case OverlayMode::Checker: {
+        // 升目は段の座標に固定（帯ごとに描いても継ぎ目が出ない）
+        cv::Mat1b c(rect.size());
+        for (int y = 0; y < rect.height; ++y) {
+            const int cy = (rect.y + y) / cell;
+            const uchar *p1 = g1.ptr<uchar>(y);
+            const uchar *p2 = g2.ptr<uchar>(y);
+            uchar *out = c.ptr<uchar>(y);
+            for (int x = 0; x < rect.width;) {
+                const int cx = (rect.x + x) / cell;
+                const int end = std::min(rect.width, (cx + 1) * cell - rect.x);
+                const uchar *src = ((cx + cy) & 1) ? p2 : p1;
+                std::memcpy(out + x, src + x, size_t(end - x));
+                x = end;
+            }
+        }
+        const cv::Mat ch[] = {c, c, c, alpha};
+        cv::merge(ch, 4, dst);
+        break;
+    }
+    case OverlayMode::Off:
+        break;
+    }
+}
+
+static OverlayResult renderOverlay(const OverlayRequest& req, OverlayRenderer::Cache& cache)
+{
+    OverlayResult res;
+    res.data1 = req.src1.pixels.data;
+    res.data2 = req.src2.pixels.data;
+    if (req.mode == OverlayMode::Off || req.src1.empty() || req.src2.empty()) return res;
+
+    const cv::Rect ov = cv::Rect(req.pos1, req.src1.size()) & cv::Rect(req.pos2, req.src2.size()) & req.view;
+    if (ov.empty()) return res;
+
+    // 段の 1画素が画面の 1画素を超えない最も粗い段
+    const int maxLevel = (req.pyr1 && req.pyr2)
+                             ? (int)std::min(req.pyr1->gray.size(), req.pyr2->gray.size()) : 0;
+    int level = 0;
+    while (level < maxLevel && double(1 << (level + 1)) * req.zoom <= 1.0) ++level;
+    const int sc = 1 << level;
+    if ((double)pixelCount(ov) / double(sc * sc) > kMaxOverlayPixels) {
+        res.pending = true;
+        return res;
+    }
+
+    auto levelSize = [&](const StitchImage& src, const LivePyramid *pyr) {
+        return level == 0 ? src.size() : pyr->gray[level - 1].size();
+    };
+    const cv::Size ls1 = levelSize(req.src1, req.pyr1.get());
+    const cv::Size ls2 = levelSize(req.src2, req.pyr2.get());
+
+    // 1枚目の段の座標で範囲を決める（2枚目は段の画素単位に丸めたずれ d）
+    const cv::Point d((int)std::lround(double(req.pos2.x - req.pos1.x) / sc),
+                      (int)std::lround(double(req.pos2.y - req.pos1.y) / sc));
+    const int x0 = (ov.x - req.pos1.x) / sc;
+    const int y0 = (ov.y - req.pos1.y) / sc;
+    const int x1 = (ov.br().x - req.pos1.x + sc - 1) / sc;
+    const int y1 = (ov.br().y - req.pos1.y + sc - 1) / sc;
+    const cv::Rect rect = cv::Rect(x0, y0, x1 - x0, y1 - y0)
+                          & cv::Rect(cv::Point(0, 0), ls1) & cv::Rect(d, ls2);
+    if (rect.empty()) return res;
+
+    const int cell = std::max(1, (int)std::lround(req.checkerPx / (req.zoom * sc)));
+
+    // 前回と同じ条件なら重なる部分を使い回し、新しく見えた帯だけ描く
+    cv::Mat4b image(rect.size());
+    const bool reuse = cache.level == level && cache.mode == req.mode &&
+                       cache.data1 == res.data1 && cache.data2 == res.data2 &&
+                       cache.pos1 == req.pos1 && cache.pos2 == req.pos2 &&
+                       (req.mode != OverlayMode::Checker || cache.cell == cell);
+    std::vector<cv::Rect> todo{rect};
+    if (reuse) {
+        const cv::Rect keep = rect & cache.rect;
+        if (!keep.empty()) {
+            cache.image(keep - cache.rect.tl()).copyTo(image(keep - rect.tl()));
+            todo = subtractRect(rect, keep);
+        }
+    }
+    for (const cv::Rect& r : todo) renderRegion(req, level, d, cell, r, image(r - rect.tl()));
+
+    cache.mode = req.mode;
+    cache.data1 = res.data1;
+    cache.data2 = res.data2;
+    cache.pos1 = req.pos1;
+    cache.pos2 = req.pos2;
+    cache.level = level;
+    cache.cell = cell;
+    cache.rect = rect;
+    cache.image = image;
+
+    // BGRA のメモリ配置は QImage::Format_ARGB32 と同じ
+    res.image = QImage(image.data, image.cols, image.rows, (qsizetype)image.step, QImage::Format_ARGB32).copy();
+    res.origin = req.pos1 + rect.tl() * sc;
+    res.scale = sc;
+    res.valid = true;
+    return res;
+}
+
+OverlayRenderer::OverlayRenderer(QObject *parent) : QObject(parent), cache_(std::make_shared<Cache>())
+{
+    pool_.setMaxThreadCount(1);
+}
+
+OverlayRenderer::~OverlayRenderer()
+{
+    pool_.waitForDone();
+}
+
+void OverlayRenderer::request(const OverlayRequest& req)
+{
+    if (running_) {
+        // 実行中なら最新の要求だけ残す
+        pending_ = req;
+        hasPending_ = true;
+        return;
+    }
+    start(req);
+}
+
+void OverlayRenderer::start(const OverlayRequest& req)
+{
+    running_ = true;
+    QPointer<OverlayRenderer> self(this);
+    pool_.start(QRunnable::create([self, req, cache = cache_]() {
+        const OverlayResult r = renderOverlay(req, *cache);
+        if (!self) return;
+        QMetaObject::invokeMethod(self, [self, r]() {
+            if (!self) return;
+            self->running_ = false;
+            emit self->rendered(r);
+            if (self->hasPending_) {
+                self->hasPending_ = false;
+                self->start(self->pending_);
+            }
+        }, Qt::QueuedConnection);
+    }));
+}
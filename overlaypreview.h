@@ -0,0 +1,62 @@
+#ifndef OVERLAYPREVIEW_H
+#define OVERLAYPREVIEW_H
+
+#include <QObject>
+#include <QThreadPool>
+#include <QImage>
+
+#include "livealign.h"
+
+#include <memory>
+
+// 重なり確認の表示方法
+enum class OverlayMode { Off, Difference, Checker, FalseColor };
+
+// 1回分の入力（表示範囲と拡大率に合わせた段で、表示中の重なりだけ作る）
+struct OverlayRequest {
+    OverlayMode mode = OverlayMode::Off;
+    StitchImage src1, src2;
+    std::shared_ptr<const LivePyramid> pyr1, pyr2;
+    cv::Point pos1, pos2;
+    cv::Rect view;              // 表示中のシーン範囲
+    double zoom = 1.0;          // 画面 px / シーン px
+    int checkerPx = 32;         // チェッカーの升目（画面 px）
+};
+
+struct OverlayResult {
+    bool valid = false;
+    bool pending = false;       // ピラミッド準備中で作れなかった
+    QImage image;               // ARGB32（重なり外・無効画素は透明）
+    cv::Point origin;           // image の左上（シーン座標）
+    int scale = 1;              // image 1画素のシーン px（= 2^level）
+    const uchar *data1 = nullptr; // 作った時の src1 / src2（差し替え検出用）
+    const uchar *data2 = nullptr;
+};
+
+// 最新の要求だけを別スレッドで処理する
+// 直前と同じ段・位置・表示方法なら、パンで新しく見えた帯だけ計算して前回の結果を使い回す
+class OverlayRenderer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit OverlayRenderer(QObject *parent = nullptr);
+    ~OverlayRenderer() override;
+
+    void request(const OverlayRequest& req);
+
+    struct Cache; // 前回の結果（作業スレッドだけが触る）
+
+signals:
+    void rendered(const OverlayResult& result);
+
+private:
+    void start(const OverlayRequest& req);
+
+    QThreadPool pool_;
+    std::shared_ptr<Cache> cache_;
+    bool running_ = false;
+    bool hasPending_ = false;
+    OverlayRequest pending_;
+};
+
+#endif // OVERLAYPREVIEW_H
@@ -0,0 +1,102 @@
+#include "projectfile.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+
+static constexpr int kProjectVersion = 1;
+
+static QJsonObject resultToJson(const return_struct1& r)
+{
+    return QJsonObject{{"score", r.score}, {"x", r.x}, {"y", r.y}};
+}
+
+static return_struct1 resultFromJson(const QJsonObject& o)
+{
+    return_struct1 r;
+    r.score = o.value("score").toDouble();
+    r.x = o.value("x").toInt();
+    r.y = o.value("y").toInt();
+    return r;
+}
+
+bool saveProject(const QString& path, const ProjectData& data)
+{
+    // 画像パスはプロジェクトからの相対で保存（フォルダごと移動しても開ける）
+    const QDir base = QFileInfo(path).absoluteDir();
+
+    QJsonArray tiles;
+    for (const ProjectTile& t : data.tiles) {
+        tiles.append(QJsonObject{
+            {"path", t.path.isEmpty() ? QString() : base.relativeFilePath(t.path)},
+            {"name", t.name},
+            {"cacheKey", t.cacheKey},
+            {"x", t.pos.x()},
+            {"y", t.pos.y()},
+            {"z", t.z},
+        });
+    }
+
+    QJsonObject root{
+        {"version", kProjectVersion},
+        {"tiles", tiles},
+        {"searchRadius", data.searchRadius},
+    };
+    if (data.hasIfft) root.insert("ifft", resultToJson(data.ifft));
+    if (data.hasSsim) root.insert("ssim", resultToJson(data.ssim));
+
+    QSaveFile f(path);
+    if (!f.open(QIODevice::WriteOnly)) return false;
+    f.write(QJsonDocument(root).toJson());
+    return f.commit();
+}
+
+bool loadProject(const QString& path, ProjectData *data, QString *error)
+{
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly)) {
+        if (error) *error = "ファイルを開けません。";
+        return false;
+    }
+
+    QJsonParseError pe;
+    const QJsonDocument doc = QJsonDocument::fromJson(f.readAll(), &pe);
+    if (doc.isNull() || !doc.isObject()) {
+        if (error) *error = pe.errorString();
+        return false;
+    }
+
+    const QJsonObject root = doc.object();
+    if (root.value("version").toInt() > kProjectVersion) {
+        if (error) *error = "新しいバージョンのプロジェクトです。";
+        return false;
+    }
+
+    const QDir base = QFileInfo(path).absoluteDir();
+
+    ProjectData d;
+    for (const QJsonValue& v : root.value("tiles").toArray()) {
+        const QJsonObject o = v.toObject();
+        ProjectTile t;
+        const QString rel = o.value("path").toString();
+        t.path = rel.isEmpty() ? QString() : QDir::cleanPath(base.absoluteFilePath(rel));
+        t.name = o.value("name").toString();
+        t.cacheKey = o.value("cacheKey").toString();
+        t.pos = QPointF(o.value("x").toDouble(), o.value("y").toDouble());
+        t.z = o.value("z").toDouble();
+        d.tiles.push_back(t);
+    }
+
+    d.searchRadius = root.value("searchRadius").toInt(d.searchRadius);
+    d.hasIfft = root.contains("ifft");
+    if (d.hasIfft) d.ifft = resultFromJson(root.value("ifft").toObject());
+    d.hasSsim = root.contains("ssim");
+    if (d.hasSsim) d.ssim = resultFromJson(root.value("ssim").toObject());
+
+    *data = d;
+    return true;
+}
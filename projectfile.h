@@ -0,0 +1,33 @@
+#ifndef PROJECTFILE_H
+#define PROJECTFILE_H
+
+#include "stitchcore.h"
+
+#include <QList>
+#include <QPointF>
+#include <QString>
+
+// プロジェクトファイル（JSON）
+// 画像のパス・配置と、位置合わせの結果を保存する。画素はキャッシュ（imagecache）から開く
+
+struct ProjectTile {
+    QString path;      // 元ファイル（結合結果なら空）
+    QString name;      // 書き出し名の元になるファイル名
+    QString cacheKey;  // デコード済みキャッシュのキー
+    QPointF pos;
+    qreal z = 0;
+};
+
+struct ProjectData {
+    QList<ProjectTile> tiles;
+    bool hasIfft = false;
+    return_struct1 ifft;   // 位相相関の結果（1枚目基準の 2枚目位置）
+    bool hasSsim = false;
+    return_struct1 ssim;   // SSIM探索の結果
+    int searchRadius = 10;
+};
+
+bool saveProject(const QString& path, const ProjectData& data);
+bool loadProject(const QString& path, ProjectData *data, QString *error = nullptr);
+
+#endif // PROJECTFILE_H
@@ -0,0 +1,242 @@
+#include "sessionlog.h"
+#include "alignops.h"
+#include "imagecache.h"
+#include "imageio.h"
+#include "projectfile.h"
+#include "simdkernels.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QSaveFile>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QtConcurrent/QtConcurrent>
+
+#include <exception>
+#include <stdexcept>
+#include <vector>
+
+static constexpr int kSessionVersion = 1;
+
+bool SessionRecorder::open(const QString& path)
+{
+    close();
+    file_.setFileName(path);
+    if (!file_.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) return false;
+    timer_.start();
+    record("session", QJsonObject{
+        {"version", kSessionVersion},
+        {"started", QDateTime::currentDateTime().toString(Qt::ISODate)},
+    });
+    return true;
+}
+
+void SessionRecorder::close()
+{
+    if (file_.isOpen()) file_.close();
+}
+
+void SessionRecorder::record(const QString& op, QJsonObject args)
+{
+    if (!file_.isOpen()) return;
+    args.insert("t", timer_.elapsed());
+    args.insert("op", op);
+    file_.write(QJsonDocument(args).toJson(QJsonDocument::Compact));
+    file_.write("\n");
+    file_.flush(); // 異常終了しても途中までは残す
+}
+
+QJsonArray SessionRecorder::point(cv::Point p)
+{
+    return QJsonArray{p.x, p.y};
+}
+
+namespace {
+
+cv::Point pointFromJson(const QJsonValue& v)
+{
+    const QJsonArray a = v.toArray();
+    return cv::Point(a.at(0).toInt(), a.at(1).toInt());
+}
+
+// 再生中の状態（GUI の item1 / item2 に対応）
+struct ReplayState {
+    StitchImage src[2];
+    cv::Point pos[2];
+
+    // GUI と同じく空いている方へ入れる（2枚を超える分は捨てる）
+    void place(const StitchImage& img)
+    {
+        if (img.empty()) return;
+        if (src[0].empty()) { src[0] = img; pos[0] = cv::Point(0, 0); }
+        else if (src[1].empty()) { src[1] = img; pos[1] = cv::Point(0, 0); }
+    }
+    void clear() { src[0] = src[1] = StitchImage(); }
+};
+
+// 1ステップの結果
+struct StepResult {
+    QString op;
+    double ms = 0.0;
+    QString detail;
+    QJsonObject json;
+};
+
+} // namespace
+
+int replaySession(const QString& path, const ReplayOptions& opt)
+{
+    QTextStream out(stdout);
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        QTextStream(stderr) << "記録を開けません: " << path << Qt::endl;
+        return 1;
+    }
+
+    QTemporaryDir tmp;
+    const QString outDir = opt.outDir.isEmpty() ? tmp.path() : opt.outDir;
+    QDir().mkpath(outDir);
+
+    ReplayState st;
+    std::vector<StepResult> steps;
+    int lineNo = 0;
+    double totalMs = 0.0;
+
+    while (!f.atEnd()) {
+        const QByteArray line = f.readLine().trimmed();
+        ++lineNo;
+        if (line.isEmpty()) continue;
+
+        QJsonParseError pe;
+        const QJsonDocument doc = QJsonDocument::fromJson(line, &pe);
+        if (!doc.isObject()) {
+            QTextStream(stderr) << QString("%1 行目: %2").arg(lineNo).arg(pe.errorString()) << Qt::endl;
+            return 1;
+        }
+        const QJsonObject o = doc.object();
+        const QString op = o.value("op").toString();
+        if (op == "session") {
+            if (o.value("version").toInt() > kSessionVersion) {
+                QTextStream(stderr) << "新しいバージョンの記録です。" << Qt::endl;
+                return 1;
+            }
+            continue;
+        }
+
+        // ボタンを押した時点の位置を復元
+        if (o.contains("pos1")) st.pos[0] = pointFromJson(o.value("pos1"));
+        if (o.contains("pos2")) st.pos[1] = pointFromJson(o.value("pos2"));
+
+        StepResult r;
+        r.op = op;
+        r.json = QJsonObject{{"line", lineNo}, {"op", op}};
+        const AlignSource a{st.src[0], {}};
+        const AlignSource b{st.src[1], {}};
+        auto alignResult = [&r](const return_struct1& res) {
+            r.json.insert("score", res.score);
+            r.json.insert("x", res.x);
+            r.json.insert("y", res.y);
+            r.detail = QString("score %1 @ (%2, %3)").arg(res.score, 0, 'f', 6).arg(res.x).arg(res.y);
+        };
+
+        QElapsedTimer t;
+        t.start();
+        try {
+            if (op == "load") {
+                QStringList paths;
+                for (const QJsonValue& v : o.value("paths").toArray()) paths << v.toString();
+                const QList<StitchImage> imgs = QtConcurrent::blockingMapped<QList<StitchImage>>(paths, [](const QString& p) {
+                    StitchImage img = loadStitchImageCached(p);
+                    if (!img.empty()) toDisplayImage(img); // GUI と同じく表示用も作る
+                    return img;
+                });
+                for (const StitchImage& img : imgs) st.place(img);
+                r.detail = QString("%1 枚").arg(paths.size());
+            } else if (op == "project") {
+                ProjectData data;
+                QString error;
+                if (!loadProject(o.value("path").toString(), &data, &error)) throw std::runtime_error(error.toStdString());
+                st.clear();
+                for (int i = 0; i < data.tiles.size() && i < 2; ++i) {
+                    const ProjectTile& tile = data.tiles[i];
+                    StitchImage img = loadCachedImage(tile.cacheKey);
+                    if (img.empty() && !tile.path.isEmpty()) img = loadStitchImageCached(tile.path);
+                    st.place(img);
+                }
+            } else if (st.src[0].empty() && op != "delete" && op != "front_back") {
+                r.detail = "画像が無いので省略";
+            } else if (op == "ifft") {
+                const return_struct1 res = runPhaseAlign(a, b, st.pos[0], st.pos[1]);
+                const std::optional<double> verify = runVerifySsim(a, b, res);
+                alignResult(res);
+                if (verify) {
+                    r.json.insert("verify", *verify);
+                    r.detail += QString(", SSIM %1").arg(*verify, 0, 'f', 6);
+                }
+                if (res.score != 0) { st.pos[0] = cv::Point(0, 0); st.pos[1] = cv::Point(res.x, res.y); }
+            } else if (op == "auto") {
+                const return_struct1 res = runCoarsePlacement(a, b);
+                alignResult(res);
+                if (res.score != 0) { st.pos[0] = cv::Point(0, 0); st.pos[1] = cv::Point(res.x, res.y); }
+            } else if (op == "ssim") {
+                const int radius = o.value("radius").toInt();
+                return_struct1 res;
+                const QString search = o.value("search").toString();
+                if (search == "surface") res = runSurfaceSearch(a, b, st.pos[0], st.pos[1], radius, {}).first;
+                else if (search == "topk") res = runTopKSearch(a, b, st.pos[0], st.pos[1], o.value("k").toInt(4));
+                else res = runSsimSearch(a, b, st.pos[0], st.pos[1], radius, {});
+                alignResult(res);
+                if (res.score != 0) { st.pos[0] = cv::Point(0, 0); st.pos[1] = cv::Point(res.x, res.y); }
+            } else if (op == "stitch") {
+                const cv::Point2d shiftV(st.pos[0].x - st.pos[1].x, st.pos[0].y - st.pos[1].y);
+                const StitchImage res = make_canvas_bgra_feather_dt(st.src[0], st.src[1], shiftV, 80.0f);
+                toDisplayImage(res);
+                st.src[0] = res;
+                st.src[1] = StitchImage();
+                st.pos[0] = cv::Point(0, 0);
+                r.json.insert("width", res.cols());
+                r.json.insert("height", res.rows());
+                r.detail = QString("%1 x %2").arg(res.cols()).arg(res.rows());
+            } else if (op == "export") {
+                const QString dst = QDir(outDir).filePath(QFileInfo(o.value("path").toString()).fileName());
+                if (!saveStitchImage(dst, st.src[0])) throw std::runtime_error("書き出しに失敗しました");
+                r.detail = dst;
+            } else if (op == "delete") {
+                if (o.value("item").toInt() == 1) { st.src[0] = st.src[1]; st.pos[0] = st.pos[1]; }
+                st.src[1] = StitchImage();
+            } else if (op == "front_back") {
+                // 重なり順だけなので計算は無い
+            } else {
+                r.detail = "未対応の操作";
+            }
+        } catch (const std::exception& e) {
+            r.detail = QString("失敗: ") + QString::fromLocal8Bit(e.what());
+            r.json.insert("error", r.detail);
+        }
+        r.ms = t.nsecsElapsed() / 1e6;
+        r.json.insert("ms", r.ms);
+        totalMs += r.ms;
+
+        out << QString("%1  %2  %3 ms  %4").arg(lineNo, 4).arg(op, -10).arg(r.ms, 10, 'f', 1).arg(r.detail) << Qt::endl;
+        steps.push_back(r);
+    }
+    const QString isa = simdIsaName(activeSimdIsa());
+    out << QString("合計 %1 ms（%2 ステップ、SIMD: %3）").arg(totalMs, 0, 'f', 1).arg(steps.size()).arg(isa) << Qt::endl;
+
+    if (!opt.reportPath.isEmpty()) {
+        QJsonArray arr;
+        for (const StepResult& s : steps) arr.append(s.json);
+        QSaveFile rep(opt.reportPath);
+        if (!rep.open(QIODevice::WriteOnly)) return 1;
+        rep.write(QJsonDocument(QJsonObject{
+            {"session", QFileInfo(path).absoluteFilePath()},
+            {"totalMs", totalMs},
+            {"simd", isa},
+            {"steps", arr},
+        }).toJson());
+        if (!rep.commit()) return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,46 @@
+#ifndef SESSIONLOG_H
+#define SESSIONLOG_H
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QString>
+
+#include <opencv2/core.hpp>
+
+// 操作の記録と再生（性能の回帰確認用）
+// 記録は 1行 1操作の JSON（JSON Lines）。画素ではなく操作（ファイル・位置・ボタン・パラメータ）だけを残す
+//   {"t": 1234, "op": "load", "paths": [...]}
+//   {"t": 2345, "op": "ifft", "pos1": [x, y], "pos2": [x, y]}
+//   {"t": 3456, "op": "ssim", "pos1": [...], "pos2": [...], "radius": 10, "search": "exhaustive" | "surface"}
+//   {"t": 4567, "op": "stitch", "pos1": [...], "pos2": [...]}
+//   {"t": 5678, "op": "export", "path": "..."}
+//   その他: "project"（path）, "delete"（item: 1 / 2）, "front_back", "auto"（自動配置。続く位相相関は "ifft" で残る）
+class SessionRecorder
+{
+public:
+    bool open(const QString& path);
+    void close();
+    bool isOpen() const { return file_.isOpen(); }
+
+    void record(const QString& op, QJsonObject args = {});
+
+    static QJsonArray point(cv::Point p);
+
+private:
+    QFile file_;
+    QElapsedTimer timer_;
+};
+
+// 再生の設定
+struct ReplayOptions {
+    QString reportPath;     // 各ステップの時間・結果を JSON で書き出す（空なら書かない）
+    QString outDir;         // export の書き出し先（空なら一時フォルダ）
+};
+
+// 記録した操作をウィンドウ無しで順に実行し、ステップごとの時間を標準出力へ。戻り値は終了コード
+// GUI ではジョブが重なり得るが、再生は 1操作ずつ完了を待って進める（同じ作業量をビルド間で比べるため）
+int replaySession(const QString& path, const ReplayOptions& opt);
+
+#endif // SESSIONLOG_H
@@ -0,0 +1,166 @@
+#include "simdkernels.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SIMD_X86 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace {
+
+#ifdef SIMD_X86
+void cpuid(unsigned leaf, unsigned sub, unsigned r[4])
+{
+#if defined(_MSC_VER)
+    int v[4];
+    __cpuidex(v, (int)leaf, (int)sub);
+    for (int i = 0; i < 4; ++i) r[i] = (unsigned)v[i];
+#else
+    __cpuid_count(leaf, sub, r[0], r[1], r[2], r[3]);
+#endif
+}
+
+// OS がレジスタの退避に対応している状態（XCR0）
+unsigned long long xgetbv0()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    unsigned lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((unsigned long long)hi << 32) | lo;
+#endif
+}
+#endif
+
+// CPU と OS の両方が対応している最も新しい版
+SimdIsa detectCpu()
+{
+#ifdef SIMD_X86
+    unsigned r[4];
+    cpuid(0, 0, r);
+    const unsigned maxLeaf = r[0];
+    if (maxLeaf < 7) return SimdIsa::Baseline;
+
+    cpuid(1, 0, r);
+    const bool fma = r[2] & (1u << 12);
+    const bool osxsave = r[2] & (1u << 27);
+    const bool avx = r[2] & (1u << 28);
+    const bool f16c = r[2] & (1u << 29);
+    if (!osxsave || !avx) return SimdIsa::Baseline;
+
+    const unsigned long long xcr0 = xgetbv0();
+    if ((xcr0 & 0x6) != 0x6) return SimdIsa::Baseline; // XMM / YMM
+
+    cpuid(7, 0, r);
+    const bool avx2 = r[1] & (1u << 5);
+    const bool avx512 = (r[1] & (1u << 16)) && (r[1] & (1u << 17)) &&  // F, DQ
+                        (r[1] & (1u << 30)) && (r[1] & (1u << 31));    // BW, VL
+    if (!avx2 || !fma || !f16c) return SimdIsa::Baseline;
+    if (avx512 && (xcr0 & 0xE6) == 0xE6) return SimdIsa::Avx512;       // opmask / ZMM
+    return SimdIsa::Avx2;
+#else
+    return SimdIsa::Baseline;
+#endif
+}
+
+// ビルドに含まれない版は 1つ下げる
+SimdIsa clampToBuilt(SimdIsa isa)
+{
+#ifndef STITCHER_SIMD_AVX512
+    if (isa == SimdIsa::Avx512) isa = SimdIsa::Avx2;
+#endif
+#ifndef STITCHER_SIMD_AVX2
+    if (isa == SimdIsa::Avx2) isa = SimdIsa::Baseline;
+#endif
+    return isa;
+}
+
+const SimdKernels* tableFor(SimdIsa isa)
+{
+    switch (clampToBuilt(isa)) {
+#ifdef STITCHER_SIMD_AVX512
+    case SimdIsa::Avx512: return &simdKernelsAvx512();
+#endif
+#ifdef STITCHER_SIMD_AVX2
+    case SimdIsa::Avx2: return &simdKernelsAvx2();
+#endif
+    default: return &simdKernelsBaseline();
+    }
+}
+
+// 初回の選択（環境変数 STITCHER_ISA で上限を下げられる。知らない名前・対応していない版は無視）
+const SimdKernels* initialTable()
+{
+    SimdIsa isa = detectedSimdIsa();
+    SimdIsa requested;
+    const char* env = std::getenv("STITCHER_ISA");
+    if (env && *env && parseSimdIsa(env, &requested) && requested < isa) isa = requested;
+    return tableFor(isa);
+}
+
+std::atomic<const SimdKernels*> g_active{nullptr};
+
+} // namespace
+
+const SimdKernels& simdKernels()
+{
+    const SimdKernels* k = g_active.load(std::memory_order_acquire);
+    if (!k) {
+        // 同時に初回が来ても同じ表を選ぶので、先に入れた方を使う
+        const SimdKernels* expected = nullptr;
+        k = initialTable();
+        if (!g_active.compare_exchange_strong(expected, k, std::memory_order_acq_rel)) k = expected;
+    }
+    return *k;
+}
+
+SimdIsa detectedSimdIsa()
+{
+    static const SimdIsa isa = clampToBuilt(detectCpu());
+    return isa;
+}
+
+SimdIsa activeSimdIsa()
+{
+    return simdKernels().isa;
+}
+
+bool setSimdIsa(SimdIsa isa)
+{
+    if (isa > detectedSimdIsa()) return false;
+    g_active.store(tableFor(isa), std::memory_order_release);
+    return true;
+}
+
+const char* simdIsaName(SimdIsa isa)
+{
+    switch (isa) {
+    case SimdIsa::Avx512: return "avx512";
+    case SimdIsa::Avx2: return "avx2";
+    default:
+#ifdef SIMD_X86
+        return "sse2";
+#else
+        return "generic";
+#endif
+    }
+}
+
+bool parseSimdIsa(const char* name, SimdIsa* isa)
+{
+    if (!name) return false;
+    if (!std::strcmp(name, "avx512")) *isa = SimdIsa::Avx512;
+    else if (!std::strcmp(name, "avx2")) *isa = SimdIsa::Avx2;
+    else if (!std::strcmp(name, "sse2") || !std::strcmp(name, "baseline") || !std::strcmp(name, "generic"))
+        *isa = SimdIsa::Baseline;
+    else return false;
+    return true;
+}
@@ -0,0 +1,67 @@
+#ifndef SIMDKERNELS_H
+#define SIMDKERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// 命令セットごとにビルドした SIMD カーネルの表（実行時に CPU を調べて 1つ選ぶ）
+// - ライブラリ本体は既定の命令セット（x86-64 なら SSE2）でビルドし、AVX2 / AVX-512 の版だけを
+//   それぞれのフラグでビルドする（simdkernels_<isa>.cpp）。同じ実行ファイルが古い CPU でも動く
+// - 最初に使う時に、CPU が対応していてビルドにも含まれる最も新しい版を選ぶ
+//   環境変数 STITCHER_ISA（sse2 / avx2 / avx512）か setSimdIsa で、それより古い版に下げられる
+// - 版によって float の丸めが違う（FMA の有無・総和の順）ので、SSIM・位相相関の前処理は最下位ビットで変わることがある
+//   フェザーの重み・マスクの詰め替えはどの版でも同じ結果
+enum class SimdIsa { Baseline, Avx2, Avx512 };
+
+struct SimdKernels {
+    SimdIsa isa;
+
+    // 分離型畳み込み（SSIM は 11タップ、位相相関の前処理は 9タップ）
+    // 水平: dst[x] = Σ w[k] * src[x + k]、垂直: dst[x] = Σ w[k] * rows[k][x]
+    void (*convRow9)(const float* src, float* dst, int n, const float* w);
+    void (*convCol9)(const float* const* rows, float* dst, int n, const float* w);
+    void (*convRow11)(const float* src, float* dst, int n, const float* w);
+    void (*convCol11)(const float* const* rows, float* dst, int n, const float* w);
+
+    // 1行分の SSIM の総和。mom は μ1, μ2, E[a²], E[b²], E[ab] の行（1画素の SSIM は 1 で抑える）
+    double (*ssimRowSum)(const float* const* mom, int n, float C1, float C2);
+
+    // Sobel(3x3) x/y → 勾配強度。up/mid/dn は左右に 1画素ずつ折り返し済み（[-1, n]）
+    // 戻り値は総和、*sumSq に二乗和を足す
+    double (*sobelMagRow)(const float* up, const float* mid, const float* dn, float* dst, int n, double* sumSq);
+    // p[x] = (p[x] - mean) * scale * wc[x]（標準化と Hanning窓）
+    void (*windowRow)(float* p, const float* wc, int n, float mean, float scale);
+    // FP16（IEEE half のビット列）の 1行の書き出し・読み込み。F16C の無い版は nullptr（呼び出し側で変換する）
+    void (*storeRowF16)(uint16_t* dst, const float* src, int n, float scale);
+    void (*loadRowF16)(const uint16_t* src, float* dst, int n);
+
+    // u8 BGRA の 1行 → alpha >= thr を 255、それ以外を 0
+    void (*alphaMaskRow)(const uint8_t* bgra, uint8_t* dst, int n, uint8_t thr);
+    // 1行の非0 を 1 としてビット詰め（BitMask の行。余りビットは 0）
+    void (*packMaskRow)(const uint8_t* src, uint64_t* dst, int n);
+    // a[i] &= b[i]
+    void (*andWords)(uint64_t* a, const uint64_t* b, size_t n);
+    // フェザーの重み: s = d1 + d2 が eps 未満なら 0.5 ずつ、それ以外は d1 / s, d2 / s
+    void (*featherWeightsRow)(const float* d1, const float* d2, float* w1, float* w2, int n, float eps);
+};
+
+// 今の表（初回に選ぶ。以降は setSimdIsa で替えない限り同じ）
+const SimdKernels& simdKernels();
+
+// CPU が対応していてビルドにも含まれる最も新しい版
+SimdIsa detectedSimdIsa();
+SimdIsa activeSimdIsa();
+// 使う版を替える（detectedSimdIsa より新しい版は選べず false）。表は行の帯ごとに引き直すので、処理の合間に替えること
+bool setSimdIsa(SimdIsa isa);
+
+// "sse2"（x86 以外は "generic"）/ "avx2" / "avx512"
+const char* simdIsaName(SimdIsa isa);
+// 名前から（"baseline" / "sse2" / "generic" も Baseline）。知らない名前は false
+bool parseSimdIsa(const char* name, SimdIsa* isa);
+
+// 各版の表（simdkernels_<isa>.cpp。ビルドに含まれる版だけ定義される）
+const SimdKernels& simdKernelsBaseline();
+const SimdKernels& simdKernelsAvx2();
+const SimdKernels& simdKernelsAvx512();
+
+#endif // SIMDKERNELS_H
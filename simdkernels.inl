@@ -0,0 +1,437 @@
+// SIMD カーネルの本体。simdkernels_<isa>.cpp から、その版の命令セットのフラグで 1回ずつインクルードする
+// インクルードする前に SIMD_KERNELS_NS（版ごとの名前空間）と SIMD_KERNELS_TABLE（表を返す関数名）を定義すること
+//
+// 別々のフラグでビルドした翻訳単位の間で、インライン関数・テンプレートの実体を共有してはいけない
+// （リンカがどれか 1つを残すので、古い CPU で AVX の命令を踏むことがある）。
+// そのため、ここでは STL・OpenCV のヘッダを使わず、関数は全て版ごとの無名名前空間に置く
+
+#include "simdkernels.h"
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__AVX512F__) && defined(__AVX512BW__) && defined(__AVX512VL__)
+#include <immintrin.h>
+#define SIMD_KERNELS_AVX512 1
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define SIMD_KERNELS_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SIMD_KERNELS_SSE2 1
+#endif
+
+#if defined(SIMD_KERNELS_AVX512) || defined(SIMD_KERNELS_AVX2) || defined(SIMD_KERNELS_SSE2)
+#define SIMD_KERNELS_VEC 1
+#endif
+
+namespace SIMD_KERNELS_NS {
+namespace {
+
+// ---- ベクトルの薄い抽象（vf: float x kLanes、vd: その半分の double） ----
+
+#if defined(SIMD_KERNELS_AVX512)
+typedef __m512 vf;
+typedef __m512d vd;
+constexpr int kLanes = 16;
+inline vf vload(const float* p) { return _mm512_loadu_ps(p); }
+inline void vstore(float* p, vf v) { _mm512_storeu_ps(p, v); }
+inline vf vset(float v) { return _mm512_set1_ps(v); }
+inline vf vadd(vf a, vf b) { return _mm512_add_ps(a, b); }
+inline vf vsub(vf a, vf b) { return _mm512_sub_ps(a, b); }
+inline vf vmul(vf a, vf b) { return _mm512_mul_ps(a, b); }
+inline vf vdiv(vf a, vf b) { return _mm512_div_ps(a, b); }
+inline vf vmin(vf a, vf b) { return _mm512_min_ps(a, b); }
+inline vf vsqrt(vf a) { return _mm512_sqrt_ps(a); }
+inline vf vfma(vf a, vf b, vf c) { return _mm512_fmadd_ps(a, b, c); }
+inline vf vsel_lt(vf a, vf b, vf t, vf f) { return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(a, b, _CMP_LT_OQ), f, t); }
+inline vd vd_zero() { return _mm512_setzero_pd(); }
+inline vd vd_lo(vf v) { return _mm512_cvtps_pd(_mm512_castps512_ps256(v)); }
+inline vd vd_hi(vf v) { return _mm512_cvtps_pd(_mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(v), 1))); }
+inline vd vd_add(vd a, vd b) { return _mm512_add_pd(a, b); }
+inline vd vd_fma(vd a, vd b, vd c) { return _mm512_fmadd_pd(a, b, c); }
+inline double vd_sum(vd a) { return _mm512_reduce_add_pd(a); }
+#elif defined(SIMD_KERNELS_AVX2)
+typedef __m256 vf;
+typedef __m256d vd;
+constexpr int kLanes = 8;
+inline vf vload(const float* p) { return _mm256_loadu_ps(p); }
+inline void vstore(float* p, vf v) { _mm256_storeu_ps(p, v); }
+inline vf vset(float v) { return _mm256_set1_ps(v); }
+inline vf vadd(vf a, vf b) { return _mm256_add_ps(a, b); }
+inline vf vsub(vf a, vf b) { return _mm256_sub_ps(a, b); }
+inline vf vmul(vf a, vf b) { return _mm256_mul_ps(a, b); }
+inline vf vdiv(vf a, vf b) { return _mm256_div_ps(a, b); }
+inline vf vmin(vf a, vf b) { return _mm256_min_ps(a, b); }
+inline vf vsqrt(vf a) { return _mm256_sqrt_ps(a); }
+inline vf vfma(vf a, vf b, vf c) { return _mm256_fmadd_ps(a, b, c); }
+inline vf vsel_lt(vf a, vf b, vf t, vf f) { return _mm256_blendv_ps(f, t, _mm256_cmp_ps(a, b, _CMP_LT_OQ)); }
+inline vd vd_zero() { return _mm256_setzero_pd(); }
+inline vd vd_lo(vf v) { return _mm256_cvtps_pd(_mm256_castps256_ps128(v)); }
+inline vd vd_hi(vf v) { return _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)); }
+inline vd vd_add(vd a, vd b) { return _mm256_add_pd(a, b); }
+inline vd vd_fma(vd a, vd b, vd c) { return _mm256_fmadd_pd(a, b, c); }
+inline double vd_sum(vd a)
+{
+    alignas(32) double lanes[4];
+    _mm256_store_pd(lanes, a);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+#elif defined(SIMD_KERNELS_SSE2)
+// SSE2 には FMA が無いので、積和は掛けてから足す（スカラーの式と同じ丸め）
+typedef __m128 vf;
+typedef __m128d vd;
+constexpr int kLanes = 4;
+inline vf vload(const float* p) { return _mm_loadu_ps(p); }
+inline void vstore(float* p, vf v) { _mm_storeu_ps(p, v); }
+inline vf vset(float v) { return _mm_set1_ps(v); }
+inline vf vadd(vf a, vf b) { return _mm_add_ps(a, b); }
+inline vf vsub(vf a, vf b) { return _mm_sub_ps(a, b); }
+inline vf vmul(vf a, vf b) { return _mm_mul_ps(a, b); }
+inline vf vdiv(vf a, vf b) { return _mm_div_ps(a, b); }
+inline vf vmin(vf a, vf b) { return _mm_min_ps(a, b); }
+inline vf vsqrt(vf a) { return _mm_sqrt_ps(a); }
+inline vf vfma(vf a, vf b, vf c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+inline vf vsel_lt(vf a, vf b, vf t, vf f)
+{
+    const vf m = _mm_cmplt_ps(a, b);
+    return _mm_or_ps(_mm_and_ps(m, t), _mm_andnot_ps(m, f));
+}
+inline vd vd_zero() { return _mm_setzero_pd(); }
+inline vd vd_lo(vf v) { return _mm_cvtps_pd(v); }
+inline vd vd_hi(vf v) { return _mm_cvtps_pd(_mm_movehl_ps(v, v)); }
+inline vd vd_add(vd a, vd b) { return _mm_add_pd(a, b); }
+inline vd vd_fma(vd a, vd b, vd c) { return _mm_add_pd(_mm_mul_pd(a, b), c); }
+inline double vd_sum(vd a)
+{
+    double lanes[2];
+    _mm_storeu_pd(lanes, a);
+    return lanes[0] + lanes[1];
+}
+#endif
+
+// ---- 畳み込み ----
+
+template <int Taps>
+void conv_row(const float* src, float* dst, int n, const float* w)
+{
+    int x = 0;
+#ifdef SIMD_KERNELS_VEC
+    vf wk[Taps];
+    for (int k = 0; k < Taps; ++k) wk[k] = vset(w[k]);
+    for (; x + kLanes <= n; x += kLanes) {
+        vf acc = vmul(wk[0], vload(src + x));
+        for (int k = 1; k < Taps; ++k) acc = vfma(wk[k], vload(src + x + k), acc);
+        vstore(dst + x, acc);
+    }
+#endif
+    for (; x < n; ++x) {
+        float acc = w[0] * src[x];
+        for (int k = 1; k < Taps; ++k) acc += w[k] * src[x + k];
+        dst[x] = acc;
+    }
+}
+
+template <int Taps>
+void conv_col(const float* const* rows, float* dst, int n, const float* w)
+{
+    int x = 0;
+#ifdef SIMD_KERNELS_VEC
+    vf wk[Taps];
+    for (int k = 0; k < Taps; ++k) wk[k] = vset(w[k]);
+    for (; x + kLanes <= n; x += kLanes) {
+        vf acc = vmul(wk[0], vload(rows[0] + x));
+        for (int k = 1; k < Taps; ++k) acc = vfma(wk[k], vload(rows[k] + x), acc);
+        vstore(dst + x, acc);
+    }
+#endif
+    for (; x < n; ++x) {
+        float acc = w[0] * rows[0][x];
+        for (int k = 1; k < Taps; ++k) acc += w[k] * rows[k][x];
+        dst[x] = acc;
+    }
+}
+
+void conv_row9(const float* src, float* dst, int n, const float* w) { conv_row<9>(src, dst, n, w); }
+void conv_col9(const float* const* rows, float* dst, int n, const float* w) { conv_col<9>(rows, dst, n, w); }
+void conv_row11(const float* src, float* dst, int n, const float* w) { conv_row<11>(src, dst, n, w); }
+void conv_col11(const float* const* rows, float* dst, int n, const float* w) { conv_col<11>(rows, dst, n, w); }
+
+// ---- SSIM ----
+
+// 1画素の SSIM は理論上 1 以下だが、σ² の引き算の丸めでわずかに超えることがあるので 1 で抑える
+double ssim_row_sum(const float* const* mom, int n, float C1, float C2)
+{
+    const float* mu1 = mom[0];
+    const float* mu2 = mom[1];
+    const float* e11 = mom[2];
+    const float* e22 = mom[3];
+    const float* e12 = mom[4];
+
+    double sum = 0.0;
+    int x = 0;
+#ifdef SIMD_KERNELS_VEC
+    const vf c1 = vset(C1), c2 = vset(C2), two = vset(2.0f), one = vset(1.0f);
+    vd acc0 = vd_zero(), acc1 = vd_zero();
+    for (; x + kLanes <= n; x += kLanes) {
+        const vf m1 = vload(mu1 + x);
+        const vf m2 = vload(mu2 + x);
+        const vf m11 = vmul(m1, m1);
+        const vf m22 = vmul(m2, m2);
+        const vf m12 = vmul(m1, m2);
+        const vf s11 = vsub(vload(e11 + x), m11);
+        const vf s22 = vsub(vload(e22 + x), m22);
+        const vf s12 = vsub(vload(e12 + x), m12);
+
+        const vf t1 = vfma(two, m12, c1);
+        const vf t2 = vfma(two, s12, c2);
+        const vf t3 = vadd(vadd(m11, m22), c1);
+        const vf t4 = vadd(vadd(s11, s22), c2);
+        const vf v = vmin(vdiv(vmul(t1, t2), vmul(t3, t4)), one);
+
+        acc0 = vd_add(acc0, vd_lo(v));
+        acc1 = vd_add(acc1, vd_hi(v));
+    }
+    sum = vd_sum(vd_add(acc0, acc1));
+#endif
+    for (; x < n; ++x) {
+        const float m11 = mu1[x] * mu1[x];
+        const float m22 = mu2[x] * mu2[x];
+        const float m12 = mu1[x] * mu2[x];
+        const float s11 = e11[x] - m11;
+        const float s22 = e22[x] - m22;
+        const float s12 = e12[x] - m12;
+        const float t1 = 2.0f * m12 + C1;
+        const float t2 = 2.0f * s12 + C2;
+        const float t3 = m11 + m22 + C1;
+        const float t4 = s11 + s22 + C2;
+        const float v = (t1 * t2) / (t3 * t4);
+        sum += (double)(1.0f < v ? 1.0f : v);
+    }
+    return sum;
+}
+
+// ---- 位相相関の前処理 ----
+
+double sobel_mag_row(const float* up, const float* mid, const float* dn, float* dst, int n, double* sumSq)
+{
+    double sum = 0.0;
+    int x = 0;
+#ifdef SIMD_KERNELS_VEC
+    const vf two = vset(2.0f);
+    vd s0 = vd_zero(), s1 = vd_zero();
+    vd q0 = vd_zero(), q1 = vd_zero();
+    for (; x + kLanes <= n; x += kLanes) {
+        const vf ul = vload(up + x - 1), uc = vload(up + x), ur = vload(up + x + 1);
+        const vf ml = vload(mid + x - 1), mr = vload(mid + x + 1);
+        const vf dl = vload(dn + x - 1), dc = vload(dn + x), dr = vload(dn + x + 1);
+
+        const vf gx = vfma(two, vsub(mr, ml), vadd(vsub(ur, ul), vsub(dr, dl)));
+        const vf gy = vsub(vfma(two, dc, vadd(dl, dr)), vfma(two, uc, vadd(ul, ur)));
+        const vf m = vsqrt(vfma(gx, gx, vmul(gy, gy)));
+        vstore(dst + x, m);
+
+        const vd lo = vd_lo(m);
+        const vd hi = vd_hi(m);
+        s0 = vd_add(s0, lo);
+        s1 = vd_add(s1, hi);
+        q0 = vd_fma(lo, lo, q0);
+        q1 = vd_fma(hi, hi, q1);
+    }
+    sum = vd_sum(vd_add(s0, s1));
+    *sumSq += vd_sum(vd_add(q0, q1));
+#endif
+    for (; x < n; ++x) {
+        const float gx = (up[x + 1] - up[x - 1]) + 2.0f * (mid[x + 1] - mid[x - 1]) + (dn[x + 1] - dn[x - 1]);
+        const float gy = (dn[x - 1] + 2.0f * dn[x] + dn[x + 1]) - (up[x - 1] + 2.0f * up[x] + up[x + 1]);
+        const float m = sqrtf(gx * gx + gy * gy);
+        dst[x] = m;
+        sum += m;
+        *sumSq += (double)m * m;
+    }
+    return sum;
+}
+
+void window_row(float* p, const float* wc, int n, float mean, float scale)
+{
+    int x = 0;
+#ifdef SIMD_KERNELS_VEC
+    const vf vm = vset(mean), vs = vset(scale);
+    for (; x + kLanes <= n; x += kLanes) {
+        const vf v = vmul(vsub(vload(p + x), vm), vs);
+        vstore(p + x, vmul(v, vload(wc + x)));
+    }
+#endif
+    for (; x < n; ++x) p[x] = (p[x] - mean) * scale * wc[x];
+}
+
+// F16C は AVX2 / AVX-512 の版だけ（どちらも -mf16c 付きでビルドする）
+#if defined(SIMD_KERNELS_AVX512) || defined(SIMD_KERNELS_AVX2)
+#define SIMD_KERNELS_F16 1
+
+void store_row_f16(uint16_t* dst, const float* src, int n, float scale)
+{
+    int x = 0;
+    const __m256 vs = _mm256_set1_ps(scale);
+    for (; x + 8 <= n; x += 8) {
+        const __m256 v = _mm256_mul_ps(_mm256_loadu_ps(src + x), vs);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+    }
+    for (; x < n; ++x) {
+        const __m128 v = _mm_set_ss(src[x] * scale);
+        dst[x] = (uint16_t)_mm_extract_epi16(_mm_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT), 0);
+    }
+}
+
+void load_row_f16(const uint16_t* src, float* dst, int n)
+{
+    int x = 0;
+    for (; x + 8 <= n; x += 8) {
+        _mm256_storeu_ps(dst + x, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x))));
+    }
+    for (; x < n; ++x) dst[x] = _mm_cvtss_f32(_mm_cvtph_ps(_mm_cvtsi32_si128(src[x])));
+}
+#endif
+
+// ---- マスク ----
+
+void alpha_mask_row(const uint8_t* bgra, uint8_t* dst, int n, uint8_t thr)
+{
+    int x = 0;
+#if defined(SIMD_KERNELS_AVX512)
+    const __m512i vt = _mm512_set1_epi32(thr);
+    for (; x + 16 <= n; x += 16) {
+        const __m512i a = _mm512_srli_epi32(_mm512_loadu_si512(bgra + 4 * x), 24);
+        const __mmask16 k = _mm512_cmpge_epu32_mask(a, vt);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm512_cvtepi32_epi8(_mm512_maskz_set1_epi32(k, 0xFF)));
+    }
+#elif defined(SIMD_KERNELS_AVX2)
+    // 8画素 x 4 → 32バイト（pack は 128bit ごとなので、最後に 32bit 単位で並べ直す）
+    const __m256i vt = _mm256_set1_epi32((int)thr - 1);
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    for (; x + 32 <= n; x += 32) {
+        __m256i m[4];
+        for (int i = 0; i < 4; ++i) {
+            const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bgra + 4 * (x + 8 * i)));
+            m[i] = _mm256_cmpgt_epi32(_mm256_srli_epi32(v, 24), vt);
+        }
+        const __m256i p = _mm256_packs_epi16(_mm256_packs_epi32(m[0], m[1]), _mm256_packs_epi32(m[2], m[3]));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x), _mm256_permutevar8x32_epi32(p, order));
+    }
+#elif defined(SIMD_KERNELS_SSE2)
+    const __m128i vt = _mm_set1_epi32((int)thr - 1);
+    for (; x + 16 <= n; x += 16) {
+        __m128i m[4];
+        for (int i = 0; i < 4; ++i) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bgra + 4 * (x + 4 * i)));
+            m[i] = _mm_cmpgt_epi32(_mm_srli_epi32(v, 24), vt);
+        }
+        const __m128i p = _mm_packs_epi16(_mm_packs_epi32(m[0], m[1]), _mm_packs_epi32(m[2], m[3]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), p);
+    }
+#endif
+    for (; x < n; ++x) dst[x] = bgra[4 * x + 3] >= thr ? 255 : 0;
+}
+
+// 64バイト → 非0 のバイトを 1 とした 64bit
+inline uint64_t pack_bytes64(const uint8_t* p)
+{
+#if defined(SIMD_KERNELS_AVX512)
+    const __m512i v = _mm512_loadu_si512(p);
+    return (uint64_t)_mm512_test_epi8_mask(v, v);
+#elif defined(SIMD_KERNELS_AVX2)
+    const __m256i zero = _mm256_setzero_si256();
+    uint64_t w = 0;
+    for (int i = 0; i < 2; ++i) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32 * i));
+        w |= (uint64_t)(uint32_t)~_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero)) << (32 * i);
+    }
+    return w;
+#elif defined(SIMD_KERNELS_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    uint64_t w = 0;
+    for (int i = 0; i < 4; ++i) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * i));
+        w |= (uint64_t)(~_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) & 0xFFFF) << (16 * i);
+    }
+    return w;
+#else
+    // 8バイトずつ: 各バイトの最上位ビット = 非0 を作り、8bit に集める
+    const uint64_t low7 = 0x7F7F7F7F7F7F7F7FULL;
+    uint64_t w = 0;
+    for (int b = 0; b < 8; ++b) {
+        uint64_t v;
+        memcpy(&v, p + 8 * b, 8);
+        const uint64_t nz = (((v & low7) + low7) | v) & ~low7;
+        w |= (((nz >> 7) * 0x0102040810204080ULL) >> 56) << (8 * b);
+    }
+    return w;
+#endif
+}
+
+void pack_mask_row(const uint8_t* src, uint64_t* dst, int n)
+{
+    int x = 0;
+    for (; x + 64 <= n; x += 64) dst[x >> 6] = pack_bytes64(src + x);
+    if (x < n) {
+        uint64_t w = 0;
+        for (int i = 0; x + i < n; ++i) w |= uint64_t(src[x + i] != 0) << i;
+        dst[x >> 6] = w;
+    }
+}
+
+// 単純なループ（版ごとのフラグでコンパイラがその幅でベクトル化する）
+void and_words(uint64_t* a, const uint64_t* b, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) a[i] &= b[i];
+}
+
+// ---- フェザー ----
+
+// 割り算は IEEE で正確に丸めるので、どの版でもスカラーと同じ値
+void feather_weights_row(const float* d1, const float* d2, float* w1, float* w2, int n, float eps)
+{
+    int x = 0;
+#ifdef SIMD_KERNELS_VEC
+    const vf ve = vset(eps), half = vset(0.5f);
+    for (; x + kLanes <= n; x += kLanes) {
+        const vf a = vload(d1 + x), b = vload(d2 + x);
+        const vf s = vadd(a, b);
+        vstore(w1 + x, vsel_lt(s, ve, half, vdiv(a, s)));
+        vstore(w2 + x, vsel_lt(s, ve, half, vdiv(b, s)));
+    }
+#endif
+    for (; x < n; ++x) {
+        const float s = d1[x] + d2[x];
+        if (s < eps) { w1[x] = 0.5f; w2[x] = 0.5f; }
+        else { w1[x] = d1[x] / s; w2[x] = d2[x] / s; }
+    }
+}
+
+const SimdKernels kTable = {
+#if defined(SIMD_KERNELS_AVX512)
+    SimdIsa::Avx512,
+#elif defined(SIMD_KERNELS_AVX2)
+    SimdIsa::Avx2,
+#else
+    SimdIsa::Baseline,
+#endif
+    conv_row9, conv_col9, conv_row11, conv_col11,
+    ssim_row_sum,
+    sobel_mag_row, window_row,
+#ifdef SIMD_KERNELS_F16
+    store_row_f16, load_row_f16,
+#else
+    nullptr, nullptr,
+#endif
+    alpha_mask_row, pack_mask_row, and_words,
+    feather_weights_row,
+};
+
+} // namespace
+} // namespace SIMD_KERNELS_NS
+
+const SimdKernels& SIMD_KERNELS_TABLE()
+{
+    return SIMD_KERNELS_NS::kTable;
+}
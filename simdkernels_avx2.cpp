@@ -0,0 +1,5 @@
+// SIMD カーネルの AVX2 / FMA / F16C の版（このファイルだけ -mavx2 -mfma -mf16c / MSVC は /arch:AVX2 でビルドする）
+
+#define SIMD_KERNELS_NS simd_avx2
+#define SIMD_KERNELS_TABLE simdKernelsAvx2
+#include "simdkernels.inl"
@@ -0,0 +1,5 @@
+// SIMD カーネルの AVX-512（F / BW / VL / DQ）の版（このファイルだけ -mavx512* / MSVC は /arch:AVX512 でビルドする）
+
+#define SIMD_KERNELS_NS simd_avx512
+#define SIMD_KERNELS_TABLE simdKernelsAvx512
+#include "simdkernels.inl"
@@ -0,0 +1,5 @@
+// SIMD カーネルの基本の版（既定の命令セット。x86-64 なら SSE2、それ以外はスカラー）
+
+#define SIMD_KERNELS_NS simd_baseline
+#define SIMD_KERNELS_TABLE simdKernelsBaseline
+#include "simdkernels.inl"
@@ -0,0 +1,209 @@
+#include "ssimkernel.h"
+#include "simdkernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace {
+
+constexpr int kTaps = 11;
+constexpr int kR = kTaps / 2;
+
+// getGaussianKernel(11, 1.5, CV_32F) と同じ重み（double で正規化してから float へ）
+struct GaussKernel {
+    float w[kTaps];
+    GaussKernel()
+    {
+        const double sigma = 1.5;
+        double t[kTaps], s = 0.0;
+        for (int i = 0; i < kTaps; ++i) {
+            const double x = i - kR;
+            t[i] = std::exp(-x * x / (2.0 * sigma * sigma));
+            s += t[i];
+        }
+        for (int i = 0; i < kTaps; ++i) w[i] = (float)(t[i] / s);
+    }
+};
+
+const GaussKernel& gauss()
+{
+    static const GaussKernel k;
+    return k;
+}
+
+inline int reflect101(int i, int n)
+{
+    if (i < 0) return -i;
+    if (i >= n) return 2 * n - 2 - i;
+    return i;
+}
+
+// スレッドごとの作業領域（最大幅に合わせて伸ばすだけで、縮めない＝定常状態では確保しない）
+struct Scratch {
+    std::vector<float> pad[5];   // 左右を折り返した1行（a, b, a², b², ab）
+    std::vector<float> ring[5];  // 水平方向に畳み込んだ行 x 11（行の間隔は今回の幅）
+    std::vector<float> mom[5];   // 1行分のモーメント
+    int capacity = 0;
+
+    void reserve(int W)
+    {
+        if (W <= capacity) return;
+        capacity = W;
+        for (int m = 0; m < 5; ++m) {
+            pad[m].assign((size_t)W + 2 * kR, 0.0f);
+            ring[m].assign((size_t)W * kTaps, 0.0f);
+            mom[m].assign((size_t)W, 0.0f);
+        }
+    }
+};
+
+// 入力1行 → 水平方向に畳み込んだ 5モーメントをリングの slot へ
+template <typename T>
+void horizontal_pass(const SimdKernels& K, const T* a, const T* b, int W, Scratch& s, int slot, const float* w)
+{
+    float* pa = s.pad[0].data() + kR;
+    float* pb = s.pad[1].data() + kR;
+    float* paa = s.pad[2].data() + kR;
+    float* pbb = s.pad[3].data() + kR;
+    float* pab = s.pad[4].data() + kR;
+
+    for (int x = 0; x < W; ++x) {
+        const float fa = (float)a[x];
+        const float fb = (float)b[x];
+        pa[x] = fa;
+        pb[x] = fb;
+        paa[x] = fa * fa;
+        pbb[x] = fb * fb;
+        pab[x] = fa * fb;
+    }
+
+    // BORDER_REFLECT_101（端の画素は繰り返さない）
+    for (int m = 0; m < 5; ++m) {
+        float* p = s.pad[m].data() + kR;
+        for (int k = 1; k <= kR; ++k) {
+            p[-k] = p[k];
+            p[W - 1 + k] = p[W - 1 - k];
+        }
+        K.convRow11(s.pad[m].data(), s.ring[m].data() + (size_t)slot * W, W, w);
+    }
+}
+
+template <typename T>
+double ssim_rows_impl(const T* a, size_t stepA, const T* b, size_t stepB,
+                      int W, int H, double L, int y0, int y1)
+{
+    if (y0 >= y1) return 0.0;
+
+    static thread_local Scratch s;
+    s.reserve(W);
+
+    const SimdKernels& K = simdKernels();
+    const float* w = gauss().w;
+    const float C1 = (float)((0.01 * L) * (0.01 * L));
+    const float C2 = (float)((0.03 * L) * (0.03 * L));
+
+    auto rowA = [&](int r) { return reinterpret_cast<const T*>(reinterpret_cast<const uint8_t*>(a) + stepA * (size_t)r); };
+    auto rowB = [&](int r) { return reinterpret_cast<const T*>(reinterpret_cast<const uint8_t*>(b) + stepB * (size_t)r); };
+
+    // 最初の出力行に必要な入力行（折り返し先は全て [y0-R, y0+R] ∩ [0, H) に収まる）
+    int next = std::max(0, y0 - kR);
+    const int firstNeed = std::min(H - 1, y0 + kR);
+    for (; next <= firstNeed; ++next) horizontal_pass(K, rowA(next), rowB(next), W, s, next % kTaps, w);
+
+    double sum = 0.0;
+    const float* rows[kTaps];
+    const float* mom[5] = {s.mom[0].data(), s.mom[1].data(), s.mom[2].data(), s.mom[3].data(), s.mom[4].data()};
+    for (int y = y0; y < y1; ++y) {
+        // 1行進める
+        const int need = std::min(H - 1, y + kR);
+        for (; next <= need; ++next) horizontal_pass(K, rowA(next), rowB(next), W, s, next % kTaps, w);
+
+        for (int m = 0; m < 5; ++m) {
+            for (int k = 0; k < kTaps; ++k) {
+                const int r = reflect101(y - kR + k, H);
+                rows[k] = s.ring[m].data() + (size_t)(r % kTaps) * W;
+            }
+            K.convCol11(rows, s.mom[m].data(), W, w);
+        }
+        sum += K.ssimRowSum(mom, W, C1, C2);
+    }
+    return sum;
+}
+
+} // namespace
+
+double ssim_fused_rows_u8(const uint8_t* a, size_t stepA, const uint8_t* b, size_t stepB,
+                          int width, int height, double L, int y0, int y1)
+{
+    return ssim_rows_impl(a, stepA, b, stepB, width, height, L, y0, y1);
+}
+
+double ssim_fused_rows_u16(const uint16_t* a, size_t stepA, const uint16_t* b, size_t stepB,
+                           int width, int height, double L, int y0, int y1)
+{
+    return ssim_rows_impl(a, stepA, b, stepB, width, height, L, y0, y1);
+}
+
+namespace {
+
+constexpr int kBand = 64;
+
+// 帯 i（行 [i * kBand, min(H, (i + 1) * kBand))）の SSIM の総和
+double band_sum(const cv::Mat& a, const cv::Mat& b, double L, int i)
+{
+    const int W = a.cols, H = a.rows;
+    const int y0 = i * kBand, y1 = std::min(H, y0 + kBand);
+    return a.depth() == CV_8U
+               ? ssim_fused_rows_u8(a.ptr<uint8_t>(), a.step, b.ptr<uint8_t>(), b.step, W, H, L, y0, y1)
+               : ssim_fused_rows_u16(a.ptr<uint16_t>(), a.step, b.ptr<uint16_t>(), b.step, W, H, L, y0, y1);
+}
+
+void check_inputs(const cv::Mat& a, const cv::Mat& b)
+{
+    CV_Assert(a.size() == b.size() && a.type() == b.type());
+    CV_Assert(a.type() == CV_8UC1 || a.type() == CV_16UC1);
+    CV_Assert(a.cols >= kTaps && a.rows >= kTaps);
+}
+
+} // namespace
+
+double ssim_fused(const cv::Mat& a, const cv::Mat& b, double L)
+{
+    check_inputs(a, b);
+    const int W = a.cols, H = a.rows;
+
+    // 行の帯ごとに並列（帯の境界では上下 R 行を重複して水平畳み込みする）
+    const int bands = (H + kBand - 1) / kBand;
+    cv::AutoBuffer<double, 64> partial(bands); // 帯が少なければスタック上
+
+    cv::parallel_for_(cv::Range(0, bands), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; ++i) partial[i] = band_sum(a, b, L, i);
+    });
+
+    double sum = 0.0;
+    for (int i = 0; i < bands; ++i) sum += partial[i];
+    return sum / ((double)W * (double)H);
+}
+
+double ssim_fused_bounded(const cv::Mat& a, const cv::Mat& b, double L, const std::atomic<double>& best)
+{
+    check_inputs(a, b);
+    const int W = a.cols, H = a.rows;
+    const double n = (double)W * (double)H;
+
+    // 帯の和を ssim_fused と同じ順に足す（最後まで評価すれば同じ値になる）
+    // 和の丸め誤差で正しい候補を落とさないよう、比べる時だけ少し緩める
+    constexpr double kSlack = 1e-9;
+    const int bands = (H + kBand - 1) / kBand;
+    double sum = 0.0;
+    for (int i = 0; i < bands; ++i) {
+        sum += band_sum(a, b, L, i);
+        const int rest = H - std::min(H, (i + 1) * kBand);
+        if (rest == 0) break;
+        const double upper = (sum + (double)rest * W) / n; // 残りの画素が全て 1 の場合
+        if (upper < best.load(std::memory_order_relaxed) - kSlack) return -std::numeric_limits<double>::infinity();
+    }
+    return sum / n;
+}
@@ -0,0 +1,30 @@
+#ifndef SSIMKERNEL_H
+#define SSIMKERNEL_H
+
+#include <opencv2/core.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// 1パスで SSIM の平均を求める融合カーネル
+// GaussianBlur(11x11, σ=1.5, BORDER_REFLECT_101) の 5モーメント（μ1, μ2, σ1², σ2², σ12）を
+// 行リングバッファ上の分離型畳み込みで求め、SSIM式をその場で評価して平均だけを返す（SSIMマップは作らない）
+// 畳み込みと SSIM式は、実行時に CPU に合わせて選んだ SIMD の版（simdkernels.h）で計算する
+
+// 1ch（u8 / u16、同じ型・サイズ）の SSIM 平均。L は画素値のダイナミックレンジ
+// 11x11 より小さい画像は対象外（呼び出し側で従来の実装を使う）
+double ssim_fused(const cv::Mat& a, const cv::Mat& b, double L);
+
+// 分枝限定用。64行の帯ごとに順に評価し、「残りの画素の SSIM が全て 1 でも平均が best に届かない」と
+// 分かった時点で打ち切って -inf を返す。best は評価中も他のスレッドが更新してよい（帯ごとに読み直す）
+// 最後まで評価した場合は ssim_fused と同じ値（同じ帯を同じ順に足す）。候補ごとに並列で呼ぶ前提で、中は逐次
+double ssim_fused_bounded(const cv::Mat& a, const cv::Mat& b, double L, const std::atomic<double>& best);
+
+// 生ポインタ版（行 [y0, y1) の SSIM の総和を返す。並列化・検証用）
+double ssim_fused_rows_u8(const uint8_t* a, size_t stepA, const uint8_t* b, size_t stepB,
+                          int width, int height, double L, int y0, int y1);
+double ssim_fused_rows_u16(const uint16_t* a, size_t stepA, const uint16_t* b, size_t stepB,
+                           int width, int height, double L, int y0, int y1);
+
+#endif // SSIMKERNEL_H
@@ -0,0 +1,242 @@
+#include "stitchapi.h"
+#include "stitchcore.h"
+#include "simdkernels.h"
+
+#include <opencv2/core.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <string>
+
+// 呼び出したスレッドごとの直前のエラー
+static thread_local std::string g_lastError;
+
+static int cvTypeOf(StitcherFormat f)
+{
+    switch (f) {
+    case STITCHER_GRAY8:  return CV_8UC1;
+    case STITCHER_BGR8:   return CV_8UC3;
+    case STITCHER_BGRA8:  return CV_8UC4;
+    case STITCHER_GRAY16: return CV_16UC1;
+    case STITCHER_BGR16:  return CV_16UC3;
+    case STITCHER_BGRA16: return CV_16UC4;
+    }
+    return -1;
+}
+
+static StitcherFormat formatOf(int type)
+{
+    switch (type) {
+    case CV_8UC1:  return STITCHER_GRAY8;
+    case CV_8UC3:  return STITCHER_BGR8;
+    case CV_8UC4:  return STITCHER_BGRA8;
+    case CV_16UC1: return STITCHER_GRAY16;
+    case CV_16UC3: return STITCHER_BGR16;
+    default: break;
+    }
+    return STITCHER_BGRA16;
+}
+
+static StitcherStatus fail(StitcherStatus st, const char* msg)
+{
+    g_lastError = msg;
+    return st;
+}
+
+static bool validBuffer(const StitcherBuffer* b)
+{
+    if (!b || !b->data || b->width <= 0 || b->height <= 0) return false;
+    const int type = cvTypeOf(b->format);
+    if (type < 0) return false;
+    if (b->stride < (size_t)b->width * CV_ELEM_SIZE(type)) return false;
+    if (b->mask) {
+        if (CV_MAT_CN(type) == 4 || b->maskStride < (size_t)b->width) return false;
+    }
+    return true;
+}
+
+// 呼び出し側のバッファを cv::Mat のヘッダで包む（画素はコピーしない）
+static StitchImage wrap(const StitcherBuffer* b)
+{
+    StitchImage img;
+    img.pixels = cv::Mat(b->height, b->width, cvTypeOf(b->format), b->data, b->stride);
+    if (b->mask) img.mask = cv::Mat1b(b->height, b->width, const_cast<uint8_t*>(b->mask), b->maskStride);
+    return img;
+}
+
+// 入力の検査と例外の変換をまとめる
+template <typename F>
+static StitcherStatus guarded(const StitcherBuffer* a, const StitcherBuffer* b, F&& f)
+{
+    g_lastError.clear();
+    if (!validBuffer(a) || !validBuffer(b)) return fail(STITCHER_INVALID_ARGUMENT, "invalid input buffer");
+    try {
+        return f(wrap(a), wrap(b));
+    } catch (const cv::Exception& e) {
+        return fail(STITCHER_INTERNAL_ERROR, e.what());
+    } catch (const std::exception& e) {
+        return fail(STITCHER_INTERNAL_ERROR, e.what());
+    } catch (...) {
+        return fail(STITCHER_INTERNAL_ERROR, "unknown error");
+    }
+}
+
+// 2枚を揃えた後の型（深さは u16 側へ、チャンネルは多い側へ）
+static int unifiedType(const StitcherBuffer* a, const StitcherBuffer* b)
+{
+    const int ta = cvTypeOf(a->format), tb = cvTypeOf(b->format);
+    return CV_MAKETYPE(std::max(CV_MAT_DEPTH(ta), CV_MAT_DEPTH(tb)), std::max(CV_MAT_CN(ta), CV_MAT_CN(tb)));
+}
+
+// 合成キャンバス（1枚目を原点とした外接矩形）
+static cv::Rect blendCanvas(const StitcherBuffer* a, const StitcherBuffer* b, int x, int y)
+{
+    return unionExtent(cv::Rect(0, 0, a->width, a->height), cv::Rect(x, y, b->width, b->height));
+}
+
+extern "C" {
+
+StitcherStatus stitcher_align_phase(const StitcherBuffer* a, const StitcherBuffer* b,
+                                    int x, int y, StitcherResult* out)
+{
+    if (!out) return fail(STITCHER_INVALID_ARGUMENT, "out is null");
+    return guarded(a, b, [&](const StitchImage& in1, const StitchImage& in2) {
+        if (overlapValidRect(in1, in2, cv::Point(0, 0), cv::Point(x, y)).empty()) return STITCHER_NO_OVERLAP;
+        const return_struct1 r = align_phase_correlate(in1, in2, cv::Point(0, 0), cv::Point(x, y));
+        *out = StitcherResult{r.score, r.x, r.y};
+        return STITCHER_OK;
+    });
+}
+
+StitcherStatus stitcher_auto_place(const StitcherBuffer* a, const StitcherBuffer* b, StitcherResult* out)
+{
+    if (!out) return fail(STITCHER_INVALID_ARGUMENT, "out is null");
+    return guarded(a, b, [&](const StitchImage& in1, const StitchImage& in2) {
+        const return_struct1 r = align_coarse_placement(in1, in2);
+        if (r.score <= 0) return STITCHER_NO_OVERLAP;
+        *out = StitcherResult{r.score, r.x, r.y};
+        return STITCHER_OK;
+    });
+}
+
+StitcherStatus stitcher_align_phase_topk(const StitcherBuffer* a, const StitcherBuffer* b,
+                                         int x, int y, int k, StitcherResult* out)
+{
+    if (!out) return fail(STITCHER_INVALID_ARGUMENT, "out is null");
+    if (k < 1) return fail(STITCHER_INVALID_ARGUMENT, "k must be >= 1");
+    return guarded(a, b, [&](const StitchImage& in1, const StitchImage& in2) {
+        const return_struct1 r = align_phase_topk(in1, in2, cv::Point(0, 0), cv::Point(x, y), k);
+        if (r.score <= 0) return STITCHER_NO_OVERLAP;
+        *out = StitcherResult{r.score, r.x, r.y};
+        return STITCHER_OK;
+    });
+}
+
+StitcherStatus stitcher_align_ssim(const StitcherBuffer* a, const StitcherBuffer* b,
+                                   int x, int y, int radius,
+                                   StitcherCancelFn cancel, void* user, StitcherResult* out)
+{
+    if (!out) return fail(STITCHER_INVALID_ARGUMENT, "out is null");
+    if (radius < 0) return fail(STITCHER_INVALID_ARGUMENT, "radius must be >= 0");
+    return guarded(a, b, [&](const StitchImage& in1, const StitchImage& in2) {
+        std::function<bool()> isCanceled;
+        if (cancel) isCanceled = [cancel, user]() { return cancel(user) != 0; };
+
+        const return_struct1 r = align_ssim_search(in1, in2, cv::Point(0, 0), cv::Point(x, y), radius, isCanceled);
+        if (isCanceled && isCanceled()) {
+            *out = StitcherResult{r.score, r.x, r.y};
+            return STITCHER_CANCELED;
+        }
+        if (r.score <= 0) return STITCHER_NO_OVERLAP;
+        *out = StitcherResult{r.score, r.x, r.y};
+        return STITCHER_OK;
+    });
+}
+
+StitcherStatus stitcher_ssim(const StitcherBuffer* a, const StitcherBuffer* b,
+                             int x, int y, double* score)
+{
+    if (!score) return fail(STITCHER_INVALID_ARGUMENT, "score is null");
+    return guarded(a, b, [&](const StitchImage& in1, const StitchImage& in2) {
+        // SSIM は負にもなるので、重なりの有無は値ではなく有効な重なりで決める
+        if (overlapValidRect(in1, in2, cv::Point(0, 0), cv::Point(x, y)).empty()) return STITCHER_NO_OVERLAP;
+        const SSIM_SharedInput shared = prepareSsimShared(in1, in2, cv::Point(0, 0), cv::Point(x, y));
+        *score = SSIM_calc_shared(shared, 0, 0);
+        return STITCHER_OK;
+    });
+}
+
+StitcherStatus stitcher_overlap(const StitcherBuffer* a, const StitcherBuffer* b,
+                                int x, int y, StitcherRect* rectA, StitcherRect* rectB)
+{
+    if (!rectA || !rectB) return fail(STITCHER_INVALID_ARGUMENT, "rect is null");
+    return guarded(a, b, [&](const StitchImage& in1, const StitchImage& in2) {
+        const cv::Rect r = overlapValidRect(in1, in2, cv::Point(0, 0), cv::Point(x, y));
+        if (r.empty()) return STITCHER_NO_OVERLAP;
+        *rectA = StitcherRect{r.x, r.y, r.width, r.height};
+        *rectB = StitcherRect{r.x - x, r.y - y, r.width, r.height};
+        return STITCHER_OK;
+    });
+}
+
+StitcherStatus stitcher_blend_size(const StitcherBuffer* a, const StitcherBuffer* b,
+                                   int x, int y, int* width, int* height, StitcherFormat* format)
+{
+    g_lastError.clear();
+    if (!width || !height || !format) return fail(STITCHER_INVALID_ARGUMENT, "output is null");
+    if (!validBuffer(a) || !validBuffer(b)) return fail(STITCHER_INVALID_ARGUMENT, "invalid input buffer");
+    const cv::Rect canvas = blendCanvas(a, b, x, y);
+    *width = canvas.width;
+    *height = canvas.height;
+    *format = formatOf(unifiedType(a, b));
+    return STITCHER_OK;
+}
+
+StitcherStatus stitcher_blend(const StitcherBuffer* a, const StitcherBuffer* b,
+                              int x, int y, float featherRadius, StitcherBuffer* out)
+{
+    if (!out || !out->data) return fail(STITCHER_INVALID_ARGUMENT, "out is null");
+    return guarded(a, b, [&](StitchImage in1, StitchImage in2) {
+        const cv::Rect canvas = blendCanvas(a, b, x, y);
+        const int type = unifiedType(a, b);
+        if (out->width != canvas.width || out->height != canvas.height || cvTypeOf(out->format) != type
+            || out->stride < (size_t)canvas.width * CV_ELEM_SIZE(type)) {
+            return fail(STITCHER_BUFFER_MISMATCH, "output buffer does not match stitcher_blend_size");
+        }
+
+        // 形式が同じなら画素は呼び出し側のバッファのまま
+        if (in1.pixels.type() != in2.pixels.type()) unifyPixelTypes(in1, in2);
+
+        // make_canvas_bgra_feather_dt と同じ重みで、出力バッファへ直接合成する
+        // （サイズ・型が一致する cv::Mat への create は確保し直さない）
+        const FeatherTile t1 = prepareFeatherTile(in1, -canvas.tl(), canvas.size(), featherRadius);
+        const FeatherTile t2 = prepareFeatherTile(in2, cv::Point(x, y) - canvas.tl(), canvas.size(), featherRadius);
+        cv::Mat dst(canvas.height, canvas.width, type, out->data, out->stride);
+        composeFeatherRows({&t1, &t2}, canvas.size(), 0, canvas.height, featherRadius, dst);
+        CV_Assert(dst.data == out->data);
+        return STITCHER_OK;
+    });
+}
+
+const char* stitcher_simd_isa(void)
+{
+    return simdIsaName(activeSimdIsa());
+}
+
+StitcherStatus stitcher_set_simd_isa(const char* name)
+{
+    g_lastError.clear();
+    if (!name) return fail(STITCHER_INVALID_ARGUMENT, "name is null");
+    SimdIsa isa = detectedSimdIsa();
+    if (std::strcmp(name, "auto") != 0 && !parseSimdIsa(name, &isa)) return fail(STITCHER_INVALID_ARGUMENT, "unknown ISA name");
+    if (!setSimdIsa(isa)) return fail(STITCHER_INVALID_ARGUMENT, "ISA not supported by this CPU");
+    return STITCHER_OK;
+}
+
+const char* stitcher_last_error(void)
+{
+    return g_lastError.c_str();
+}
+
+} // extern "C"
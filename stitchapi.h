@@ -0,0 +1,113 @@
+#ifndef STITCHAPI_H
+#define STITCHAPI_H
+
+// 結合処理の組み込み用 C API（stitchcore ライブラリ。Qt・ファイルを介さない）
+// 画素は呼び出し側のバッファ（先頭・行ストライド・形式）をそのまま参照し、コピーしない
+// - 位置は全て「1枚目基準の 2枚目位置」(x, y)
+// - 戻り値は StitcherStatus。失敗時の詳細は stitcher_last_error()（スレッドごと）
+// - 2枚の形式が違う場合だけ内部で揃える（その分はコピーになる）
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum StitcherFormat {
+    STITCHER_GRAY8 = 0,
+    STITCHER_BGR8,
+    STITCHER_BGRA8,
+    STITCHER_GRAY16,
+    STITCHER_BGR16,
+    STITCHER_BGRA16
+} StitcherFormat;
+
+typedef enum StitcherStatus {
+    STITCHER_OK = 0,
+    STITCHER_NO_OVERLAP = 1,          // 有効な重なりが無い（結果は未設定）
+    STITCHER_CANCELED = 2,            // 打ち切られた（結果はそれまでの最良）
+    STITCHER_INVALID_ARGUMENT = -1,
+    STITCHER_BUFFER_MISMATCH = -2,    // 出力バッファのサイズ・形式が違う
+    STITCHER_INTERNAL_ERROR = -3
+} StitcherStatus;
+
+// 呼び出し側のバッファ
+// stride: 行の先頭どうしのバイト数（負は不可）
+// mask  : 1 / 3ch 用の有効領域（0 / 255）。NULL なら全面有効。4ch はαを使う
+typedef struct StitcherBuffer {
+    void* data;
+    int width;
+    int height;
+    size_t stride;
+    StitcherFormat format;
+    const uint8_t* mask;
+    size_t maskStride;
+} StitcherBuffer;
+
+typedef struct StitcherResult {
+    double score;   // 位相相関: 応答 / SSIM: SSIM値
+    int x;
+    int y;
+} StitcherResult;
+
+typedef struct StitcherRect {
+    int x;
+    int y;
+    int width;
+    int height;
+} StitcherRect;
+
+// 打ち切り判定（0 以外を返すと打ち切る）
+typedef int (*StitcherCancelFn)(void* user);
+
+// 位相相関法による位置合わせ。(x, y) は初期位置
+StitcherStatus stitcher_align_phase(const StitcherBuffer* a, const StitcherBuffer* b,
+                                    int x, int y, StitcherResult* out);
+
+// 初期位置なしの粗い自動配置（縮小した 2枚の位相相関。score は縮小画像の重なりの NCC）
+// 結果を初期位置として stitcher_align_phase / stitcher_align_ssim で詰める
+StitcherStatus stitcher_auto_place(const StitcherBuffer* a, const StitcherBuffer* b, StitcherResult* out);
+
+// 位相相関面の上位 k 個のピーク（周期の折り返しを含む）の ±1px だけを SSIM で評価。score は SSIM
+StitcherStatus stitcher_align_phase_topk(const StitcherBuffer* a, const StitcherBuffer* b,
+                                         int x, int y, int k, StitcherResult* out);
+
+// SSIM 全探索（(x, y) から ±radius）。cancel は NULL 可
+StitcherStatus stitcher_align_ssim(const StitcherBuffer* a, const StitcherBuffer* b,
+                                   int x, int y, int radius,
+                                   StitcherCancelFn cancel, void* user, StitcherResult* out);
+
+// (x, y) での SSIM（-1..1。有効な重なりが無ければ STITCHER_NO_OVERLAP）
+StitcherStatus stitcher_ssim(const StitcherBuffer* a, const StitcherBuffer* b,
+                             int x, int y, double* score);
+
+// 両方とも有効な重なりの最大矩形を、それぞれのバッファの座標で返す
+// （Crop_2ImageTo2Image の切り出し範囲。呼び出し側はそのままビューにできる）
+StitcherStatus stitcher_overlap(const StitcherBuffer* a, const StitcherBuffer* b,
+                                int x, int y, StitcherRect* rectA, StitcherRect* rectB);
+
+// 合成結果のサイズと形式（2枚の形式を揃えた後のもの）
+StitcherStatus stitcher_blend_size(const StitcherBuffer* a, const StitcherBuffer* b,
+                                   int x, int y, int* width, int* height, StitcherFormat* format);
+
+// 距離変換フェザーで合成し、呼び出し側の out へ直接書く
+// out は stitcher_blend_size のサイズ・形式で確保しておくこと（out->mask は使わない）
+// featherRadius: 0 以下なら無制限。どちらも掛からない画素は 0
+StitcherStatus stitcher_blend(const StitcherBuffer* a, const StitcherBuffer* b,
+                              int x, int y, float featherRadius, StitcherBuffer* out);
+
+// 使っている SIMD の版（"sse2" / "avx2" / "avx512"。x86 以外は "generic"）
+const char* stitcher_simd_isa(void);
+// SIMD の版を替える（"auto" は CPU が対応する最も新しい版）。知らない名前・CPU が対応していない版は
+// STITCHER_INVALID_ARGUMENT で、使う版はそのまま。他のスレッドの処理中には呼ばないこと
+StitcherStatus stitcher_set_simd_isa(const char* name);
+
+// 直前に失敗した呼び出しのメッセージ（呼び出したスレッドのもの。無ければ空文字列）
+const char* stitcher_last_error(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // STITCHAPI_H
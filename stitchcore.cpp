@@ -0,0 +1,1217 @@
+#include "stitchcore.h"
+#include "ssimkernel.h"
+#include "gradkernel.h"
+#include "bitmask.h"
+#include "largealloc.h"
+#include "simdkernels.h"
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/core.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <type_traits>
+#include <vector>
+
+// 画像を指定の深さ・チャンネル数へ昇格する
+static void promotePixelType(StitchImage& img, int depth, int channels)
+{
+    if (img.pixels.depth() != depth) {
+        // u8 → u16（0..255 → 0..65535）
+        img.pixels.convertTo(img.pixels, CV_MAKETYPE(depth, img.pixels.channels()), 257.0);
+    }
+
+    const int cn = img.pixels.channels();
+    if (cn == channels) return;
+
+    if (channels == 3) { // 1 → 3
+        cv::cvtColor(img.pixels, img.pixels, cv::COLOR_GRAY2BGR);
+        return;
+    }
+
+    // → 4ch：分離マスクはαへ移す
+    cv::Mat bgra;
+    cv::cvtColor(img.pixels, bgra, cn == 1 ? cv::COLOR_GRAY2BGRA : cv::COLOR_BGR2BGRA);
+    if (!img.mask.empty()) {
+        cv::Mat alpha;
+        img.mask.convertTo(alpha, depth, pixelMaxValue(depth) / 255.0);
+        cv::insertChannel(alpha, bgra, 3);
+    }
+    img.pixels = bgra;
+    img.mask.release();
+}
+
+void unifyPixelTypes(StitchImage& a, StitchImage& b)
+{
+    CV_Assert(!a.empty() && !b.empty());
+    if (a.pixels.type() == b.pixels.type()) return;
+
+    const int depth = std::max(a.pixels.depth(), b.pixels.depth()); // CV_8U < CV_16U
+    const int channels = std::max(a.pixels.channels(), b.pixels.channels());
+    promotePixelType(a, depth, channels);
+    promotePixelType(b, depth, channels);
+}
+
+// αまたは分離マスクから logical配列にする
+cv::Mat1b alphaMaskFromImage(const StitchImage& img, double alphaThreshold)
+{
+    CV_Assert(!img.empty());
+
+    cv::Mat1b mask;
+    if (img.hasAlpha()) {
+        // alpha >= 0.5 → u8: alpha >= 128, u16: alpha >= 32768
+        const double thr = (double)std::lround(alphaThreshold * pixelMaxValue(img.pixels.depth()));
+
+        cv::Mat alpha;
+        cv::extractChannel(img.pixels, alpha, 3);
+        cv::compare(alpha, thr, mask, cv::CMP_GE); // 0 or 255 のマスク
+    } else if (!img.mask.empty()) {
+        mask = img.mask.clone(); // 分離マスク（0 or 255）
+    } else {
+        return cv::Mat1b(img.size(), uchar(1)); // マスク無し＝全面有効
+    }
+
+    // 「logical配列」(0/1)にしたいなら 0/255 を 0/1 に落とす
+    mask /= 255;
+
+    return mask; // CV_8U, 値は 0 or 1
+}
+
+// 入力: logical配列 mask（CV_8U, 値0/1推奨。非0をtrue扱いでもOK）
+// 出力: 最大面積矩形の (x,y,w,h)。無ければ (0,0,0,0)
+// ビット詰めにしてから行の run 単位で探す（同じ内容の行は1回の評価で済む）
+cv::Rect maxRectOnesFromLogical(const cv::Mat1b& mask)
+{
+    CV_Assert(!mask.empty());
+    CV_Assert(mask.channels() == 1);
+    CV_Assert(mask.depth() == CV_8U);
+
+    return BitMask::fromLogical(mask).maxRect();
+}
+
+bool overlapRegions(cv::Size size1, cv::Size size2, cv::Point pos1, cv::Point pos2, int margin,
+                    cv::Rect& roi1, cv::Rect& roi2)
+{
+    const cv::Rect r1(pos1, size1);
+    const cv::Rect r2(pos2, size2);
+    cv::Rect ov = r1 & r2;
+    if (ov.empty()) return false;
+
+    // 探索でずらす分だけ広げ、各画像の内側に収める
+    ov = cv::Rect(ov.x - margin, ov.y - margin, ov.width + 2 * margin, ov.height + 2 * margin);
+    roi1 = (ov & r1) - pos1;
+    roi2 = (ov & r2) - pos2;
+    return !roi1.empty() && !roi2.empty();
+}
+
+// 1 / 3 / 4ch をグレースケールへ（1ch はそのまま共有）
+static cv::Mat toGray(const cv::Mat& im)
+{
+    cv::Mat g;
+    switch (im.channels()) {
+    case 1: g = im; break;
+    case 3: cv::cvtColor(im, g, cv::COLOR_BGR2GRAY); break;
+    case 4: cv::cvtColor(im, g, cv::COLOR_BGRA2GRAY); break;
+    default: CV_Error(cv::Error::StsBadArg, "unsupported channel count");
+    }
+    return g;
+}
+
+// iFFT用関数
+cv::Mat1f clahe_then_grad(const cv::Mat& im)
+{
+    CV_Assert(!im.empty());
+    CV_Assert(im.depth() == CV_8U || im.depth() == CV_16U);
+
+    const cv::Mat gray = toGray(im);
+
+    // CLAHE（u8 / u16 どちらも可。1ch入力を書き換えないよう別バッファへ）
+    cv::Mat eq;
+    cv::Ptr<cv::CLAHE> clahe = cv::createCLAHE(2.0, cv::Size(8, 8));
+    clahe->apply(gray, eq);
+
+    // 通常は融合カーネル（ぼかし〜窓掛けを行の帯ごとに 1パス。中間の float 画像を作らない）
+    if (eq.cols >= 5 && eq.rows >= 5) return grad_window_fused(eq, CV_32F);
+
+    cv::Mat1f g;
+    eq.convertTo(g, CV_32F);
+
+    // Gaussian blur (sigma=1.0, ksize=(0,0) means auto)
+    cv::GaussianBlur(g, g, cv::Size(0, 0), 1.0);
+
+    // Sobel gradients
+    cv::Mat1f gx, gy;
+    cv::Sobel(g, gx, CV_32F, 1, 0, 3);
+    cv::Sobel(g, gy, CV_32F, 0, 1, 3);
+
+    // magnitude
+    cv::Mat1f mag;
+    cv::magnitude(gx, gy, mag);
+
+    // mag -= mean; mag /= std
+    cv::Scalar mean, stddev;
+    cv::meanStdDev(mag, mean, stddev);
+    mag -= (float)mean[0];
+    float s = (float)stddev[0];
+    if (s > 1e-6f) mag /= s;
+
+    // Hanning window (reduce edge/DC effects)
+    cv::Mat1f win;
+    cv::createHanningWindow(win, mag.size(), CV_32F);
+    mag = mag.mul(win);
+
+    return mag;
+}
+
+// 重なりのうち両画像とも有効な最大矩形
+// 有効領域の AND は両画像の外接矩形の交わりにしか立たないので、交わりの範囲だけビットマスクで求める
+cv::Rect overlapValidRect(const StitchImage& input1, const StitchImage& input2,
+                          cv::Point pos1, cv::Point pos2)
+{
+    const cv::Rect ov = cv::Rect(pos1, input1.size()) & cv::Rect(pos2, input2.size());
+    if (ov.empty()) return cv::Rect();
+
+    // Alphaをビットマスクへ変換し、重なり領域を得る
+    BitMask andMask = BitMask::fromImage(input1, ov - pos1, 0.5);
+    andMask &= BitMask::fromImage(input2, ov - pos2, 0.5);
+
+    // and領域を矩形化する（交わりの座標 → 共通座標）
+    const cv::Rect rect = andMask.maxRect();
+    if (rect.empty()) return cv::Rect();
+    return rect + ov.tl();
+}
+
+// 2つの画像から重なり領域をクロップして取り出す
+return_struct2 Crop_2ImageTo2Image(const StitchImage& input1, const StitchImage& input2,
+                                   cv::Point pos1, cv::Point pos2)
+{
+    StitchImage in1 = input1, in2 = input2;
+    unifyPixelTypes(in1, in2);
+
+    return_struct2 r;
+    const cv::Rect rect = overlapValidRect(in1, in2, pos1, pos2);
+    if (rect.empty()) return r;
+
+    // 重なり領域をcropして取り出す（4ch はαを落とす）
+    // 大きな重なりは行の帯ごとに first-touch した領域へ書く
+    auto cropNoAlpha = [](const cv::Mat& roi) {
+        cv::Mat crop = createLargeZeroed(roi.rows, roi.cols, CV_MAKETYPE(roi.depth(), std::min(roi.channels(), 3)));
+        if (roi.channels() == 4) cv::cvtColor(roi, crop, cv::COLOR_BGRA2BGR);
+        else roi.copyTo(crop);
+        return crop;
+    };
+
+    // 返り値を設定
+    r.img1 = cropNoAlpha(in1.pixels(rect - pos1));
+    r.img2 = cropNoAlpha(in2.pixels(rect - pos2));
+    return r;
+}
+
+// SSIM計算関数（L: 画素値のダイナミックレンジ）
+static double ssim_single_channel(const cv::Mat& i1, const cv::Mat& i2, double L)
+{
+    // 通常は融合カーネル（中間の float 画像を作らない）。窓より小さい画像だけ従来の実装
+    if (i1.cols >= 11 && i1.rows >= 11) return ssim_fused(i1, i2, L);
+
+    cv::Mat I1, I2;
+    i1.convertTo(I1, CV_32F);
+    i2.convertTo(I2, CV_32F);
+
+    const double C1 = (0.01 * L) * (0.01 * L);
+    const double C2 = (0.03 * L) * (0.03 * L);
+
+    cv::Mat mu1, mu2;
+    cv::GaussianBlur(I1, mu1, cv::Size(11, 11), 1.5);
+    cv::GaussianBlur(I2, mu2, cv::Size(11, 11), 1.5);
+
+    cv::Mat mu1_2 = mu1.mul(mu1);
+    cv::Mat mu2_2 = mu2.mul(mu2);
+    cv::Mat mu1_mu2 = mu1.mul(mu2);
+
+    cv::Mat sigma1_2, sigma2_2, sigma12;
+    cv::GaussianBlur(I1.mul(I1), sigma1_2, cv::Size(11, 11), 1.5);
+    sigma1_2 -= mu1_2;
+
+    cv::GaussianBlur(I2.mul(I2), sigma2_2, cv::Size(11, 11), 1.5);
+    sigma2_2 -= mu2_2;
+
+    cv::GaussianBlur(I1.mul(I2), sigma12, cv::Size(11, 11), 1.5);
+    sigma12 -= mu1_mu2;
+
+    cv::Mat t1 = 2 * mu1_mu2 + C1;
+    cv::Mat t2 = 2 * sigma12 + C2;
+    cv::Mat t3 = mu1_2 + mu2_2 + C1;
+    cv::Mat t4 = sigma1_2 + sigma2_2 + C2;
+
+    cv::Mat ssim_map = (t1.mul(t2)) / (t3.mul(t4));
+    return cv::mean(ssim_map)[0];
+}
+
+double ssim(const cv::Mat& a, const cv::Mat& b)
+{
+    CV_Assert(!a.empty() && !b.empty());
+    CV_Assert(a.size() == b.size());
+
+    // SSIMは基本「同じチャンネル数」で。迷ったらグレースケールに落とすのが簡単
+    cv::Mat A = toGray(a), B = toGray(b);
+
+    CV_Assert(A.type() == B.type());
+    CV_Assert(A.depth() == CV_8U || A.depth() == CV_16U);
+    return ssim_single_channel(A, B, pixelMaxValue(A.depth()));
+}
+
+return_struct1 align_phase_correlate(const StitchImage& input1, const StitchImage& input2,
+                                     cv::Point pos1, cv::Point pos2,
+                                     const std::function<bool()>& isCanceled)
+{
+    auto canceled = [&isCanceled]() { return isCanceled && isCanceled(); };
+
+    // 重なり領域をcropして取り出す。
+    return_struct2 r_st = Crop_2ImageTo2Image(input1, input2, pos1, pos2);
+    cv::Mat crop1 = r_st.img1;
+    cv::Mat crop2 = r_st.img2;
+
+    if (crop1.rows == 0 || canceled()) {
+        return return_struct1{};
+    }
+
+    // 以下、計算
+    cv::Mat1f a = clahe_then_grad(crop1);
+    if (canceled()) return return_struct1{};
+    cv::Mat1f b = clahe_then_grad(crop2);
+    if (canceled()) return return_struct1{};
+
+    // 位相相関法による位置合わせ
+    double response = 0.0;
+    cv::Point2d shift = cv::phaseCorrelate(a, b, cv::noArray(), &response);
+
+    // 四捨五入
+    cv::Point2d shift_r(std::round(shift.x), std::round(shift.y));
+
+    // 2枚目画像の位置計算
+    return_struct1 r;
+    r.score = response;
+    r.x = (int)(pos2.x - pos1.x - shift_r.x);
+    r.y = (int)(pos2.y - pos1.y - shift_r.y);
+    return r;
+}
+
+return_struct1 align_phase_pair(const StitchImage& a, const StitchImage& b, cv::Point nominalRel)
+{
+    cv::Rect roi1, roi2;
+    if (!overlapRegions(a.size(), b.size(), cv::Point(0, 0), nominalRel, 0, roi1, roi2)) return return_struct1{};
+
+    StitchImage sa, sb;
+    sa.pixels = a.pixels(roi1);
+    sb.pixels = b.pixels(roi2);
+    if (!a.mask.empty()) sa.mask = a.mask(roi1);
+    if (!b.mask.empty()) sb.mask = b.mask(roi2);
+
+    // 切り出した画像どうしの結果を元画像どうしへ
+    return_struct1 r = align_phase_correlate(sa, sb, roi1.tl(), nominalRel + roi2.tl());
+    if (r.score == 0) return return_struct1{};
+    r.x += roi1.x - roi2.x;
+    r.y += roi1.y - roi2.y;
+    return r;
+}
+
+// 位相相関面（正規化クロスパワースペクトルの逆変換。fftshift しない）
+// 画素 (px, py) のピークは 2枚目の中身が 1枚目に対して (-px, -py) を周期 (W, H) で折り返した分だけずれていることを表す
+static cv::Mat1f phase_surface(const cv::Mat1f& a, const cv::Mat1f& b)
+{
+    cv::Mat A, B, P;
+    cv::dft(a, A, cv::DFT_COMPLEX_OUTPUT);
+    cv::dft(b, B, cv::DFT_COMPLEX_OUTPUT);
+    cv::mulSpectrums(A, B, P, 0, true);
+
+    // 振幅で割って位相だけにする
+    cv::Mat ch[2];
+    cv::split(P, ch);
+    cv::Mat mag;
+    cv::magnitude(ch[0], ch[1], mag);
+    mag += FLT_EPSILON;
+    cv::divide(ch[0], mag, ch[0]);
+    cv::divide(ch[1], mag, ch[1]);
+    cv::merge(ch, 2, P);
+
+    cv::Mat1f surface;
+    cv::idft(P, surface, cv::DFT_REAL_OUTPUT | cv::DFT_SCALE);
+    return surface;
+}
+
+// 上位 k 個の局所最大（周期境界。近すぎるピークは 1つにまとめる）
+static std::vector<cv::Point> phase_peaks(cv::Mat1f surface, int k)
+{
+    constexpr int kSuppress = 2;
+    std::vector<cv::Point> peaks;
+    const int W = surface.cols, H = surface.rows;
+    for (int i = 0; i < k; ++i) {
+        double maxV = 0;
+        cv::Point p;
+        cv::minMaxLoc(surface, nullptr, &maxV, nullptr, &p);
+        if (maxV <= 0) break;
+        peaks.push_back(p);
+        for (int dy = -kSuppress; dy <= kSuppress; ++dy) {
+            float* row = surface.ptr<float>(((p.y + dy) % H + H) % H);
+            for (int dx = -kSuppress; dx <= kSuppress; ++dx) row[((p.x + dx) % W + W) % W] = -FLT_MAX;
+        }
+    }
+    return peaks;
+}
+
+return_struct1 align_phase_topk(const StitchImage& input1, const StitchImage& input2,
+                                cv::Point pos1, cv::Point pos2, int k)
+{
+    CV_Assert(k >= 1);
+
+    // 重なり領域をcropして取り出す。
+    return_struct2 r_st = Crop_2ImageTo2Image(input1, input2, pos1, pos2);
+    if (r_st.img1.rows == 0) return return_struct1{};
+
+    const cv::Mat1f a = clahe_then_grad(r_st.img1);
+    const cv::Mat1f b = clahe_then_grad(r_st.img2);
+    const int W = a.cols, H = a.rows;
+
+    // ピークごとに、折り返し（±周期）も候補にする。現在位置からのずらし量で持つ
+    std::vector<cv::Point> centers;
+    for (const cv::Point& p : phase_peaks(phase_surface(a, b), k)) {
+        const int xs[2] = {p.x, p.x - W};
+        const int ys[2] = {p.y, p.y - H};
+        for (int ix = 0; ix < (p.x > 0 ? 2 : 1); ++ix) {
+            for (int iy = 0; iy < (p.y > 0 ? 2 : 1); ++iy) centers.push_back(cv::Point(xs[ix], ys[iy]));
+        }
+    }
+
+    // 各候補の ±1px（重複は 1回だけ）
+    std::vector<cv::Point> offsets;
+    for (const cv::Point& c : centers) {
+        for (int dy = -1; dy <= 1; ++dy) {
+            for (int dx = -1; dx <= 1; ++dx) offsets.push_back(c + cv::Point(dx, dy));
+        }
+    }
+    std::sort(offsets.begin(), offsets.end(), [](const cv::Point& l, const cv::Point& r) {
+        return l.y != r.y ? l.y < r.y : l.x < r.x;
+    });
+    offsets.erase(std::unique(offsets.begin(), offsets.end()), offsets.end());
+
+    // 折り返し候補は重なりが小さくなるので、小さすぎるもの（平坦な小領域で SSIM が高く出る）は外す
+    constexpr double kMinOverlapRatio = 0.1;
+    const double minArea = kMinOverlapRatio * W * H;
+    const cv::Rect r1(pos1, input1.size());
+
+    const SSIM_SharedInput shared = prepareSsimShared(input1, input2, pos1, pos2);
+    std::vector<return_struct1> scored(offsets.size());
+    cv::parallel_for_(cv::Range(0, (int)offsets.size()), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; ++i) {
+            const cv::Point d = offsets[i];
+            return_struct1& r = scored[i];
+            r.x = pos2.x - pos1.x + d.x;
+            r.y = pos2.y - pos1.y + d.y;
+            if (pixelCount(r1 & cv::Rect(pos2 + d, input2.size())) < minArea) continue;
+            r.score = SSIM_calc_shared(shared, d.x, d.y);
+        }
+    });
+
+    return_struct1 best;
+    for (const return_struct1& r : scored) {
+        if (r.score > best.score) best = r;
+    }
+    return best;
+}
+
+// SSIM 各スレッドの計算処理
+double SSIM_calc_oneshot(const SSIM_TaskInput& in)
+{
+    // 2枚目画像を(dx,dy)移動
+    cv::Point in_pos2(in.pos2.x + in.dx, in.pos2.y + in.dy);
+
+    // 重なり領域をcropして取り出す。
+    return_struct2 r_st = Crop_2ImageTo2Image(in.input1, in.input2, in.pos1, in_pos2);
+    cv::Mat crop1 = r_st.img1;
+    cv::Mat crop2 = r_st.img2;
+
+    if (crop1.rows == 0) {
+        return 0.0;
+    }
+
+    return ssim(crop1, crop2);
+}
+
+SSIM_SharedInput prepareSsimShared(const StitchImage& input1, const StitchImage& input2,
+                                   cv::Point pos1, cv::Point pos2)
+{
+    StitchImage in1 = input1, in2 = input2;
+    unifyPixelTypes(in1, in2);
+
+    SSIM_SharedInput s;
+    s.gray1 = toGray(in1.pixels);
+    s.gray2 = toGray(in2.pixels);
+    s.pos1 = pos1;
+    s.pos2 = pos2;
+    s.L = pixelMaxValue(s.gray1.depth());
+
+    // 全面有効ならマスクは持たない（多くの入力はこれ）
+    auto validOf = [](const StitchImage& img) {
+        if (img.isOpaqueRect()) return BitMask();
+        BitMask m = BitMask::fromImage(img, cv::Rect(0, 0, img.cols(), img.rows()));
+        return m.count() == (int64_t)img.cols() * img.rows() ? BitMask() : m;
+    };
+    s.valid1 = validOf(in1);
+    s.valid2 = validOf(in2);
+    return s;
+}
+
+// best を渡すと分枝限定（届かない候補は途中で打ち切って -inf）
+static double ssim_shared_impl(const SSIM_SharedInput& in, int dx, int dy, const std::atomic<double>* best)
+{
+    const cv::Point p2(in.pos2.x + dx, in.pos2.y + dy);
+    const cv::Rect ov = cv::Rect(in.pos1, in.gray1.size()) & cv::Rect(p2, in.gray2.size());
+    if (ov.empty()) return 0.0;
+
+    // 重なりの中の有効領域の最大矩形（重なりの座標）
+    cv::Rect rect(0, 0, ov.width, ov.height);
+    if (!in.valid1.empty() || !in.valid2.empty()) {
+        thread_local BitMask m;
+        if (!in.valid1.empty()) {
+            m.assignRegion(in.valid1, ov - in.pos1);
+            if (!in.valid2.empty()) m.andRegion(in.valid2, ov - p2);
+        } else {
+            m.assignRegion(in.valid2, ov - p2);
+        }
+        rect = m.maxRect();
+        if (rect.empty()) return 0.0;
+    }
+
+    // 共有画像のビュー（コピーしない）
+    const cv::Mat a = in.gray1(rect + ov.tl() - in.pos1);
+    const cv::Mat b = in.gray2(rect + ov.tl() - p2);
+    if (a.cols >= 11 && a.rows >= 11) return best ? ssim_fused_bounded(a, b, in.L, *best) : ssim_fused(a, b, in.L);
+    return ssim(a, b);
+}
+
+double SSIM_calc_shared(const SSIM_SharedInput& in, int dx, int dy)
+{
+    return ssim_shared_impl(in, dx, dy, nullptr);
+}
+
+double SSIM_calc_shared_bounded(const SSIM_SharedInput& in, int dx, int dy, const std::atomic<double>& best)
+{
+    return ssim_shared_impl(in, dx, dy, &best);
+}
+
+std::vector<cv::Point> ssimSearchOrder(int radius)
+{
+    CV_Assert(radius >= 0);
+    std::vector<cv::Point> order;
+    order.reserve((size_t)(2 * radius + 1) * (2 * radius + 1));
+    order.push_back(cv::Point(0, 0));
+    // 距離 d の正方形の周を上辺・下辺（x 順）、左辺・右辺（y 順）で
+    for (int d = 1; d <= radius; ++d) {
+        for (int x = -d; x <= d; ++x) order.push_back(cv::Point(x, -d));
+        for (int y = -d + 1; y <= d - 1; ++y) {
+            order.push_back(cv::Point(-d, y));
+            order.push_back(cv::Point(d, y));
+        }
+        for (int x = -d; x <= d; ++x) order.push_back(cv::Point(x, d));
+    }
+    return order;
+}
+
+void ssimUpdateBest(std::atomic<double>& best, double score)
+{
+    double cur = best.load(std::memory_order_relaxed);
+    while (score > cur && !best.compare_exchange_weak(cur, score, std::memory_order_relaxed)) {
+    }
+}
+
+bool ssimBetterCandidate(double score, cv::Point d, double bestScore, cv::Point bestD)
+{
+    if (score != bestScore) return score > bestScore;
+    return d.x != bestD.x ? d.x < bestD.x : d.y < bestD.y;
+}
+
+return_struct1 align_ssim_search(const StitchImage& input1, const StitchImage& input2,
+                                 cv::Point pos1, cv::Point pos2, int radius,
+                                 const std::function<bool()>& isCanceled)
+{
+    CV_Assert(radius >= 0);
+    const SSIM_SharedInput shared = prepareSsimShared(input1, input2, pos1, pos2);
+
+    // 候補 1つを 1要素として現在位置から外側へ並列に評価し、それまでの最良に届かない候補は途中で打ち切る
+    // （各候補の中の parallel_for_ は入れ子になるので OpenCV 側で逐次になる。
+    //   nstripes = 候補数にして、候補が順番に取られるようにする）
+    const std::vector<cv::Point> order = ssimSearchOrder(radius);
+    const int n = (int)order.size();
+    std::atomic<double> bestScore{0.0};
+    std::vector<double> scores(n, 0.0);
+    cv::parallel_for_(cv::Range(0, n), [&](const cv::Range& range) {
+        for (int k = range.start; k < range.end; ++k) {
+            if (isCanceled && isCanceled()) return;
+            scores[k] = SSIM_calc_shared_bounded(shared, order[k].x, order[k].y, bestScore);
+            ssimUpdateBest(bestScore, scores[k]);
+        }
+    }, n);
+
+    // 打ち切った候補は -inf なので選ばれない。同点は全探索（dx, dy の順）で先に来る方
+    return_struct1 acc;
+    cv::Point accD;
+    for (int k = 0; k < n; ++k) {
+        if (scores[k] <= 0.0) continue;
+        if (acc.score > 0.0 && !ssimBetterCandidate(scores[k], order[k], acc.score, accD)) continue;
+        accD = order[k];
+        acc.x = pos2.x - pos1.x + accD.x;
+        acc.y = pos2.y - pos1.y + accD.y;
+        acc.score = scores[k];
+    }
+    return acc;
+}
+
+// 画像の一部を切り出す（画素・マスクとも共有）
+static StitchImage subImage(const StitchImage& img, const cv::Rect& roi)
+{
+    StitchImage r;
+    r.pixels = img.pixels(roi);
+    if (!img.mask.empty()) r.mask = img.mask(roi);
+    return r;
+}
+
+// 全画素が非 0 か（cv::countNonZero は int で数えるので 2^31 画素を超える画像では使わない）
+static bool allNonZero(const cv::Mat1b& m)
+{
+    for (int r = 0; r < m.rows; ++r) {
+        if (std::memchr(m.ptr<uchar>(r), 0, (size_t)m.cols)) return false;
+    }
+    return true;
+}
+
+StitchImage alignGrayImage(const StitchImage& img)
+{
+    CV_Assert(!img.empty());
+
+    StitchImage r;
+    r.pixels = toGray(img.pixels); // 1ch はそのまま共有
+    if (!img.hasAlpha()) {
+        r.mask = img.mask;
+        return r;
+    }
+
+    // α → 分離マスク（BitMask::fromImage と同じしきい値）。全面不透明なら持たない
+    const double thr = (double)std::lround(0.5 * pixelMaxValue(img.pixels.depth()));
+    cv::Mat alpha;
+    cv::Mat1b m;
+    cv::extractChannel(img.pixels, alpha, 3);
+    cv::compare(alpha, thr, m, cv::CMP_GE);
+    if (!allNonZero(m)) r.mask = m;
+    return r;
+}
+
+// 倍率 f へ縮小した位置合わせ用の画像（αは面積平均してからしきい値、分離マスクは最近傍）
+static StitchImage shrinkForAlign(const StitchImage& img, double f)
+{
+    if (f >= 1.0) return alignGrayImage(img);
+
+    const cv::Size sz(std::max(1, (int)std::lround(img.cols() * f)), std::max(1, (int)std::lround(img.rows() * f)));
+    StitchImage small;
+    cv::resize(img.pixels, small.pixels, sz, 0, 0, cv::INTER_AREA);
+    if (!img.mask.empty()) cv::resize(img.mask, small.mask, sz, 0, 0, cv::INTER_NEAREST);
+    return alignGrayImage(small);
+}
+
+// 2枚目を pos2 に置いた時の重なり（両方とも有効な最大矩形）の NCC。重なりが minArea 未満なら 0
+static double overlapNcc(const StitchImage& a, const StitchImage& b, cv::Point pos2, int64_t minArea)
+{
+    const return_struct2 c = Crop_2ImageTo2Image(a, b, cv::Point(0, 0), pos2);
+    if (c.img1.empty() || c.img1.rows < 8 || c.img1.cols < 8 || pixelCount(c.img1.size()) < minArea) return 0.0;
+
+    cv::Mat fa, fb;
+    c.img1.convertTo(fa, CV_32F);
+    c.img2.convertTo(fb, CV_32F);
+    cv::Mat1f r;
+    cv::matchTemplate(fa, fb, r, cv::TM_CCOEFF_NORMED);
+    const double v = r(0, 0);
+    return std::isfinite(v) ? v : 0.0; // 平坦な重なりは NaN
+}
+
+return_struct1 align_coarse_placement(const StitchImage& input1, const StitchImage& input2, int maxSide)
+{
+    CV_Assert(!input1.empty() && !input2.empty());
+    CV_Assert(maxSide >= 16);
+
+    const int longest = std::max({input1.cols(), input1.rows(), input2.cols(), input2.rows()});
+    const double f = std::min(1.0, (double)maxSide / longest);
+    StitchImage a = shrinkForAlign(input1, f);
+    StitchImage b = shrinkForAlign(input2, f);
+    unifyPixelTypes(a, b); // 深さだけ（どちらも 1ch）
+
+    // 仮定する重なりの割合（短い方の辺に対して）。位相相関は重なりの幅の半分までのずれを戻せるので、
+    // 倍ずつ変えれば 5% 〜 100% の重なりをどれかの仮定が覆う
+    constexpr double kOverlaps[] = {0.1, 0.2, 0.4, 0.8};
+    const int minW = std::min(a.cols(), b.cols());
+    const int minH = std::min(a.rows(), b.rows());
+    std::vector<cv::Point> hypotheses;
+    for (double r : kOverlaps) {
+        const int w = std::max(1, (int)std::lround(r * minW));
+        const int h = std::max(1, (int)std::lround(r * minH));
+        hypotheses.push_back(cv::Point(a.cols() - w, 0));  // 右
+        hypotheses.push_back(cv::Point(w - b.cols(), 0));  // 左
+        hypotheses.push_back(cv::Point(0, a.rows() - h));  // 下
+        hypotheses.push_back(cv::Point(0, h - b.rows()));  // 上
+    }
+
+    // 小さすぎる重なり（平坦な細い帯で NCC が高く出る）は候補にしない
+    constexpr double kMinOverlapRatio = 0.05;
+    const int64_t minArea = (int64_t)(kMinOverlapRatio * std::min(pixelCount(a.size()), pixelCount(b.size())));
+
+    std::vector<return_struct1> scored(hypotheses.size());
+    cv::parallel_for_(cv::Range(0, (int)hypotheses.size()), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; ++i) {
+            const return_struct1 p = align_phase_correlate(a, b, cv::Point(0, 0), hypotheses[i]);
+            if (p.score == 0) continue;
+            scored[i].x = p.x;
+            scored[i].y = p.y;
+            scored[i].score = overlapNcc(a, b, cv::Point(p.x, p.y), minArea);
+        }
+    });
+
+    // 同点は仮定の順（重なりの小さい方・右 → 左 → 下 → 上）
+    return_struct1 best;
+    for (const return_struct1& r : scored) {
+        if (r.score > best.score) best = r;
+    }
+    if (best.score <= 0) return return_struct1{};
+
+    // 入力の画素へ戻す
+    best.x = (int)std::lround(best.x / f);
+    best.y = (int)std::lround(best.y / f);
+    return best;
+}
+
+return_struct1 align_ncc_surface(const StitchImage& input1, const StitchImage& input2,
+                                 cv::Point pos1, cv::Point pos2, int radius)
+{
+    CV_Assert(!input1.empty() && !input2.empty());
+    CV_Assert(radius >= 0);
+
+    // テンプレート（2枚目の重なり）は、±radius ずらしても1枚目に収まる範囲に限る
+    const cv::Rect r1(pos1, input1.size());
+    const cv::Rect r2(pos2, input2.size());
+    const cv::Rect inner1(r1.x + radius, r1.y + radius, r1.width - 2 * radius, r1.height - 2 * radius);
+    cv::Rect T = r1 & r2 & inner1; // シーン座標
+    if (T.width <= 0 || T.height <= 0) return return_struct1{};
+
+    // 有効領域：1枚目は全候補で有効な画素（(2r+1)角で収縮）、2枚目はそのまま
+    {
+        const cv::Rect S(T.x - radius, T.y - radius, T.width + 2 * radius, T.height + 2 * radius);
+        cv::Mat1b m1 = alphaMaskFromImage(subImage(input1, S - pos1));
+        if (!allNonZero(m1)) {
+            cv::erode(m1, m1, cv::getStructuringElement(cv::MORPH_RECT, cv::Size(2 * radius + 1, 2 * radius + 1)));
+        }
+        const cv::Mat1b m2 = alphaMaskFromImage(subImage(input2, T - pos2));
+
+        cv::Mat1b andMask;
+        cv::bitwise_and(m1(cv::Rect(radius, radius, T.width, T.height)), m2, andMask);
+        const cv::Rect rect = maxRectOnesFromLogical(andMask);
+        T = cv::Rect(T.tl() + rect.tl(), rect.size());
+    }
+
+    // 小さすぎるテンプレートでは相関面が当てにならない
+    if (T.width < 8 || T.height < 8) return return_struct1{};
+
+    const cv::Rect S(T.x - radius, T.y - radius, T.width + 2 * radius, T.height + 2 * radius);
+
+    // グレースケール float（NCC は明るさのスケールに依らないので深さは揃えない）
+    cv::Mat1f img, templ;
+    toGray(input1.pixels(S - pos1)).convertTo(img, CV_32F);
+    toGray(input2.pixels(T - pos2)).convertTo(templ, CV_32F);
+
+    // (2r+1)^2 の相関面を一度に求める（大きいテンプレートでは内部で DFT）
+    cv::Mat1f surface;
+    cv::matchTemplate(img, templ, surface, cv::TM_CCOEFF_NORMED);
+
+    double maxVal = 0.0;
+    cv::Point maxLoc;
+    cv::minMaxLoc(surface, nullptr, &maxVal, nullptr, &maxLoc);
+    if (!std::isfinite(maxVal)) return return_struct1{}; // 平坦なテンプレート
+
+    // テンプレートが1枚目の T + d に一致 → 2枚目を d だけ動かす
+    const cv::Point d = maxLoc - cv::Point(radius, radius);
+
+    return_struct1 r;
+    r.score = maxVal;
+    r.x = pos2.x - pos1.x + d.x;
+    r.y = pos2.y - pos1.y + d.y;
+    return r;
+}
+
+// DIST_L2 / maskSize=3 の距離変換で使われる軸方向1画素のコスト
+// 矩形の外側（キャンバス内）までの最短経路は常に軸方向なので、距離は kChamferAxis * 画素数 に一致する
+static constexpr float kChamferAxis = 0.955f;
+
+// 1画像分の有効領域とフェザー重み（有効領域境界からの距離）
+// 不透明な矩形なら解析式でその場計算し、任意のα / マスクの時だけ距離変換する
+struct FeatherSource {
+    cv::Rect roi;                  // キャンバス上の配置
+    bool rect = false;             // 不透明な矩形か
+    float featherRadius = 0.0f;
+
+    cv::Mat1b mask;                // 任意形状: 有効領域（0/255, キャンバスサイズ）
+    cv::Mat1f dist;                // 任意形状: 距離変換結果
+
+    std::vector<uchar> colValid;   // 矩形: 列の有効フラグ
+    std::vector<uchar> noValid;    // 矩形: 範囲外の行（全て0）
+    std::vector<float> colDist;    // 矩形: 左右の境界までの距離
+    int out_h = 0;
+
+    const uchar* validRow(int r) const
+    {
+        if (!rect) return mask.ptr<uchar>(r);
+        return (r >= roi.y && r < roi.y + roi.height) ? colValid.data() : noValid.data();
+    }
+
+    // 矩形は buf（キャンバス幅。呼び出し側のスレッドごと）に 1行分の距離を作る
+    const float* distRow(int r, std::vector<float>& buf) const
+    {
+        if (!rect) return dist.ptr<float>(r);
+
+        // 上下の境界（キャンバス端は境界に数えない。距離変換と同じ扱い）
+        const float far_ = (float)(colDist.size() + out_h);
+        const float top = (roi.y > 0) ? kChamferAxis * (r - roi.y + 1) : far_;
+        const float bottom = (roi.y + roi.height < out_h) ? kChamferAxis * (roi.y + roi.height - r) : far_;
+        float dv = std::min(top, bottom);
+        if (featherRadius > 0.0f) dv = std::min(dv, featherRadius);
+
+        const int W = (int)colDist.size();
+        buf.resize(W);
+        for (int c = 0; c < W; ++c) buf[c] = std::min(colDist[c], dv);
+        return buf.data();
+    }
+};
+
+// 有効領域・重みの準備。alphaRow は 4ch の時のみ使う（alpha > 0 を有効とする）
+template <typename T, int CN>
+static void prepare_feather_source(FeatherSource& fs, const StitchImage& src, const cv::Rect& roi,
+                                   cv::Size canvas, float featherRadius)
+{
+    using Px = cv::Vec<T, CN>;
+
+    fs.roi = roi;
+    fs.out_h = canvas.height;
+    fs.featherRadius = featherRadius;
+    fs.rect = src.isOpaqueRect();
+
+    if (fs.rect) {
+        const int W = canvas.width;
+        const float far_ = (float)(canvas.width + canvas.height);
+        fs.colValid.assign(W, 0);
+        fs.noValid.assign(W, 0);
+        fs.colDist.assign(W, 0.0f);
+        for (int c = roi.x; c < roi.x + roi.width; ++c) {
+            const float left = (roi.x > 0) ? kChamferAxis * (c - roi.x + 1) : far_;
+            const float right = (roi.x + roi.width < W) ? kChamferAxis * (roi.x + roi.width - c) : far_;
+            float d = std::min(left, right);
+            if (featherRadius > 0.0f) d = std::min(d, featherRadius);
+            fs.colValid[c] = 255;
+            fs.colDist[c] = d;
+        }
+        return;
+    }
+
+    // 任意形状: 有効領域マスク（4ch: alpha > 0 / 1・3ch: 分離マスク）
+    // キャンバスサイズなので、合成と同じ行の帯ごとに first-touch して確保する
+    fs.mask = createLargeZeroed(canvas.height, canvas.width, CV_8UC1);
+    if constexpr (CN == 4 && std::is_same_v<T, uchar>) {
+        const SimdKernels& K = simdKernels();
+        for (int r = 0; r < roi.height; ++r) {
+            K.alphaMaskRow(src.pixels.ptr<uchar>(r), fs.mask.ptr<uchar>(r + roi.y) + roi.x, roi.width, 1);
+        }
+    } else if constexpr (CN == 4) {
+        for (int r = 0; r < roi.height; ++r) {
+            const Px* p = src.pixels.ptr<Px>(r);
+            uchar* q = fs.mask.ptr<uchar>(r + roi.y) + roi.x;
+            for (int c = 0; c < roi.width; ++c) q[c] = (p[c][3] > 0) ? 255 : 0;
+        }
+    } else {
+        src.mask.copyTo(fs.mask(roi));
+    }
+
+    // 距離変換（非ゼロ画素について、最も近いゼロ画素までの距離）
+    // → 有効領域内部ほど距離が大きく、境界で0に近い（出力は確保済みのものへ書く）
+    fs.dist = createLargeZeroed(canvas.height, canvas.width, CV_32FC1);
+    cv::distanceTransform(fs.mask, fs.dist, cv::DIST_L2, 3);
+
+    // フェザー幅制御（任意）
+    if (featherRadius > 0.0f) cv::min(fs.dist, featherRadius, fs.dist);
+}
+
+// フェザー合成の本体（画素型ごとにインスタンス化）
+template <typename T, int CN>
+static StitchImage feather_blend_impl(
+    const StitchImage& cam1,
+    const StitchImage& cam2,
+    const cv::Point2d& shift_from_phaseCorrelate,
+    float featherRadius)
+{
+    using Px = cv::Vec<T, CN>;
+    constexpr float maxV = (float)PixelTraits<T>::maxValue;
+
+    // 貼り付けオフセット
+    const int x1 = 0, y1 = 0;
+    const int x2 = checkedExtent(std::llround(-shift_from_phaseCorrelate.x));
+    const int y2 = checkedExtent(std::llround(-shift_from_phaseCorrelate.y));
+
+    const int h1 = cam1.rows(), w1 = cam1.cols();
+    const int h2 = cam2.rows(), w2 = cam2.cols();
+
+    // キャンバスサイズ（端は 64bit で求め、辺が int に収まるか確かめる）
+    const cv::Rect canvasRect = unionExtent(cv::Rect(x1, y1, w1, h1), cv::Rect(x2, y2, w2, h2));
+    const int out_w = canvasRect.width;
+    const int out_h = canvasRect.height;
+
+    const int sx = -canvasRect.x;
+    const int sy = -canvasRect.y;
+
+    // 各画像のキャンバス上の配置（画素はコピーせず元画像から直接読む）
+    const cv::Rect roi1(x1 + sx, y1 + sy, w1, h1);
+    const cv::Rect roi2(x2 + sx, y2 + sy, w2, h2);
+    CV_Assert(0 <= roi1.x && 0 <= roi1.y && roi1.x + roi1.width <= out_w && roi1.y + roi1.height <= out_h);
+    CV_Assert(0 <= roi2.x && 0 <= roi2.y && roi2.x + roi2.width <= out_w && roi2.y + roi2.height <= out_h);
+
+    const cv::Size canvasSize(out_w, out_h);
+    FeatherSource fs1, fs2;
+    prepare_feather_source<T, CN>(fs1, cam1, roi1, canvasSize, featherRadius);
+    prepare_feather_source<T, CN>(fs2, cam2, roi2, canvasSize, featherRadius);
+
+    // 合成（フェザー）
+    // キャンバスは行の帯ごとに並列に 0 を書いて確保し、合成も同じ分け方で並列に回す（ページが処理するスレッドの側に載る）
+    cv::Mat canvas = createLargeZeroed(out_h, out_w, cam1.pixels.type());
+    cv::Mat1b outMask;
+    if constexpr (CN != 4) outMask = createLargeZeroed(out_h, out_w, CV_8UC1);
+    std::atomic<int64_t> covered{0};
+    constexpr float eps = 1e-6f;
+
+    // 両方が有効になり得る列（2枚の配置の横方向の重なり）
+    const int ox0 = std::max(roi1.x, roi2.x);
+    const int ox1 = std::min(roi1.x + roi1.width, roi2.x + roi2.width);
+    const SimdKernels& K = simdKernels();
+
+    cv::parallel_for_(cv::Range(0, out_h), [&](const cv::Range& range) {
+        int64_t coveredLocal = 0;
+        std::vector<float> buf1, buf2, wbuf1, wbuf2;
+        for (int r = range.start; r < range.end; ++r) {
+            const uchar* q1 = fs1.validRow(r);
+            const uchar* q2 = fs2.validRow(r);
+            const Px* p1 = (r >= roi1.y && r < roi1.y + roi1.height) ? cam1.pixels.ptr<Px>(r - roi1.y) : nullptr;
+            const Px* p2 = (r >= roi2.y && r < roi2.y + roi2.height) ? cam2.pixels.ptr<Px>(r - roi2.y) : nullptr;
+
+            // 両方が掛かる行だけ、重なりの列の正規化済みの重みを 1行分まとめて作る（添字はキャンバスの列 - ox0）
+            const float* ww1Row = nullptr;
+            const float* ww2Row = nullptr;
+            if (p1 && p2 && ox0 < ox1) {
+                const float* dd1 = fs1.distRow(r, buf1);
+                const float* dd2 = fs2.distRow(r, buf2);
+                wbuf1.resize(ox1 - ox0);
+                wbuf2.resize(ox1 - ox0);
+                K.featherWeightsRow(dd1 + ox0, dd2 + ox0, wbuf1.data(), wbuf2.data(), ox1 - ox0, eps);
+                ww1Row = wbuf1.data();
+                ww2Row = wbuf2.data();
+            }
+            Px* out = canvas.ptr<Px>(r);
+            uchar* mo = outMask.empty() ? nullptr : outMask.ptr<uchar>(r);
+
+            for (int c = 0; c < out_w; ++c) {
+                // 有効 ⇒ 元画像の範囲内
+                const bool v1 = q1[c] != 0;
+                const bool v2 = q2[c] != 0;
+
+                if (!v1 && !v2) continue; // キャンバスは0初期化済み
+                ++coveredLocal;
+                if (mo) mo[c] = 255;
+                if (v1 && !v2) { out[c] = p1[c - roi1.x]; continue; }
+                if (!v1 && v2) { out[c] = p2[c - roi2.x]; continue; }
+
+                // 両方有効：距離から重み（境界ピッタリで両方ほぼ0 なら等分）
+                const float ww1 = ww1Row[c - ox0];
+                const float ww2 = ww2Row[c - ox0];
+
+                const Px a = p1[c - roi1.x];
+                const Px b = p2[c - roi2.x];
+
+                if constexpr (CN == 4) {
+                    const float a1 = a[3] / maxV;
+                    const float a2 = b[3] / maxV;
+
+                    // αも含めて「事前乗算」で混ぜる（境界が破綻しにくい）
+                    // フェザー重みで混合
+                    const float ao = std::clamp(a1*ww1 + a2*ww2, 0.0f, 1.0f); // 出力alpha
+
+                    for (int k = 0; k < 3; ++k) {
+                        float o = 0.0f;
+                        if (ao > eps) o = ((a[k]/maxV) * a1 * ww1 + (b[k]/maxV) * a2 * ww2) / ao;
+                        out[c][k] = (T)std::lround(std::clamp(o, 0.0f, 1.0f) * maxV);
+                    }
+                    out[c][3] = (T)std::lround(ao * maxV);
+                } else {
+                    for (int k = 0; k < CN; ++k) {
+                        out[c][k] = cv::saturate_cast<T>(a[k] * ww1 + b[k] * ww2);
+                    }
+                }
+            }
+        }
+        covered += coveredLocal;
+    });
+
+    StitchImage result;
+    result.pixels = canvas;
+
+    // 出力の有効領域（全面有効ならマスク無し）
+    if (!outMask.empty() && covered.load() != (int64_t)out_w * out_h) result.mask = outMask;
+
+    return result;
+}
+
+StitchImage make_canvas_bgra_feather_dt(
+    const StitchImage& cam1,
+    const StitchImage& cam2,
+    const cv::Point2d& shift_from_phaseCorrelate,
+    float featherRadius)
+{
+    CV_Assert(!cam1.empty() && !cam2.empty());
+
+    StitchImage in1 = cam1, in2 = cam2;
+    unifyPixelTypes(in1, in2);
+
+    return dispatchPixelType(in1.pixels.type(), [&](auto tag) {
+        using T = typename decltype(tag)::type;
+        return feather_blend_impl<T, decltype(tag)::channels>(in1, in2, shift_from_phaseCorrelate, featherRadius);
+    });
+}
+
+// 有効領域の境界からの距離（フェザー幅で抑える）。キャンバス内側の辺には 0 の縁を付けて境界にする
+static cv::Mat1f featherDistance(const cv::Mat1b& valid, bool left, bool right, bool top, bool bottom, float featherRadius)
+{
+    const int pl = left ? 1 : 0, pr = right ? 1 : 0, pt = top ? 1 : 0, pb = bottom ? 1 : 0;
+    cv::Mat1b padded;
+    cv::copyMakeBorder(valid, padded, pt, pb, pl, pr, cv::BORDER_CONSTANT, cv::Scalar(0));
+    cv::Mat1f d;
+    cv::distanceTransform(padded, d, cv::DIST_L2, 3);
+    cv::Mat1f dist = d(cv::Rect(pl, pt, valid.cols, valid.rows)).clone();
+    if (featherRadius > 0.0f) cv::min(dist, featherRadius, dist);
+    return dist;
+}
+
+FeatherTile prepareFeatherWeights(const cv::Mat1b& valid, cv::Size size, cv::Point pos, cv::Size canvas, float featherRadius)
+{
+    CV_Assert(size.width > 0 && size.height > 0);
+    CV_Assert(valid.empty() || valid.size() == size);
+
+    FeatherTile t;
+    t.rect = cv::Rect(pos, size);
+    t.opaqueRect = valid.empty();
+
+    // 各辺がキャンバス内にあるか（キャンバス端・はみ出しは境界に数えない）
+    const bool left = t.rect.x > 0;
+    const bool right = t.rect.x + t.rect.width < canvas.width;
+    const bool top = t.rect.y > 0;
+    const bool bottom = t.rect.y + t.rect.height < canvas.height;
+
+    if (t.opaqueRect) {
+        const float far_ = (float)(canvas.width + canvas.height);
+        t.colDist.resize(t.rect.width);
+        for (int c = 0; c < t.rect.width; ++c) {
+            const float dl = left ? kChamferAxis * (c + 1) : far_;
+            const float dr = right ? kChamferAxis * (t.rect.width - c) : far_;
+            float d = std::min(dl, dr);
+            if (featherRadius > 0.0f) d = std::min(d, featherRadius);
+            t.colDist[c] = d;
+        }
+        t.topEdge = top ? 1.0f : 0.0f;
+        t.bottomEdge = bottom ? 1.0f : 0.0f;
+        return t;
+    }
+
+    // 任意形状: タイル内で距離変換
+    t.valid = valid;
+    t.dist = featherDistance(valid, left, right, top, bottom, featherRadius);
+    return t;
+}
+
+FeatherTile prepareFeatherPlacement(cv::Size size, cv::Point pos, bool opaqueRect, cv::Size canvas, float featherRadius)
+{
+    if (opaqueRect) return prepareFeatherWeights(cv::Mat1b(), size, pos, canvas, featherRadius);
+
+    CV_Assert(size.width > 0 && size.height > 0);
+    FeatherTile t;
+    t.rect = cv::Rect(pos, size);
+    return t;
+}
+
+int featherHalo(float featherRadius)
+{
+    // 1歩で動けるのは 1行まで、1歩の長さは kChamferAxis 以上
+    CV_Assert(featherRadius > 0.0f);
+    return (int)std::ceil(featherRadius / kChamferAxis) + 1;
+}
+
+void setFeatherWeightRows(FeatherTile& t, const cv::Mat1b& validWindow, int win0, int row0, int row1,
+                          cv::Size canvas, float featherRadius)
+{
+    CV_Assert(!t.opaqueRect && featherRadius > 0.0f);
+    CV_Assert(validWindow.cols == t.rect.width && 0 <= win0 && win0 + validWindow.rows <= t.rect.height);
+    const int halo = featherHalo(featherRadius);
+    CV_Assert(win0 <= std::max(0, row0 - halo) && std::min(t.rect.height, row1 + halo) <= win0 + validWindow.rows);
+
+    // 窓の上下はタイルの端の時だけ境界になり得る（途中で切った所は境界に数えない）
+    const int win1 = win0 + validWindow.rows;
+    const bool left = t.rect.x > 0;
+    const bool right = t.rect.x + t.rect.width < canvas.width;
+    const bool top = win0 == 0 && t.rect.y > 0;
+    const bool bottom = win1 == t.rect.height && t.rect.y + t.rect.height < canvas.height;
+    const cv::Mat1f d = featherDistance(validWindow, left, right, top, bottom, featherRadius);
+
+    t.valid = validWindow.rowRange(row0 - win0, row1 - win0);
+    t.dist = d.rowRange(row0 - win0, row1 - win0);
+    t.weightRow0 = row0;
+}
+
+FeatherTile prepareFeatherTile(const StitchImage& img, cv::Point pos, cv::Size canvas, float featherRadius)
+{
+    CV_Assert(!img.empty());
+
+    cv::Mat1b valid;
+    if (img.hasAlpha()) {
+        cv::Mat alpha;
+        cv::extractChannel(img.pixels, alpha, 3);
+        cv::compare(alpha, 0, valid, cv::CMP_GT);
+    } else if (!img.isOpaqueRect()) {
+        valid = img.mask;
+    }
+
+    FeatherTile t = prepareFeatherWeights(valid, img.size(), pos, canvas, featherRadius);
+    t.image = img;
+    return t;
+}
+
+// 行単位のストリーミング合成（画素型ごとにインスタンス化）
+template <typename T, int CN>
+static void compose_rows_impl(const std::vector<const FeatherTile*>& tiles, cv::Size canvas,
+                              int y0, int y1, float featherRadius, cv::Mat& out)
+{
+    using Px = cv::Vec<T, CN>;
+    constexpr float maxV = (float)PixelTraits<T>::maxValue;
+    constexpr float eps = 1e-6f;
+    const int W = canvas.width;
+    const float far_ = (float)(canvas.width + canvas.height);
+
+    // 新しく確保する時は行の帯ごとに並列に 0 を書く（下の合成と同じ分け方）。確保済みのバッファはそのまま使う
+    const int type = CV_MAKETYPE(PixelTraits<T>::depth, CN);
+    if (out.rows == y1 - y0 && out.cols == W && out.type() == type) out.setTo(cv::Scalar::all(0));
+    else out = createLargeZeroed(y1 - y0, W, type);
+
+    cv::parallel_for_(cv::Range(y0, y1), [&](const cv::Range& range) {
+        // 重み付きの和と、重みが全て 0 の時に使う単純和（4ch は事前乗算）
+        std::vector<float> acc((size_t)W * CN), accU((size_t)W * CN), wsum(W);
+        std::vector<int> count(W), last(W);
+
+        for (int r = range.start; r < range.end; ++r) {
+            std::fill(acc.begin(), acc.end(), 0.0f);
+            std::fill(accU.begin(), accU.end(), 0.0f);
+            std::fill(wsum.begin(), wsum.end(), 0.0f);
+            std::fill(count.begin(), count.end(), 0);
+
+            for (int i = 0; i < (int)tiles.size(); ++i) {
+                const FeatherTile& t = *tiles[i];
+                const int tr = r - t.rect.y;
+                if (tr < 0 || tr >= t.rect.height) continue;
+
+                const int c0 = std::max(0, t.rect.x), c1 = std::min(W, t.rect.x + t.rect.width);
+                const Px* p = t.image.pixels.ptr<Px>(tr - t.imageRow0);
+                const uchar* v = t.opaqueRect ? nullptr : t.valid.ptr<uchar>(tr - t.weightRow0);
+                const float* dd = t.opaqueRect ? nullptr : t.dist.ptr<float>(tr - t.weightRow0);
+
+                // 矩形: 上下の境界までの距離
+                float dv = far_;
+                if (t.opaqueRect) {
+                    if (t.topEdge > 0) dv = std::min(dv, kChamferAxis * (tr + 1));
+                    if (t.bottomEdge > 0) dv = std::min(dv, kChamferAxis * (t.rect.height - tr));
+                    if (featherRadius > 0.0f) dv = std::min(dv, featherRadius);
+                }
+
+                for (int c = c0; c < c1; ++c) {
+                    const int tc = c - t.rect.x;
+                    if (v && v[tc] == 0) continue;
+
+                    const float w = t.opaqueRect ? std::min(t.colDist[tc], dv) : dd[tc];
+                    ++count[c];
+                    last[c] = i;
+                    wsum[c] += w;
+
+                    const Px& px = p[tc];
+                    float* a = &acc[(size_t)c * CN];
+                    float* u = &accU[(size_t)c * CN];
+                    if constexpr (CN == 4) {
+                        const float al = px[3] / maxV;
+                        for (int k = 0; k < 3; ++k) {
+                            a[k] += (px[k] / maxV) * al * w;
+                            u[k] += (px[k] / maxV) * al;
+                        }
+                        a[3] += al * w;
+                        u[3] += al;
+                    } else {
+                        for (int k = 0; k < CN; ++k) {
+                            a[k] += px[k] * w;
+                            u[k] += px[k];
+                        }
+                    }
+                }
+            }
+
+            Px* o = out.ptr<Px>(r - y0);
+            for (int c = 0; c < W; ++c) {
+                if (count[c] == 0) continue;
+
+                // 1枚だけ掛かる画素はそのまま（非重複部は入力と一致）
+                if (count[c] == 1) {
+                    const FeatherTile& t = *tiles[last[c]];
+                    o[c] = t.image.pixels.ptr<Px>(r - t.rect.y - t.imageRow0)[c - t.rect.x];
+                    continue;
+                }
+
+                // 境界ピッタリで重みが全て 0 → 等分
+                const bool flat = wsum[c] < eps;
+                const float* a = flat ? &accU[(size_t)c * CN] : &acc[(size_t)c * CN];
+                const float inv = flat ? 1.0f / count[c] : 1.0f / wsum[c];
+
+                if constexpr (CN == 4) {
+                    const float ao = std::clamp(a[3] * inv, 0.0f, 1.0f); // 出力alpha
+                    for (int k = 0; k < 3; ++k) {
+                        const float v = ao > eps ? a[k] * inv / ao : 0.0f;
+                        o[c][k] = (T)std::lround(std::clamp(v, 0.0f, 1.0f) * maxV);
+                    }
+                    o[c][3] = (T)std::lround(ao * maxV);
+                } else {
+                    for (int k = 0; k < CN; ++k) o[c][k] = cv::saturate_cast<T>(a[k] * inv);
+                }
+            }
+        }
+    });
+}
+
+void composeFeatherRows(const std::vector<const FeatherTile*>& tiles, cv::Size canvas,
+                        int y0, int y1, float featherRadius, cv::Mat& out)
+{
+    CV_Assert(!tiles.empty());
+    CV_Assert(0 <= y0 && y0 <= y1 && y1 <= canvas.height);
+
+    const int type = tiles.front()->image.pixels.type();
+    for (const FeatherTile* t : tiles) CV_Assert(t->image.pixels.type() == type);
+
+    dispatchPixelType(type, [&](auto tag) {
+        using T = typename decltype(tag)::type;
+        compose_rows_impl<T, decltype(tag)::channels>(tiles, canvas, y0, y1, featherRadius, out);
+    });
+}
@@ -0,0 +1,187 @@
+#ifndef STITCHCORE_H
+#define STITCHCORE_H
+
+#include "imagetypes.h"
+#include "bitmask.h"
+
+#include <opencv2/core.hpp>
+
+#include <atomic>
+#include <functional>
+#include <vector>
+
+// 位置合わせ・SSIM・合成の本体（OpenCV のみに依存。Qt には依存しない）
+// アプリ以外からは stitchapi.h の C API で呼べる
+
+// 位置合わせ結果
+struct return_struct1 {
+    double score = 0.0;
+    int x = 0;
+    int y = 0;
+};
+
+// 重なり領域のcrop結果（αを除いた 1 / 3ch、入力と同じ深さ）
+struct return_struct2 {
+    cv::Mat img1;
+    cv::Mat img2;
+};
+
+// SSIM 1スレッドの入力
+struct SSIM_TaskInput {
+    StitchImage input1;
+    StitchImage input2;
+    cv::Point pos1;
+    cv::Point pos2;
+    int dx;
+    int dy;
+};
+
+// 2枚の画素型を揃える（深さは u16 側へ、チャンネルは多い側へ昇格）
+void unifyPixelTypes(StitchImage& a, StitchImage& b);
+
+// αまたは分離マスクから logical配列（CV_8U, 0/1）を作る
+cv::Mat1b alphaMaskFromImage(const StitchImage& img, double alphaThreshold = 0.5);
+
+// logical配列の最大面積矩形。無ければ (0,0,0,0)
+cv::Rect maxRectOnesFromLogical(const cv::Mat1b& mask);
+
+// 位置合わせに必要な範囲（重なり + margin）を各画像の座標で求める。重ならなければ false
+// 部分読み込みした画像は、位置に roi.tl() を足せば全体と同じ結果になる
+bool overlapRegions(cv::Size size1, cv::Size size2, cv::Point pos1, cv::Point pos2, int margin,
+                    cv::Rect& roi1, cv::Rect& roi2);
+
+// 位相相関法の前処理（gray → CLAHE → 勾配強度 → 正規化 → Hanning窓）
+cv::Mat1f clahe_then_grad(const cv::Mat& im);
+
+// 重なりのうち両画像とも有効な最大矩形（pos1, pos2 と同じ座標）。無ければ空
+// Crop_2ImageTo2Image の切り出し範囲。画素はコピーしない
+cv::Rect overlapValidRect(const StitchImage& input1, const StitchImage& input2,
+                          cv::Point pos1, cv::Point pos2);
+
+// 2つの画像から重なり領域をクロップして取り出す
+return_struct2 Crop_2ImageTo2Image(const StitchImage& input1, const StitchImage& input2,
+                                   cv::Point pos1, cv::Point pos2);
+
+// SSIM（カラーはグレースケールに落として評価）
+double ssim(const cv::Mat& a, const cv::Mat& b);
+
+// 位相相関法による位置合わせ。戻り値の x, y は 1枚目基準の 2枚目位置
+// isCanceled が true を返したら前処理の途中で止めて score 0 を返す（先読みの打ち切り用）
+return_struct1 align_phase_correlate(const StitchImage& input1, const StitchImage& input2,
+                                     cv::Point pos1, cv::Point pos2,
+                                     const std::function<bool()>& isCanceled = {});
+
+// タイルスキャンの隣接ペアの位置合わせ。公称の相対位置 nominalRel（1枚目基準の 2枚目位置）での重なりだけを
+// 切り出して位相相関する。戻り値の x, y は 1枚目基準の 2枚目位置、score は応答（重ならない・求まらなければ 0）
+// 公称から外れた結果を捨てるかどうかは呼び出し側で決める
+return_struct1 align_phase_pair(const StitchImage& a, const StitchImage& b, cv::Point nominalRel);
+
+// 位置合わせ用の 1ch 画像（元の深さのグレースケール + 有効領域）
+// 位置合わせ・SSIM はどれもグレースケールで評価するので、読み込み後に 1回作っておけばボタンごとの変換が要らない
+// 4ch は alpha >= 0.5 を分離マスクへ移し、全面不透明ならマスクは空（不透明な矩形として扱える）
+// 深さが同じ画像どうしなら、元の画像の代わりに使っても位置合わせの結果は変わらない
+StitchImage alignGrayImage(const StitchImage& img);
+
+// 手で大体の位置に置かずに使える粗い自動配置
+// 2枚を長辺 maxSide 以下へ縮小し、2枚目が 1枚目の右・左・下・上にある場合ごとに重なりの幅（高さ）を何通りか仮定して、
+// その重なりの位相相関で位置を求める。候補どうしは縮小画像の重なりの NCC で比べる
+// 戻り値の x, y は 1枚目基準の 2枚目位置（入力の画素）、score は NCC（見つからなければ 0）
+// 縮小した分だけ粗いので、この後 align_phase_correlate / SSIM で詰める
+return_struct1 align_coarse_placement(const StitchImage& input1, const StitchImage& input2, int maxSide = 512);
+
+// 位相相関面の上位 k 個のピーク（周期の折り返しを含む）とその ±1px だけを SSIM で評価する
+// 単一ピークが周期構造などで外れる場合の代わり。戻り値の score は SSIM（候補が無ければ 0）
+return_struct1 align_phase_topk(const StitchImage& input1, const StitchImage& input2,
+                                cv::Point pos1, cv::Point pos2, int k);
+
+// 正規化相互相関の相関面による局所探索（現在位置から ±radius を一括評価）
+// 戻り値の x, y は 1枚目基準の 2枚目位置、score は相関面の最大値（重なり不足なら 0）
+return_struct1 align_ncc_surface(const StitchImage& input1, const StitchImage& input2,
+                                 cv::Point pos1, cv::Point pos2, int radius);
+
+// SSIM 1候補の評価
+double SSIM_calc_oneshot(const SSIM_TaskInput& in);
+
+// SSIM 全探索の共有入力（読み取り専用。全候補・全スレッドで 1つ）
+// 型の統一・グレースケール化・有効領域のビット化を探索の前に 1回だけ行い、
+// 候補ごとには重なりのビューを取るだけにする（候補ごとの画像コピー・確保をしない）
+struct SSIM_SharedInput {
+    cv::Mat gray1, gray2;       // 同じ深さの 1ch
+    BitMask valid1, valid2;     // 有効領域。全面有効なら空
+    cv::Point pos1, pos2;
+    double L = 255.0;           // 画素値のダイナミックレンジ
+};
+
+SSIM_SharedInput prepareSsimShared(const StitchImage& input1, const StitchImage& input2,
+                                   cv::Point pos1, cv::Point pos2);
+
+// 2枚目を (dx, dy) ずらした候補の SSIM（SSIM_calc_oneshot と同じ値）
+// マスク・SSIM の作業領域はスレッドごとに使い回す
+double SSIM_calc_shared(const SSIM_SharedInput& in, int dx, int dy);
+
+// 分枝限定版。best（全スレッドで共有するそれまでの最良スコア）に届かないと分かった時点で打ち切り -inf を返す
+// 最後まで評価した候補は SSIM_calc_shared と同じ値
+double SSIM_calc_shared_bounded(const SSIM_SharedInput& in, int dx, int dy, const std::atomic<double>& best);
+
+// SSIM 探索の候補の順（±radius のずらし量を現在位置から外側へ、チェビシェフ距離の順）
+// 良い候補が早く見つかるほど、残りの候補の打ち切りが早くなる
+std::vector<cv::Point> ssimSearchOrder(int radius);
+
+// best を score との大きい方へ（複数スレッドから呼んでよい）
+void ssimUpdateBest(std::atomic<double>& best, double score);
+
+// ずらし量 d の候補が現在の最良 bestD より良いか。同点は全探索の順（dx, dy の昇順）で先の方
+// 評価の順に関係なく、全候補を評価して最大を取るのと同じ結果にするため
+bool ssimBetterCandidate(double score, cv::Point d, double bestScore, cv::Point bestD);
+
+// SSIM 探索（現在位置から ±radius を cv::parallel_for_ で評価。分枝限定で打ち切るが結果は全探索と同じ）
+// 戻り値の x, y は 1枚目基準の 2枚目位置。isCanceled が true を返したら残りの候補は評価しない
+return_struct1 align_ssim_search(const StitchImage& input1, const StitchImage& input2,
+                                 cv::Point pos1, cv::Point pos2, int radius,
+                                 const std::function<bool()>& isCanceled = {});
+
+// 画像２枚を合成（距離変換フェザー）
+// shift: phaseCorrelate(a,b) の戻り値を想定（x2=-shift.x）
+// featherRadius: フェザー幅（ピクセル）。0以下なら無制限（画像内側ほど重くなる）
+StitchImage make_canvas_bgra_feather_dt(
+    const StitchImage& cam1,
+    const StitchImage& cam2,
+    const cv::Point2d& shift_from_phaseCorrelate,
+    float featherRadius = 80.0f);
+
+// グリッド結合用：1タイルの配置とフェザー重み（make_canvas_bgra_feather_dt と同じ規則）
+// 有効領域（4ch: alpha > 0 / 分離マスク / 矩形）の境界からの距離を重みにし、キャンバス端は境界に数えない
+struct FeatherTile {
+    StitchImage image;            // 全体、または合成する行を含む一部の行（imageRow0 から）
+    int imageRow0 = 0;            // image の先頭行（タイル座標）
+    cv::Rect rect;                // キャンバス上の配置（はみ出しても良い。はみ出し分は捨てる）
+    bool opaqueRect = false;
+    std::vector<float> colDist;   // 矩形: 左右の境界までの距離（タイル幅）
+    float topEdge = 0, bottomEdge = 0; // 矩形: 上下が境界なら 1（キャンバス端なら 0）
+    cv::Mat1b valid;              // 任意形状: 有効領域（0/255、タイル幅。weightRow0 の行から）
+    cv::Mat1f dist;               // 任意形状: 距離変換結果（valid と同じ行）
+    int weightRow0 = 0;           // valid・dist の先頭行（タイル座標。帯ごとに作る時は帯の先頭）
+};
+
+FeatherTile prepareFeatherTile(const StitchImage& img, cv::Point pos, cv::Size canvas, float featherRadius = 80.0f);
+
+// 画素を持たずに配置と重みだけを準備する（image・imageRow0 は合成する行に合わせて後から入れる）
+// valid: 有効領域（0/255、size と同じ）。空なら不透明な矩形
+FeatherTile prepareFeatherWeights(const cv::Mat1b& valid, cv::Size size, cv::Point pos, cv::Size canvas,
+                                  float featherRadius = 80.0f);
+
+// 重みを帯ごとに作る用（タイル全体の有効領域・距離を持たない）
+// prepareFeatherPlacement で配置だけを準備し、任意形状なら帯ごとに setFeatherWeightRows で行 [row0, row1) の重みを入れる
+// validWindow は行 [win0, win0 + rows) の有効領域（0/255、タイル幅）で、[row0 - featherHalo, row1 + featherHalo) ∩ タイル
+// を含むこと。フェザー幅は有限（> 0）に限る（帯の外で距離が featherRadius 未満になる経路は無いので、全体と同じ値）
+FeatherTile prepareFeatherPlacement(cv::Size size, cv::Point pos, bool opaqueRect, cv::Size canvas, float featherRadius);
+int featherHalo(float featherRadius);
+void setFeatherWeightRows(FeatherTile& t, const cv::Mat1b& validWindow, int win0, int row0, int row1,
+                          cv::Size canvas, float featherRadius);
+
+// キャンバスの行 [y0, y1) を合成して out へ（(y1 - y0) x canvas.width、タイルと同じ型）
+// 掛かるタイルは全て tiles に含めること。どのタイルも掛からない画素は 0
+void composeFeatherRows(const std::vector<const FeatherTile*>& tiles, cv::Size canvas,
+                        int y0, int y1, float featherRadius, cv::Mat& out);
+
+#endif // STITCHCORE_H
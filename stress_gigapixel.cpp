@@ -0,0 +1,179 @@
+// 2^31 画素・2^31 バイトを超えるキャンバスでの負荷確認
+// 面積・行のオフセット・キャンバスの外接矩形が 32bit で溢れないことを、既知の答えがある入力で確かめる
+// 使い方: stress_gigapixel [入力の幅] [高さ] [ずらし量 x]   既定: 40000 x 32000、x = 30000（キャンバス 70000 x 32000 = 2.24G 画素）
+// 必要なメモリの目安は 1ch u8 で 入力 2枚 + キャンバス 2枚分（既定で約 10GB）。失敗があれば終了コード 1
+
+#include "stitchcore.h"
+#include "stitchapi.h"
+#include "tilestore.h"
+
+#include <opencv2/core.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <initializer_list>
+
+static int g_failures = 0;
+
+static void check(bool ok, const char *what)
+{
+    std::printf("  %-4s %s\n", ok ? "OK" : "FAIL", what);
+    if (!ok) ++g_failures;
+}
+
+static double secSince(std::chrono::steady_clock::time_point t0)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// 入力の内容（行・列ごとに変わる。行や列のずれ・タイルの取り違えが値の違いになり、タイルも LZ で圧縮される）
+// 偶数にしておき、重なりの中央（重み 0.5 ずつ）の平均が割り切れるようにする
+static uchar patternA(int64_t r, int64_t c) { return (uchar)(2 * ((r * 7 + c) % 127)); }
+static uchar patternB(int64_t r, int64_t c) { return (uchar)(2 * ((r * 13 + 3 * c) % 127)); }
+
+static cv::Mat makePattern(int rows, int cols, uchar (*f)(int64_t, int64_t))
+{
+    cv::Mat m(rows, cols, CV_8UC1);
+    cv::parallel_for_(cv::Range(0, rows), [&](const cv::Range& range) {
+        for (int r = range.start; r < range.end; ++r) {
+            uchar *p = m.ptr<uchar>(r);
+            for (int c = 0; c < cols; ++c) p[c] = f(r, c);
+        }
+    });
+    return m;
+}
+
+// m の行 r の列 [c0, c1) が入力の行 srcRow・列 c - dx の内容と同じか
+static bool rowMatches(const cv::Mat& m, int r, int64_t srcRow, int c0, int c1, int dx, uchar (*f)(int64_t, int64_t))
+{
+    const uchar *p = m.ptr<uchar>(r);
+    for (int c = std::max(0, c0); c < std::min(m.cols, c1); ++c) {
+        if (p[c] != f(srcRow, c - dx)) return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    const int W = argc > 1 ? std::atoi(argv[1]) : 40000;
+    const int H = argc > 2 ? std::atoi(argv[2]) : 32000;
+    const int dx = argc > 3 ? std::atoi(argv[3]) : 30000;
+    if (W <= 0 || H <= 0 || dx <= 0 || dx >= W) {
+        std::fprintf(stderr, "0 < ずらし量 < 幅 にしてください\n");
+        return 2;
+    }
+    const cv::Size canvas(checkedExtent((int64_t)W + dx), H);
+    std::printf("inputs %d x %d, canvas %d x %d (%.2fG px), threads %d\n",
+                W, H, canvas.width, canvas.height, pixelCount(canvas) / 1e9, cv::getNumThreads());
+
+    // 1) 外接矩形・面積
+    std::printf("[extent]\n");
+    if (pixelCount(canvas) <= INT_MAX) std::printf("  note: canvas is below 2^31 pixels\n");
+    check(unionExtent(cv::Rect(0, 0, W, H), cv::Rect(dx, 0, W, H)) == cv::Rect(cv::Point(0, 0), canvas), "unionExtent");
+
+    // 2) 最大矩形（キャンバス全体のマスク。右端近くの縦の隙間で切れる）
+    {
+        std::printf("[max rect]\n");
+        const auto t0 = std::chrono::steady_clock::now();
+        cv::Mat1b mask(canvas, uchar(1));
+        mask.colRange(canvas.width - 100, canvas.width - 90).setTo(0);
+        const cv::Rect r = maxRectOnesFromLogical(mask);
+        std::printf("  %.1f s\n", secSince(t0));
+        check(r == cv::Rect(0, 0, canvas.width - 100, H), "rect left of the gap");
+        check(pixelCount(r) == (int64_t)(canvas.width - 100) * H, "64-bit area");
+    }
+
+    StitchImage a, b;
+    a.pixels = makePattern(H, W, patternA);
+    b.pixels = makePattern(H, W, patternB);
+
+    // 3) 重なりの有効矩形
+    {
+        std::printf("[overlap]\n");
+        const cv::Rect r = overlapValidRect(a, b, cv::Point(0, 0), cv::Point(dx, 0));
+        check(r == cv::Rect(dx, 0, W - dx, H), "overlapValidRect");
+    }
+
+    // 4) フェザー合成（片側だけの範囲は元の値、重なりの中央は 2枚の平均）
+    cv::Mat blended;
+    {
+        std::printf("[feather blend]\n");
+        const auto t0 = std::chrono::steady_clock::now();
+        const StitchImage r = make_canvas_bgra_feather_dt(a, b, cv::Point2d(-dx, 0), 80.0f);
+        std::printf("  %.1f s\n", secSince(t0));
+        check(r.size() == canvas, "canvas size");
+        check(r.mask.empty(), "fully covered");
+        const int mid = dx + (W - dx) / 2;
+        bool ok = true;
+        for (int row : {0, H / 2, H - 1}) {
+            ok = ok && rowMatches(r.pixels, row, row, 0, dx - 100, 0, patternA);
+            ok = ok && rowMatches(r.pixels, row, row, W + 100, canvas.width, dx, patternB);
+            ok = ok && r.pixels.at<uchar>(row, mid) == (patternA(row, mid) + patternB(row, mid - dx)) / 2;
+        }
+        check(ok, "first / last rows and the overlap centre");
+        blended = r.pixels;
+    }
+
+    // 5) C API（呼び出し側のバッファへ。行ストライドは size_t）
+    {
+        std::printf("[C API]\n");
+        int w = 0, h = 0;
+        StitcherFormat fmt = STITCHER_GRAY8;
+        StitcherBuffer ba{a.pixels.data, W, H, a.pixels.step, STITCHER_GRAY8, nullptr, 0};
+        StitcherBuffer bb{b.pixels.data, W, H, b.pixels.step, STITCHER_GRAY8, nullptr, 0};
+        check(stitcher_blend_size(&ba, &bb, dx, 0, &w, &h, &fmt) == STITCHER_OK && w == canvas.width && h == H,
+              "stitcher_blend_size");
+
+        cv::Mat out(canvas, CV_8UC1);
+        StitcherBuffer bo{out.data, w, h, out.step, STITCHER_GRAY8, nullptr, 0};
+        const auto t0 = std::chrono::steady_clock::now();
+        const bool ok = stitcher_blend(&ba, &bb, dx, 0, 80.0f, &bo) == STITCHER_OK;
+        std::printf("  %.1f s\n", secSince(t0));
+        check(ok && cv::norm(out, blended, cv::NORM_INF) == 0, "stitcher_blend matches");
+    }
+
+    // 6) 圧縮して保持（帯ごとの合成が全体の合成・入力の内容と一致するか。タイルの境目をまたぐ帯と最後の帯も確かめる）
+    {
+        std::printf("[tiled]\n");
+        const auto t0 = std::chrono::steady_clock::now();
+        const auto ta = TiledImage::compress(a);
+        const auto tb = TiledImage::compress(b);
+        a = b = StitchImage();
+        const auto tc = make_canvas_feather_tiled(*ta, *tb, cv::Point(dx, 0), 80.0f);
+        std::printf("  %.1f s, inputs %.1f MB, canvas %.1f MB compressed of %.1f GB\n", secSince(t0),
+                    (ta->compressedBytes() + tb->compressedBytes()) / 1e6, tc->compressedBytes() / 1e6,
+                    tc->rawBytes() / 1e9);
+        check(tc->size() == canvas, "tiled canvas size");
+
+        // 1画素だけ持つタイル（全画素が同じ値）ではなく LZ で圧縮されていること
+        const int64_t tiles = (int64_t)((W + ta->tileSize() - 1) / ta->tileSize()) *
+                              ((H + ta->tileSize() - 1) / ta->tileSize());
+        check(ta->compressedBytes() > (size_t)tiles * 64 && ta->compressedBytes() < ta->rawBytes(),
+              "inputs go through the LZ codec");
+
+        bool ok = true;
+        const int edge = ta->tileSize();
+        for (int y : {0, edge - 32, H / 2 + 37, H - 64}) {
+            if (y < 0 || y + 64 > H) continue;
+            const cv::Rect band(0, y, canvas.width, 64);
+            const cv::Mat got = tc->read(band).pixels;
+            ok = ok && cv::norm(got, blended(band), cv::NORM_INF) == 0;
+            for (int r : {0, 31, 32, 63}) {
+                ok = ok && rowMatches(got, r, y + r, 0, dx - 100, 0, patternA);
+                ok = ok && rowMatches(got, r, y + r, W + 100, canvas.width, dx, patternB);
+            }
+        }
+        check(ok, "tiled bands match the full blend and the inputs");
+    }
+
+    if (g_failures) {
+        std::printf("%d FAILED\n", g_failures);
+        return 1;
+    }
+    std::printf("all passed\n");
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include "threadbudget.h"
+
+#include <QSettings>
+#include <QThread>
+#include <QThreadPool>
+
+#include <opencv2/core.hpp>
+
+#include <algorithm>
+#include <mutex>
+
+#if defined(Q_OS_WIN)
+#define NOMINMAX
+#include <windows.h>
+#elif defined(Q_OS_LINUX)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+std::mutex g_mutex;
+int g_total = 1;
+bool g_pin = false;
+bool g_applied = false;          // 起動時の apply が済んだか
+
+// 先頭 count コアへ限定する。Windows はプロセス全体、それ以外は呼び出しスレッドだけ
+// （既に動いているスレッドは変わらない。起動時にワーカーを作る前に呼び、以後に作られるスレッドへ継承させる）
+void restrictStartupAffinity(int count)
+{
+#if defined(Q_OS_WIN)
+    DWORD_PTR mask = 0;
+    for (int i = 0; i < count && i < (int)(sizeof(DWORD_PTR) * 8); ++i) mask |= (DWORD_PTR)1 << i;
+    if (mask != 0) SetProcessAffinityMask(GetCurrentProcess(), mask);
+#elif defined(Q_OS_LINUX)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int i = 0; i < count && i < CPU_SETSIZE; ++i) CPU_SET(i, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    Q_UNUSED(count); // 未対応OSでは固定しない
+#endif
+}
+} // namespace
+
+ThreadBudget::Settings ThreadBudget::loadSettings()
+{
+    QSettings st;
+    Settings s;
+    s.threads = st.value("threads/count", 0).toInt();
+    s.pinCores = st.value("threads/pinCores", false).toBool();
+    return s;
+}
+
+void ThreadBudget::saveSettings(const Settings& s)
+{
+    QSettings st;
+    st.setValue("threads/count", s.threads);
+    st.setValue("threads/pinCores", s.pinCores);
+}
+
+void ThreadBudget::apply(const Settings& s)
+{
+    const int hw = std::max(1, QThread::idealThreadCount());
+
+    std::lock_guard<std::mutex> lock(g_mutex);
+    g_total = s.threads > 0 ? s.threads : hw;
+
+    // コア固定は起動時の 1回だけ（プールのスレッドを作る前に。後から固定し直しても既存のスレッドには効かない）
+    if (!g_applied) {
+        g_applied = true;
+        g_pin = s.pinCores;
+        if (g_pin) restrictStartupAffinity(std::min(g_total, hw));
+    }
+
+    QThreadPool::globalInstance()->setMaxThreadCount(g_total);
+    cv::setNumThreads(g_total);
+}
+
+int ThreadBudget::total()
+{
+    std::lock_guard<std::mutex> lock(g_mutex);
+    return g_total;
+}
+
+bool ThreadBudget::pinned()
+{
+    std::lock_guard<std::mutex> lock(g_mutex);
+    return g_pin;
+}
@@ -0,0 +1,27 @@
+#ifndef THREADBUDGET_H
+#define THREADBUDGET_H
+
+// スレッド数の一元管理（QtConcurrent の外側並列 × OpenCV 内部並列の過剰生成を防ぐ）
+// - 総スレッド数を QThreadPool のグローバルプールと OpenCV の両方に設定する
+// - 候補ごとの並列は cv::parallel_for_ で回す（各候補の中の parallel_for_ は入れ子になり、OpenCV 側で逐次になる）
+// - 任意でコア固定（起動時に先頭 N コアへ限定し、以後に作られるスレッドへ継承させる）
+//   固定は起動時だけで、実行中に切り替えたり固定するコア数を変えたりはしない（再起動後に有効）
+class ThreadBudget
+{
+public:
+    struct Settings {
+        int threads = 0;        // 0 なら論理コア数
+        bool pinCores = false;
+    };
+
+    static Settings loadSettings();              // QSettings から
+    static void saveSettings(const Settings& s);
+
+    // 起動時（スレッドを作る前）に1回呼ぶ。以後の呼び出しはスレッド数だけ変え、コア固定（pinCores）は無視する
+    static void apply(const Settings& s);
+
+    static int total();          // 総スレッド数
+    static bool pinned();        // 起動時にコア固定したか
+};
+
+#endif // THREADBUDGET_H
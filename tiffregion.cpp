@@ -0,0 +1,171 @@
+#include "tiffregion.h"
+
+#include <QFile>
+#include <QFileInfo>
+
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <climits>
+#include <vector>
+
+#ifdef HAVE_LIBTIFF
+#include <tiffio.h>
+#endif
+
+TiffRegionReader::~TiffRegionReader()
+{
+#ifdef HAVE_LIBTIFF
+    if (tif_) TIFFClose(static_cast<TIFF*>(tif_));
+#endif
+}
+
+std::shared_ptr<TiffRegionReader> TiffRegionReader::open(const QString& path)
+{
+#ifdef HAVE_LIBTIFF
+    const QString suffix = QFileInfo(path).suffix().toLower();
+    if (suffix != "tif" && suffix != "tiff") return nullptr;
+
+    TIFFSetWarningHandler(nullptr); // 未知タグの警告などは出さない
+
+#ifdef _WIN32
+    TIFF *tif = TIFFOpenW(reinterpret_cast<const wchar_t*>(path.utf16()), "r");
+#else
+    TIFF *tif = TIFFOpen(QFile::encodeName(path).constData(), "r");
+#endif
+    if (!tif) return nullptr;
+
+    std::shared_ptr<TiffRegionReader> r(new TiffRegionReader);
+    r->tif_ = tif;
+
+    uint32_t w = 0, h = 0;
+    uint16_t bits = 0, spp = 1, planar = PLANARCONFIG_CONTIG, photo = 0, format = SAMPLEFORMAT_UINT;
+    TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &w);
+    TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &h);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_BITSPERSAMPLE, &bits);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_SAMPLESPERPIXEL, &spp);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_PLANARCONFIG, &planar);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_SAMPLEFORMAT, &format);
+    TIFFGetField(tif, TIFFTAG_PHOTOMETRIC, &photo);
+
+    // 対応外（パレット・YCbCr・白黒反転・プレーン分割・浮動小数など）は全体デコードへ
+    const bool gray = photo == PHOTOMETRIC_MINISBLACK && (spp == 1 || spp == 2);
+    const bool rgb = photo == PHOTOMETRIC_RGB && (spp == 3 || spp == 4);
+    if (w == 0 || h == 0 || w > (uint32_t)INT_MAX || h > (uint32_t)INT_MAX ||
+        (bits != 8 && bits != 16) || format != SAMPLEFORMAT_UINT ||
+        planar != PLANARCONFIG_CONTIG || !(gray || rgb)) {
+        return nullptr;
+    }
+
+    r->size_ = cv::Size((int)w, (int)h);
+    r->depth_ = bits == 16 ? CV_16U : CV_8U;
+    r->fileChannels_ = spp;
+    r->type_ = CV_MAKETYPE(r->depth_, spp == 2 ? 4 : spp);
+    r->tiled_ = TIFFIsTiled(tif) != 0;
+
+    if (r->tiled_) {
+        uint32_t tw = 0, th = 0;
+        TIFFGetField(tif, TIFFTAG_TILEWIDTH, &tw);
+        TIFFGetField(tif, TIFFTAG_TILELENGTH, &th);
+        if (tw == 0 || th == 0) return nullptr;
+        r->block_ = cv::Size((int)tw, (int)th);
+        r->blocksAcross_ = (int)((w + tw - 1) / tw);
+    } else {
+        uint32_t rps = h;
+        TIFFGetFieldDefaulted(tif, TIFFTAG_ROWSPERSTRIP, &rps);
+        r->block_ = cv::Size((int)w, (int)std::min(rps, h));
+        r->blocksAcross_ = 1;
+    }
+    return r;
+#else
+    Q_UNUSED(path);
+    return nullptr;
+#endif
+}
+
+void TiffRegionReader::setCacheLimit(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    cacheLimit_ = bytes;
+}
+
+// タイル（ストリップ）1個をデコードして返す。x0, y0 は画像上の左上
+std::shared_ptr<const cv::Mat> TiffRegionReader::block(int index, int& x0, int& y0)
+{
+    x0 = (index % blocksAcross_) * block_.width;
+    y0 = (index / blocksAcross_) * block_.height;
+
+    auto it = cache_.find(index);
+    if (it != cache_.end()) {
+        lru_.remove(index);
+        lru_.push_front(index);
+        return it->second;
+    }
+
+#ifdef HAVE_LIBTIFF
+    TIFF *tif = static_cast<TIFF*>(tif_);
+
+    // 端のストリップは短い。タイルは常に全サイズで符号化されている
+    const int rows = tiled_ ? block_.height : std::min(block_.height, size_.height - y0);
+    cv::Mat raw(rows, block_.width, CV_MAKETYPE(depth_, fileChannels_));
+    const tmsize_t bytes = (tmsize_t)raw.total() * (tmsize_t)raw.elemSize();
+    const tmsize_t got = tiled_ ? TIFFReadEncodedTile(tif, (uint32_t)index, raw.data, bytes)
+                                : TIFFReadEncodedStrip(tif, (uint32_t)index, raw.data, bytes);
+    if (got < 0) CV_Error(cv::Error::StsError, "TIFF decode failed");
+
+    // OpenCV の並び（BGR / BGRA）へ。Gray+α は BGRA（loadStitchImage と同じ）
+    auto m = std::make_shared<cv::Mat>();
+    switch (fileChannels_) {
+    case 1: *m = raw; break;
+    case 2: {
+        std::vector<cv::Mat> ch;
+        cv::split(raw, ch);
+        cv::merge(std::vector<cv::Mat>{ch[0], ch[0], ch[0], ch[1]}, *m);
+        break;
+    }
+    case 3: cv::cvtColor(raw, *m, cv::COLOR_RGB2BGR); break;
+    default: cv::cvtColor(raw, *m, cv::COLOR_RGBA2BGRA); break;
+    }
+#else
+    auto m = std::make_shared<cv::Mat>();
+#endif
+
+    cache_.emplace(index, m);
+    lru_.push_front(index);
+    cacheBytes_ += m->total() * m->elemSize();
+
+    // 古いものから手放す（今返すものは残す）
+    while (cacheBytes_ > cacheLimit_ && lru_.size() > 1) {
+        const int old = lru_.back();
+        lru_.pop_back();
+        auto o = cache_.find(old);
+        cacheBytes_ -= o->second->total() * o->second->elemSize();
+        cache_.erase(o);
+    }
+    return m;
+}
+
+StitchImage TiffRegionReader::read(const cv::Rect& roi)
+{
+    StitchImage out;
+    const cv::Rect r = roi & cv::Rect(cv::Point(0, 0), size_);
+    if (r.empty()) return out;
+
+    out.pixels.create(r.size(), type_);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // 範囲に掛かるタイルだけ
+    const int bx0 = r.x / block_.width, bx1 = (r.x + r.width - 1) / block_.width;
+    const int by0 = r.y / block_.height, by1 = (r.y + r.height - 1) / block_.height;
+    for (int by = by0; by <= by1; ++by) {
+        for (int bx = bx0; bx <= bx1; ++bx) {
+            int x0 = 0, y0 = 0;
+            const auto b = block(by * blocksAcross_ + bx, x0, y0);
+            const cv::Rect br = cv::Rect(x0, y0, b->cols, b->rows) & r;
+            if (br.empty()) continue;
+            (*b)(br - cv::Point(x0, y0)).copyTo(out.pixels(br - r.tl()));
+        }
+    }
+    return out;
+}
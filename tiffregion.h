@@ -0,0 +1,56 @@
+#ifndef TIFFREGION_H
+#define TIFFREGION_H
+
+#include "imagetypes.h"
+
+#include <QString>
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+
+// タイル / ストリップ TIFF の部分読み込み
+// 要求範囲に掛かるタイル（ストリップ）だけをデコードし、デコード済みタイルは LRU で保持する。
+// 位置合わせは重なり（+探索範囲）しか見ないので、I/O は重なりの面積に比例する。
+// libtiff が無いビルド（HAVE_LIBTIFF 未定義）や未対応の形式では open() が nullptr を返すので、
+// 呼び出し側は全体デコードに切り替える。
+class TiffRegionReader
+{
+public:
+    ~TiffRegionReader();
+
+    // 部分読み込みできる TIFF なら開く（u8 / u16、1〜4ch、チャンネル連続のみ）
+    static std::shared_ptr<TiffRegionReader> open(const QString& path);
+
+    cv::Size size() const { return size_; }
+    int type() const { return type_; } // 読み出し後の型（Gray+α は BGRA）
+
+    // 範囲を読み出す（画像外はクリップ）。スレッドセーフ
+    StitchImage read(const cv::Rect& roi);
+
+    // デコード済みタイルの保持上限
+    void setCacheLimit(size_t bytes);
+
+private:
+    TiffRegionReader() = default;
+
+    std::shared_ptr<const cv::Mat> block(int index, int& x0, int& y0); // mutex_ 保持中に呼ぶ
+
+    void *tif_ = nullptr;        // TIFF*
+    cv::Size size_;
+    int type_ = 0;
+    int fileChannels_ = 0;       // ファイル上のチャンネル数
+    int depth_ = CV_8U;
+    bool tiled_ = false;
+    cv::Size block_;             // タイル（ストリップなら 幅 x RowsPerStrip）
+    int blocksAcross_ = 1;
+
+    std::mutex mutex_;           // TIFF* はスレッドセーフでない
+    std::map<int, std::shared_ptr<const cv::Mat>> cache_;
+    std::list<int> lru_;         // 先頭が最近
+    size_t cacheBytes_ = 0;
+    size_t cacheLimit_ = 256u << 20;
+};
+
+#endif // TIFFREGION_H
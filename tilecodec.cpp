@@ -0,0 +1,127 @@
+#include "tilecodec.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace {
+
+// ---- LZ77（LZ4 と同じ系統のトークン形式。互換ではない） ----
+// トークン: 上位 4bit = リテラル長、下位 4bit = 一致長 - 4（15 なら 255 単位の延長バイトが続く）
+// 続いてリテラル、一致のオフセット（2バイト LE）。最後の系列はリテラルのみ
+
+constexpr int kMinMatch = 4;
+constexpr int kHashBits = 13;
+constexpr size_t kMaxOffset = 65535;
+constexpr size_t kTailLiterals = 12; // 末尾はリテラルのまま（4バイト読み出しの範囲チェックを省く）
+
+inline uint32_t read32(const uint8_t* p)
+{
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint32_t hash4(uint32_t v)
+{
+    return (v * 2654435761u) >> (32 - kHashBits);
+}
+
+inline void writeLength(std::vector<uint8_t>& out, size_t n)
+{
+    for (; n >= 255; n -= 255) out.push_back(255);
+    out.push_back((uint8_t)n);
+}
+
+void emitSequence(std::vector<uint8_t>& out, const uint8_t* lit, size_t litLen, size_t offset, size_t matchLen)
+{
+    const size_t ml = matchLen ? matchLen - kMinMatch : 0;
+    out.push_back((uint8_t)((std::min<size_t>(litLen, 15) << 4) | std::min<size_t>(ml, 15)));
+    if (litLen >= 15) writeLength(out, litLen - 15);
+    out.insert(out.end(), lit, lit + litLen);
+    if (!matchLen) return; // 最後の系列
+    out.push_back((uint8_t)(offset & 0xff));
+    out.push_back((uint8_t)(offset >> 8));
+    if (ml >= 15) writeLength(out, ml - 15);
+}
+
+} // namespace
+
+void lzCompress(const uint8_t* src, size_t n, std::vector<uint8_t>& out)
+{
+    out.clear();
+    out.reserve(n / 4 + 16);
+
+    thread_local std::vector<int32_t> table;
+    table.assign((size_t)1 << kHashBits, -1);
+
+    size_t anchor = 0, i = 0, misses = 0;
+    const size_t limit = n > kTailLiterals ? n - kTailLiterals : 0;
+    while (i < limit) {
+        const uint32_t v = read32(src + i);
+        const uint32_t h = hash4(v);
+        const int32_t cand = table[h];
+        table[h] = (int32_t)i;
+
+        if (cand < 0 || i - (size_t)cand > kMaxOffset || read32(src + cand) != v) {
+            i += 1 + (misses++ >> 6); // 圧縮できない区間は読み飛ばしを広げる
+            continue;
+        }
+        misses = 0;
+
+        size_t len = kMinMatch;
+        while (i + len < limit && src[cand + len] == src[i + len]) ++len;
+
+        emitSequence(out, src + anchor, i - anchor, i - (size_t)cand, len);
+        i += len;
+        anchor = i;
+        if (i - 2 < limit) table[hash4(read32(src + i - 2))] = (int32_t)(i - 2);
+    }
+    emitSequence(out, src + anchor, n - anchor, 0, 0);
+}
+
+bool lzDecompress(const uint8_t* src, size_t srcLen, uint8_t* dst, size_t dstLen)
+{
+    const uint8_t* ip = src;
+    const uint8_t* const iend = src + srcLen;
+    uint8_t* op = dst;
+    uint8_t* const oend = dst + dstLen;
+
+    auto readLength = [&](size_t n) -> size_t {
+        if (n != 15) return n;
+        for (;;) {
+            if (ip >= iend) return SIZE_MAX;
+            const uint8_t b = *ip++;
+            n += b;
+            if (b != 255) return n;
+        }
+    };
+
+    while (ip < iend) {
+        const uint8_t token = *ip++;
+        const size_t lit = readLength(token >> 4);
+        if (lit == SIZE_MAX || lit > (size_t)(iend - ip) || lit > (size_t)(oend - op)) return false;
+        if (lit) std::memcpy(op, ip, lit); // 空の画像では dst が null のことがある
+        ip += lit;
+        op += lit;
+        if (ip >= iend) break; // 最後の系列
+
+        if (iend - ip < 2) return false;
+        const size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        size_t len = readLength(token & 15);
+        if (len == SIZE_MAX) return false;
+        len += kMinMatch;
+        if (offset == 0 || offset > (size_t)(op - dst) || len > (size_t)(oend - op)) return false;
+
+        // 重なるコピー（offset < len）があるので前から 1バイトずつ
+        const uint8_t* m = op - offset;
+        if (offset >= len) {
+            std::memcpy(op, m, len);
+            op += len;
+        } else {
+            for (size_t k = 0; k < len; ++k) *op++ = m[k];
+        }
+    }
+    return op == oend;
+}
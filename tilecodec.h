@@ -0,0 +1,16 @@
+#ifndef TILECODEC_H
+#define TILECODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// タイルの圧縮（LZ4 と同じ系統の高速な LZ77。形式は互換ではない。OpenCV に依存しない）
+
+// src の n バイトを圧縮して out へ（out は作り直す）
+void lzCompress(const uint8_t* src, size_t n, std::vector<uint8_t>& out);
+
+// 展開して dst へ。dstLen バイトちょうどに戻らない・壊れている時は false
+bool lzDecompress(const uint8_t* src, size_t srcLen, uint8_t* dst, size_t dstLen);
+
+#endif // TILECODEC_H
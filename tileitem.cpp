@@ -0,0 +1,80 @@
+#include "tileitem.h"
+#include "imageio.h"
+
+#include <QPainter>
+#include <QStyleOptionGraphicsItem>
+
+#include <algorithm>
+#include <cmath>
+
+TileItem::TileItem(const QPixmap& pix, QGraphicsItem *parent) : QGraphicsPixmapItem(pix, parent)
+{
+    setFlags(QGraphicsItem::ItemIsMovable |
+             QGraphicsItem::ItemIsSelectable |
+             QGraphicsItem::ItemIsFocusable |
+             QGraphicsItem::ItemSendsGeometryChanges); // itemChange で位置変化を受け取る
+    tileCache.setMaxCost(64 << 20); // 表示用タイル（バイト）
+}
+
+void TileItem::setTileSource(TileSource s)
+{
+    source = std::move(s);
+    tileCache.clear();
+    setFlag(QGraphicsItem::ItemUsesExtendedStyleOption, (bool)source.read); // exposedRect を受け取る
+    update();
+}
+
+void TileItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
+{
+    if (!source.read || pixmap().isNull()) {
+        QGraphicsPixmapItem::paint(painter, option, widget);
+        return;
+    }
+
+    // 縮小版 1px あたりの元画像の画素数
+    const cv::Size full = source.size;
+    const qreal sx = (qreal)full.width / pixmap().width();
+    const qreal sy = (qreal)full.height / pixmap().height();
+    if (QStyleOptionGraphicsItem::levelOfDetailFromTransform(painter->worldTransform()) <= 1.0) {
+        // 縮小版の 1px が画面の 1px 以下なら縮小版で足りる
+        QGraphicsPixmapItem::paint(painter, option, widget);
+        return;
+    }
+
+    // 見えている範囲（元画像の座標）に掛かるタイルだけ
+    const QRectF exposed = option->exposedRect;
+    const int ts = source.tileSize;
+    const int x0 = std::max(0, (int)std::floor(exposed.left() * sx) / ts);
+    const int y0 = std::max(0, (int)std::floor(exposed.top() * sy) / ts);
+    const int x1 = std::min((full.width - 1) / ts, (int)std::ceil(exposed.right() * sx) / ts);
+    const int y1 = std::min((full.height - 1) / ts, (int)std::ceil(exposed.bottom() * sy) / ts);
+
+    painter->save();
+    painter->scale(1.0 / sx, 1.0 / sy);
+    painter->setRenderHint(QPainter::SmoothPixmapTransform, transformationMode() == Qt::SmoothTransformation);
+    for (int ty = y0; ty <= y1; ++ty) {
+        for (int tx = x0; tx <= x1; ++tx) {
+            const cv::Rect r = cv::Rect(tx * ts, ty * ts, ts, ts) & cv::Rect(cv::Point(0, 0), full);
+            const quint64 key = ((quint64)ty << 32) | (quint32)tx;
+            QPixmap *pix = tileCache.object(key);
+            if (!pix) {
+                pix = new QPixmap(QPixmap::fromImage(toDisplayImage(source.read(r))));
+                tileCache.insert(key, pix, r.area() * 4);
+            }
+            painter->drawPixmap(r.x, r.y, *pix);
+        }
+    }
+    painter->restore();
+}
+
+QVariant TileItem::itemChange(GraphicsItemChange change, const QVariant& value)
+{
+    if (change == ItemPositionHasChanged && onMoved) onMoved();
+    return QGraphicsPixmapItem::itemChange(change, value);
+}
+
+void TileItem::mouseReleaseEvent(QGraphicsSceneMouseEvent *event)
+{
+    QGraphicsPixmapItem::mouseReleaseEvent(event);
+    if (onReleased) onReleased();
+}
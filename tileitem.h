@@ -0,0 +1,42 @@
+#ifndef TILEITEM_H
+#define TILEITEM_H
+
+#include <QCache>
+#include <QGraphicsPixmapItem>
+
+#include "imagetypes.h"
+
+#include <functional>
+
+// 位置の変化・マウス操作の終了を通知する画像アイテム
+class TileItem : public QGraphicsPixmapItem
+{
+public:
+    explicit TileItem(const QPixmap& pix, QGraphicsItem *parent = nullptr);
+
+    std::function<void()> onMoved;    // 位置が変わった（ドラッグ中は毎フレーム）
+    std::function<void()> onReleased; // マウスを離した
+
+    // 元画像を範囲ごとに読む表示元（圧縮して保持している画像・1枚の QImage にできない大きな画像）
+    struct TileSource {
+        cv::Size size;                                   // 元画像の大きさ
+        int tileSize = 256;                              // 1回に読む範囲（元画像の画素）
+        std::function<StitchImage(const cv::Rect&)> read;
+    };
+
+    // pixmap は縮小版で、拡大表示では見えている範囲のタイルだけ読んで QImage へ変換して描く
+    // read が空なら通常の pixmap 表示に戻す
+    void setTileSource(TileSource source);
+
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) override;
+
+protected:
+    QVariant itemChange(GraphicsItemChange change, const QVariant& value) override;
+    void mouseReleaseEvent(QGraphicsSceneMouseEvent *event) override;
+
+private:
+    TileSource source;
+    QCache<quint64, QPixmap> tileCache; // 表示用に変換したタイル
+};
+
+#endif // TILEITEM_H
@@ -0,0 +1,358 @@
+#include "tilestore.h"
+#include "stitchcore.h"
+#include "tilecodec.h"
+
+#include <opencv2/core.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+namespace {
+
+// ---- 展開済みタイルの LRU（プロセス全体） ----
+
+struct TileCache {
+    std::mutex mutex;
+    size_t budget = size_t(512) << 20;
+    size_t used = 0;
+    std::list<uint64_t> order; // 先頭が最近使ったもの
+    struct Entry {
+        std::shared_ptr<const void> tile;
+        size_t bytes = 0;
+        std::list<uint64_t>::iterator it;
+    };
+    std::unordered_map<uint64_t, Entry> map;
+
+    void evict()
+    {
+        while (used > budget && !order.empty()) {
+            auto e = map.find(order.back());
+            used -= e->second.bytes;
+            map.erase(e);
+            order.pop_back();
+        }
+    }
+};
+
+TileCache& cache()
+{
+    static TileCache c;
+    return c;
+}
+
+std::atomic<uint64_t> g_nextId{1};
+
+inline uint64_t cacheKey(uint64_t id, int index)
+{
+    return (id << 32) | (uint32_t)index;
+}
+
+// 画素 1つ分のバイト列が全画素で同じか
+bool isUniform(const cv::Mat& m)
+{
+    const size_t es = m.elemSize();
+    const uchar* first = m.ptr(0);
+    std::vector<uchar> row((size_t)m.cols * es);
+    for (int c = 0; c < m.cols; ++c) std::memcpy(row.data() + c * es, first, es);
+    for (int r = 0; r < m.rows; ++r) {
+        if (std::memcmp(m.ptr(r), row.data(), row.size()) != 0) return false;
+    }
+    return true;
+}
+
+void packMat(const cv::Mat& m, std::vector<uint8_t>& out, bool& uniform)
+{
+    uniform = isUniform(m);
+    if (uniform) {
+        out.assign(m.ptr(0), m.ptr(0) + m.elemSize());
+        return;
+    }
+    const size_t rowBytes = (size_t)m.cols * m.elemSize();
+    if (m.isContinuous()) {
+        lzCompress(m.ptr(0), rowBytes * m.rows, out);
+        return;
+    }
+    thread_local std::vector<uint8_t> buf;
+    buf.resize(rowBytes * m.rows);
+    for (int r = 0; r < m.rows; ++r) std::memcpy(buf.data() + rowBytes * r, m.ptr(r), rowBytes);
+    lzCompress(buf.data(), buf.size(), out);
+}
+
+void unpackMat(const std::vector<uint8_t>& in, bool uniform, cv::Mat& m)
+{
+    const size_t es = m.elemSize();
+    if (uniform) {
+        CV_Assert(in.size() == es);
+        uchar* row0 = m.ptr(0);
+        for (int c = 0; c < m.cols; ++c) std::memcpy(row0 + c * es, in.data(), es);
+        for (int r = 1; r < m.rows; ++r) std::memcpy(m.ptr(r), row0, (size_t)m.cols * es);
+        return;
+    }
+    CV_Assert(m.isContinuous());
+    if (!lzDecompress(in.data(), in.size(), m.ptr(0), (size_t)m.cols * m.rows * es)) {
+        CV_Error(cv::Error::StsError, "corrupted compressed tile");
+    }
+}
+
+} // namespace
+
+struct TiledImage::Decoded {
+    cv::Mat pixels;
+    cv::Mat1b mask; // 全て 255 なら空
+};
+
+std::shared_ptr<TiledImage> TiledImage::compress(const StitchImage& img, int tileSize)
+{
+    CV_Assert(!img.empty());
+    auto t = std::make_shared<TiledImage>(img.size(), img.pixels.type(), !img.mask.empty(), tileSize);
+
+    cv::parallel_for_(cv::Range(0, t->tilesX_ * t->tilesY_), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; ++i) {
+            const int tx = i % t->tilesX_, ty = i / t->tilesX_;
+            const cv::Rect r = t->tileRect(tx, ty);
+            t->packTile(tx, ty, img.pixels(r), img.mask.empty() ? cv::Mat1b() : img.mask(r));
+        }
+    });
+    return t;
+}
+
+TiledImage::TiledImage(cv::Size size, int type, bool withMask, int tileSize)
+    : size_(size), type_(type), withMask_(withMask && CV_MAT_CN(type) != 4), tile_(tileSize)
+{
+    CV_Assert(size.width > 0 && size.height > 0 && tileSize > 0);
+    tilesX_ = (size.width + tile_ - 1) / tile_;
+    tilesY_ = (size.height + tile_ - 1) / tile_;
+    tiles_.resize((size_t)tilesX_ * tilesY_);
+    id_ = g_nextId++;
+}
+
+TiledImage::~TiledImage()
+{
+    // このタイルの展開結果を LRU から外す
+    TileCache& c = cache();
+    std::lock_guard<std::mutex> lock(c.mutex);
+    for (int i = 0; i < (int)tiles_.size(); ++i) {
+        auto e = c.map.find(cacheKey(id_, i));
+        if (e == c.map.end()) continue;
+        c.used -= e->second.bytes;
+        c.order.erase(e->second.it);
+        c.map.erase(e);
+    }
+}
+
+cv::Rect TiledImage::tileRect(int tx, int ty) const
+{
+    return cv::Rect(tx * tile_, ty * tile_, tile_, tile_) & cv::Rect(0, 0, size_.width, size_.height);
+}
+
+void TiledImage::packTile(int tx, int ty, const cv::Mat& pixels, const cv::Mat1b& mask)
+{
+    Tile& t = tiles_[(size_t)ty * tilesX_ + tx];
+    packMat(pixels, t.pixels, t.uniformPixels);
+    if (withMask_) {
+        if (mask.empty()) {
+            t.mask.assign(1, 255);
+            t.uniformMask = true;
+        } else {
+            packMat(mask, t.mask, t.uniformMask);
+        }
+    }
+    packed_ += t.pixels.size() + t.mask.size();
+}
+
+void TiledImage::writeRows(int y0, const StitchImage& band)
+{
+    CV_Assert(y0 >= 0 && y0 % tile_ == 0 && y0 < size_.height);
+    CV_Assert(band.cols() == size_.width && band.pixels.type() == type_);
+    CV_Assert(band.rows() == std::min(tile_, size_.height - y0));
+
+    const int ty = y0 / tile_;
+    for (int tx = 0; tx < tilesX_; ++tx) {
+        const cv::Rect r = tileRect(tx, ty) - cv::Point(0, y0);
+        packTile(tx, ty, band.pixels(r), band.mask.empty() ? cv::Mat1b() : band.mask(r));
+    }
+}
+
+std::shared_ptr<const TiledImage::Decoded> TiledImage::tile(int tx, int ty) const
+{
+    const int index = ty * tilesX_ + tx;
+    const uint64_t key = cacheKey(id_, index);
+    TileCache& c = cache();
+    {
+        std::lock_guard<std::mutex> lock(c.mutex);
+        auto e = c.map.find(key);
+        if (e != c.map.end()) {
+            c.order.splice(c.order.begin(), c.order, e->second.it);
+            return std::static_pointer_cast<const Decoded>(e->second.tile);
+        }
+    }
+
+    // 展開はロックの外で（同じタイルを同時に展開しても結果は同じ）
+    const Tile& t = tiles_[index];
+    const cv::Rect r = tileRect(tx, ty);
+    auto d = std::make_shared<Decoded>();
+    d->pixels.create(r.height, r.width, type_);
+    unpackMat(t.pixels, t.uniformPixels, d->pixels);
+    if (withMask_ && !(t.uniformMask && t.mask[0] == 255)) {
+        d->mask.create(r.height, r.width);
+        unpackMat(t.mask, t.uniformMask, d->mask);
+    }
+    const size_t bytes = d->pixels.total() * d->pixels.elemSize() + d->mask.total();
+
+    std::lock_guard<std::mutex> lock(c.mutex);
+    auto e = c.map.find(key);
+    if (e != c.map.end()) return std::static_pointer_cast<const Decoded>(e->second.tile);
+    c.order.push_front(key);
+    c.map.emplace(key, TileCache::Entry{d, bytes, c.order.begin()});
+    c.used += bytes;
+    c.evict();
+    return d;
+}
+
+StitchImage TiledImage::read(const cv::Rect& roi) const
+{
+    CV_Assert((roi & cv::Rect(0, 0, size_.width, size_.height)) == roi && !roi.empty());
+
+    const int tx0 = roi.x / tile_, tx1 = (roi.x + roi.width - 1) / tile_;
+    const int ty0 = roi.y / tile_, ty1 = (roi.y + roi.height - 1) / tile_;
+    const int nx = tx1 - tx0 + 1;
+    const int n = nx * (ty1 - ty0 + 1);
+
+    // 掛かるタイルを並列に展開してから、マスクの要否を決めて写す
+    std::vector<std::shared_ptr<const Decoded>> tiles(n);
+    cv::parallel_for_(cv::Range(0, n), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; ++i) tiles[i] = tile(tx0 + i % nx, ty0 + i / nx);
+    });
+    const bool anyMask = std::any_of(tiles.begin(), tiles.end(), [](const auto& d) { return !d->mask.empty(); });
+
+    StitchImage out;
+    out.pixels.create(roi.size(), type_);
+    if (anyMask) out.mask.create(roi.size());
+
+    cv::parallel_for_(cv::Range(0, n), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; ++i) {
+            const cv::Rect tr = tileRect(tx0 + i % nx, ty0 + i / nx);
+            const cv::Rect r = tr & roi;
+            const cv::Rect src = r - tr.tl(), dst = r - roi.tl();
+            tiles[i]->pixels(src).copyTo(out.pixels(dst));
+            if (!anyMask) continue;
+            if (tiles[i]->mask.empty()) out.mask(dst).setTo(255);
+            else tiles[i]->mask(src).copyTo(out.mask(dst));
+        }
+    });
+    return out;
+}
+
+cv::Mat1b TiledImage::validMask(const cv::Rect& roi) const
+{
+    const StitchImage img = read(roi);
+    if (CV_MAT_CN(type_) == 4) {
+        cv::Mat a;
+        cv::Mat1b valid;
+        cv::extractChannel(img.pixels, a, 3);
+        cv::compare(a, 0, valid, cv::CMP_GT);
+        return valid;
+    }
+    if (!img.mask.empty()) return img.mask;
+    return cv::Mat1b(roi.size(), uchar(255));
+}
+
+size_t TiledImage::rawBytes() const
+{
+    const size_t n = (size_t)size_.width * (size_t)size_.height;
+    return n * CV_ELEM_SIZE(type_) + (withMask_ ? n : 0);
+}
+
+void setTileCacheBudget(size_t bytes)
+{
+    TileCache& c = cache();
+    std::lock_guard<std::mutex> lock(c.mutex);
+    c.budget = bytes;
+    c.evict();
+}
+
+size_t tileCacheBudget()
+{
+    TileCache& c = cache();
+    std::lock_guard<std::mutex> lock(c.mutex);
+    return c.budget;
+}
+
+std::shared_ptr<TiledImage> make_canvas_feather_tiled(const TiledImage& img1, const TiledImage& img2,
+                                                      cv::Point pos2, float featherRadius)
+{
+    CV_Assert(img1.type() == img2.type());
+    CV_Assert(featherRadius > 0.0f);
+
+    const cv::Rect r1(cv::Point(0, 0), img1.size()), r2(pos2, img2.size());
+    const cv::Rect canvasRect = unionExtent(r1, r2);
+    const cv::Size canvas = canvasRect.size();
+    const cv::Point o1 = r1.tl() - canvasRect.tl(), o2 = r2.tl() - canvasRect.tl();
+
+    // 不透明な矩形は重みを式で求める。任意形状（4ch・マスク付き）は帯ごとに距離変換する
+    auto opaque = [](const TiledImage& img) { return CV_MAT_CN(img.type()) != 4 && !img.hasMask(); };
+    FeatherTile t1 = prepareFeatherPlacement(img1.size(), o1, opaque(img1), canvas, featherRadius);
+    FeatherTile t2 = prepareFeatherPlacement(img2.size(), o2, opaque(img2), canvas, featherRadius);
+    const int halo = featherHalo(featherRadius);
+
+    // 1 / 3ch は有効領域を持つ（キャンバスの隙間・マスク付き入力がある時だけ。無ければ全面有効）
+    const bool needMask = CV_MAT_CN(img1.type()) != 4
+                          && (img1.hasMask() || img2.hasMask() || pixelCount(r1) + pixelCount(r2) - pixelCount(r1 & r2) != pixelCount(canvasRect));
+    auto out = std::make_shared<TiledImage>(canvas, img1.type(), needMask, img1.tileSize());
+
+    struct Source {
+        const TiledImage* img;
+        FeatherTile* tile;
+    };
+    const Source sources[2] = {{&img1, &t1}, {&img2, &t2}};
+
+    const int band = out->tileSize();
+    for (int y0 = 0; y0 < canvas.height; y0 += band) {
+        const int y1 = std::min(canvas.height, y0 + band);
+
+        // この帯に掛かる行だけ展開する
+        std::vector<const FeatherTile*> active;
+        for (const Source& s : sources) {
+            FeatherTile& t = *s.tile;
+            const int row0 = std::max(0, y0 - t.rect.y), row1 = std::min(t.rect.height, y1 - t.rect.y);
+            if (row0 >= row1) continue;
+            t.image = s.img->read(cv::Rect(0, row0, t.rect.width, row1 - row0));
+            t.imageRow0 = row0;
+            if (!t.opaqueRect) {
+                // 帯の上下 halo 行まで含めて距離変換する（それより遠い境界は featherRadius に届かない）
+                const int win0 = std::max(0, row0 - halo), win1 = std::min(t.rect.height, row1 + halo);
+                const cv::Mat1b window = s.img->validMask(cv::Rect(0, win0, t.rect.width, win1 - win0));
+                setFeatherWeightRows(t, window, win0, row0, row1, canvas, featherRadius);
+            }
+            active.push_back(&t);
+        }
+
+        StitchImage rows;
+        if (active.empty()) rows.pixels = cv::Mat::zeros(y1 - y0, canvas.width, img1.type());
+        else composeFeatherRows(active, canvas, y0, y1, featherRadius, rows.pixels);
+
+        if (needMask) {
+            rows.mask = cv::Mat1b::zeros(y1 - y0, canvas.width);
+            for (const FeatherTile* t : active) {
+                const cv::Rect on = t->rect & cv::Rect(0, y0, canvas.width, y1 - y0);
+                if (on.empty()) continue;
+                cv::Mat1b dst = rows.mask(on - cv::Point(0, y0));
+                if (t->opaqueRect) dst.setTo(255);
+                else cv::bitwise_or(dst, t->valid(on - t->rect.tl() - cv::Point(0, t->weightRow0)), dst);
+            }
+        }
+        out->writeRows(y0, rows);
+
+        for (FeatherTile* t : {&t1, &t2}) { // 展開した行・帯の重みは次の帯で作り直す
+            t->image = StitchImage();
+            if (!t->opaqueRect) {
+                t->valid.release();
+                t->dist.release();
+            }
+        }
+    }
+    return out;
+}
@@ -0,0 +1,88 @@
+#ifndef TILESTORE_H
+#define TILESTORE_H
+
+#include "imagetypes.h"
+
+#include <opencv2/core.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// メモリ上で圧縮して保持する画像（入力・結合結果用）
+// - 画像を tileSize 四方のタイルに分け、タイルごとに独立に圧縮する（LZ4 と同じ系統の高速な LZ77。
+//   全画素が同じ値のタイルは 1画素だけ持つ。背景の多い画像ほど小さくなる）
+// - 読み出しは必要なタイルだけ展開する。展開したタイルはプロセス全体の LRU に置いて使い回す
+// - タイルは不変。書き込みは writeRows で 1回だけ（結合結果を帯ごとに作る用）
+class TiledImage
+{
+public:
+    static constexpr int kDefaultTileSize = 256;
+
+    // 画像全体を圧縮して作る（タイルごとに並列）
+    static std::shared_ptr<TiledImage> compress(const StitchImage& img, int tileSize = kDefaultTileSize);
+
+    // 空の画像（writeRows で埋める）。withMask なら 1 / 3ch の有効領域も持つ
+    TiledImage(cv::Size size, int type, bool withMask, int tileSize = kDefaultTileSize);
+    ~TiledImage();
+
+    TiledImage(const TiledImage&) = delete;
+    TiledImage& operator=(const TiledImage&) = delete;
+
+    // 行 [y0, y0 + band.rows()) を書く。y0 はタイルの高さの倍数、band は全幅で最後の帯以外はタイルの高さ
+    // 別々の帯なら並行に呼んで良い
+    void writeRows(int y0, const StitchImage& band);
+
+    cv::Size size() const { return size_; }
+    int rows() const { return size_.height; }
+    int cols() const { return size_.width; }
+    int type() const { return type_; }
+    bool hasMask() const { return withMask_; }
+    int tileSize() const { return tile_; }
+
+    // 範囲 roi（画像の内側）を展開して返す。触れたマスクのタイルが全て 255 ならマスクは空
+    StitchImage read(const cv::Rect& roi) const;
+
+    // 範囲 roi の有効領域（0/255）。4ch は alpha > 0、マスク無しの 1 / 3ch は全て 255（read と同じく LRU を通す）
+    cv::Mat1b validMask(const cv::Rect& roi) const;
+
+    size_t compressedBytes() const { return packed_.load(std::memory_order_relaxed); }
+    size_t rawBytes() const;
+
+private:
+    struct Tile {
+        std::vector<uint8_t> pixels;  // 圧縮済み（uniform なら 1画素分）
+        std::vector<uint8_t> mask;
+        bool uniformPixels = false;
+        bool uniformMask = false;
+    };
+
+    struct Decoded;                   // 展開済みのタイル（LRU に置く）
+
+    cv::Rect tileRect(int tx, int ty) const;
+    std::shared_ptr<const Decoded> tile(int tx, int ty) const;
+    void packTile(int tx, int ty, const cv::Mat& pixels, const cv::Mat1b& mask);
+
+    cv::Size size_;
+    int type_ = 0;
+    bool withMask_ = false;
+    int tile_ = kDefaultTileSize;
+    int tilesX_ = 0, tilesY_ = 0;
+    uint64_t id_ = 0;                 // LRU のキー
+    std::vector<Tile> tiles_;
+    std::atomic<size_t> packed_{0};
+};
+
+// 展開済みタイルの LRU の上限（バイト、プロセス全体。既定 512MB）
+void setTileCacheBudget(size_t bytes);
+size_t tileCacheBudget();
+
+// 2枚のフェザー合成を、キャンバスの行の帯ごとに必要なタイルだけ展開して行い、結果も圧縮して保持する
+// 重みは make_canvas_bgra_feather_dt と同じ。pos2 は 1枚目基準の 2枚目位置
+// 任意形状の入力の距離変換も帯（と上下 featherHalo 行）ごとに行い、全体の有効領域・距離は作らない（featherRadius > 0 に限る）
+std::shared_ptr<TiledImage> make_canvas_feather_tiled(const TiledImage& img1, const TiledImage& img2,
+                                                      cv::Point pos2, float featherRadius = 80.0f);
+
+#endif // TILESTORE_H
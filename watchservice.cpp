@@ -0,0 +1,418 @@
+#include "watchservice.h"
+#include "bigtiffwriter.h"
+#include "imageio.h"
+#include "stitchcore.h"
+#include "simdkernels.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QTextStream>
+#include <QtConcurrent/QtConcurrent>
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <functional>
+
+static const char *kManifestName = "manifest.json";
+
+// 段の番号（統計表示と busy_ の添字）
+enum Stage { kDecode = 0, kAlign, kBlend, kExport };
+
+// 1セット分の処理状態（段から段へ受け渡す。同時に触るのは 1つの段だけ）
+struct BatchJob {
+    QString name;
+    QString dir;
+    QString outPath;
+    QStringList paths;
+
+    // 公称配置（positions か grid のどちらか）
+    std::vector<cv::Point> nominal;
+    int gridRows = 0, gridCols = 0;
+    double gridOverlap = 0.0;
+    bool gridSnake = false;
+
+    std::vector<StitchImage> images;
+    std::vector<cv::Point> pos;
+    int pairs = 0;
+    int rejected = 0;       // 公称位置に戻したペア数
+    StitchImage result;
+
+    QString error;
+    QElapsedTimer timer;
+};
+
+namespace {
+
+// manifest.json を読む。不正なら job->error に理由
+std::shared_ptr<BatchJob> readManifest(const QString& dir, const QString& outDir)
+{
+    auto job = std::make_shared<BatchJob>();
+    job->dir = dir;
+    job->name = QFileInfo(dir).fileName();
+    job->outPath = QDir(outDir).filePath(job->name + ".tif");
+    job->timer.start();
+
+    QFile f(QDir(dir).filePath(kManifestName));
+    if (!f.open(QIODevice::ReadOnly)) {
+        job->error = "manifest を開けません。";
+        return job;
+    }
+    QJsonParseError pe;
+    const QJsonDocument doc = QJsonDocument::fromJson(f.readAll(), &pe);
+    if (!doc.isObject()) {
+        job->error = "manifest: " + pe.errorString();
+        return job;
+    }
+    const QJsonObject root = doc.object();
+
+    for (const QJsonValue& v : root.value("images").toArray()) {
+        job->paths << QDir::cleanPath(QDir(dir).absoluteFilePath(v.toString()));
+    }
+    if (job->paths.size() < 2) {
+        job->error = "manifest: images は 2枚以上必要です。";
+        return job;
+    }
+
+    const QString out = root.value("output").toString();
+    if (!out.isEmpty()) job->outPath = QDir(outDir).absoluteFilePath(out);
+
+    if (root.contains("positions")) {
+        for (const QJsonValue& v : root.value("positions").toArray()) {
+            const QJsonArray p = v.toArray();
+            job->nominal.emplace_back(p.at(0).toInt(), p.at(1).toInt());
+        }
+        if ((int)job->nominal.size() != job->paths.size()) job->error = "manifest: positions の数が images と一致しません。";
+    } else if (root.contains("grid")) {
+        const QJsonObject g = root.value("grid").toObject();
+        job->gridRows = g.value("rows").toInt();
+        job->gridCols = g.value("cols").toInt();
+        job->gridOverlap = g.value("overlap").toDouble(0.1);
+        job->gridSnake = g.value("snake").toBool();
+        if (job->gridRows * job->gridCols != job->paths.size()) job->error = "manifest: grid の rows x cols が images と一致しません。";
+        else if (!(job->gridOverlap > 0.0 && job->gridOverlap < 1.0)) job->error = "manifest: grid の overlap は 0〜1 で指定してください。";
+    } else {
+        job->error = "manifest: positions または grid が必要です。";
+    }
+    return job;
+}
+
+// 重なりの SSIM（重ならなければ -1）
+double overlapSsim(const StitchImage& a, const StitchImage& b, cv::Point rel)
+{
+    const return_struct2 c = Crop_2ImageTo2Image(a, b, cv::Point(0, 0), rel);
+    if (c.img1.empty() || c.img1.rows < 2 || c.img1.cols < 2) return -1.0;
+    return ssim(c.img1, c.img2);
+}
+
+// b の位置を a 基準で求める（align_phase_pair）。公称から外れる・SSIM が公称位置より悪い結果は採らない
+bool alignVerified(const StitchImage& a, const StitchImage& b, cv::Point nominalRel, cv::Point& rel)
+{
+    rel = nominalRel;
+    const return_struct1 p = align_phase_pair(a, b, nominalRel);
+    if (p.score == 0) return false;
+    const cv::Point found(p.x, p.y);
+
+    // 公称の重なり幅の半分まで
+    const cv::Rect ov = cv::Rect(cv::Point(0, 0), a.size()) & cv::Rect(nominalRel, b.size());
+    const int tolX = std::max(4, ov.width / 2);
+    const int tolY = std::max(4, ov.height / 2);
+    if (std::abs(found.x - nominalRel.x) > tolX || std::abs(found.y - nominalRel.y) > tolY) return false;
+
+    if (found != nominalRel && overlapSsim(a, b, found) < overlapSsim(a, b, nominalRel)) return false;
+    rel = found;
+    return true;
+}
+
+void decodeStage(BatchJob& job)
+{
+    QList<int> idx;
+    for (int i = 0; i < job.paths.size(); ++i) idx << i;
+    const QList<StitchImage> imgs = QtConcurrent::blockingMapped<QList<StitchImage>>(idx, [&](int i) {
+        return loadStitchImage(job.paths[i]);
+    });
+    job.images.assign(imgs.begin(), imgs.end());
+
+    for (int i = 0; i < job.paths.size(); ++i) {
+        if (job.images[i].empty()) {
+            job.error = "読み込みに失敗しました: " + job.paths[i];
+            return;
+        }
+    }
+
+    // グリッドの公称配置は 1枚目のサイズから
+    if (job.nominal.empty()) {
+        const cv::Size t = job.images.front().size();
+        const int stepX = (int)std::lround(t.width * (1.0 - job.gridOverlap));
+        const int stepY = (int)std::lround(t.height * (1.0 - job.gridOverlap));
+        for (int i = 0; i < job.paths.size(); ++i) {
+            const int r = i / job.gridCols;
+            int c = i % job.gridCols;
+            if (job.gridSnake && (r % 2 == 1)) c = job.gridCols - 1 - c;
+            job.nominal.emplace_back(stepX * c, stepY * r);
+        }
+    }
+}
+
+void alignStage(BatchJob& job)
+{
+    const int n = (int)job.images.size();
+
+    // 各画像の基準は、それより前の画像のうち公称の重なりが最も大きいもの（1枚目は固定）
+    std::vector<int> ref(n, -1);
+    for (int k = 1; k < n; ++k) {
+        const cv::Rect rk(job.nominal[k], job.images[k].size());
+        int best = 0;
+        for (int j = 0; j < k; ++j) {
+            const cv::Rect rj(job.nominal[j], job.images[j].size());
+            if (pixelCount(rk & rj) > pixelCount(rk & cv::Rect(job.nominal[best], job.images[best].size()))) best = j;
+        }
+        ref[k] = best;
+    }
+
+    // ペアは互いに独立なので並列
+    QList<int> ks;
+    for (int k = 1; k < n; ++k) ks << k;
+    const QList<std::pair<bool, cv::Point>> rels = QtConcurrent::blockingMapped<QList<std::pair<bool, cv::Point>>>(ks, [&](int k) {
+        cv::Point rel;
+        const bool ok = alignVerified(job.images[ref[k]], job.images[k], job.nominal[k] - job.nominal[ref[k]], rel);
+        return std::make_pair(ok, rel);
+    });
+
+    job.pos.assign(n, cv::Point(0, 0));
+    job.pos[0] = job.nominal[0];
+    for (int k = 1; k < n; ++k) {
+        ++job.pairs;
+        if (!rels[k - 1].first) ++job.rejected;
+        job.pos[k] = job.pos[ref[k]] + rels[k - 1].second;
+    }
+}
+
+void blendStage(BatchJob& job, float featherRadius)
+{
+    const int type = job.images.front().pixels.type();
+    cv::Rect bounds(job.pos[0], job.images[0].size());
+    for (size_t i = 0; i < job.images.size(); ++i) {
+        if (job.images[i].pixels.type() != type) {
+            job.error = "画素型が揃っていません: " + job.paths[(int)i];
+            return;
+        }
+        bounds = unionExtent(bounds, cv::Rect(job.pos[i], job.images[i].size()));
+    }
+
+    std::vector<FeatherTile> tiles(job.images.size());
+    cv::parallel_for_(cv::Range(0, (int)tiles.size()), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; ++i) {
+            tiles[i] = prepareFeatherTile(job.images[i], job.pos[i] - bounds.tl(), bounds.size(), featherRadius);
+        }
+    });
+    std::vector<const FeatherTile*> active;
+    for (const FeatherTile& t : tiles) active.push_back(&t);
+
+    // 出力の行へ直接合成する
+    job.result.pixels.create(bounds.size(), type);
+    constexpr int kChunk = 256;
+    for (int y = 0; y < bounds.height; y += kChunk) {
+        const int y1 = std::min(bounds.height, y + kChunk);
+        cv::Mat band = job.result.pixels.rowRange(y, y1);
+        composeFeatherRows(active, bounds.size(), y, y1, featherRadius, band);
+    }
+    job.images.clear(); // 元画像はもう使わない
+}
+
+void exportStage(BatchJob& job)
+{
+    QDir().mkpath(QFileInfo(job.outPath).absolutePath());
+
+    const QString suffix = QFileInfo(job.outPath).suffix().toLower();
+    if (suffix == "tif" || suffix == "tiff") {
+        // 4GB を超えても書けるよう BigTIFF
+        BigTiffWriter writer;
+        bool ok = writer.open(job.outPath, job.result.size(), job.result.pixels.type());
+        constexpr int kChunk = 256;
+        for (int y = 0; ok && y < job.result.rows(); y += kChunk) {
+            ok = writer.write(job.result.pixels.rowRange(y, std::min(job.result.rows(), y + kChunk)));
+        }
+        if (!writer.close() || !ok) job.error = "書き出しに失敗しました: " + job.outPath;
+    } else if (!saveStitchImage(job.outPath, job.result)) {
+        job.error = "書き出しに失敗しました: " + job.outPath;
+    }
+}
+
+// 出力フォルダの記録（記録があるセットは再処理しない）
+QString recordPath(const QString& outDir, const QString& name)
+{
+    return QDir(outDir).filePath(name + ".json");
+}
+
+} // namespace
+
+WatchService::WatchService(const Options& opt, QObject *parent) : QObject(parent), opt_(opt)
+{
+    if (opt_.outDir.isEmpty()) opt_.outDir = QDir(opt_.watchDir).filePath("stitched");
+
+    const size_t depth = (size_t)std::max(1, opt_.queueDepth);
+    decodeQ_ = std::make_unique<Queue>(depth);
+    alignQ_ = std::make_unique<Queue>(depth);
+    blendQ_ = std::make_unique<Queue>(depth);
+    exportQ_ = std::make_unique<Queue>(depth);
+
+    connect(&pollTimer_, &QTimer::timeout, this, &WatchService::scan);
+    connect(&reportTimer_, &QTimer::timeout, this, &WatchService::report);
+}
+
+WatchService::~WatchService()
+{
+    // 上流から閉じる（各段は残りを流し終えてから下流を閉じる）
+    decodeQ_->close();
+    for (std::thread& t : stages_) t.join();
+}
+
+bool WatchService::start(QString *error)
+{
+    if (!QFileInfo(opt_.watchDir).isDir()) {
+        if (error) *error = "監視フォルダがありません: " + opt_.watchDir;
+        return false;
+    }
+    if (!QDir().mkpath(opt_.outDir)) {
+        if (error) *error = "出力フォルダを作れません: " + opt_.outDir;
+        return false;
+    }
+
+    // 段ごとに 1スレッド。段の中の画素並列はグローバルプール側
+    auto runStage = [this](Stage stage, Queue *in, Queue *out, std::function<void(BatchJob&)> work) {
+        return std::thread([this, stage, in, out, work]() {
+            while (std::optional<std::shared_ptr<BatchJob>> job = in->pop()) {
+                BatchJob& j = **job;
+                if (j.error.isEmpty()) {
+                    busy_[stage]++;
+                    try {
+                        work(j);
+                    } catch (const std::exception& e) {
+                        j.error = QString::fromLocal8Bit(e.what());
+                    } catch (...) {
+                        j.error = "unknown error";
+                    }
+                    busy_[stage]--;
+                }
+                if (out) {
+                    out->push(*job); // 失敗したセットも最後まで流して記録する
+                } else {
+                    std::shared_ptr<BatchJob> done = *job;
+                    QMetaObject::invokeMethod(this, [this, done]() { finished(done); }, Qt::QueuedConnection);
+                }
+            }
+            if (out) out->close();
+        });
+    };
+
+    const float feather = opt_.featherRadius;
+    stages_.push_back(runStage(kDecode, decodeQ_.get(), alignQ_.get(), decodeStage));
+    stages_.push_back(runStage(kAlign, alignQ_.get(), blendQ_.get(), alignStage));
+    stages_.push_back(runStage(kBlend, blendQ_.get(), exportQ_.get(), [feather](BatchJob& j) { blendStage(j, feather); }));
+    stages_.push_back(runStage(kExport, exportQ_.get(), nullptr, exportStage));
+
+    uptime_.start();
+    pollTimer_.start(std::max(100, opt_.pollMs));
+    reportTimer_.start(std::max(1, opt_.reportSec) * 1000);
+
+    QTextStream(stdout) << "監視開始: " << opt_.watchDir << " → " << opt_.outDir
+                        << "（SIMD: " << simdIsaName(activeSimdIsa()) << "）" << Qt::endl;
+    scan();
+    return true;
+}
+
+// 新しく揃ったセットを探して投入する
+void WatchService::scan()
+{
+    const QDir watch(opt_.watchDir);
+    const QString outAbs = QFileInfo(opt_.outDir).absoluteFilePath();
+    const QFileInfoList dirs = watch.entryInfoList(QDir::Dirs | QDir::NoDotAndDotDot, QDir::Name);
+    for (const QFileInfo& d : dirs) {
+        if (d.absoluteFilePath() == outAbs) continue;
+        const QString name = d.fileName();
+        if (known_.contains(name)) continue;
+
+        // manifest が書き終わっていない可能性があるので、更新から少し経ったものだけ
+        const QFileInfo manifest(QDir(d.absoluteFilePath()).filePath(kManifestName));
+        if (!manifest.exists()) continue;
+        if (manifest.lastModified().msecsTo(QDateTime::currentDateTime()) < 1000) continue;
+
+        known_.insert(name);
+        if (QFileInfo::exists(recordPath(opt_.outDir, name))) continue; // 処理済み
+
+        waiting_.push_back(readManifest(d.absoluteFilePath(), opt_.outDir));
+    }
+    feed();
+}
+
+// 読み込みキューに空きがあるだけ入れる（メインスレッドは待たない）
+void WatchService::feed()
+{
+    while (!waiting_.empty() && decodeQ_->tryPush(waiting_.front())) waiting_.pop_front();
+}
+
+void WatchService::finished(const std::shared_ptr<BatchJob>& job)
+{
+    const bool ok = job->error.isEmpty();
+    const double sec = job->timer.elapsed() / 1000.0;
+    if (ok) {
+        ++done_;
+        recent_.push_back(uptime_.elapsed());
+    } else {
+        ++failed_;
+    }
+
+    QJsonObject rec{
+        {"ok", ok},
+        {"output", ok ? job->outPath : QString()},
+        {"error", job->error},
+        {"seconds", sec},
+        {"pairs", job->pairs},
+        {"rejected", job->rejected},
+        {"width", job->result.cols()},
+        {"height", job->result.rows()},
+        {"finished", QDateTime::currentDateTime().toString(Qt::ISODate)},
+    };
+    QSaveFile f(recordPath(opt_.outDir, job->name));
+    if (f.open(QIODevice::WriteOnly)) {
+        f.write(QJsonDocument(rec).toJson());
+        f.commit();
+    }
+
+    QTextStream(stdout) << (ok ? "完了: " : "失敗: ") << job->name
+                        << QString(" (%1 s").arg(sec, 0, 'f', 1)
+                        << (ok ? QString(", %1 / %2 ペアを公称位置に補正)").arg(job->rejected).arg(job->pairs)
+                               : QString(") ") + job->error)
+                        << Qt::endl;
+    job->result = StitchImage();
+    feed();
+}
+
+// jobs/hour と各段のキュー深さ
+void WatchService::report()
+{
+    const qint64 now = uptime_.elapsed();
+    while (!recent_.empty() && now - recent_.front() > 3600 * 1000) recent_.pop_front();
+
+    const double hours = std::max(now / 3600000.0, 1e-9);
+    const double lastHour = std::min(hours, 1.0);
+    QTextStream(stdout)
+        << QString("統計: 完了 %1 / 失敗 %2, %3 jobs/h（直近 %4 jobs/h）")
+               .arg(done_).arg(failed_)
+               .arg(done_ / hours, 0, 'f', 1)
+               .arg(recent_.size() / lastHour, 0, 'f', 1)
+        << QString(" | 待ち %1 | 読込 %2+%3 | 位置合わせ %4+%5 | 合成 %6+%7 | 書出 %8+%9")
+               .arg(waiting_.size())
+               .arg(decodeQ_->size()).arg(busy_[kDecode].load())
+               .arg(alignQ_->size()).arg(busy_[kAlign].load())
+               .arg(blendQ_->size()).arg(busy_[kBlend].load())
+               .arg(exportQ_->size()).arg(busy_[kExport].load())
+        << Qt::endl;
+}
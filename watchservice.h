@@ -0,0 +1,74 @@
+#ifndef WATCHSERVICE_H
+#define WATCHSERVICE_H
+
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QTimer>
+#include <QElapsedTimer>
+
+#include "boundedqueue.h"
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <vector>
+
+struct BatchJob;
+
+// 監視フォルダの一括結合（起動オプション --watch）
+// 監視フォルダ直下のサブフォルダ 1つが 1セット。manifest.json が置かれた時点で揃ったものとみなす
+//   {"images": ["a.tif", ...],                       撮影順（必須）
+//    "positions": [[x, y], ...],                    公称位置（または grid）
+//    "grid": {"rows": R, "cols": C, "overlap": 0.1, "snake": false},
+//    "output": "name.tif"}                          省略時は <サブフォルダ名>.tif
+// 読み込み → 位置合わせ（位相相関 + SSIM で検証） → 合成 → 書き出し の各段を専用スレッドで動かし、
+// 段の間は上限つきキューでつなぐ（前のセットの合成中に次のセットを読み込む）
+// 結果は出力フォルダの <名前>.json に記録し、記録のあるセットは再処理しない
+class WatchService : public QObject
+{
+    Q_OBJECT
+public:
+    struct Options {
+        QString watchDir;
+        QString outDir;             // 空なら <watchDir>/stitched
+        int pollMs = 2000;          // フォルダの走査間隔
+        int reportSec = 60;         // 統計の出力間隔
+        int queueDepth = 2;         // 段の間のキューの上限（セット数）
+        float featherRadius = 80.0f;
+    };
+
+    explicit WatchService(const Options& opt, QObject *parent = nullptr);
+    ~WatchService() override;
+
+    bool start(QString *error);
+
+private:
+    void scan();
+    void feed();
+    void report();
+    void finished(const std::shared_ptr<BatchJob>& job); // 書き出し段から（メインスレッドで実行）
+
+    using Queue = BoundedQueue<std::shared_ptr<BatchJob>>;
+
+    Options opt_;
+    QTimer pollTimer_;
+    QTimer reportTimer_;
+    QElapsedTimer uptime_;
+
+    QSet<QString> known_;                       // 投入済み・処理済みのセット名
+    std::deque<std::shared_ptr<BatchJob>> waiting_; // 読み込みキューが満杯で待っているセット
+
+    // 段の間のキュー（読み込み待ち → 位置合わせ待ち → 合成待ち → 書き出し待ち）
+    std::unique_ptr<Queue> decodeQ_, alignQ_, blendQ_, exportQ_;
+    std::vector<std::thread> stages_;
+    std::atomic_int busy_[4] = {};              // 各段で処理中のセット数
+
+    int done_ = 0;
+    int failed_ = 0;
+    std::deque<qint64> recent_;                 // 直近1時間の完了時刻（uptime ms）
+};
+
+#endif // WATCHSERVICE_H